@@ -0,0 +1,114 @@
+/*
+ * Copyright 2014, 2015 High Performance Computing Center, Stuttgart
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <math.h>
+#include "adaptive.h"
+
+/* values below this magnitude are compared absolutely instead of relatively */
+#define ADAPTIVE_EPSILON 1e-6
+
+/*******************************************************************************
+ * Forward Declarations
+ ******************************************************************************/
+static int same_events(const AdaptiveSampler *as, const Plugin_metrics *metrics);
+static void keep_values(AdaptiveSampler *as, const Plugin_metrics *metrics);
+
+/*******************************************************************************
+ * Functions implementation
+ ******************************************************************************/
+/* Initialize the adaptive interval */
+void AdaptiveSampler_init(AdaptiveSampler *as, long min_interval, long max_interval, long interval,
+	double threshold, double weight)
+{
+	if (max_interval < min_interval) {
+		max_interval = min_interval;
+	}
+	if (interval < min_interval) {
+		interval = min_interval;
+	}
+	if (interval > max_interval) {
+		interval = max_interval;
+	}
+	as->min_interval = min_interval;
+	as->max_interval = max_interval;
+	as->interval = interval;
+	as->threshold = threshold;
+	as->weight = weight;
+	as->ewma = 0.0;
+	as->num_values = 0;
+}
+
+/* Update the EWMA of the relative change and adapt the interval */
+long AdaptiveSampler_update(AdaptiveSampler *as, const Plugin_metrics *metrics)
+{
+	int i;
+	double change = 0.0;
+
+	/* nothing to compare with, e.g. the first sample or the set of metrics changed */
+	if (metrics->num_events == 0 || !same_events(as, metrics)) {
+		keep_values(as, metrics);
+		return as->interval;
+	}
+
+	for (i = 0; i < metrics->num_events; i++) {
+		double prev = as->values[i];
+		double diff = fabs(metrics->values[i] - prev);
+		double base = fabs(prev);
+		change += (base > ADAPTIVE_EPSILON) ? diff / base : diff;
+	}
+	change /= metrics->num_events;
+	as->ewma = as->weight * change + (1.0 - as->weight) * as->ewma;
+	keep_values(as, metrics);
+
+	if (as->ewma > as->threshold) {
+		as->interval /= 2;
+	} else if (as->ewma < as->threshold / 2) {
+		as->interval += as->interval / 4;
+	}
+	if (as->interval < as->min_interval) {
+		as->interval = as->min_interval;
+	}
+	if (as->interval > as->max_interval) {
+		as->interval = as->max_interval;
+	}
+	return as->interval;
+}
+
+/* check if the sample holds the same metrics as the previous one */
+static int same_events(const AdaptiveSampler *as, const Plugin_metrics *metrics)
+{
+	int i;
+	if (as->num_values != metrics->num_events) {
+		return 0;
+	}
+	for (i = 0; i < metrics->num_events; i++) {
+		if (as->events[i] != metrics->events[i]) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+/* remember the values of the latest sample */
+static void keep_values(AdaptiveSampler *as, const Plugin_metrics *metrics)
+{
+	int i;
+	for (i = 0; i < metrics->num_events; i++) {
+		as->events[i] = metrics->events[i];
+		as->values[i] = metrics->values[i];
+	}
+	as->num_values = metrics->num_events;
+}
@@ -0,0 +1,56 @@
+/*
+ * Copyright 2014, 2015 High Performance Computing Center, Stuttgart
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ADAPTIVE_H_
+#define ADAPTIVE_H_
+
+#include <plugin_utils.h>
+
+/**
+ * @brief Adaptive sampling interval of a plug-in
+ *
+ * The relative change of the metrics between two samples is smoothed by an
+ * exponentially weighted moving average (EWMA). The interval is halved when
+ * the average exceeds the threshold, i.e. the signal changes a lot, and
+ * lengthened by a quarter when it stays below half of the threshold; it is
+ * always kept between the minimum and maximum interval.
+ */
+typedef struct AdaptiveSampler_t {
+	long min_interval;				/* in ns */
+	long max_interval;				/* in ns */
+	long interval;					/* current interval in ns */
+	double threshold;				/* relative change, above which the interval is shortened */
+	double weight;					/* weight of the latest change in the EWMA */
+	double ewma;
+	int num_values;					/* number of values of the previous sample, 0 if none */
+	char *events[MAX_EVENTS_NUMBER];
+	double values[MAX_EVENTS_NUMBER];
+} AdaptiveSampler;
+
+/**
+ * @brief Initializes the adaptive interval, starting at the given interval
+ */
+void AdaptiveSampler_init(AdaptiveSampler *as, long min_interval, long max_interval, long interval,
+	double threshold, double weight);
+
+/**
+ * @brief Updates the interval with the metrics of the latest sample
+ *
+ * @returns the interval to be used for the next sample in ns
+ */
+long AdaptiveSampler_update(AdaptiveSampler *as, const Plugin_metrics *metrics);
+
+#endif /* ADAPTIVE_H_ */
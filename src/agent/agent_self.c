@@ -0,0 +1,371 @@
+/*
+ * Copyright 2014, 2015 High Performance Computing Center, Stuttgart
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "agent_self.h"
+#include "agent_stats.h"		// variables like agent_stats
+#include "plugin_discover.h"	// variables like pluginCount
+#include "mf_debug.h"			// functions like log_error(), log_info()...
+#include <plugin_utils.h>		// Plugin_sample
+
+/* metrics of the agent process including its spool, and of each plugin */
+#define PROCESS_METRICS 8
+#define PLUGIN_METRICS 7
+/* number of plugins reported per sample, the others follow in the next samples */
+#define PLUGINS_PER_SAMPLE ((MAX_EVENTS_NUMBER - PROCESS_METRICS) / PLUGIN_METRICS)
+#define MAX_METRIC_NAMES (256 * PLUGIN_METRICS)
+#define PLUGIN_PREFIX "mf_plugin_"
+
+/*******************************************************************************
+ * Variable Declarations
+ ******************************************************************************/
+/* statistics of a plugin at its last report */
+typedef struct StatsBaseline_t {
+	unsigned seq;
+	unsigned long long hook_hist[AGENT_STATS_BUCKETS];
+	unsigned long long serialize_ns;
+	unsigned long long serialized;
+	unsigned long long publish_ns;
+	unsigned long long published;
+	unsigned long long bytes_sent;
+	unsigned long long dropped;
+	const char *names[PLUGIN_METRICS];	/* metric names of the plugin, resolved once it is loaded */
+} StatsBaseline;
+
+/* fields of the metrics of each plugin, in the order of StatsBaseline.names */
+static const char *plugin_fields[PLUGIN_METRICS] = {
+	"hook_p50_ns", "hook_p99_ns", "hook_max_ns", "serialize_ns", "publish_ms", "bytes_sent", "dropped"
+};
+
+static StatsBaseline baselines[256];
+static unsigned long long spool_dropped = 0;	/* bulks dropped by the spools at the last report */
+
+/* metric names handed out with the samples; they are kept until the plugin is shut down,
+   since the samples are serialized later on by the publisher */
+static char *metric_names[MAX_METRIC_NAMES];
+static int num_metric_names = 0;
+
+static int next_slot = 0;			/* first plugin slot of the next sample */
+static long long last_time_ns = 0;	/* time and cpu time of the last sample */
+static double last_cpu_s = 0.0;
+static long clock_ticks = 100;
+static long page_size = 4096;
+static int is_initialized = 0;
+
+/*******************************************************************************
+ * Forward Declarations
+ ******************************************************************************/
+static int mf_plugin_agent_self_hook(Plugin_sample *sample);
+static int read_process(double *rss_kb, double *cpu_user_s, double *cpu_system_s);
+static int read_stats(int num, AgentStats *copy);
+static void add_spool(Plugin_sample *sample);
+static int add_plugin(Plugin_sample *sample, int num);
+static void add_metric(Plugin_sample *sample, const char *name, double value);
+static const char* metric_name(const char *plugin, const char *field);
+static double percentile(const unsigned long long *hist, unsigned long long total, double fraction);
+
+/*******************************************************************************
+ * Functions implementation
+ ******************************************************************************/
+/* Initialize the plugin; 
+   register the plugin hook to the plugin manager 
+   @return 1 on success; 0 otherwise */
+int init_mf_plugin_agent_self(PluginManager *pm)
+{
+	double rss_kb, cpu_user_s, cpu_system_s;
+
+	clock_ticks = sysconf(_SC_CLK_TCK);
+	page_size = sysconf(_SC_PAGESIZE);
+	if (clock_ticks <= 0 || page_size <= 0 || 
+		read_process(&rss_kb, &cpu_user_s, &cpu_system_s) == 0) {
+		log_error("Plugin %s init function failed.\n", AGENT_SELF_NAME);
+		return 0;
+	}
+	last_time_ns = AgentStats_now();
+	last_cpu_s = cpu_user_s + cpu_system_s;
+	memset(baselines, 0, sizeof(baselines));
+	spool_dropped = 0;
+	next_slot = 0;
+
+	PluginManager_register_sample_hook(pm, AGENT_SELF_NAME, mf_plugin_agent_self_hook);
+	is_initialized = 1;
+	return 1;
+}
+
+/* the hook function, reports the resource usage of the agent and the overhead of 
+   up to PLUGINS_PER_SAMPLE plugins, rotating over all plugins from sample to sample
+   @return 1 if a sample was taken; 0 otherwise */
+static int mf_plugin_agent_self_hook(Plugin_sample *sample)
+{
+	double rss_kb, cpu_user_s, cpu_system_s;
+	struct timespec now;
+	int i, reported = 0;
+
+	if (!is_initialized || read_process(&rss_kb, &cpu_user_s, &cpu_system_s) == 0) {
+		return 0;
+	}
+	clock_gettime(CLOCK_REALTIME, &now);
+	sample->type = "agent_self";
+	sample->timestamp = (now.tv_sec + now.tv_nsec * 1.0e-9) * 1.0e3;
+	sample->metrics.num_events = 0;
+
+	long long time_ns = AgentStats_now();
+	double cpu_s = cpu_user_s + cpu_system_s;
+	double cpu_usage = 0.0;
+	if (time_ns > last_time_ns) {
+		cpu_usage = (cpu_s - last_cpu_s) * 1.0e9 / (time_ns - last_time_ns) * 100.0;
+	}
+	last_time_ns = time_ns;
+	last_cpu_s = cpu_s;
+
+	add_metric(sample, "rss_kb", rss_kb);
+	add_metric(sample, "cpu_user_s", cpu_user_s);
+	add_metric(sample, "cpu_system_s", cpu_system_s);
+	add_metric(sample, "cpu_usage_percent", cpu_usage);
+	add_spool(sample);
+
+	int count = __atomic_load_n(&pluginCount, __ATOMIC_ACQUIRE);
+	for (i = 0; i < count && reported < PLUGINS_PER_SAMPLE; i++) {
+		int num = (next_slot + i) % count;
+		reported += add_plugin(sample, num);
+		if (reported == PLUGINS_PER_SAMPLE) {
+			next_slot = num + 1;
+		}
+	}
+	return 1;
+}
+
+/* Shut down the plugin before its slot is freed;
+   the hook is not called anymore at this point */
+void shutdown_mf_plugin_agent_self(void)
+{
+	int i;
+	if (!is_initialized) {
+		return;
+	}
+	is_initialized = 0;
+
+	for (i = 0; i < num_metric_names; i++) {
+		free(metric_names[i]);
+	}
+	num_metric_names = 0;
+}
+
+/* read the resident set size and the cpu time of the agent from /proc/self 
+   @return 1 on success; 0 otherwise */
+static int read_process(double *rss_kb, double *cpu_user_s, double *cpu_system_s)
+{
+	char line[1024];
+	unsigned long utime, stime;
+	long size, resident;
+
+	FILE *fp = fopen("/proc/self/stat", "r");
+	if (fp == NULL) {
+		return 0;
+	}
+	char *ret = fgets(line, sizeof(line), fp);
+	fclose(fp);
+	/* the command name may contain spaces, fields are counted after its closing bracket */
+	char *fields = ret ? strrchr(line, ')') : NULL;
+	if (fields == NULL || sscanf(fields + 2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu", 
+		&utime, &stime) != 2) {
+		return 0;
+	}
+
+	fp = fopen("/proc/self/statm", "r");
+	if (fp == NULL) {
+		return 0;
+	}
+	int n = fscanf(fp, "%ld %ld", &size, &resident);
+	fclose(fp);
+	if (n != 2) {
+		return 0;
+	}
+
+	*rss_kb = (double) resident * page_size / 1024.0;
+	*cpu_user_s = (double) utime / clock_ticks;
+	*cpu_system_s = (double) stime / clock_ticks;
+	return 1;
+}
+
+/* copy the statistics of a plugin slot, which are updated concurrently 
+   @return 1 if the slot is in use and was not reset meanwhile; 0 otherwise */
+static int read_stats(int num, AgentStats *copy)
+{
+	int i;
+	AgentStats *stats = &agent_stats[num];
+
+	copy->seq = __atomic_load_n(&stats->seq, __ATOMIC_ACQUIRE);
+	if (copy->seq & 1) {
+		return 0;
+	}
+	memcpy(copy->name, stats->name, AGENT_STATS_NAME_LEN);
+	for (i = 0; i < AGENT_STATS_BUCKETS; i++) {
+		copy->hook_hist[i] = __atomic_load_n(&stats->hook_hist[i], __ATOMIC_RELAXED);
+	}
+	copy->serialize_ns = __atomic_load_n(&stats->serialize_ns, __ATOMIC_RELAXED);
+	copy->serialized = __atomic_load_n(&stats->serialized, __ATOMIC_RELAXED);
+	copy->publish_ns = __atomic_load_n(&stats->publish_ns, __ATOMIC_RELAXED);
+	copy->published = __atomic_load_n(&stats->published, __ATOMIC_RELAXED);
+	copy->bytes_sent = __atomic_load_n(&stats->bytes_sent, __ATOMIC_RELAXED);
+	copy->dropped = __atomic_load_n(&stats->dropped, __ATOMIC_RELAXED);
+
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	if (__atomic_load_n(&stats->seq, __ATOMIC_RELAXED) != copy->seq) {
+		return 0;
+	}
+	copy->name[AGENT_STATS_NAME_LEN - 1] = '\0';
+	return copy->name[0] != '\0';
+}
+
+/* add the size and lag of the spools of all publisher threads to the sample */
+static void add_spool(Plugin_sample *sample)
+{
+	int i;
+	unsigned long long bytes = 0, records = 0, dropped = 0;
+	long long oldest_ns = 0;
+	struct timespec now;
+
+	for (i = 0; i < 256; i++) {
+		AgentSpoolStats *stats = &agent_spool_stats[i];
+		long long oldest = __atomic_load_n(&stats->oldest_ns, __ATOMIC_RELAXED);
+		bytes += __atomic_load_n(&stats->bytes, __ATOMIC_RELAXED);
+		records += __atomic_load_n(&stats->records, __ATOMIC_RELAXED);
+		dropped += __atomic_load_n(&stats->dropped, __ATOMIC_RELAXED);
+		if (oldest > 0 && (oldest_ns == 0 || oldest < oldest_ns)) {
+			oldest_ns = oldest;
+		}
+	}
+	clock_gettime(CLOCK_REALTIME, &now);
+	long long now_ns = (long long) now.tv_sec * 1000000000LL + now.tv_nsec;
+
+	add_metric(sample, "spool_bytes", (double) bytes);
+	add_metric(sample, "spool_records", (double) records);
+	add_metric(sample, "spool_lag_s", (oldest_ns > 0 && now_ns > oldest_ns) ? (now_ns - oldest_ns) / 1.0e9 : 0.0);
+	/* like the metrics of the plugins, the drops are counted since the last report; 
+	   a spool which has been opened again counts from 0 */
+	add_metric(sample, "spool_dropped", (double) (dropped >= spool_dropped ? dropped - spool_dropped : dropped));
+	spool_dropped = dropped;
+}
+
+/* add the overhead of a plugin since its last report to the sample 
+   @return 1 if the plugin was added; 0 if the slot is not in use */
+static int add_plugin(Plugin_sample *sample, int num)
+{
+	int i;
+	AgentStats stats;
+	StatsBaseline *base = &baselines[num];
+	unsigned long long hist[AGENT_STATS_BUCKETS], total = 0;
+
+	if (read_stats(num, &stats) == 0) {
+		return 0;
+	}
+	if (base->seq != stats.seq || base->names[0] == NULL) {
+		/* another plugin has been loaded into the slot */
+		memset(base, 0, sizeof(StatsBaseline));
+		base->seq = stats.seq;
+		for (i = 0; i < PLUGIN_METRICS; i++) {
+			base->names[i] = metric_name(stats.name, plugin_fields[i]);
+		}
+	}
+	for (i = 0; i < AGENT_STATS_BUCKETS; i++) {
+		hist[i] = stats.hook_hist[i] - base->hook_hist[i];
+		total += hist[i];
+	}
+	unsigned long long serialized = stats.serialized - base->serialized;
+	unsigned long long published = stats.published - base->published;
+
+	/* hook times are counted in power-of-two buckets, so the percentiles are the upper bounds 
+	   of their buckets, up to twice the actual times */
+	add_metric(sample, base->names[0], percentile(hist, total, 0.5));
+	add_metric(sample, base->names[1], percentile(hist, total, 0.99));
+	add_metric(sample, base->names[2], percentile(hist, total, 1.0));
+	add_metric(sample, base->names[3], 
+		serialized ? (double) (stats.serialize_ns - base->serialize_ns) / serialized : 0.0);
+	add_metric(sample, base->names[4], 
+		published ? (double) (stats.publish_ns - base->publish_ns) / published / 1.0e6 : 0.0);
+	add_metric(sample, base->names[5], (double) (stats.bytes_sent - base->bytes_sent));
+	add_metric(sample, base->names[6], (double) (stats.dropped - base->dropped));
+
+	memcpy(base->hook_hist, stats.hook_hist, sizeof(base->hook_hist));
+	base->serialize_ns = stats.serialize_ns;
+	base->serialized = stats.serialized;
+	base->publish_ns = stats.publish_ns;
+	base->published = stats.published;
+	base->bytes_sent = stats.bytes_sent;
+	base->dropped = stats.dropped;
+	return 1;
+}
+
+/* add one metric to the sample; the name has to stay valid until the plugin is shut down */
+static void add_metric(Plugin_sample *sample, const char *name, double value)
+{
+	int n = sample->metrics.num_events;
+
+	if (name == NULL || n >= MAX_EVENTS_NUMBER) {
+		return;
+	}
+	sample->metrics.events[n] = (char *) name;
+	sample->metrics.values[n] = value;
+	sample->metrics.num_events = n + 1;
+}
+
+/* get the name <plugin>_<field> without the prefix mf_plugin_, once a plugin is loaded into a slot;
+   the names of the process and the spool are constant
+   @return the name, which stays valid until the plugin is shut down; NULL if there are too many names */
+static const char* metric_name(const char *plugin, const char *field)
+{
+	int i;
+	char name[AGENT_STATS_NAME_LEN + 32];
+
+	if (strncmp(plugin, PLUGIN_PREFIX, strlen(PLUGIN_PREFIX)) == 0) {
+		plugin += strlen(PLUGIN_PREFIX);
+	}
+	snprintf(name, sizeof(name), "%s_%s", plugin, field);
+
+	for (i = 0; i < num_metric_names; i++) {
+		if (strcmp(metric_names[i], name) == 0) {
+			return metric_names[i];
+		}
+	}
+	if (num_metric_names >= MAX_METRIC_NAMES) {
+		return NULL;
+	}
+	metric_names[num_metric_names] = strdup(name);
+	return metric_names[num_metric_names++];
+}
+
+/* get the upper bound in ns of the bucket, which holds the given fraction of the hook times */
+static double percentile(const unsigned long long *hist, unsigned long long total, double fraction)
+{
+	int i;
+	unsigned long long sum = 0;
+
+	if (total == 0) {
+		return 0.0;
+	}
+	for (i = 0; i < AGENT_STATS_BUCKETS; i++) {
+		sum += hist[i];
+		if (sum >= fraction * total && hist[i] > 0) {
+			return (double) (1ULL << (i + 1));
+		}
+	}
+	return (double) (1ULL << AGENT_STATS_BUCKETS);
+}
@@ -0,0 +1,37 @@
+/*
+ * Copyright 2014, 2015 High Performance Computing Center, Stuttgart
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef AGENT_SELF_H_
+#define AGENT_SELF_H_
+
+#include "plugin_manager.h"
+
+/* name of the built-in plug-in, which reports the overhead of the agent itself */
+#define AGENT_SELF_NAME "mf_plugin_agent_self"
+
+/**
+ * @brief Initializes the built-in plug-in and registers its hook to the plugin manager
+ *
+ * @returns 1 on success; 0 otherwise
+ */
+int init_mf_plugin_agent_self(PluginManager *pm);
+
+/**
+ * @brief Shuts down the built-in plug-in before its slot is freed
+ */
+void shutdown_mf_plugin_agent_self(void);
+
+#endif /* AGENT_SELF_H_ */
@@ -0,0 +1,113 @@
+/*
+ * Copyright 2014, 2015 High Performance Computing Center, Stuttgart
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string.h>
+#include <time.h>
+#include "agent_stats.h"
+
+/*******************************************************************************
+ * Variable Declarations
+ ******************************************************************************/
+AgentStats agent_stats[256];
+AgentSpoolStats agent_spool_stats[256];
+
+/*******************************************************************************
+ * Forward Declarations
+ ******************************************************************************/
+static void add(unsigned long long *counter, unsigned long long value);
+
+/*******************************************************************************
+ * Functions implementation
+ ******************************************************************************/
+/* Get the time of the monotonic clock */
+long long AgentStats_now(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (long long) now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+/* Clear the statistics of a slot */
+void AgentStats_reset(int num, const char *name)
+{
+	AgentStats *stats = &agent_stats[num];
+	__atomic_add_fetch(&stats->seq, 1, __ATOMIC_ACQ_REL);
+	memset(stats->hook_hist, 0, sizeof(stats->hook_hist));
+	stats->serialize_ns = 0;
+	stats->serialized = 0;
+	stats->publish_ns = 0;
+	stats->published = 0;
+	stats->bytes_sent = 0;
+	stats->dropped = 0;
+	strncpy(stats->name, name, AGENT_STATS_NAME_LEN - 1);
+	stats->name[AGENT_STATS_NAME_LEN - 1] = '\0';
+	__atomic_add_fetch(&stats->seq, 1, __ATOMIC_RELEASE);
+}
+
+/* Count the hook time in its histogram bucket */
+void AgentStats_hook(int num, long long ns)
+{
+	add(&agent_stats[num].hook_hist[AgentStats_bucket(ns)], 1);
+}
+
+/* Add the serialization time of one sample */
+void AgentStats_serialize(int num, long long ns)
+{
+	add(&agent_stats[num].serialize_ns, ns);
+	add(&agent_stats[num].serialized, 1);
+}
+
+/* Add a publish request */
+void AgentStats_publish(int num, long long ns, size_t bytes)
+{
+	add(&agent_stats[num].publish_ns, ns);
+	add(&agent_stats[num].published, 1);
+	add(&agent_stats[num].bytes_sent, bytes);
+}
+
+/* Set the number of dropped samples */
+void AgentStats_dropped(int num, unsigned long long dropped)
+{
+	__atomic_store_n(&agent_stats[num].dropped, dropped, __ATOMIC_RELAXED);
+}
+
+/* Set the state of the spool of a publisher thread */
+void AgentStats_spool(int id, unsigned long long bytes, unsigned long long records, 
+	long long oldest_ns, unsigned long long dropped)
+{
+	AgentSpoolStats *stats = &agent_spool_stats[id];
+	__atomic_store_n(&stats->bytes, bytes, __ATOMIC_RELAXED);
+	__atomic_store_n(&stats->records, records, __ATOMIC_RELAXED);
+	__atomic_store_n(&stats->oldest_ns, oldest_ns, __ATOMIC_RELAXED);
+	__atomic_store_n(&stats->dropped, dropped, __ATOMIC_RELAXED);
+}
+
+/* Get the bucket of the time, i.e. the position of its highest bit */
+int AgentStats_bucket(long long ns)
+{
+	int bucket = 0;
+	while (ns > 1 && bucket < AGENT_STATS_BUCKETS - 1) {
+		ns >>= 1;
+		bucket++;
+	}
+	return bucket;
+}
+
+/* add to a counter, which has a single writer but concurrent readers */
+static void add(unsigned long long *counter, unsigned long long value)
+{
+	__atomic_store_n(counter, *counter + value, __ATOMIC_RELAXED);
+}
@@ -0,0 +1,107 @@
+/*
+ * Copyright 2014, 2015 High Performance Computing Center, Stuttgart
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef AGENT_STATS_H_
+#define AGENT_STATS_H_
+
+#include <stddef.h>
+
+/* number of buckets of the hook time histogram; bucket b counts times in [2^b, 2^(b+1)) ns */
+#define AGENT_STATS_BUCKETS 32
+#define AGENT_STATS_NAME_LEN 64
+
+/**
+ * @brief Overhead statistics of one plug-in slot
+ *
+ * Each counter is written by one thread only: the hook times by the sampling
+ * thread, the serialization and publishing counters by the publisher thread.
+ * Readers load them without locking; the sequence counter is odd while the
+ * slot is being reset for another plug-in.
+ */
+typedef struct AgentStats_t {
+	unsigned seq;
+	char name[AGENT_STATS_NAME_LEN];
+	unsigned long long hook_hist[AGENT_STATS_BUCKETS];
+	unsigned long long serialize_ns;
+	unsigned long long serialized;
+	unsigned long long publish_ns;
+	unsigned long long published;
+	unsigned long long bytes_sent;
+	unsigned long long dropped;
+} AgentStats;
+
+/**
+ * @brief Statistics of the spool of one publisher thread, written by this thread only
+ */
+typedef struct AgentSpoolStats_t {
+	unsigned long long bytes;
+	unsigned long long records;
+	long long oldest_ns;		/* CLOCK_REALTIME of the oldest record, 0 if the spool is empty */
+	unsigned long long dropped;
+} AgentSpoolStats;
+
+/**
+ * @brief Statistics of all plug-in slots
+ */
+extern AgentStats agent_stats[256];
+
+/**
+ * @brief Statistics of the spools, by publisher thread
+ */
+extern AgentSpoolStats agent_spool_stats[256];
+
+/**
+ * @brief Returns the current time of the monotonic clock in ns
+ */
+long long AgentStats_now(void);
+
+/**
+ * @brief Clears the statistics of a slot, when a plug-in is loaded into it
+ */
+void AgentStats_reset(int num, const char *name);
+
+/**
+ * @brief Records the execution time of a plug-in hook
+ */
+void AgentStats_hook(int num, long long ns);
+
+/**
+ * @brief Records the time spent to serialize one sample
+ */
+void AgentStats_serialize(int num, long long ns);
+
+/**
+ * @brief Records a publish request with its latency and size
+ */
+void AgentStats_publish(int num, long long ns, size_t bytes);
+
+/**
+ * @brief Records the number of samples dropped so far
+ */
+void AgentStats_dropped(int num, unsigned long long dropped);
+
+/**
+ * @brief Records the state of the spool of a publisher thread
+ */
+void AgentStats_spool(int id, unsigned long long bytes, unsigned long long records, 
+	long long oldest_ns, unsigned long long dropped);
+
+/**
+ * @brief Returns the histogram bucket of the given time
+ */
+int AgentStats_bucket(long long ns);
+
+#endif /* AGENT_STATS_H_ */
@@ -57,6 +57,7 @@ void set_pwd(void);
 void createLogFile(void);
 int writeTmpPID(void);
 int prepare(void);
+void set_publisher_options(void);
 
 /*******************************************************************************
  * Functions implementation
@@ -150,6 +151,7 @@ int main(int argc, char* argv[]) {
 	free(logFileName);
 	free(confFile);
 
+	publisher_cleanup();
 	mfp_parse_clean();
 	exit(SUCCESS);
 }
@@ -247,6 +249,8 @@ int prepare(void)
 	sprintf(metrics_publish_URL, "%s/phantom_mf/metrics", server_name);
 	/* get platform_id */
 	mfp_get_value("generic", "platform_id", platform_id);
+	/* set the transport options of the publisher, before the first request */
+	set_publisher_options();
 
 	/* by default, no application_id and task_id is given, 
 	therefore set application_id to infrastructure; task_id to the platform_id */
@@ -284,3 +288,17 @@ int prepare(void)
 
 	return SUCCESS;
 }
+
+/* pass the transport options in the generic section of mf_config.ini to the publisher */
+void set_publisher_options(void)
+{
+	int i;
+	mfp_data *data = malloc(sizeof(mfp_data));
+	mfp_get_data("generic", data);
+	for (i = 0; i < data->size; i++) {
+		if (publisher_set_option(data->keys[i], data->values[i]) == FAILURE) {
+			log_warn("Invalid setting %s = %s in section generic\n", data->keys[i], data->values[i]);
+		}
+	}
+	mfp_data_free(data);
+}
@@ -28,46 +28,71 @@
 /*******************************************************************************
  * Variable Declarations
  ******************************************************************************/
-/* List of pointers of plugin handles */
-typedef struct PluginHandleList_t {
-	void* handle;
-	struct PluginHandleList_t* next;
-} PluginHandleList;
-
-/* First node of the list*/
+/* State of the plugin discovery */
 typedef struct PluginDiscoveryState_t {
-	PluginHandleList* handle_list;
+	char *dirname;
 } PluginDiscoveryState;
 
-/* Plugin init function */
-typedef int (*PluginInitFunc)(PluginManager *pm);
-
 int pluginCount = 0;
 
 char* plugins_name[256];
 
+/* handles of the loaded plugins, indexed like plugins_name */
+static void* plugin_handles[256];
+
+/* shutdown functions of the built-in plugins, which have no handle */
+static PluginShutdownFunc builtin_shutdown[256];
+static int builtin[256];
+
 /*******************************************************************************
  * Forward Declarations
  ******************************************************************************/
 /* Load a plugin by calling the init function of a plugin */
 void* load_plugin(char *name, char *fullpath, PluginManager *pm);
 
+/* Call a function of a plugin, which is named prefix + name */
+static void* plugin_function(void *handle, const char *prefix, const char *name);
+
+/* Find a free plugin slot */
+static int free_slot(const char *name);
+
+/* Hand a plugin slot over to the plugin of the given name */
+static void use_slot(int num, const char *name);
+
 /* parse mf_config.ini
  * if one plugin is switched on, call load_plugin function to load the plugin, 
- * store all the loaded plugin handlers to a list */
+ * store all the loaded plugin handlers */
 void* discover_plugins(const char *dirname, PluginManager *pm) {
+	char *names[256];
+	int i;
+
+	int count = list_plugins(dirname, names, 256);
+	if (count < 0) {
+		return NULL;
+	}
+
+	PluginDiscoveryState *plugins_state = malloc(sizeof(*plugins_state));
+	plugins_state->dirname = strdup(dirname);
+
+	for (i = 0; i < count; i++) {
+		load_plugin_slot(dirname, names[i], pm);
+		free(names[i]);
+	}
+	return (void*) plugins_state;
+}
+
+/* list the names of all plugins in the directory, which are not switched off */
+int list_plugins(const char *dirname, char **names, int max) {
 	DIR* dir = opendir(dirname);
 	struct dirent *direntry;
+	int count = 0;
 
 	if (!dir) {
 		log_error("Unable to open directory %s!\n", dirname);
-		return NULL ;
+		return -1;
 	}
 
-	PluginDiscoveryState *plugins_state = malloc(sizeof(*plugins_state));
-	plugins_state->handle_list = NULL;
-
-	while ((direntry = readdir(dir))) {
+	while ((direntry = readdir(dir)) && count < max) {
 		/*get the name of the plugin*/
 		char *last_slash = strrchr(direntry->d_name, '/');
 		char *name_start = last_slash ? last_slash + 1 : direntry->d_name;
@@ -89,47 +114,134 @@ void* discover_plugins(const char *dirname, PluginManager *pm) {
 			free(name);
 			continue;
 		}
+		names[count++] = name;
+	}
+
+	closedir(dir);
+	return count;
+}
+
+/* load the plugin of the given name from the directory into a free slot
+   return the slot of the plugin; -1 if the plugin cannot be loaded */
+int load_plugin_slot(const char *dirname, const char *name, PluginManager *pm) {
+	/* reuse the first free slot, or append a new one */
+	int num = free_slot(name);
+	if (num < 0) {
+		return -1;
+	}
+
+	char *fullpath = malloc(strlen(dirname) + strlen(name) + 5);
+	sprintf(fullpath, "%s/%s.so", dirname, name);
+	void *handle = load_plugin((char *) name, fullpath, pm);
+	free(fullpath);
+	if (!handle) {
+		return -1;
+	}
+
+	plugin_handles[num] = handle;
+	use_slot(num, name);
+	return num;
+}
 
-		char *fullpath = malloc(200 * sizeof(char));
-
-		strcpy(fullpath, dirname);
-		strcat(fullpath, "/");
-		strcat(fullpath, direntry->d_name);
-		plugins_name[pluginCount] = malloc(sizeof(char) * 256);
-		strcpy(plugins_name[pluginCount], name);
-		void *handle = load_plugin(name, fullpath, pm);
-		if (handle) {
-			PluginHandleList *handle_node = malloc(sizeof(*handle_node));
-			handle_node->handle = handle;
-			handle_node->next = plugins_state->handle_list;
-			plugins_state->handle_list = handle_node;
-			pluginCount++;
+/* find a free slot, or append a new one
+   return the slot; -1 if all slots are used */
+static int free_slot(const char *name) {
+	int num;
+	for (num = 0; num < pluginCount; num++) {
+		if (plugins_name[num] == NULL) {
+			break;
 		}
-		free(name);
-		free(fullpath);
 	}
+	if (num >= 256) {
+		log_error("Unable to load plugin %s, too many plugins\n", name);
+		return -1;
+	}
+	return num;
+}
 
-	closedir(dir);
-	if (plugins_state->handle_list)
-		return (void*) plugins_state;
-	else {
-		free(plugins_state);
-		return NULL ;
+/* set the name of the slot, and make the slot visible to other threads */
+static void use_slot(int num, const char *name) {
+	plugins_name[num] = malloc(sizeof(char) * 256);
+	strcpy(plugins_name[num], name);
+	if (num == pluginCount) {
+		/* the slot is set up completely, before other threads may see it */
+		__atomic_store_n(&pluginCount, num + 1, __ATOMIC_RELEASE);
+	}
+}
+
+/* load a plugin, which is compiled into the agent, into a free slot
+   return the slot of the plugin; -1 if the plugin cannot be loaded */
+int load_builtin_plugin(const char *name, PluginInitFunc init_func, PluginShutdownFunc shutdown_func, 
+	PluginManager *pm) {
+	int num = free_slot(name);
+	if (num < 0) {
+		return -1;
+	}
+	if (init_func(pm) <= 0) {
+		log_error("Plugin init function failed for %s\n", name);
+		return -1;
+	}
+	builtin[num] = 1;
+	builtin_shutdown[num] = shutdown_func;
+	use_slot(num, name);
+	return num;
+}
+
+/* check if the plugin of the slot is compiled into the agent */
+int is_builtin_plugin(int num) {
+	return num >= 0 && num < pluginCount && plugins_name[num] != NULL && builtin[num];
+}
+
+/* shut down the plugin of the given slot, and unload it */
+void unload_plugin_slot(int num) {
+	if (num < 0 || num >= pluginCount || plugins_name[num] == NULL) {
+		return;
+	}
+
+	if (builtin[num]) {
+		if (builtin_shutdown[num] != NULL) {
+			builtin_shutdown[num]();
+		}
+		builtin[num] = 0;
+		builtin_shutdown[num] = NULL;
+		log_info("Unloaded plugin %s\n", plugins_name[num]);
+		free(plugins_name[num]);
+		plugins_name[num] = NULL;
+		return;
+	}
+
+	void *ptr = plugin_function(plugin_handles[num], "shutdown_", plugins_name[num]);
+	if (ptr) {
+		PluginShutdownFunc shutdown_func = (PluginShutdownFunc) (intptr_t) ptr;
+		shutdown_func();
 	}
-	return 0;
+	dlclose(plugin_handles[num]);
+	plugin_handles[num] = NULL;
+	log_info("Unloaded plugin %s\n", plugins_name[num]);
+	free(plugins_name[num]);
+	plugins_name[num] = NULL;
+}
+
+/* find the slot of a loaded plugin */
+int find_plugin_slot(const char *name) {
+	int num;
+	for (num = 0; num < pluginCount; num++) {
+		if (plugins_name[num] != NULL && strcmp(plugins_name[num], name) == 0) {
+			return num;
+		}
+	}
+	return -1;
 }
 
 /* Clean-up plug-ins after execution */
 void cleanup_plugins(void* vpds) {
+	int num;
+	for (num = 0; num < pluginCount; num++) {
+		unload_plugin_slot(num);
+	}
 	if(vpds != NULL) {
 		PluginDiscoveryState *pds = (PluginDiscoveryState*) vpds;
-		PluginHandleList *node = pds->handle_list;
-		while (node) {
-			PluginHandleList *next = node->next;
-			dlclose(node->handle);
-			free(node);
-			node = next;
-		}
+		free(pds->dirname);
 		free(pds);	
 	}
 }
@@ -138,24 +250,17 @@ void cleanup_plugins(void* vpds) {
    when successfully, the plugin hook function is registered by the 
    PluginManager */
 void* load_plugin(char *name, char *fullpath, PluginManager *pm) {
-	char* slashed_path = strdup(fullpath);
-
-	void *libhandle = dlopen(slashed_path, RTLD_NOW);
+	void *libhandle = dlopen(fullpath, RTLD_NOW);
 
 	if (!libhandle) {
 		log_error("Unable to load library %s\n", dlerror());
 		return NULL;
 	}
 
-	char *init_func_name = malloc((strlen("init_") + strlen(name)) * sizeof(char) + 1);
-
-	strcpy(init_func_name, "init_");
-	strcat(init_func_name, name);
-
-	void *ptr = dlsym(libhandle, init_func_name);
-	free(init_func_name);
+	void *ptr = plugin_function(libhandle, "init_", name);
 	if (!ptr) {
 		log_error("Unable to load init function %s\n", dlerror());
+		dlclose(libhandle);
 		return NULL;
 	}
 
@@ -163,11 +268,21 @@ void* load_plugin(char *name, char *fullpath, PluginManager *pm) {
 
 	int rc = init_func(pm);
 	if (rc <= 0) {
-		log_error("Plugin init function failed for %s\n", strerror(rc));
+		log_error("Plugin init function failed for %s\n", name);
 		dlclose(libhandle);
 		return NULL ;
 	}
-
-	free(slashed_path);
 	return libhandle;
-}
\ No newline at end of file
+}
+
+/* Look up the function prefix + name of a plugin */
+static void* plugin_function(void *handle, const char *prefix, const char *name) {
+	char *func_name = malloc((strlen(prefix) + strlen(name)) * sizeof(char) + 1);
+
+	strcpy(func_name, prefix);
+	strcat(func_name, name);
+
+	void *ptr = dlsym(handle, func_name);
+	free(func_name);
+	return ptr;
+}
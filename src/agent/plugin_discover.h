@@ -20,12 +20,22 @@
 #include "plugin_manager.h"
 
 /**
- * @brief Number of plug-ins found at run-time
+ * @brief Plugin init function
+ */
+typedef int (*PluginInitFunc)(PluginManager *pm);
+
+/**
+ * @brief Plugin shutdown function, optional
+ */
+typedef void (*PluginShutdownFunc)(void);
+
+/**
+ * @brief Number of plug-in slots used at run-time; unloaded plug-ins leave a free slot
  */
 extern int pluginCount;
 
 /**
- * @brief Name of a given plug-in
+ * @brief Name of a given plug-in; NULL for a free slot
  */
 extern char* plugins_name[256];
 
@@ -34,6 +44,48 @@ extern char* plugins_name[256];
  */
 void* discover_plugins(const char *dirname, PluginManager *pm);
 
+/**
+ * @brief Lists the plug-ins in the given directory, which are not switched off
+ *
+ * The names are allocated and have to be freed by the caller.
+ *
+ * @returns the number of plug-ins listed; -1 if the directory cannot be opened
+ */
+int list_plugins(const char *dirname, char **names, int max);
+
+/**
+ * @brief Loads a single plug-in into a free slot, and registers it to the plugin manager
+ *
+ * @returns the slot of the plug-in, i.e. its index in plugins_name; -1 on failure
+ */
+int load_plugin_slot(const char *dirname, const char *name, PluginManager *pm);
+
+/**
+ * @brief Loads a plug-in, which is compiled into the agent, into a free slot
+ *
+ * @returns the slot of the plug-in; -1 on failure
+ */
+int load_builtin_plugin(const char *name, PluginInitFunc init_func, PluginShutdownFunc shutdown_func, 
+	PluginManager *pm);
+
+/**
+ * @brief Returns 1 if the plug-in of the given slot is compiled into the agent; 0 otherwise
+ */
+int is_builtin_plugin(int num);
+
+/**
+ * @brief Shuts down and unloads the plug-in of the given slot
+ *
+ * The function shutdown_<name>() of the plug-in is called, if it exists. The
+ * hook of the plug-in must not be called anymore.
+ */
+void unload_plugin_slot(int num);
+
+/**
+ * @brief Returns the slot of the loaded plug-in of the given name; -1 if it is not loaded
+ */
+int find_plugin_slot(const char *name);
+
 /**
  * @brief Clean-up plug-ins after execution
  */
@@ -16,10 +16,46 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <pthread.h>
 #include <excess_concurrent_queue.h>
 #include "plugin_manager.h"
 #include "mf_debug.h"		//functions like log_error(), log_info()...
 
+/* libraries shared by plug-ins, which are initialized once per process */
+#define MAX_LIBRARIES 8
+
+typedef struct LibraryUsers_t {
+	char *name;	//copy of the name, the caller's string may be unloaded with its plugin
+	int users;
+} LibraryUsers;
+
+static LibraryUsers libraries[MAX_LIBRARIES];
+static pthread_mutex_t libraries_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Find the users of the library, or add them if create is set */
+static LibraryUsers *find_library(const char *library, int create) {
+	LibraryUsers *free_slot = NULL;
+	int i;
+
+	for (i = 0; i < MAX_LIBRARIES; i++) {
+		if (libraries[i].users > 0 && strcmp(libraries[i].name, library) == 0) {
+			return &libraries[i];
+		}
+		if (libraries[i].users == 0 && free_slot == NULL) {
+			free_slot = &libraries[i];
+		}
+	}
+	if (create && free_slot != NULL) {
+		free_slot->name = strdup(library);
+		if (free_slot->name == NULL) {
+			return NULL;
+		}
+		return free_slot;
+	}
+	return NULL;
+}
+
 /* Creat a new plugin manager, which contains a hook queue */
 PluginManager* PluginManager_new() {
 	PluginManager *pm = malloc(sizeof(PluginManager));
@@ -38,6 +74,21 @@ void PluginManager_free(PluginManager *pm) {
 void PluginManager_register_hook(PluginManager *pm, const char *name, PluginHook hook) {
 	PluginHookType *hookType = malloc(sizeof(PluginHookType));
 	hookType->hook = hook;
+	hookType->sample_hook = NULL;
+	hookType->name = name;
+
+	EXCESS_concurrent_queue_handle_t hook_queue_handle;
+	hook_queue_handle = ECQ_get_handle(pm->hook_queue);
+	ECQ_enqueue(hook_queue_handle, (void *)hookType);
+	ECQ_free_handle(hook_queue_handle);
+}
+
+/* Register a plugin hook handing over binary samples to the plugin manager 
+ * push the hook to the hook queue */
+void PluginManager_register_sample_hook(PluginManager *pm, const char *name, PluginSampleHook hook) {
+	PluginHookType *hookType = malloc(sizeof(PluginHookType));
+	hookType->hook = NULL;
+	hookType->sample_hook = hook;
 	hookType->name = name;
 
 	EXCESS_concurrent_queue_handle_t hook_queue_handle;
@@ -46,6 +97,56 @@ void PluginManager_register_hook(PluginManager *pm, const char *name, PluginHook
 	ECQ_free_handle(hook_queue_handle);
 }
 
+/* Count the caller as user of the library, e.g. "papi" */
+int PluginManager_library_acquire(const char *library) {
+	pthread_mutex_lock(&libraries_lock);
+	LibraryUsers *l = find_library(library, 1);
+	int users = 1;
+	if (l != NULL) {
+		users = ++l->users;
+	} else {
+		log_error("Too many shared libraries of plugins, %s is not counted", library);
+	}
+	pthread_mutex_unlock(&libraries_lock);
+	return users;
+}
+
+/* Count the caller no longer as user of the library; the last one shuts it down */
+int PluginManager_library_release(const char *library) {
+	pthread_mutex_lock(&libraries_lock);
+	LibraryUsers *l = find_library(library, 0);
+	int users = 0;
+	if (l != NULL) {
+		users = --l->users;
+		if (users == 0) {
+			free(l->name);
+			l->name = NULL;
+		}
+	}
+	pthread_mutex_unlock(&libraries_lock);
+	return users;
+}
+
+/* Pop one hook type from the hook queue */
+int PluginManager_get_hook_type(PluginManager *pm, PluginHookType *hook_type) {
+	int found = 0;
+	void *retPtr;
+
+	EXCESS_concurrent_queue_handle_t hook_queue_handle;
+	hook_queue_handle = ECQ_get_handle(pm->hook_queue);
+
+	if(ECQ_try_dequeue(hook_queue_handle, &retPtr)) {
+		PluginHookType *typePtr = (struct PluginHookType_t *) retPtr;
+		*hook_type = *typePtr;
+		log_info("Using plugin %s\n", typePtr->name);
+		free(typePtr);
+		found = 1;
+	}
+
+	ECQ_free_handle(hook_queue_handle);
+	return found;
+}
+
 /* Pop one hook from the hook queue */
 PluginHook PluginManager_get_hook(PluginManager *pm) {
 	PluginHook funcPtr = NULL;
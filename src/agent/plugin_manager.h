@@ -18,12 +18,27 @@
 #define PLUGIN_MANAGER_H_
 
 #include <excess_concurrent_queue.h>
+#include <plugin_utils.h>
 
 /**
  * @brief Entry function of a plug-in
+ *
+ * Returns a json-formatted sample allocated by the plug-in, which is freed by
+ * the caller. Kept for compatibility; new plug-ins should register a
+ * PluginSampleHook instead.
  */
 typedef char* (*PluginHook)();
 
+/**
+ * @brief Entry function of a plug-in handing over a binary sample
+ *
+ * The plug-in fills the given sample with its selected metrics; the agent
+ * serializes the sample only once, when it is published.
+ *
+ * @returns 1 if a sample was taken; 0 otherwise
+ */
+typedef int (*PluginSampleHook)(Plugin_sample *sample);
+
 /**
  * @brief definition of plugin manager struct
  */
@@ -35,7 +50,8 @@ typedef struct PluginManager_t {
  * @brief definition of plugin hook
  */
 typedef struct PluginHookType_t {
-	PluginHook hook;
+	PluginHook hook;				/* set for plug-ins registered by PluginManager_register_hook() */
+	PluginSampleHook sample_hook;	/* set for plug-ins registered by PluginManager_register_sample_hook() */
 	const char *name;
 } PluginHookType;
 
@@ -54,6 +70,29 @@ void PluginManager_free(PluginManager *pm);
  */
 void PluginManager_register_hook(PluginManager *pm, const char *name, PluginHook hook);
 
+/**
+ * @brief Registers hooks, which hand over binary samples, for each plug-in
+ */
+void PluginManager_register_sample_hook(PluginManager *pm, const char *name, PluginSampleHook hook);
+
+/**
+ * @brief Counts a plug-in as user of a library which is initialized once per process, e.g. "papi"
+ *
+ * Plug-ins sharing such a library call PluginManager_library_acquire() when
+ * they start using it, and PluginManager_library_release() once they have
+ * stopped; only the last one shuts the library down.
+ *
+ * @returns the number of users of the library, including the caller
+ */
+int PluginManager_library_acquire(const char *library);
+
+/**
+ * @brief Counts a plug-in no longer as user of the library
+ *
+ * @returns the number of users left; 0 if the caller has to shut the library down
+ */
+int PluginManager_library_release(const char *library);
+
 /**
  * @brief Return the hook function associated with the given plug-in
  *
@@ -63,4 +102,13 @@ void PluginManager_register_hook(PluginManager *pm, const char *name, PluginHook
  */
 PluginHook PluginManager_get_hook(PluginManager *pm);
 
+/**
+ * @brief Return the hook type, i.e. either kind of hook, of the given plug-in
+ *
+ * It should be noted that hooks are stored in a FIFO queue.
+ *
+ * @returns the hook type, which is copied into the given one; 0 if no hook is left
+ */
+int PluginManager_get_hook_type(PluginManager *pm, PluginHookType *hook_type);
+
 #endif /* PLUGIN_MANAGER_H_ */
@@ -0,0 +1,121 @@
+/*
+ * Copyright 2014, 2015 High Performance Computing Center, Stuttgart
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdlib.h>
+#include "sample_ring.h"
+
+/*******************************************************************************
+ * Functions implementation
+ ******************************************************************************/
+/* Create a ring, the number of slots is rounded up to a power of two */
+SampleRing* SampleRing_new(size_t capacity, size_t elem_size)
+{
+	size_t slots = 1;
+	while (slots < capacity) {
+		slots <<= 1;
+	}
+
+	SampleRing *ring = NULL;
+	if (posix_memalign((void **) &ring, SAMPLE_RING_CACHE_LINE, sizeof(SampleRing)) != 0) {
+		return NULL;
+	}
+	ring->capacity = slots;
+	ring->elem_size = elem_size;
+	ring->head = 0;
+	ring->tail = 0;
+	ring->pushed = 0;
+	ring->dropped = 0;
+	ring->high_watermark = 0;
+	ring->buffer = calloc(slots, elem_size);
+	if (ring->buffer == NULL) {
+		free(ring);
+		return NULL;
+	}
+	return ring;
+}
+
+/* Free the ring */
+void SampleRing_free(SampleRing *ring)
+{
+	if (ring != NULL) {
+		free(ring->buffer);
+		free(ring);
+	}
+}
+
+/* Reserve the next free slot; return NULL and count a drop if the ring is full */
+void* SampleRing_reserve(SampleRing *ring)
+{
+	size_t head = ring->head;
+	size_t tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+
+	if (head - tail >= ring->capacity) {
+		__atomic_store_n(&ring->dropped, ring->dropped + 1, __ATOMIC_RELAXED);
+		return NULL;
+	}
+	return ring->buffer + (head & (ring->capacity - 1)) * ring->elem_size;
+}
+
+/* Count a drop of a sample, which is not reserved */
+void SampleRing_drop(SampleRing *ring)
+{
+	__atomic_store_n(&ring->dropped, ring->dropped + 1, __ATOMIC_RELAXED);
+}
+
+/* Publish the reserved slot to the consumer */
+void SampleRing_commit(SampleRing *ring)
+{
+	size_t head = ring->head + 1;
+	size_t used = head - __atomic_load_n(&ring->tail, __ATOMIC_RELAXED);
+
+	if (used > ring->high_watermark) {
+		__atomic_store_n(&ring->high_watermark, used, __ATOMIC_RELAXED);
+	}
+	__atomic_store_n(&ring->pushed, ring->pushed + 1, __ATOMIC_RELAXED);
+	__atomic_store_n(&ring->head, head, __ATOMIC_RELEASE);
+}
+
+/* Return the oldest committed slot, or NULL if the ring is empty */
+void* SampleRing_peek(SampleRing *ring)
+{
+	size_t tail = ring->tail;
+	size_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+
+	if (tail == head) {
+		return NULL;
+	}
+	return ring->buffer + (tail & (ring->capacity - 1)) * ring->elem_size;
+}
+
+/* Hand the oldest slot back to the producer */
+void SampleRing_release(SampleRing *ring)
+{
+	__atomic_store_n(&ring->tail, ring->tail + 1, __ATOMIC_RELEASE);
+}
+
+/* Number of samples waiting in the ring */
+size_t SampleRing_size(SampleRing *ring)
+{
+	size_t tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+	size_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+	return head - tail;
+}
+
+/* Number of samples dropped so far */
+unsigned long long SampleRing_dropped(SampleRing *ring)
+{
+	return __atomic_load_n(&ring->dropped, __ATOMIC_RELAXED);
+}
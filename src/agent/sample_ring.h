@@ -0,0 +1,96 @@
+/*
+ * Copyright 2014, 2015 High Performance Computing Center, Stuttgart
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SAMPLE_RING_H_
+#define SAMPLE_RING_H_
+
+#include <stddef.h>
+
+#define SAMPLE_RING_CACHE_LINE 64
+
+/**
+ * @brief Bounded lock-free ring buffer for one producer and one consumer
+ *
+ * The ring holds a fixed number of equally sized slots. The producer (the
+ * sampling thread of a plug-in) reserves a slot, fills it, and commits it;
+ * the consumer (a publisher thread) peeks at the oldest slot and releases it
+ * after use. Samples are dropped if the ring is full.
+ */
+typedef struct SampleRing_t {
+	size_t capacity;			/* number of slots, a power of two */
+	size_t elem_size;			/* size of each slot in bytes */
+	char *buffer;
+
+	/* written by the producer only */
+	size_t head __attribute__((aligned(SAMPLE_RING_CACHE_LINE)));
+	unsigned long long pushed;
+	unsigned long long dropped;
+	size_t high_watermark;
+
+	/* written by the consumer only */
+	size_t tail __attribute__((aligned(SAMPLE_RING_CACHE_LINE)));
+} SampleRing;
+
+/**
+ * @brief Creates a ring with at least the given number of slots of elem_size bytes
+ */
+SampleRing* SampleRing_new(size_t capacity, size_t elem_size);
+
+/**
+ * @brief Frees the ring and its slots
+ */
+void SampleRing_free(SampleRing *ring);
+
+/**
+ * @brief Reserves the next free slot (producer only)
+ *
+ * @returns the slot, or NULL if the ring is full; the sample is counted as dropped then
+ */
+void* SampleRing_reserve(SampleRing *ring);
+
+/**
+ * @brief Counts a sample as dropped, which the producer rejects (producer only)
+ */
+void SampleRing_drop(SampleRing *ring);
+
+/**
+ * @brief Makes the reserved slot visible to the consumer (producer only)
+ */
+void SampleRing_commit(SampleRing *ring);
+
+/**
+ * @brief Returns the oldest committed slot (consumer only)
+ *
+ * @returns the slot, or NULL if the ring is empty
+ */
+void* SampleRing_peek(SampleRing *ring);
+
+/**
+ * @brief Frees the slot returned by SampleRing_peek() (consumer only)
+ */
+void SampleRing_release(SampleRing *ring);
+
+/**
+ * @brief Returns the number of committed but not yet released slots
+ */
+size_t SampleRing_size(SampleRing *ring);
+
+/**
+ * @brief Returns the number of samples dropped because the ring was full or they were rejected
+ */
+unsigned long long SampleRing_dropped(SampleRing *ring);
+
+#endif /* SAMPLE_RING_H_ */
@@ -0,0 +1,414 @@
+/*
+ * Copyright 2014, 2015 High Performance Computing Center, Stuttgart
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include "spool.h"
+#include "mf_debug.h"
+
+#define SUCCESS 1
+#define FAILURE 0
+#define SPOOL_MAGIC 0x5053464dU		/* "MFSP" */
+#define SPOOL_SUFFIX ".spool"
+#define SPOOL_CURSOR "cursor"
+
+/*******************************************************************************
+ * Variable Declarations
+ ******************************************************************************/
+/* header of each record in a segment, followed by len bytes of data */
+typedef struct SpoolHeader_t {
+	unsigned magic;
+	unsigned len;
+	long long time_ns;			/* CLOCK_REALTIME when the record was appended */
+} SpoolHeader;
+
+/* read position, stored in the cursor file */
+typedef struct SpoolCursor_t {
+	unsigned long long seg;
+	unsigned long long off;
+} SpoolCursor;
+
+/*******************************************************************************
+ * Forward Declarations
+ ******************************************************************************/
+static int make_dirs(const char *dir);
+static void segment_path(Spool *spool, unsigned long long seg, char *path);
+static int find_segments(Spool *spool, unsigned long long *first, unsigned long long *last);
+static void count_segment(Spool *spool, unsigned long long seg, off_t off);
+static int read_header(int fd, off_t off, SpoolHeader *header);
+static void next_segment(Spool *spool);
+static void save_cursor(Spool *spool);
+static void reset(Spool *spool);
+static long long now_ns(void);
+
+/*******************************************************************************
+ * Functions implementation
+ ******************************************************************************/
+/* Open the spool, continuing at the cursor of a previous run */
+Spool* Spool_open(const char *dir, size_t max_size, size_t segment_size, int sync_every)
+{
+	char path[SPOOL_PATH_LEN + 32];
+	unsigned long long first, last, seg;
+	SpoolCursor cursor;
+
+	if (make_dirs(dir) != SUCCESS) {
+		log_error("Cannot create spool directory %s: %s\n", dir, strerror(errno));
+		return NULL;
+	}
+	Spool *spool = calloc(1, sizeof(Spool));
+	snprintf(spool->dir, SPOOL_PATH_LEN, "%s", dir);
+	spool->max_size = max_size;
+	spool->segment_size = segment_size;
+	spool->sync_every = (sync_every > 0) ? sync_every : 1;
+	spool->write_fd = -1;
+	spool->read_fd = -1;
+
+	snprintf(path, sizeof(path), "%s/%s", spool->dir, SPOOL_CURSOR);
+	spool->cursor_fd = open(path, O_RDWR | O_CREAT, 0644);
+	if (spool->cursor_fd < 0 || find_segments(spool, &first, &last) != SUCCESS) {
+		log_error("Cannot open spool %s: %s\n", dir, strerror(errno));
+		if (spool->cursor_fd >= 0) {
+			close(spool->cursor_fd);
+		}
+		free(spool);
+		return NULL;
+	}
+
+	/* continue behind the records consumed by the previous run; new records go to a new segment */
+	spool->read_seg = first;
+	spool->read_off = 0;
+	if (pread(spool->cursor_fd, &cursor, sizeof(cursor), 0) == sizeof(cursor) &&
+		cursor.seg >= first && cursor.seg <= last) {
+		spool->read_seg = cursor.seg;
+		spool->read_off = cursor.off;
+	}
+	for (seg = first; seg < spool->read_seg; seg++) {
+		segment_path(spool, seg, path);
+		unlink(path);
+	}
+	for (seg = spool->read_seg; seg <= last; seg++) {
+		count_segment(spool, seg, (seg == spool->read_seg) ? spool->read_off : 0);
+	}
+	spool->write_seg = last + 1;
+	if (spool->records == 0) {
+		reset(spool);
+	} else {
+		log_info("Spool %s holds %llu records (%zu bytes) of a previous run\n",
+			dir, spool->records, spool->size);
+	}
+	return spool;
+}
+
+/* Sync and close the spool */
+void Spool_close(Spool *spool)
+{
+	if (spool == NULL) {
+		return;
+	}
+	if (spool->write_fd >= 0) {
+		fdatasync(spool->write_fd);
+		close(spool->write_fd);
+	}
+	if (spool->read_fd >= 0) {
+		close(spool->read_fd);
+	}
+	fdatasync(spool->cursor_fd);
+	close(spool->cursor_fd);
+	free(spool->record);
+	free(spool);
+}
+
+/* Append a record to the current segment, starting a new segment once it is full */
+int Spool_append(Spool *spool, const char *data, size_t len)
+{
+	char path[SPOOL_PATH_LEN + 32];
+	SpoolHeader header = { SPOOL_MAGIC, (unsigned) len, now_ns() };
+	size_t size = sizeof(SpoolHeader) + len;
+
+	if (spool->size + size > spool->max_size) {
+		spool->dropped++;
+		return FAILURE;
+	}
+	if (spool->write_fd >= 0 && spool->write_len >= spool->segment_size) {
+		fdatasync(spool->write_fd);
+		close(spool->write_fd);
+		spool->write_fd = -1;
+		spool->write_seg++;
+		spool->unsynced = 0;
+	}
+	if (spool->write_fd < 0) {
+		segment_path(spool, spool->write_seg, path);
+		spool->write_fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+		if (spool->write_fd < 0) {
+			log_error("Cannot create spool segment %s: %s\n", path, strerror(errno));
+			spool->dropped++;
+			return FAILURE;
+		}
+		spool->write_len = 0;
+	}
+
+	struct iovec iov[2] = { { &header, sizeof(header) }, { (void *) data, len } };
+	ssize_t written = writev(spool->write_fd, iov, 2);
+	if (written != (ssize_t) size) {
+		log_error("Cannot write to spool %s: %s\n", spool->dir, strerror(errno));
+		/* do not leave a partial record behind */
+		if (ftruncate(spool->write_fd, spool->write_len) != 0 ||
+			lseek(spool->write_fd, spool->write_len, SEEK_SET) < 0) {
+			log_error("Cannot truncate spool %s: %s\n", spool->dir, strerror(errno));
+		}
+		spool->dropped++;
+		return FAILURE;
+	}
+	spool->write_len += size;
+	spool->size += size;
+	spool->records++;
+	if (++spool->unsynced >= spool->sync_every) {
+		fdatasync(spool->write_fd);
+		spool->unsynced = 0;
+	}
+	return SUCCESS;
+}
+
+/* Read the oldest record, skipping over segments which are read completely */
+char* Spool_peek(Spool *spool, size_t *len)
+{
+	char path[SPOOL_PATH_LEN + 32];
+	SpoolHeader header;
+
+	if (spool->record_len > 0) {
+		*len = spool->record_len - sizeof(SpoolHeader);
+		return spool->record;
+	}
+	while (spool->records > 0) {
+		if (spool->read_fd < 0) {
+			segment_path(spool, spool->read_seg, path);
+			spool->read_fd = open(path, O_RDONLY);
+			if (spool->read_fd < 0) {
+				if (spool->read_seg >= spool->write_seg) {
+					return NULL;
+				}
+				next_segment(spool);
+				continue;
+			}
+		}
+		if (read_header(spool->read_fd, spool->read_off, &header) == SUCCESS) {
+			if (header.len + 1 > spool->record_size) {
+				spool->record_size = header.len + 1;
+				spool->record = realloc(spool->record, spool->record_size);
+			}
+			if (pread(spool->read_fd, spool->record, header.len, spool->read_off + sizeof(header)) ==
+				(ssize_t) header.len) {
+				spool->record[header.len] = '\0';
+				spool->record_len = sizeof(header) + header.len;
+				spool->record_time = header.time_ns;
+				*len = header.len;
+				return spool->record;
+			}
+		}
+		/* end of the segment, or a record torn by a crash */
+		if (spool->read_seg >= spool->write_seg) {
+			return NULL;
+		}
+		next_segment(spool);
+	}
+	return NULL;
+}
+
+/* Remove the peeked record; the segments are deleted once the spool is empty */
+void Spool_consume(Spool *spool)
+{
+	if (spool->record_len == 0) {
+		return;
+	}
+	spool->read_off += spool->record_len;
+	spool->size -= spool->record_len;
+	spool->records--;
+	spool->record_len = 0;
+
+	if (spool->records == 0) {
+		reset(spool);
+	} else {
+		save_cursor(spool);
+	}
+}
+
+/* Get the time of the oldest record */
+long long Spool_oldest(Spool *spool)
+{
+	size_t len;
+	if (Spool_peek(spool, &len) == NULL) {
+		return 0;
+	}
+	return spool->record_time;
+}
+
+/* create the directory and its parents
+   return 1 on success; 0 otherwise */
+static int make_dirs(const char *dir)
+{
+	char path[SPOOL_PATH_LEN];
+	char *p;
+
+	snprintf(path, sizeof(path), "%s", dir);
+	for (p = path + 1; *p != '\0'; p++) {
+		if (*p == '/') {
+			*p = '\0';
+			if (mkdir(path, 0755) != 0 && errno != EEXIST) {
+				return FAILURE;
+			}
+			*p = '/';
+		}
+	}
+	if (mkdir(path, 0755) != 0 && errno != EEXIST) {
+		return FAILURE;
+	}
+	return SUCCESS;
+}
+
+/* get the path of a segment */
+static void segment_path(Spool *spool, unsigned long long seg, char *path)
+{
+	sprintf(path, "%s/%016llu%s", spool->dir, seg, SPOOL_SUFFIX);
+}
+
+/* get the numbers of the first and last segment in the directory; both are 0 if there is none
+   return 1 on success; 0 otherwise */
+static int find_segments(Spool *spool, unsigned long long *first, unsigned long long *last)
+{
+	struct dirent *entry;
+	unsigned long long seg;
+	char suffix[16];
+
+	DIR *dir = opendir(spool->dir);
+	if (dir == NULL) {
+		return FAILURE;
+	}
+	*first = 0;
+	*last = 0;
+	while ((entry = readdir(dir)) != NULL) {
+		if (sscanf(entry->d_name, "%llu%15s", &seg, suffix) != 2 || strcmp(suffix, SPOOL_SUFFIX) != 0) {
+			continue;
+		}
+		if (*first == 0 || seg < *first) {
+			*first = seg;
+		}
+		if (seg > *last) {
+			*last = seg;
+		}
+	}
+	closedir(dir);
+	return SUCCESS;
+}
+
+/* count the complete records of a segment from the given offset */
+static void count_segment(Spool *spool, unsigned long long seg, off_t off)
+{
+	char path[SPOOL_PATH_LEN + 32];
+	SpoolHeader header;
+	struct stat st;
+
+	segment_path(spool, seg, path);
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		return;
+	}
+	if (fstat(fd, &st) == 0) {
+		while (read_header(fd, off, &header) == SUCCESS &&
+			off + (off_t) (sizeof(header) + header.len) <= st.st_size) {
+			off += sizeof(header) + header.len;
+			spool->size += sizeof(header) + header.len;
+			spool->records++;
+		}
+	}
+	close(fd);
+}
+
+/* read the header of the record at the given offset
+   return 1 if a valid header was read; 0 otherwise */
+static int read_header(int fd, off_t off, SpoolHeader *header)
+{
+	if (pread(fd, header, sizeof(SpoolHeader), off) != sizeof(SpoolHeader)) {
+		return FAILURE;
+	}
+	return header->magic == SPOOL_MAGIC;
+}
+
+/* delete the segment read completely, and continue with the next one */
+static void next_segment(Spool *spool)
+{
+	char path[SPOOL_PATH_LEN + 32];
+
+	if (spool->read_fd >= 0) {
+		close(spool->read_fd);
+		spool->read_fd = -1;
+	}
+	segment_path(spool, spool->read_seg, path);
+	unlink(path);
+	spool->read_seg++;
+	spool->read_off = 0;
+	save_cursor(spool);
+}
+
+/* store the read position in the cursor file */
+static void save_cursor(Spool *spool)
+{
+	SpoolCursor cursor = { spool->read_seg, (unsigned long long) spool->read_off };
+	if (pwrite(spool->cursor_fd, &cursor, sizeof(cursor), 0) != sizeof(cursor)) {
+		log_warn("Cannot write the cursor of spool %s\n", spool->dir);
+	}
+}
+
+/* delete all segments of the empty spool, new records start a new segment */
+static void reset(Spool *spool)
+{
+	char path[SPOOL_PATH_LEN + 32];
+	unsigned long long seg;
+
+	if (spool->read_fd >= 0) {
+		close(spool->read_fd);
+		spool->read_fd = -1;
+	}
+	if (spool->write_fd >= 0) {
+		close(spool->write_fd);
+		spool->write_fd = -1;
+	}
+	for (seg = spool->read_seg; seg <= spool->write_seg; seg++) {
+		segment_path(spool, seg, path);
+		unlink(path);
+	}
+	spool->write_seg++;
+	spool->read_seg = spool->write_seg;
+	spool->read_off = 0;
+	spool->size = 0;
+	spool->unsynced = 0;
+	save_cursor(spool);
+}
+
+/* get the current time of the realtime clock in ns */
+static long long now_ns(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_REALTIME, &now);
+	return (long long) now.tv_sec * 1000000000LL + now.tv_nsec;
+}
@@ -0,0 +1,106 @@
+/*
+ * Copyright 2014, 2015 High Performance Computing Center, Stuttgart
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SPOOL_H_
+#define SPOOL_H_
+
+#include <stddef.h>
+#include <sys/types.h>
+
+#define SPOOL_PATH_LEN 256
+
+/**
+ * @brief Bounded on-disk queue of records, used by one thread
+ *
+ * Records are appended to segment files named <number>.spool in the spool
+ * directory; a new segment is started once the current one exceeds the
+ * segment size. Records are read back in the order they were written, and
+ * a segment is deleted once all of its records are consumed. Appended
+ * records are synced to disk in batches of sync_every records; the read
+ * position is kept in the file cursor, so that a restarted agent continues
+ * where it stopped.
+ */
+typedef struct Spool_t {
+	char dir[SPOOL_PATH_LEN];
+	size_t max_size;			/* bound of the size of all segments */
+	size_t segment_size;		/* a new segment is started above this size */
+	int sync_every;				/* records appended between two fsync() calls */
+	int cursor_fd;
+
+	/* writing end */
+	unsigned long long write_seg;
+	int write_fd;
+	size_t write_len;
+	int unsynced;
+
+	/* reading end */
+	unsigned long long read_seg;
+	int read_fd;
+	off_t read_off;
+	char *record;				/* record returned by Spool_peek() */
+	size_t record_size;
+	size_t record_len;			/* size of the record on disk, 0 if none is peeked */
+	long long record_time;
+
+	/* statistics */
+	size_t size;				/* bytes in all segments, not yet consumed */
+	unsigned long long records;
+	unsigned long long dropped;
+} Spool;
+
+/**
+ * @brief Opens the spool in the given directory, which is created if needed
+ *
+ * Records left by a previous run are kept and read first.
+ *
+ * @returns the spool, or NULL on failure
+ */
+Spool* Spool_open(const char *dir, size_t max_size, size_t segment_size, int sync_every);
+
+/**
+ * @brief Syncs and closes the spool; its records are kept on disk
+ */
+void Spool_close(Spool *spool);
+
+/**
+ * @brief Appends a record of len bytes
+ *
+ * @returns 1 on success; 0 if the spool is full or cannot be written, the record is counted as dropped then
+ */
+int Spool_append(Spool *spool, const char *data, size_t len);
+
+/**
+ * @brief Returns the oldest record, terminated by '\0'
+ *
+ * The record stays valid and is returned again until Spool_consume() is called.
+ *
+ * @returns the record, or NULL if the spool is empty
+ */
+char* Spool_peek(Spool *spool, size_t *len);
+
+/**
+ * @brief Removes the record returned by Spool_peek()
+ */
+void Spool_consume(Spool *spool);
+
+/**
+ * @brief Returns the time (CLOCK_REALTIME, in ns) when the oldest record was appended
+ *
+ * @returns the time, or 0 if the spool is empty
+ */
+long long Spool_oldest(Spool *spool);
+
+#endif /* SPOOL_H_ */
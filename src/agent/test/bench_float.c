@@ -0,0 +1,204 @@
+/*
+ * Check and microbenchmark of mf_json_fixed() of mf_json.h against snprintf
+ *
+ * First, the text of mf_json_fixed() is compared with the text of snprintf
+ * with "%.3f" and "%.1f" for edge cases (halfway values, powers of two and
+ * ten, zeros, subnormals, the fallback range) and for the given number of
+ * random values: metric values of various magnitudes, single precision values
+ * like those of PAPI and NVML, and millisecond timestamps. Any difference is
+ * printed and fails the check. The same values, and doubles up to DBL_MAX,
+ * are written as MessagePack and converted back by msgpack_to_json(), which
+ * has to give the text of "%.3f" as well. Then both are timed on the random
+ * values and their ns per value are printed:
+ *
+ *   ./bench_float                # 10000000 values
+ *   ./bench_float -n 1000000
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+#include <float.h>
+#include <time.h>
+#include "mf_json.h"
+#include "msgpack.h"
+
+#define NSEC_PER_SEC 1000000000LL
+
+static unsigned long long differences = 0;
+
+static long long now_ns(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec * NSEC_PER_SEC + now.tv_nsec;
+}
+
+/* xorshift64*, to get the same values on every run */
+static unsigned long long random_state = 88172645463325252ULL;
+
+static unsigned long long random_bits(void)
+{
+	random_state ^= random_state >> 12;
+	random_state ^= random_state << 25;
+	random_state ^= random_state >> 27;
+	return random_state * 2685821657736338717ULL;
+}
+
+static double random_uniform(void)
+{
+	return (random_bits() >> 11) * (1.0 / 9007199254740992.0);
+}
+
+/* the i-th random value, of one of the kinds sampled by the plugins */
+static double random_value(unsigned long long i)
+{
+	double sign = (random_bits() & 1) ? -1.0 : 1.0;
+
+	switch (i % 6) {
+	case 0: return sign * random_uniform() * 1000.0;
+	case 1: return sign * pow(10.0, random_uniform() * 21.0 - 6.0);
+	case 2: return (float) (random_uniform() * 100000.0);
+	case 3: return (double) (random_bits() % 100000000) / 1000.0 + sign * 0.0005;
+	case 4: return 1.5e12 + random_uniform() * 1e11;
+	default: return (double) (random_bits() % 1000000000);
+	}
+}
+
+static void check(double value, int decimals)
+{
+	char expected[MF_JSON_NUMBER_LEN], text[MF_JSON_NUMBER_LEN];
+	int expected_len = snprintf(expected, sizeof(expected), "%.*f", decimals, value);
+	int len = mf_json_fixed(text, value, decimals);
+
+	if (len != expected_len || strcmp(text, expected) != 0) {
+		if (differences++ < 20) {
+			fprintf(stderr, "%.17g with %d decimals: \"%s\" instead of \"%s\"\n", value, decimals, text, expected);
+		}
+	}
+}
+
+/* convert the value as MessagePack array of one double into json */
+static void check_msgpack(double value)
+{
+	char data[16], expected[400];
+	char *json;
+	size_t json_len;
+	char *p = msgpack_write_double(msgpack_write_array32(data, 1), value);
+	int expected_len = snprintf(expected, sizeof(expected), "[%.3f]", value);
+
+	if (!msgpack_to_json(data, p - data, &json, &json_len)) {
+		if (differences++ < 20) {
+			fprintf(stderr, "%.17g: msgpack_to_json fails\n", value);
+		}
+		return;
+	}
+	if (json_len != (size_t) expected_len || strcmp(json, expected) != 0) {
+		if (differences++ < 20) {
+			fprintf(stderr, "%.17g: msgpack_to_json gives \"%.80s\" instead of \"%.80s\"\n", value, json, expected);
+		}
+	}
+	free(json);
+}
+
+static void check_all(double value)
+{
+	int decimals;
+	for (decimals = 0; decimals <= 3; decimals++) {
+		check(value, decimals);
+		check(-value, decimals);
+	}
+	check_msgpack(value);
+	check_msgpack(-value);
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr, "Usage: %s [-n number of values]\n", name);
+}
+
+int main(int argc, char **argv)
+{
+	long long count = 10000000, i;
+	int opt, e;
+
+	while ((opt = getopt(argc, argv, "n:h")) != -1) {
+		switch (opt) {
+		case 'n': count = atoll(optarg); break;
+		default: usage(argv[0]); return 1;
+		}
+	}
+	if (count <= 0) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	/* halfway values, e.g. 0.0625, and their neighbours */
+	for (i = 0; i < 1 << 16; i++) {
+		double value = i / 16.0 + 0.0005;
+		check_all(value);
+		check_all(nextafter(value, 0.0));
+		check_all(nextafter(value, 1e300));
+		check_all(i / 1024.0);
+		check_all(i / 2000.0);
+	}
+	for (e = -1074; e < 64; e++) {
+		check_all(ldexp(1.0, e));
+		check_all(nextafter(ldexp(1.0, e), 0.0));
+	}
+	for (e = -10; e <= 20; e++) {
+		check_all(pow(10.0, e));
+		check_all(nextafter(pow(10.0, e), 0.0));
+		check_all(nextafter(pow(10.0, e), 1e300));
+	}
+	check_all(0.0);
+	check_all(MF_JSON_FIXED_MAX);
+	check_all(nextafter(MF_JSON_FIXED_MAX, 0.0));
+	/* longer than MF_JSON_NUMBER_LEN: formatted by msgpack_to_json() only */
+	check_msgpack(1e61);
+	check_msgpack(-1e300);
+	check_msgpack(DBL_MAX);
+	check_msgpack(-DBL_MAX);
+	check_all(INFINITY);
+	check_all(NAN);
+
+	double *values = malloc(count * sizeof(double));
+	if (values == NULL) {
+		fprintf(stderr, "Cannot allocate %lld values\n", count);
+		return 1;
+	}
+	for (i = 0; i < count; i++) {
+		values[i] = random_value(i);
+		check(values[i], (i % 6 == 4) ? 1 : 3);
+		if (i < 100000) {
+			check_msgpack(values[i]);
+		}
+	}
+	if (differences > 0) {
+		fprintf(stderr, "%llu values differ from snprintf\n", differences);
+		return 1;
+	}
+	printf("%lld random values and the edge cases give the same text as snprintf\n", count);
+
+	char text[MF_JSON_NUMBER_LEN];
+	size_t bytes = 0;
+	long long start = now_ns();
+	for (i = 0; i < count; i++) {
+		bytes += snprintf(text, sizeof(text), "%.3f", values[i]);
+	}
+	double snprintf_ns = (double) (now_ns() - start) / count;
+	start = now_ns();
+	for (i = 0; i < count; i++) {
+		bytes -= mf_json_fixed(text, values[i], 3);
+	}
+	double fixed_ns = (double) (now_ns() - start) / count;
+	if (bytes != 0) {
+		fprintf(stderr, "The lengths differ\n");
+		return 1;
+	}
+	printf("%16s %16s %8s\n", "snprintf ns", "mf_json_fixed ns", "speedup");
+	printf("%16.1f %16.1f %7.1fx\n", snprintf_ns, fixed_ns, snprintf_ns / fixed_ns);
+	free(values);
+	return 0;
+}
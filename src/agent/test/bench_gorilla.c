@@ -0,0 +1,499 @@
+/*
+ * Check and compression benchmark of the time-series encoding of gorilla.h
+ *
+ * First, batches of edge cases (nulls, negative and quoted numbers, -0.000,
+ * numbers with too many digits or decimals, mixed decimals, strings and
+ * objects, empty batches) are encoded and decoded, and the text is compared
+ * with the batch; every truncated encoding has to be rejected. Then the same
+ * is checked for each bulk of the benchmark: the given files, as kept by
+ * mock_server -d (json, MessagePack, columns or gorilla, not compressed), or
+ * else bulks formatted like those of the agent with the given number of
+ * samples and metrics, whose timestamps jitter and whose values are
+ * counters, constants and random walks. Any difference fails the check. The
+ * sizes of the bulks as rows (json), columns and gorilla, plain and compressed
+ * with gzip, and the time to encode and decode them are printed:
+ *
+ *   ./bench_gorilla                       # 1000 bulks of 100 samples of 5 metrics
+ *   ./bench_gorilla -n 100 -s 1000 -m 20
+ *   ./mock_server -d /tmp/bodies &        # agent with wire_format = columns
+ *   ./bench_gorilla /tmp/bodies/0000*.json
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include "columns.h"
+#include "gorilla.h"
+#include "msgpack.h"
+#include "compress.h"
+
+#define NSEC_PER_SEC 1000000000LL
+
+FILE *logFile;
+
+/* one bulk, as rows and as columns */
+typedef struct Bulk_t {
+	char *rows;
+	size_t rows_len;
+	char *columns;
+	size_t columns_len;
+	long samples;
+} Bulk;
+
+static unsigned long long failures = 0;
+
+static long long now_ns(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec * NSEC_PER_SEC + now.tv_nsec;
+}
+
+/* xorshift64*, to get the same values on every run */
+static unsigned long long random_state = 88172645463325252ULL;
+
+static unsigned long long random_bits(void)
+{
+	random_state ^= random_state >> 12;
+	random_state ^= random_state << 25;
+	random_state ^= random_state >> 27;
+	return random_state * 2685821657736338717ULL;
+}
+
+static double random_uniform(void)
+{
+	return (random_bits() >> 11) * (1.0 / 9007199254740992.0);
+}
+
+/* encode and decode the batch, and compare the text; with truncated, no prefix of the encoding may be decoded */
+static void check(const char *name, const char *batch, size_t len, int truncated)
+{
+	char *data, *text;
+	size_t data_len, text_len, n;
+
+	if (!gorilla_encode(batch, len, &data, &data_len)) {
+		if (failures++ < 20) {
+			fprintf(stderr, "%s: cannot encode %.200s\n", name, batch);
+		}
+		return;
+	}
+	if (!gorilla_decode(data, data_len, &text, &text_len)) {
+		if (failures++ < 20) {
+			fprintf(stderr, "%s: cannot decode the encoding of %.200s\n", name, batch);
+		}
+		free(data);
+		return;
+	}
+	if (text_len != len || memcmp(text, batch, len) != 0) {
+		if (failures++ < 20) {
+			fprintf(stderr, "%s: %.200s is decoded as %.200s\n", name, batch, text);
+		}
+	}
+	free(text);
+	for (n = 0; truncated && n < data_len; n++) {
+		char *prefix = malloc(n + 1);
+		memcpy(prefix, data, n);
+		if (gorilla_decode(prefix, n, &text, &text_len)) {
+			if (failures++ < 20) {
+				fprintf(stderr, "%s: the first %zu bytes of the encoding are decoded\n", name, n);
+			}
+			free(text);
+		}
+		free(prefix);
+	}
+	free(data);
+}
+
+static void check_edge_cases(void)
+{
+	static const char *batches[] = {
+		"{\"header\":{},\"rows\":0,\"columns\":{}}",
+		"{\"header\":{\"type\":\"T\"},\"rows\":1,\"columns\":{\"\\\"v\\\"\":[1.500]}}",
+		/* timestamps, a constant and values with nulls */
+		"{\"header\":{\"host\":\"h\",\"type\":\"T\"},\"rows\":4,\"columns\":{"
+			"\"local_timestamp\":[\"1500000000000.0\",\"1500000001000.3\",\"1500000001999.9\",\"1500000003000.0\"],"
+			"\"sampling_interval_ns\":[1000000000,1000000000,1000000000,1000000000],"
+			"\"a\":[-1.250,null,0.000,-0.001],\"b\":[null,null,null,null],\"c\":[null,7,null,8]}}",
+		/* text which is not written back the same as number: the columns are kept as text */
+		"{\"header\":{},\"rows\":3,\"columns\":{\"a\":[-0.000,1,2],\"b\":[1.50,1.5,1.500],\"c\":[01,1,2],"
+			"\"d\":[1.,2.,3.],\"e\":[.5,1,2],\"f\":[1e3,1,2],\"g\":[-1E-3,1,2]}}",
+		/* limits of the mantissa and the decimals */
+		"{\"header\":{},\"rows\":3,\"columns\":{\"a\":[999999999999999999,-999999999999999999,0],"
+			"\"b\":[9999999999999999999,1,2],\"c\":[0.123456789,-0.987654321,1.000000000],"
+			"\"d\":[0.1234567891,1,2],\"e\":[-999999999.999999999,999999999.999999999,0.000000000]}}",
+		/* quoted numbers, strings, objects and a column mixing numbers and strings */
+		"{\"header\":{\"x\":[1,{\"y\":null}]},\"rows\":3,\"columns\":{\"a\":[\"1.5\",\"-2.5\",null],"
+			"\"b\":[\"1.5\",2.5,\"3.5\"],\"c\":[\"x\",\"y\\\"z\",\"\"],\"d\":[{\"e\":[1,2]},[],true],"
+			"\"e\":[\"\\u00e9\",false,null]}}",
+		/* large differences in all buckets */
+		"{\"header\":{},\"rows\":8,\"columns\":{\"a\":[0,63,-64,255,-256,2047,-2048,0],"
+			"\"b\":[0,2147483647,-2147483648,999999999999999999,-999999999999999999,1,0,-1]}}",
+	};
+	size_t i;
+
+	for (i = 0; i < sizeof(batches) / sizeof(batches[0]); i++) {
+		check("edge case", batches[i], strlen(batches[i]), 1);
+	}
+
+	/* more rows than fit into a byte of the bitmap, with every other value missing */
+	ColumnBatch *c = columns_new();
+	char value[32];
+	char *text = NULL;
+	size_t size = 0;
+	long r;
+	columns_begin(c);
+	columns_header(c, "\"type\":\"T\"", 10);
+	for (r = 0; r < 1000; r++) {
+		columns_row(c);
+		if (r % 2 == 0) {
+			columns_value(c, "\"even\"", 6, value, sprintf(value, "%ld.%03ld", r * r, r % 1000));
+		}
+		if (r % 3 == 0) {
+			columns_value(c, "\"text\"", 6, value, sprintf(value, "\"%ld\"", r));
+		}
+	}
+	size_t len = columns_write(c, &text, &size);
+	check("nulls", text, len, 1);
+	columns_free(c);
+	free(text);
+}
+
+/* format a bulk of samples like the agent, as rows and as columns */
+static void build_bulk(Bulk *bulk, int samples, int metrics, double *timestamp, double *values)
+{
+	const char *static_json = "\"WorkflowID\":\"bench\",\"ExperimentID\":\"AVd8nQ2dvxKxzCVz8M4Z\","
+		"\"TaskID\":\"bench\",\"host\":\"node01\",\"type\":\"mf_plugin_Bench\"";
+	char key[32], value[32];
+	int i, j;
+
+	bulk->rows = malloc((size_t) samples * (256 + metrics * 48) + 64);
+	char *p = bulk->rows;
+	*p++ = '[';
+	ColumnBatch *c = columns_new();
+	columns_begin(c);
+	columns_header(c, static_json, strlen(static_json));
+	for (i = 0; i < samples; i++) {
+		/* one sample per second, up to a ms late */
+		*timestamp += 1000.0 + (random_uniform() - 0.5) * 2.0;
+		p += sprintf(p, "%s{%s,\"local_timestamp\":\"%.1f\",\"sampling_interval_ns\":%lld",
+			(i > 0) ? "," : "", static_json, *timestamp, 1000000000LL);
+		columns_row(c);
+		columns_value(c, "\"local_timestamp\"", 17, value, sprintf(value, "\"%.1f\"", *timestamp));
+		columns_value(c, "\"sampling_interval_ns\"", 22, value, sprintf(value, "%lld", 1000000000LL));
+		for (j = 0; j < metrics; j++) {
+			switch (j % 4) {
+			case 0: values[j] += (double) (random_bits() % 100000); break;       /* counter of bytes */
+			case 1: break;                                                       /* constant */
+			case 2: values[j] += (random_uniform() - 0.5) * 2.0; break;          /* random walk, e.g. a load */
+			default: values[j] = 40.0 + (double) (random_bits() % 3); break;     /* temperature */
+			}
+			p += sprintf(p, ",\"metric_%d\":%.3f", j, values[j]);
+			columns_value(c, key, sprintf(key, "\"metric_%d\"", j), value, sprintf(value, "%.3f", values[j]));
+		}
+		*p++ = '}';
+	}
+	*p++ = ']';
+	*p = '\0';
+	bulk->rows_len = p - bulk->rows;
+	bulk->columns = NULL;
+	size_t size = 0;
+	bulk->columns_len = columns_write(c, &bulk->columns, &size);
+	bulk->samples = samples;
+	columns_free(c);
+}
+
+static char *read_file(const char *filename, size_t *len)
+{
+	FILE *fp = fopen(filename, "rb");
+	if (fp == NULL) {
+		return NULL;
+	}
+	size_t size = 65536;
+	char *data = malloc(size + 1);
+	*len = 0;
+	size_t n;
+	while ((n = fread(data + *len, 1, size - *len, fp)) > 0) {
+		*len += n;
+		if (*len == size) {
+			size *= 2;
+			data = realloc(data, size + 1);
+		}
+	}
+	fclose(fp);
+	data[*len] = '\0';
+	return data;
+}
+
+/* skip a json string or any other value up to the next comma or closing bracket at the same level */
+static const char *skip_member(const char *p, const char *end)
+{
+	int depth = 0, in_string = 0;
+
+	for (; p < end; p++) {
+		if (in_string) {
+			if (*p == '\\') {
+				p++;
+			} else if (*p == '"') {
+				in_string = 0;
+			}
+		} else if (*p == '"') {
+			in_string = 1;
+		} else if (*p == '{' || *p == '[') {
+			depth++;
+		} else if (*p == '}' || *p == ']') {
+			if (depth-- == 0) {
+				break;
+			}
+		} else if (*p == ',' && depth == 0) {
+			break;
+		}
+	}
+	return p;
+}
+
+/* convert a json array of objects into columns; like the agent, the leading members which all rows
+   have in common, e.g. the identifiers and the type, go into the header */
+static int rows_to_columns(Bulk *bulk)
+{
+	const char *p = bulk->rows, *end = bulk->rows + bulk->rows_len;
+	const char **objects = NULL;
+	size_t *lengths = NULL;
+	long n = 0, i;
+
+	while (p < end && *p != '[') {
+		p++;
+	}
+	for (p++; p < end; p++) {
+		if (*p != '{') {
+			continue;
+		}
+		const char *start = ++p;
+		while (p < end && *p != '}') {
+			p = skip_member(p, end);
+			if (p < end && *p == ',') {
+				p++;
+			}
+		}
+		if (p == end) {
+			return 0;
+		}
+		objects = realloc(objects, (n + 1) * sizeof(char *));
+		lengths = realloc(lengths, (n + 1) * sizeof(size_t));
+		objects[n] = start;
+		lengths[n++] = p - start;
+	}
+	if (n == 0) {
+		free(objects);
+		free(lengths);
+		return 0;
+	}
+
+	/* the members of the first row up to the last comma which all rows have at the same position */
+	size_t header = 0, common = lengths[0];
+	for (i = 1; i < n; i++) {
+		size_t k = 0;
+		while (k < common && k < lengths[i] && objects[i][k] == objects[0][k]) {
+			k++;
+		}
+		common = k;
+	}
+	const char *first = objects[0], *first_end = objects[0] + lengths[0], *q;
+	for (q = skip_member(first, first_end); q < first_end && (size_t) (q - first) <= common; 
+		q = skip_member(q + 1, first_end)) {
+		size_t k = q - first;
+		for (i = 0; i < n && k < lengths[i] && objects[i][k] == ','; i++) {
+			;
+		}
+		if (i == n) {
+			header = k;
+		}
+	}
+
+	ColumnBatch *c = columns_new();
+	int ret = 1;
+	size_t size = 0;
+	columns_begin(c);
+	columns_header(c, objects[0], header);
+	for (i = 0; i < n && ret; i++) {
+		size_t skip = (header > 0) ? header + 1 : 0;
+		ret = columns_add_line(c, objects[i] + skip, lengths[i] - skip);
+	}
+	bulk->columns = NULL;
+	bulk->columns_len = columns_write(c, &bulk->columns, &size);
+	bulk->samples = n;
+	columns_free(c);
+	free(objects);
+	free(lengths);
+	return ret;
+}
+
+/* read a bulk kept by mock_server; a bulk of columns is written back as rows as well */
+static int load_bulk(Bulk *bulk, const char *filename)
+{
+	size_t len;
+	char *data = read_file(filename, &len);
+	ColumnView view;
+
+	if (data == NULL) {
+		fprintf(stderr, "Cannot read %s\n", filename);
+		return 0;
+	}
+	if (gorilla_is_encoded(data, len)) {
+		char *batch;
+		if (!gorilla_decode(data, len, &batch, &len)) {
+			fprintf(stderr, "%s: malformed gorilla data\n", filename);
+			free(data);
+			return 0;
+		}
+		free(data);
+		data = batch;
+	}
+	if (columns_is_batch(data, len)) {
+		bulk->columns = data;
+		bulk->columns_len = len;
+		if (!columns_parse(data, len, &view) || !columns_to_json(data, len, &bulk->rows, &bulk->rows_len)) {
+			fprintf(stderr, "%s: malformed columns\n", filename);
+			free(data);
+			return 0;
+		}
+		bulk->samples = view.rows;
+		columns_view_free(&view);
+		return 1;
+	}
+	if (len > 0 && data[0] != '[' && data[0] != ' ' && data[0] != '\n') {
+		/* MessagePack */
+		char *json;
+		if (!msgpack_to_json(data, len, &json, &len)) {
+			fprintf(stderr, "%s: neither json nor MessagePack, compressed maybe\n", filename);
+			free(data);
+			return 0;
+		}
+		free(data);
+		data = json;
+	}
+	bulk->rows = data;
+	bulk->rows_len = len;
+	if (!rows_to_columns(bulk)) {
+		fprintf(stderr, "%s: not an array of objects\n", filename);
+		free(bulk->columns);
+		free(data);
+		return 0;
+	}
+	return 1;
+}
+
+static size_t gzip_size(const char *data, size_t len)
+{
+	char *out;
+	size_t out_len;
+
+	if (!compress_buffer(COMPRESS_GZIP, 0, data, len, &out, &out_len)) {
+		return 0;
+	}
+	free(out);
+	return out_len;
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr, "Usage: %s [-n bulks] [-s samples per bulk] [-m metrics per sample] [bulk files]\n", name);
+}
+
+int main(int argc, char **argv)
+{
+	int opt, samples = 100, metrics = 5;
+	long num_bulks = 1000, i, n = 0;
+
+	while ((opt = getopt(argc, argv, "n:s:m:h")) != -1) {
+		switch (opt) {
+		case 'n': num_bulks = atol(optarg); break;
+		case 's': samples = atoi(optarg); break;
+		case 'm': metrics = atoi(optarg); break;
+		default: usage(argv[0]); return 1;
+		}
+	}
+	if (num_bulks <= 0 || samples <= 0 || metrics <= 0) {
+		usage(argv[0]);
+		return 1;
+	}
+	logFile = stderr;
+
+	check_edge_cases();
+
+	if (optind < argc) {
+		num_bulks = argc - optind;
+	}
+	Bulk *bulks = calloc(num_bulks, sizeof(Bulk));
+	if (optind < argc) {
+		for (i = optind; i < argc; i++) {
+			n += load_bulk(&bulks[n], argv[i]);
+		}
+	} else {
+		double timestamp = 1500000000000.0;
+		double *values = calloc(metrics, sizeof(double));
+		for (i = 0; i < metrics; i++) {
+			values[i] = random_uniform() * 1000.0;
+		}
+		for (n = 0; n < num_bulks; n++) {
+			build_bulk(&bulks[n], samples, metrics, &timestamp, values);
+		}
+		free(values);
+	}
+	if (n == 0) {
+		fprintf(stderr, "No bulks\n");
+		return 1;
+	}
+
+	unsigned long long rows = 0, columns = 0, gorilla = 0, rows_gzip = 0, columns_gzip = 0, gorilla_gzip = 0;
+	long long total_samples = 0, encode_ns = 0, decode_ns = 0;
+	for (i = 0; i < n; i++) {
+		Bulk *bulk = &bulks[i];
+		char *data, *text;
+		size_t data_len, text_len;
+		check("bulk", bulk->columns, bulk->columns_len, 0);
+		long long start = now_ns();
+		if (!gorilla_encode(bulk->columns, bulk->columns_len, &data, &data_len)) {
+			continue;
+		}
+		encode_ns += now_ns() - start;
+		start = now_ns();
+		if (!gorilla_decode(data, data_len, &text, &text_len)) {
+			free(data);
+			continue;
+		}
+		decode_ns += now_ns() - start;
+		rows += bulk->rows_len;
+		columns += bulk->columns_len;
+		gorilla += data_len;
+		rows_gzip += gzip_size(bulk->rows, bulk->rows_len);
+		columns_gzip += gzip_size(bulk->columns, bulk->columns_len);
+		gorilla_gzip += gzip_size(data, data_len);
+		total_samples += bulk->samples;
+		free(data);
+		free(text);
+	}
+	if (failures > 0) {
+		fprintf(stderr, "%llu batches are not decoded as they were encoded\n", failures);
+		return 1;
+	}
+	printf("The edge cases and %ld bulks of %lld samples in total are decoded as they were encoded\n",
+		n, total_samples);
+
+	printf("%8s %12s %14s %8s %12s %8s\n", "format", "bytes", "bytes/sample", "ratio", "gzip bytes", "ratio");
+	printf("%8s %12llu %14.1f %7.1fx %12llu %7.1fx\n", "rows", rows, (double) rows / total_samples, 1.0,
+		rows_gzip, (double) rows / rows_gzip);
+	printf("%8s %12llu %14.1f %7.1fx %12llu %7.1fx\n", "columns", columns, (double) columns / total_samples,
+		(double) rows / columns, columns_gzip, (double) rows / columns_gzip);
+	printf("%8s %12llu %14.1f %7.1fx %12llu %7.1fx\n", "gorilla", gorilla, (double) gorilla / total_samples,
+		(double) rows / gorilla, gorilla_gzip, (double) rows / gorilla_gzip);
+	printf("encode %.1f ns/sample (%.0f MB/s of columns), decode %.1f ns/sample\n",
+		(double) encode_ns / total_samples, columns * 1e3 / encode_ns, (double) decode_ns / total_samples);
+
+	for (i = 0; i < n; i++) {
+		free(bulks[i].rows);
+		free(bulks[i].columns);
+	}
+	free(bulks);
+	return 0;
+}
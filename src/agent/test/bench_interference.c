@@ -0,0 +1,189 @@
+/*
+ * Interference benchmark for the cpu affinity and scheduling of agent threads
+ *
+ * A worker thread, standing in for an MPI rank, runs fixed chunks of work on
+ * one cpu and records how long each chunk takes. Meanwhile, a number of noise
+ * threads behave like sampling threads: they wake up periodically and stay busy
+ * for a short time. The noise threads are set up with the same ThreadSetup as
+ * the agent threads, so the effect of e.g. sampler_cpus can be compared:
+ *
+ *   ./bench_interference -w 1 -c 1     # agent threads share the cpu of the rank
+ *   ./bench_interference -w 1 -c 0     # agent threads on a housekeeping cpu
+ *   ./bench_interference -w 1 -c 1 -p idle
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+#include "thread_setup.h"
+
+#define NSEC_PER_SEC 1000000000LL
+/* duration of one chunk of work of the worker */
+#define CHUNK_NS 50000LL
+
+FILE *logFile;
+
+static volatile int stop = 0;
+static ThreadSetup worker_setup;
+static ThreadSetup noise_setup;
+static long long interval_ns = 1000000LL;
+static long long busy_ns = 100000LL;
+static long chunk_iterations = 1;
+static long long *durations;
+static long max_chunks;
+static long num_chunks = 0;
+
+static long long now_ns(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec * NSEC_PER_SEC + now.tv_nsec;
+}
+
+/* some work, which cannot be optimized away */
+static double work(long iterations)
+{
+	long i;
+	volatile double x = 1.0;
+	for (i = 0; i < iterations; i++) {
+		x = x * 1.000001 + 0.000001;
+	}
+	return x;
+}
+
+/* find the number of iterations, which take CHUNK_NS */
+static void calibrate(void)
+{
+	long long start;
+	int i;
+
+	chunk_iterations = 1000;
+	for (i = 0; i < 20; i++) {
+		start = now_ns();
+		work(chunk_iterations);
+		long long elapsed = now_ns() - start;
+		if (elapsed > 0) {
+			chunk_iterations = chunk_iterations * CHUNK_NS / elapsed + 1;
+		}
+	}
+}
+
+static void* worker(void *arg)
+{
+	ThreadSetup_apply(&worker_setup, "worker");
+	calibrate();
+	while (!stop && num_chunks < max_chunks) {
+		long long start = now_ns();
+		work(chunk_iterations);
+		durations[num_chunks++] = now_ns() - start;
+	}
+	return NULL;
+}
+
+/* wake up every interval_ns and keep the cpu busy for busy_ns, like a sampling thread */
+static void* noise(void *arg)
+{
+	struct timespec deadline;
+
+	ThreadSetup_apply(&noise_setup, "sampler");
+	clock_gettime(CLOCK_MONOTONIC, &deadline);
+	while (!stop) {
+		long long start = now_ns();
+		while (now_ns() - start < busy_ns) {
+			work(100);
+		}
+		deadline.tv_nsec += interval_ns;
+		while (deadline.tv_nsec >= NSEC_PER_SEC) {
+			deadline.tv_nsec -= NSEC_PER_SEC;
+			deadline.tv_sec++;
+		}
+		clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL);
+	}
+	return NULL;
+}
+
+static int compare(const void *a, const void *b)
+{
+	long long x = *(const long long *) a, y = *(const long long *) b;
+	return (x > y) - (x < y);
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr, "Usage: %s [-w worker cpu] [-c noise cpus] [-p policy] [-n nice] "
+		"[-t noise threads] [-s seconds] [-i interval us] [-b busy us]\n", name);
+}
+
+int main(int argc, char **argv)
+{
+	int opt, i, num_threads = 8;
+	double seconds = 5.0;
+	const char *worker_cpu = "0";
+	pthread_t worker_thread, *threads;
+
+	logFile = stderr;
+	ThreadSetup_init(&worker_setup);
+	ThreadSetup_init(&noise_setup);
+	while ((opt = getopt(argc, argv, "w:c:p:n:t:s:i:b:h")) != -1) {
+		int ok = 1;
+		switch (opt) {
+		case 'w': worker_cpu = optarg; break;
+		case 'c': ok = ThreadSetup_set(&noise_setup, "cpus", optarg); break;
+		case 'p': ok = ThreadSetup_set(&noise_setup, "policy", optarg); break;
+		case 'n': ok = ThreadSetup_set(&noise_setup, "nice", optarg); break;
+		case 't': num_threads = atoi(optarg); break;
+		case 's': seconds = atof(optarg); break;
+		case 'i': interval_ns = atoll(optarg) * 1000; break;
+		case 'b': busy_ns = atoll(optarg) * 1000; break;
+		default: usage(argv[0]); return 1;
+		}
+		if (!ok) {
+			fprintf(stderr, "Invalid value %s of option -%c\n", optarg, opt);
+			return 1;
+		}
+	}
+	if (!ThreadSetup_set(&worker_setup, "cpus", worker_cpu) || num_threads < 0 || seconds <= 0.0) {
+		usage(argv[0]);
+		return 1;
+	}
+	if (noise_setup.num_cpus == 0) {
+		/* by default, the noise threads share the cpu of the worker */
+		ThreadSetup_set(&noise_setup, "cpus", worker_cpu);
+	}
+
+	max_chunks = (long) (seconds * NSEC_PER_SEC / CHUNK_NS) + 1;
+	durations = malloc(max_chunks * sizeof(long long));
+	threads = malloc((num_threads + 1) * sizeof(pthread_t));
+
+	pthread_create(&worker_thread, NULL, worker, NULL);
+	for (i = 0; i < num_threads; i++) {
+		pthread_create(&threads[i], NULL, noise, NULL);
+	}
+	struct timespec duration = { (time_t) seconds, (long) ((seconds - (time_t) seconds) * NSEC_PER_SEC) };
+	nanosleep(&duration, NULL);
+	stop = 1;
+	pthread_join(worker_thread, NULL);
+	for (i = 0; i < num_threads; i++) {
+		pthread_join(threads[i], NULL);
+	}
+
+	if (num_chunks == 0) {
+		fprintf(stderr, "No chunks of work completed\n");
+		return 1;
+	}
+	qsort(durations, num_chunks, sizeof(long long), compare);
+	double sum = 0.0;
+	for (i = 0; i < num_chunks; i++) {
+		sum += durations[i];
+	}
+	printf("chunks %ld, chunk time in us: mean %.1f, median %.1f, p99 %.1f, p99.9 %.1f, max %.1f\n",
+		num_chunks, sum / num_chunks / 1e3, durations[num_chunks / 2] / 1e3,
+		durations[(long) (num_chunks * 0.99)] / 1e3, durations[(long) (num_chunks * 0.999)] / 1e3,
+		durations[num_chunks - 1] / 1e3);
+
+	free(durations);
+	free(threads);
+	return 0;
+}
@@ -0,0 +1,137 @@
+/*
+ * Microbenchmark of the json writer of mf_json.h against strcat accumulation
+ *
+ * Bulks of samples are formatted like the bulks of the agent, once by
+ * appending each formatted sample to the bulk with strcat, as gatherMetric
+ * did, and once with the cursor of an MF_json writer. Both have to give the
+ * same text. For each bulk size from 8 to the given maximum, the throughput
+ * of both is printed in bytes/ns:
+ *
+ *   ./bench_json                 # bulks of 8 to 4096 samples with 8 metrics
+ *   ./bench_json -m 32 -b 1024
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include "mf_json.h"
+
+#define NSEC_PER_SEC 1000000000LL
+/* bytes formatted per bulk size, to get stable timings */
+#define BYTES_PER_RUN (64LL << 20)
+
+static const char *static_json = "{\"WorkflowID\":\"bench\",\"ExperimentID\":\"AVmLuwKkPf_Z1pfCpHe0\","
+	"\"TaskID\":\"bench\",\"host\":\"localhost\",";
+static int metrics = 8;
+static char names[64][32];
+static double values[64];
+
+static long long now_ns(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec * NSEC_PER_SEC + now.tv_nsec;
+}
+
+/* the bulk built by strcat; array is large enough for the whole bulk */
+static size_t bulk_strcat(char *array, int samples)
+{
+	char tmp[4096], metric[128];
+	int i, j;
+
+	strcpy(array, "[");
+	for (i = 0; i < samples; i++) {
+		sprintf(tmp, "%s\"type\":\"Bench\",\"local_timestamp\":\"%.1f\",\"sampling_interval_ns\":%ld",
+			static_json, 1500000000000.0 + i, 1000000000L);
+		for (j = 0; j < metrics; j++) {
+			sprintf(metric, ",\"%s\":%.3f", names[j], values[j] + i);
+			strcat(tmp, metric);
+		}
+		strcat(tmp, "},");
+		strcat(array, tmp);
+	}
+	size_t len = strlen(array);
+	array[len - 1] = ']';
+	return len;
+}
+
+/* the bulk built by the writer, whose buffer is reused */
+static size_t bulk_writer(MF_json *out, int samples)
+{
+	size_t static_len = strlen(static_json);
+	int i, j;
+
+	out->len = 0;
+	mf_json_literal(out, "[");
+	for (i = 0; i < samples; i++) {
+		mf_json_raw(out, static_json, static_len);
+		mf_json_literal(out, "\"type\":\"Bench\",\"local_timestamp\":\"");
+		mf_json_number(out, 1500000000000.0 + i, 1);
+		mf_json_literal(out, "\",\"sampling_interval_ns\":");
+		mf_json_long(out, 1000000000L);
+		for (j = 0; j < metrics; j++) {
+			mf_json_metric(out, names[j], values[j] + i);
+		}
+		mf_json_literal(out, "},");
+	}
+	out->buf[out->len - 1] = ']';
+	return out->len;
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr, "Usage: %s [-m metrics per sample] [-b largest bulk size]\n", name);
+}
+
+int main(int argc, char **argv)
+{
+	int opt, i, max_samples = 4096;
+
+	while ((opt = getopt(argc, argv, "m:b:h")) != -1) {
+		switch (opt) {
+		case 'm': metrics = atoi(optarg); break;
+		case 'b': max_samples = atoi(optarg); break;
+		default: usage(argv[0]); return 1;
+		}
+	}
+	if (metrics < 0 || metrics > 64 || max_samples < 8) {
+		usage(argv[0]);
+		return 1;
+	}
+	for (i = 0; i < metrics; i++) {
+		sprintf(names[i], "metric_%d", i);
+		values[i] = i * 1.25 + 0.0005;
+	}
+
+	MF_json out;
+	mf_json_init(&out, 1024);
+	printf("%8s %12s %16s %16s %8s\n", "samples", "bytes/bulk", "strcat bytes/ns", "writer bytes/ns", "speedup");
+	int samples;
+	for (samples = 8; samples <= max_samples; samples *= 2) {
+		size_t len = bulk_writer(&out, samples);
+		char *array = malloc(len + 4096);
+		if (bulk_strcat(array, samples) != len || memcmp(array, out.buf, len) != 0) {
+			fprintf(stderr, "The bulks of %d samples differ\n", samples);
+			return 1;
+		}
+
+		long long runs = BYTES_PER_RUN / len + 1, r;
+		/* strcat rescans the bulk for each sample; keep its runs within a few seconds */
+		long long strcat_runs = (runs * 8 / samples > 0) ? runs * 8 / samples : 1;
+		long long start = now_ns();
+		for (r = 0; r < strcat_runs; r++) {
+			bulk_strcat(array, samples);
+		}
+		double strcat_rate = (double) len * strcat_runs / (now_ns() - start);
+		start = now_ns();
+		for (r = 0; r < runs; r++) {
+			bulk_writer(&out, samples);
+		}
+		double writer_rate = (double) len * runs / (now_ns() - start);
+		printf("%8d %12zu %16.3f %16.3f %7.1fx\n", samples, len, strcat_rate, writer_rate, writer_rate / strcat_rate);
+		free(array);
+	}
+	mf_json_free(&out);
+	return 0;
+}
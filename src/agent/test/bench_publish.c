@@ -0,0 +1,273 @@
+/*
+ * Load benchmark of the publisher, against mock_server or a real server
+ *
+ * Like the agent, the benchmark first creates an experiment, then sends bulks
+ * of samples to the metrics endpoint as fast as the server accepts them, for
+ * the given number of seconds. The bulks are formatted like the bulks of the
+ * agent, with the given number of samples and metrics per sample, as json or
+ * MessagePack. Each of the threads sends with publish_bulk() like a publisher
+ * thread of the agent, or keeps up to the given number of requests in flight
+ * with the asynchronous publisher. Options of the publisher, e.g. compression,
+ * are passed on as name=value. Requests/s, bytes/s and latency percentiles are
+ * reported at the end:
+ *
+ *   ./mock_server -p 3033 -l 2 &
+ *   ./bench_publish -u http://localhost:3033 -t 4
+ *   ./bench_publish -u http://localhost:3033 -a 32 -f msgpack -o compression=gzip
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+#include "publisher.h"
+#include "msgpack.h"
+
+#define NSEC_PER_SEC 1000000000LL
+#define MAX_OPTIONS 16
+
+FILE *logFile;
+
+/* requests and latencies of one thread */
+typedef struct Worker_t {
+	pthread_t thread;
+	long long *latencies;
+	size_t num_latencies;
+	size_t max_latencies;
+	unsigned long long failed;
+} Worker;
+
+/* an asynchronous request in flight */
+typedef struct Request_t {
+	Worker *worker;
+	long long start;
+} Request;
+
+static char metrics_URL[512];
+static long long duration_ns = 10 * NSEC_PER_SEC;
+static int in_flight = 0;
+static int format = PUBLISH_JSON;
+static char *bulk;
+static size_t bulk_len;
+static long long started;
+
+static long long now_ns(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec * NSEC_PER_SEC + now.tv_nsec;
+}
+
+static void record(Worker *worker, int success, long long latency)
+{
+	if (success != 1) {
+		worker->failed++;
+		return;
+	}
+	if (worker->num_latencies == worker->max_latencies) {
+		worker->max_latencies = worker->max_latencies ? 2 * worker->max_latencies : 65536;
+		worker->latencies = realloc(worker->latencies, worker->max_latencies * sizeof(long long));
+	}
+	worker->latencies[worker->num_latencies++] = latency;
+}
+
+static void completed(int success, void *userdata)
+{
+	Request *request = (Request *) userdata;
+	record(request->worker, success, now_ns() - request->start);
+	free(request);
+}
+
+/* send bulks until the time is up */
+static void* run(void *arg)
+{
+	Worker *worker = (Worker *) arg;
+	long long end = started + duration_ns;
+
+	if (in_flight == 0) {
+		long long start;
+		while ((start = now_ns()) < end) {
+			int ret = publish_bulk(metrics_URL, bulk, bulk_len, format);
+			record(worker, ret, now_ns() - start);
+		}
+		return NULL;
+	}
+
+	AsyncPublisher *ap = publisher_async_new(in_flight);
+	while (now_ns() < end) {
+		Request *request = malloc(sizeof(Request));
+		request->worker = worker;
+		request->start = now_ns();
+		if (!publish_bulk_async(ap, metrics_URL, bulk, bulk_len, format, completed, request)) {
+			free(request);
+			worker->failed++;
+		}
+	}
+	publisher_async_free(ap);
+	return NULL;
+}
+
+/* format a bulk of samples like the agent */
+static void build_bulk(int samples, int metrics)
+{
+	const char *static_json = "{\"WorkflowID\":\"bench\",\"ExperimentID\":\"%s\",\"TaskID\":\"bench\",\"host\":\"localhost\",";
+	char timestamp[32], name[32];
+	int i, j;
+
+	bulk = malloc((size_t) samples * (512 + metrics * 64) + 64);
+	char *p = bulk;
+	if (format == PUBLISH_MSGPACK) {
+		p = msgpack_write_array32(p, samples);
+	} else {
+		*p++ = '[';
+	}
+	for (i = 0; i < samples; i++) {
+		double ts = 1500000000.0 + i * 0.1;
+		if (format == PUBLISH_MSGPACK) {
+			p = msgpack_write_map(p, 4 + 3 + metrics);
+			p = msgpack_write_str(p, "WorkflowID", 10);
+			p = msgpack_write_str(p, "bench", 5);
+			p = msgpack_write_str(p, "ExperimentID", 12);
+			p = msgpack_write_str(p, "bench", 5);
+			p = msgpack_write_str(p, "TaskID", 6);
+			p = msgpack_write_str(p, "bench", 5);
+			p = msgpack_write_str(p, "host", 4);
+			p = msgpack_write_str(p, "localhost", 9);
+			p = msgpack_write_str(p, "type", 4);
+			p = msgpack_write_str(p, "mf_plugin_Bench", 15);
+			p = msgpack_write_str(p, "local_timestamp", 15);
+			p = msgpack_write_str(p, timestamp, sprintf(timestamp, "%.1f", ts));
+			p = msgpack_write_str(p, "sampling_interval_ns", 20);
+			p = msgpack_write_int(p, 1000000000LL);
+			for (j = 0; j < metrics; j++) {
+				p = msgpack_write_str(p, name, sprintf(name, "metric_%d", j));
+				p = msgpack_write_double(p, j * 1.25 + i);
+			}
+			continue;
+		}
+		p += sprintf(p, static_json, "bench");
+		p += sprintf(p, "\"type\":\"mf_plugin_Bench\",\"local_timestamp\":\"%.1f\",\"sampling_interval_ns\":%lld",
+			ts, 1000000000LL);
+		for (j = 0; j < metrics; j++) {
+			p += sprintf(p, ",\"metric_%d\":%.3f", j, j * 1.25 + i);
+		}
+		p += sprintf(p, "}%s", (i < samples - 1) ? "," : "");
+	}
+	if (format != PUBLISH_MSGPACK) {
+		*p++ = ']';
+		*p = '\0';
+	}
+	bulk_len = p - bulk;
+}
+
+static int compare(const void *a, const void *b)
+{
+	long long x = *(const long long *) a, y = *(const long long *) b;
+	return (x > y) - (x < y);
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr, "Usage: %s [-u server URL] [-d seconds] [-t threads] [-a requests in flight] "
+		"[-b samples per bulk] [-m metrics per sample] [-f json|msgpack] [-o name=value] [-v]\n", name);
+}
+
+int main(int argc, char **argv)
+{
+	const char *server = "http://localhost:3033";
+	char *options[MAX_OPTIONS];
+	int opt, i, num_threads = 1, samples = 32, metrics = 8, num_options = 0;
+
+	logFile = NULL;
+	while ((opt = getopt(argc, argv, "u:d:t:a:b:m:f:o:vh")) != -1) {
+		switch (opt) {
+		case 'u': server = optarg; break;
+		case 'd': duration_ns = (long long) (atof(optarg) * NSEC_PER_SEC); break;
+		case 't': num_threads = atoi(optarg); break;
+		case 'a': in_flight = atoi(optarg); break;
+		case 'b': samples = atoi(optarg); break;
+		case 'm': metrics = atoi(optarg); break;
+		case 'f': format = (strcmp(optarg, "msgpack") == 0) ? PUBLISH_MSGPACK : PUBLISH_JSON; break;
+		case 'o':
+			if (num_options == MAX_OPTIONS || strchr(optarg, '=') == NULL) {
+				usage(argv[0]);
+				return 1;
+			}
+			options[num_options++] = optarg;
+			break;
+		case 'v': logFile = stderr; break;
+		default: usage(argv[0]); return 1;
+		}
+	}
+	if (duration_ns <= 0 || num_threads <= 0 || in_flight < 0 || samples <= 0 || metrics < 0) {
+		usage(argv[0]);
+		return 1;
+	}
+	if (logFile == NULL && (logFile = fopen("/dev/null", "w")) == NULL) {
+		logFile = stderr;
+	}
+
+	for (i = 0; i < num_options; i++) {
+		char *value = strchr(options[i], '=');
+		*value++ = '\0';
+		if (!publisher_set_option(options[i], value)) {
+			fprintf(stderr, "Unknown publisher option %s\n", options[i]);
+			return 1;
+		}
+	}
+
+	/* create an experiment, like the agent does at startup */
+	char experiments_URL[512];
+	char *experiment_id = calloc(128, sizeof(char));
+	char msg[] = "{\"application\":\"bench\", \"task\": \"bench\", \"host\": \"localhost\"}";
+	snprintf(experiments_URL, sizeof(experiments_URL), "%s/phantom_mf/experiments/bench", server);
+	snprintf(metrics_URL, sizeof(metrics_URL), "%s/phantom_mf/metrics", server);
+	create_new_experiment(experiments_URL, msg, experiment_id);
+	if (experiment_id[0] == '\0') {
+		fprintf(stderr, "Cannot create an experiment at %s\n", server);
+		return 1;
+	}
+	build_bulk(samples, metrics);
+	printf("Experiment %s; %d thread(s), %s, bulks of %d samples with %d metrics: %zu bytes as %s\n",
+		experiment_id, num_threads, in_flight ? "asynchronous" : "synchronous", samples, metrics,
+		bulk_len, (format == PUBLISH_MSGPACK) ? "msgpack" : "json");
+
+	Worker *workers = calloc(num_threads, sizeof(Worker));
+	started = now_ns();
+	for (i = 0; i < num_threads; i++) {
+		pthread_create(&workers[i].thread, NULL, run, &workers[i]);
+	}
+	size_t total = 0;
+	unsigned long long failed = 0;
+	for (i = 0; i < num_threads; i++) {
+		pthread_join(workers[i].thread, NULL);
+		total += workers[i].num_latencies;
+		failed += workers[i].failed;
+	}
+	double seconds = (now_ns() - started) / 1e9;
+
+	long long *latencies = malloc((total + 1) * sizeof(long long));
+	size_t n = 0;
+	for (i = 0; i < num_threads; i++) {
+		memcpy(latencies + n, workers[i].latencies, workers[i].num_latencies * sizeof(long long));
+		n += workers[i].num_latencies;
+		free(workers[i].latencies);
+	}
+	qsort(latencies, total, sizeof(long long), compare);
+
+	printf("%zu bulks sent, %llu failed in %.2f s: %.0f requests/s, %.2f MB/s of samples\n",
+		total, failed, seconds, total / seconds, total * (double) bulk_len / seconds / 1e6);
+	if (total > 0) {
+		printf("latency ms: p50 %.3f, p90 %.3f, p99 %.3f, p99.9 %.3f, max %.3f\n",
+			latencies[total / 2] / 1e6, latencies[total * 9 / 10] / 1e6, latencies[total * 99 / 100] / 1e6,
+			latencies[total * 999 / 1000] / 1e6, latencies[total - 1] / 1e6);
+	}
+
+	free(latencies);
+	free(workers);
+	free(bulk);
+	free(experiment_id);
+	publisher_cleanup();
+	return 0;
+}
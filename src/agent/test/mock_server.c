@@ -0,0 +1,387 @@
+/*
+ * Stand-in for the PHANTOM monitoring server, to test and benchmark the publisher
+ *
+ * Implements the two endpoints used by the agent and by mf_send():
+ *
+ *   POST <prefix>/phantom_mf/experiments/<application>   answers a new experiment id
+ *   POST <prefix>/phantom_mf/metrics                     accepts a bulk of metrics
+ *
+ * Bodies may be sent with Content-Length or chunked. Each request is answered
+ * after the given latency; a given fraction of the requests fails with HTTP
+ * status 503, so that retries and the circuit breaker can be exercised. With
+ * -m, MessagePack bulks are refused with 415 like by a server which only
+ * speaks json. The number of requests and bytes received is printed every
+ * second with -v, and once the server is stopped with Ctrl-C.
+ *
+ *   ./mock_server -p 3033 -l 2 -j 1 -e 0.01
+ *   ./mock_server -p 3033 -d /tmp/bodies     # keep the bulks received
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <poll.h>
+#include <pthread.h>
+#include <time.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+
+#define NSEC_PER_SEC 1000000000LL
+/* longest request line plus headers */
+#define HEADER_LEN 16384
+#define BODY_CHUNK 65536
+
+/* one connection, served by its own thread */
+typedef struct Connection_t {
+	int fd;
+	char buffer[HEADER_LEN];
+	size_t len;				/* bytes in the buffer */
+	size_t pos;				/* bytes of the buffer consumed */
+	unsigned int seed;
+} Connection;
+
+static volatile int stop = 0;
+static long long latency_ns = 0;
+static long long jitter_ns = 0;
+static double error_rate = 0.0;
+static int refuse_msgpack = 0;
+static int verbose = 0;
+static const char *body_dir = NULL;
+
+/* statistics, updated atomically */
+static unsigned long long num_experiments = 0;
+static unsigned long long num_metrics = 0;
+static unsigned long long num_errors = 0;
+static unsigned long long num_refused = 0;
+static unsigned long long num_bytes = 0;
+static unsigned long long num_connections = 0;
+static unsigned long long num_bodies = 0;
+
+static void catcher(int signo)
+{
+	stop = 1;
+}
+
+static long long now_ns(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec * NSEC_PER_SEC + now.tv_nsec;
+}
+
+/* fill the buffer with more bytes of the connection
+   return the number of new bytes; 0 if the connection is closed */
+static ssize_t fill(Connection *c)
+{
+	if (c->pos > 0) {
+		memmove(c->buffer, c->buffer + c->pos, c->len - c->pos);
+		c->len -= c->pos;
+		c->pos = 0;
+	}
+	if (c->len == sizeof(c->buffer)) {
+		return 0;
+	}
+	ssize_t n;
+	do {
+		n = read(c->fd, c->buffer + c->len, sizeof(c->buffer) - c->len);
+	} while (n < 0 && errno == EINTR);
+	if (n <= 0) {
+		return 0;
+	}
+	c->len += n;
+	return n;
+}
+
+/* read a line terminated by CRLF, which is returned without it
+   return the line; NULL if the connection is closed */
+static char *read_line(Connection *c)
+{
+	for (;;) {
+		char *start = c->buffer + c->pos;
+		char *end = memchr(start, '\n', c->len - c->pos);
+		if (end != NULL) {
+			*end = '\0';
+			if (end > start && end[-1] == '\r') {
+				end[-1] = '\0';
+			}
+			c->pos = end + 1 - c->buffer;
+			return start;
+		}
+		if (fill(c) == 0) {
+			return NULL;
+		}
+	}
+}
+
+/* read len bytes of the body, which are appended to the file if it is given
+   return 1 on success; 0 if the connection is closed */
+static int read_body(Connection *c, size_t len, FILE *fp)
+{
+	while (len > 0) {
+		if (c->pos == c->len && fill(c) == 0) {
+			return 0;
+		}
+		size_t n = c->len - c->pos;
+		if (n > len) {
+			n = len;
+		}
+		if (fp != NULL) {
+			fwrite(c->buffer + c->pos, 1, n, fp);
+		}
+		c->pos += n;
+		len -= n;
+	}
+	return 1;
+}
+
+/* read a chunked body
+   return its length; -1 if the connection is closed or the body is malformed */
+static long long read_chunked(Connection *c, FILE *fp)
+{
+	long long total = 0;
+	char *line;
+
+	for (;;) {
+		if ((line = read_line(c)) == NULL) {
+			return -1;
+		}
+		char *end;
+		size_t len = strtoul(line, &end, 16);
+		if (end == line) {
+			return -1;
+		}
+		if (len == 0) {
+			break;
+		}
+		if (!read_body(c, len, fp) || (line = read_line(c)) == NULL) {
+			return -1;
+		}
+		total += len;
+	}
+	/* trailers end with an empty line */
+	while ((line = read_line(c)) != NULL && line[0] != '\0') {
+		;
+	}
+	return (line != NULL) ? total : -1;
+}
+
+static void respond(int fd, int status, const char *reason, const char *body, int close_after)
+{
+	char response[512];
+	int len = snprintf(response, sizeof(response), "HTTP/1.1 %d %s\r\nContent-Type: text/plain\r\n"
+		"Content-Length: %zu\r\n%s\r\n%s", status, reason, strlen(body),
+		close_after ? "Connection: close\r\n" : "", body);
+	if (write(fd, response, len) != len) {
+		return;
+	}
+}
+
+/* wait for the latency of the server, with a random jitter on top */
+static void wait_latency(Connection *c)
+{
+	long long ns = latency_ns;
+	if (jitter_ns > 0) {
+		ns += (long long) ((double) rand_r(&c->seed) / RAND_MAX * jitter_ns);
+	}
+	if (ns > 0) {
+		struct timespec wait = { ns / NSEC_PER_SEC, ns % NSEC_PER_SEC };
+		nanosleep(&wait, NULL);
+	}
+}
+
+/* serve the requests of one connection, until it is closed */
+static void* serve(void *arg)
+{
+	Connection *c = (Connection *) arg;
+	char *line;
+
+	while (!stop && (line = read_line(c)) != NULL) {
+		char method[16], path[1024];
+		if (line[0] == '\0') {
+			continue;
+		}
+		if (sscanf(line, "%15s %1023s", method, path) != 2) {
+			break;
+		}
+
+		long long content_length = -1;
+		int chunked = 0, expect = 0, close_after = 0, msgpack = 0;
+		const char *format = "json", *encoding = "";
+		while ((line = read_line(c)) != NULL && line[0] != '\0') {
+			if (strncasecmp(line, "Content-Length:", 15) == 0) {
+				content_length = atoll(line + 15);
+			} else if (strncasecmp(line, "Transfer-Encoding:", 18) == 0) {
+				chunked = (strstr(line + 18, "chunked") != NULL);
+			} else if (strncasecmp(line, "Expect:", 7) == 0) {
+				expect = (strstr(line + 7, "100-continue") != NULL);
+			} else if (strncasecmp(line, "Connection:", 11) == 0) {
+				close_after = (strstr(line + 11, "close") != NULL);
+			} else if (strncasecmp(line, "Content-Type:", 13) == 0) {
+				msgpack = (strstr(line + 13, "msgpack") != NULL);
+				format = msgpack ? "msgpack" : (strstr(line + 13, "gorilla") ? "gorilla" : "json");
+			} else if (strncasecmp(line, "Content-Encoding:", 17) == 0) {
+				encoding = strstr(line + 17, "zstd") ? ".zst" : (strstr(line + 17, "gzip") ? ".gz" : "");
+			}
+		}
+		if (line == NULL) {
+			break;
+		}
+
+		int is_metrics = (strstr(path, "/phantom_mf/metrics") != NULL);
+		int is_experiment = (strstr(path, "/phantom_mf/experiments/") != NULL);
+		if (expect) {
+			const char *go_on = "HTTP/1.1 100 Continue\r\n\r\n";
+			if (write(c->fd, go_on, strlen(go_on)) < 0) {
+				break;
+			}
+		}
+
+		/* keep the bulks received, one file per request, as they are encoded */
+		FILE *fp = NULL;
+		if (body_dir != NULL && is_metrics) {
+			char filename[1024];
+			snprintf(filename, sizeof(filename), "%s/%06llu.%s%s", body_dir,
+				__atomic_add_fetch(&num_bodies, 1, __ATOMIC_RELAXED), format, encoding);
+			fp = fopen(filename, "wb");
+		}
+		long long len = 0;
+		if (chunked) {
+			len = read_chunked(c, fp);
+		} else if (content_length > 0) {
+			len = read_body(c, content_length, fp) ? content_length : -1;
+		}
+		if (fp != NULL) {
+			fclose(fp);
+		}
+		if (len < 0) {
+			break;
+		}
+		__atomic_add_fetch(&num_bytes, len, __ATOMIC_RELAXED);
+
+		wait_latency(c);
+		if (strcmp(method, "POST") != 0 || (!is_metrics && !is_experiment)) {
+			respond(c->fd, 404, "Not Found", "not found", close_after);
+		} else if (error_rate > 0.0 && (double) rand_r(&c->seed) / RAND_MAX < error_rate) {
+			__atomic_add_fetch(&num_errors, 1, __ATOMIC_RELAXED);
+			respond(c->fd, 503, "Service Unavailable", "unavailable", close_after);
+		} else if (is_metrics && msgpack && refuse_msgpack) {
+			__atomic_add_fetch(&num_refused, 1, __ATOMIC_RELAXED);
+			respond(c->fd, 415, "Unsupported Media Type", "json only", close_after);
+		} else if (is_metrics) {
+			__atomic_add_fetch(&num_metrics, 1, __ATOMIC_RELAXED);
+			respond(c->fd, 200, "OK", "{}", close_after);
+		} else {
+			char id[32];
+			snprintf(id, sizeof(id), "mock%llu", __atomic_add_fetch(&num_experiments, 1, __ATOMIC_RELAXED));
+			respond(c->fd, 200, "OK", id, close_after);
+		}
+		if (close_after) {
+			break;
+		}
+	}
+	close(c->fd);
+	free(c);
+	return NULL;
+}
+
+static void print_stats(const char *prefix, double seconds)
+{
+	unsigned long long bytes = __atomic_load_n(&num_bytes, __ATOMIC_RELAXED);
+	printf("%sconnections %llu, experiments %llu, bulks %llu, failed %llu, refused %llu, %.1f MB received",
+		prefix, __atomic_load_n(&num_connections, __ATOMIC_RELAXED),
+		__atomic_load_n(&num_experiments, __ATOMIC_RELAXED), __atomic_load_n(&num_metrics, __ATOMIC_RELAXED),
+		__atomic_load_n(&num_errors, __ATOMIC_RELAXED), __atomic_load_n(&num_refused, __ATOMIC_RELAXED),
+		bytes / 1e6);
+	if (seconds > 0.0) {
+		printf(" (%.0f bulks/s)", __atomic_load_n(&num_metrics, __ATOMIC_RELAXED) / seconds);
+	}
+	printf("\n");
+	fflush(stdout);
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr, "Usage: %s [-p port] [-l latency ms] [-j jitter ms] [-e error rate] "
+		"[-m] [-d body directory] [-v]\n", name);
+}
+
+int main(int argc, char **argv)
+{
+	int opt, port = 3033, one = 1;
+
+	while ((opt = getopt(argc, argv, "p:l:j:e:md:vh")) != -1) {
+		switch (opt) {
+		case 'p': port = atoi(optarg); break;
+		case 'l': latency_ns = (long long) (atof(optarg) * 1e6); break;
+		case 'j': jitter_ns = (long long) (atof(optarg) * 1e6); break;
+		case 'e': error_rate = atof(optarg); break;
+		case 'm': refuse_msgpack = 1; break;
+		case 'd': body_dir = optarg; break;
+		case 'v': verbose = 1; break;
+		default: usage(argv[0]); return 1;
+		}
+	}
+	if (port <= 0 || latency_ns < 0 || jitter_ns < 0 || error_rate < 0.0 || error_rate > 1.0) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	int listener = socket(AF_INET, SOCK_STREAM, 0);
+	struct sockaddr_in addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_ANY);
+	addr.sin_port = htons(port);
+	setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+	if (bind(listener, (struct sockaddr *) &addr, sizeof(addr)) != 0 || listen(listener, 1024) != 0) {
+		fprintf(stderr, "Cannot listen on port %d: %s\n", port, strerror(errno));
+		return 1;
+	}
+
+	struct sigaction sig;
+	memset(&sig, 0, sizeof(sig));
+	sig.sa_handler = catcher;
+	sigemptyset(&sig.sa_mask);
+	sigaction(SIGTERM, &sig, NULL);
+	sigaction(SIGINT, &sig, NULL);
+	signal(SIGPIPE, SIG_IGN);
+
+	printf("Listening on port %d, latency %.1f ms + up to %.1f ms, error rate %.3f%s\n", port,
+		latency_ns / 1e6, jitter_ns / 1e6, error_rate, refuse_msgpack ? ", refusing MessagePack" : "");
+	fflush(stdout);
+
+	long long started = now_ns(), next_report = started + NSEC_PER_SEC;
+	unsigned int seed = (unsigned int) started;
+	pthread_attr_t attr;
+	pthread_attr_init(&attr);
+	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+	while (!stop) {
+		struct pollfd pfd = { listener, POLLIN, 0 };
+		if (poll(&pfd, 1, 100) > 0) {
+			int fd = accept(listener, NULL, NULL);
+			if (fd >= 0) {
+				Connection *c = calloc(1, sizeof(Connection));
+				pthread_t thread;
+				c->fd = fd;
+				c->seed = rand_r(&seed);
+				setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+				__atomic_add_fetch(&num_connections, 1, __ATOMIC_RELAXED);
+				if (pthread_create(&thread, &attr, serve, c) != 0) {
+					close(fd);
+					free(c);
+				}
+			}
+		}
+		if (verbose && now_ns() >= next_report) {
+			print_stats("", 0.0);
+			next_report += NSEC_PER_SEC;
+		}
+	}
+	close(listener);
+	print_stats("Stopped after ", (now_ns() - started) / 1e9);
+	return 0;
+}
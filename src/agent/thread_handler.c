@@ -21,6 +21,11 @@
 #include <pthread.h>
 #include <unistd.h>
 #include <time.h>
+#include <errno.h>
+#include <stdint.h>
+#include <poll.h>
+#include <libgen.h>
+#include <sys/inotify.h>
 #include "main.h" 			// variables like confFile
 #include "mf_parser.h" 		// functions like mfp_parse(), ...
 #include "publisher.h" 		// function like publish_json()
@@ -29,49 +34,254 @@
 #include "plugin_discover.h" // variables like pluginCount, plugins_name; 
                              // functions like discover_plugins(), cleanup_plugins()
 #include "thread_handler.h"
+#include "timer_wheel.h"		// functions like TimerWheel_new(), TimerWheel_advance()
+#include "sample_ring.h"		// functions like SampleRing_reserve(), SampleRing_peek()
+#include "adaptive.h"			// functions like AdaptiveSampler_init(), AdaptiveSampler_update()
+#include "agent_stats.h"		// functions like AgentStats_hook(), AgentStats_publish()
+#include "agent_self.h"			// functions like init_mf_plugin_agent_self()
+#include "thread_setup.h"		// functions like ThreadSetup_set(), ThreadSetup_apply()
+#include "spool.h"				// functions like Spool_append(), Spool_peek()
+#include "msgpack.h"			// functions like msgpack_write_str(), msgpack_to_json()
+#include "columns.h"			// functions like columns_value(), columns_to_json()
+#include "mf_json.h"			// functions like mf_json_raw(), mf_json_metric()
 
 #define JSON_LEN 1024
 #define SUCCESS 1
 #define FAILURE 0
+#define NSEC_PER_SEC 1000000000L
+/* a tick counts as late if it starts more than 1/LATE_TICK_FRACTION of the interval after its deadline */
+#define LATE_TICK_FRACTION 10
+/* resolution of the timer wheel scheduler */
+#define WHEEL_TICK_NS 1000000L
+/* default number of samples buffered per plugin between sampler and publisher */
+#define DEFAULT_RING_SIZE 1024
+/* time a publisher thread waits when all of its rings are empty */
+#define PUBLISHER_IDLE_NS 10000000L
+/* time the configuration thread waits for changes of mf_config.ini before checking for the stop */
+#define CONF_POLL_MS 1000
+/* defaults of the [adaptive] section */
+#define DEFAULT_ADAPTIVE_THRESHOLD 0.05
+#define DEFAULT_ADAPTIVE_WEIGHT 0.3
+/* time the configuration thread waits for a plugin to be stopped or drained */
+#define PLUGIN_STOP_POLL_NS 10000000L
+/* classes of agent threads, configured in the [threads] section */
+#define THREAD_SAMPLER 0
+#define THREAD_PUBLISHER 1
+#define THREAD_CONF 2
+#define THREAD_CLASSES 3
+/* longest sleep of a timer wheel thread, so that it picks up new plugins */
+#define WHEEL_IDLE_NS 100000000L
+/* states of a plugin slot */
+#define PLUGIN_EMPTY 0			/* no plugin loaded */
+#define PLUGIN_RUNNING 1		/* sampled and published */
+#define PLUGIN_STOPPING 2		/* the sampling thread stops sampling the plugin */
+#define PLUGIN_DRAINING 3		/* not sampled anymore, the publisher thread drains its ring */
+#define PLUGIN_DRAINED 4		/* ring drained and bulk sent, the plugin can be unloaded */
+/* fields of the static part of each sample: WorkflowID, ExperimentID, TaskID and host */
+#define STATIC_FIELDS 4
+/* defaults of the spool settings */
+#define DEFAULT_SPOOL_MAX_MB 256
+#define DEFAULT_SPOOL_SEGMENT_MB 8
+#define DEFAULT_SPOOL_SYNC 16
+#define DEFAULT_SPOOL_REPLAY_MS 100
+#define DEFAULT_SPOOL_RETRY_S 5
 
 /*******************************************************************************
  * Variable Declarations
  ******************************************************************************/
+/* sampling deadline of a plugin, owned by its sampling thread */
+typedef struct PluginSampler_t {
+	int num;
+	struct timespec deadline;
+} PluginSampler;
+
+/* adaptive sampling settings of a plugin, written by the configuration thread */
+typedef struct AdaptiveConf_t {
+	int enabled;
+	long min_interval;
+	long max_interval;
+} AdaptiveConf;
+
+/* spool of a publisher thread, which keeps the bulks that could not be sent */
+typedef struct PublisherSpool_t {
+	int id;
+	Spool *spool;
+	int down;			/* set until the spool is empty again, new bulks are spooled then to keep them in order */
+	int failing;		/* set while replayed bulks cannot be sent */
+	int in_flight;		/* set while a replayed bulk is sent asynchronously */
+	long long next_ns;	/* earliest time of the next replay */
+	char *converted;	/* json of the replayed bulk, if it has been converted from MessagePack or columns */
+} PublisherSpool;
+
+/* bulk of samples of a plugin, owned by its publisher thread */
+typedef struct PluginBulk_t {
+	int num;
+	int count;
+	int format;			/* PUBLISH_JSON, PUBLISH_MSGPACK or PUBLISH_COLUMNS, chosen when the bulk is started */
+	char *json_array;	/* json array, MessagePack array or columnar batch of the samples */
+	size_t len;			/* length of the array so far */
+	size_t size;		/* allocated size of the array */
+	long reported_missed;
+	long reported_late;
+	unsigned long long reported_dropped;
+	AsyncPublisher *async;	/* publisher of the thread, NULL to send synchronously */
+	PublisherSpool *spool;	/* spool of the thread, NULL if spooling is off */
+	ColumnBatch *columns;	/* samples of a bulk in columns, written into json_array when it is sent */
+	const char *type;		/* type of the samples of a bulk in columns, which is part of its header */
+} PluginBulk;
+
+/* bulk sent asynchronously, until the request is completed */
+typedef struct PublishRequest_t {
+	int num;
+	int format;
+	char *json_array;
+	size_t len;
+	long long start;
+	AsyncPublisher *async;
+	PublisherSpool *spool;
+} PublishRequest;
+
 int running;
 int bulk_size;
 static PluginManager *pm;
-pthread_t threads[256];
-long timings[256];
-struct timespec sleep_tims[256];
-PluginHook *hooks;
+static char *pluginLocation;
+pthread_t threads[256];			/* sampling threads, by plugin slot or timer wheel thread */
+static pthread_t publishers[256];
+static pthread_t conf_thread;
+static int plugin_state[256];		/* PLUGIN_EMPTY, PLUGIN_RUNNING, ... of each plugin slot */
+static int sampler_started[256];	/* set if threads[num] has to be joined */
+/* incremented whenever a plugin is started or stopped, so that timer wheel threads pick it up */
+static unsigned plugins_generation = 1;
+static long ring_size = DEFAULT_RING_SIZE;
+long timings[256];				/* sampling intervals in ns, updated atomically on reload */
+long missed_ticks[256];
+long late_ticks[256];
+PluginHookType *hooks;
+SampleRing *rings[256];
+
+/* "threads": one thread per plugin; "wheel": wheel_threads threads sharing a timer wheel each */
+static int use_wheel = 0;
+static int wheel_threads = 1;
+static int num_samplers = 0;
+static int num_publishers = 1;
+/* requests in flight per publisher thread; 0 sends each bulk synchronously */
+static int async_requests = 0;
+/* spool settings; spooling is off without a spool directory */
+static char spool_dir[256] = {'\0'};
+static size_t spool_max_size;
+static size_t spool_segment_size;
+static int spool_sync;
+static long long spool_replay_ns;
+static long long spool_retry_ns;
+/* set once all sampling threads have stopped, publishers drain the rings until then */
+static volatile int sampling_done = 0;
+static char static_json[512] = {'\0'};
+static size_t static_json_len = 0;
+/* format of the bulks of sample hooks; falls back to json once the server refuses MessagePack */
+static int wire_format = PUBLISH_JSON;
+static char static_msgpack[640];
+static size_t static_msgpack_len = 0;
+
+/* cpu affinity and scheduling of the sampling, publisher and configuration threads */
+static ThreadSetup thread_setups[THREAD_CLASSES];
+static const char *thread_classes[THREAD_CLASSES] = { "sampler", "publisher", "conf" };
+
+/* [adaptive] settings, protected by a sequence counter which is odd while they are written */
+static AdaptiveConf adaptive_conf[256];
+static double adaptive_threshold = DEFAULT_ADAPTIVE_THRESHOLD;
+static double adaptive_weight = DEFAULT_ADAPTIVE_WEIGHT;
+static unsigned adaptive_seq = 0;
+/* adaptive sampling state and interval of the current tick, owned by the sampling thread of a plugin */
+static AdaptiveSampler adaptive[256];
+static int adaptive_on[256];
+static unsigned adaptive_seen[256];
+static AdaptiveConf adaptive_applied[256];
+static double adaptive_applied_threshold[256];
+static double adaptive_applied_weight[256];
+static long used_intervals[256];
 
 /*******************************************************************************
  * Forward Declarations
  ******************************************************************************/
 static void catcher(int signo);
 static void init_timings(void);
-static void *entryThreads(void *arg);  //threads entry for all threads
+static void init_scheduler(void);
+static void init_thread_setups(void);
+static void init_rings(void);
+static int init_ring(int num);
+static void init_spool(void);
+static void init_wire_format(void);
+static long get_generic_long(const char *key, long default_value);
+static void *samplerEntry(void *arg);
+static void *wheelEntry(void *arg);
+static void *publisherEntry(void *arg);
+static void *confEntry(void *arg);
+static int start_sampler(int num);
+static int get_state(int num);
+static void set_state(int num, int state);
+static int wait_state(int num, int state);
+static void sync_plugins(char **replaced, int num_replaced);
+static int start_plugin(const char *name);
+static int load_slot(const char *name);
+static int agent_self_enabled(void);
+static void stop_plugin(int num);
 static int checkConf(void);
+static int watchConf(void);
+static int reload_conf(void);
+static long plugin_interval(int num);
+static void init_adaptive(void);
+static void update_adaptive(int num);
 static int gatherMetric(int num);
+static int wheelScheduler(int id);
+static int publishMetrics(int id);
+static void sampler_init(PluginSampler *sampler, int num);
+static void sample_plugin(int num);
+static void bulk_init(PluginBulk *bulk, int num);
+static void bulk_start(PluginBulk *bulk);
+static void bulk_append(PluginBulk *bulk, const char *json);
+static void bulk_append_sample(PluginBulk *bulk, const Plugin_sample *sample);
+static void bulk_append_columns(PluginBulk *bulk, const Plugin_sample *sample);
+static void bulk_reserve(PluginBulk *bulk, size_t len);
+static void bulk_publish(PluginBulk *bulk);
+static void bulk_free(PluginBulk *bulk);
+static void publish_done(int success, void *userdata);
+static void resend_json(PublisherSpool *ps, AsyncPublisher *async, int num, const char *data, size_t len);
+static int refuse_format(void);
+static int convert_json(const char *data, size_t len, char **json, size_t *json_len);
+static PublisherSpool *open_spool(int id);
+static void close_spool(PublisherSpool *ps);
+static void spool_bulk(PublisherSpool *ps, const char *json, size_t len);
+static void replay_spool(PublisherSpool *ps, AsyncPublisher *async);
+static void replay_done(int success, void *userdata);
+static void report_spool(PublisherSpool *ps);
+static int next_deadline(int num, struct timespec *deadline);
+static void check_wakeup(int num, const struct timespec *deadline);
+static int wait_next_tick(int num, struct timespec *deadline);
+static void report_ticks(PluginBulk *bulk);
 
 /*******************************************************************************
  * Functions implementation
  ******************************************************************************/
 /* All threads starts here */
 int startThreads(void) {
-	int t;
+	int t, ret;
 	running = 1;
 
 	/* initialize plugin manager, which is a queue of plugin hooks */
 	pm = PluginManager_new();
 	const char *dirname = { "/plugins" };
-	char *pluginLocation = malloc(256 * sizeof(char));
+	pluginLocation = malloc(256 * sizeof(char));
 	strcpy(pluginLocation, pwd);
 	strcat(pluginLocation, dirname);
 
 	/* discover plugins and register them to the plugin manager */ 
 	void* pdstate = discover_plugins(pluginLocation, pm);
 
+	/* the built-in plugin reporting the overhead of the agent itself */
+	if (agent_self_enabled()) {
+		load_builtin_plugin(AGENT_SELF_NAME, init_mf_plugin_agent_self, shutdown_mf_plugin_agent_self, pm);
+	}
+
 	/* get sampling interval for each plugin */
 	init_timings();
 
@@ -79,25 +289,63 @@ int startThreads(void) {
 	char tmp_string[20] = {'\0'};
 	mfp_get_value("generic", "bulk_size", tmp_string);
 	bulk_size = atoi(tmp_string);
+	if (bulk_size <= 0) {
+		bulk_size = 1;
+	}
 
-	int num_threads = pluginCount + 1;
-	int iret[num_threads];
-	int nums[num_threads];
+	/* get the scheduler mode, which defines the number of sampling threads */
+	init_scheduler();
 
-	hooks = (PluginHook *)malloc(pluginCount * sizeof(PluginHook));
+	/* get the cpu affinity and scheduling of the threads created below */
+	init_thread_setups();
+
+	/* slots for all plugins, including those loaded later on */
+	hooks = (PluginHookType *)calloc(256, sizeof(PluginHookType));
 	for (t = 0; t < pluginCount; t++) {
-		hooks[t] = PluginManager_get_hook(pm);
+		PluginManager_get_hook_type(pm, &hooks[t]);
+		AgentStats_reset(t, plugins_name[t]);
+		plugin_state[t] = PLUGIN_RUNNING;
 	}
 
-	/* create threads for monitoring and updating configurations */
-	for (t = 0; t < num_threads; t++) {
-		nums[t] = t;
-		iret[t] = pthread_create(&threads[t], NULL, entryThreads, &nums[t]);
-		if (iret[t]) {
-			log_error("pthread_create() failed for %s.\n", strerror(iret[t]));
+	/* get the adaptive sampling settings, which need the kind of hook */
+	init_adaptive();
+
+	/* create the rings between sampling and publisher threads, sized by the kind of hook */
+	init_rings();
+
+	/* get the spool, which keeps the bulks while the server is unreachable */
+	init_spool();
+
+	static_json_len = sprintf(static_json, "{\"WorkflowID\":\"%s\",\"ExperimentID\":\"%s\",\"TaskID\":\"%s\",\"host\":\"%s\",", 
+		application_id, experiment_id, task_id, platform_id);
+
+	/* get the format of the bulks, and encode the static part of the samples once */
+	init_wire_format();
+
+	/* create threads for monitoring, publishing and updating configurations */
+	for (t = 0; t < num_samplers; t++) {
+		if (use_wheel) {
+			ret = pthread_create(&threads[t], NULL, wheelEntry, (void *) (intptr_t) t);
+			if (ret) {
+				log_error("pthread_create() failed for %s.\n", strerror(ret));
+				exit(FAILURE);
+			}
+		} else if (start_sampler(t) != SUCCESS) {
+			exit(FAILURE);
+		}
+	}
+	for (t = 0; t < num_publishers; t++) {
+		ret = pthread_create(&publishers[t], NULL, publisherEntry, (void *) (intptr_t) t);
+		if (ret) {
+			log_error("pthread_create() failed for %s.\n", strerror(ret));
 			exit(FAILURE);
 		}
 	}
+	ret = pthread_create(&conf_thread, NULL, confEntry, NULL);
+	if (ret) {
+		log_error("pthread_create() failed for %s.\n", strerror(ret));
+		exit(FAILURE);
+	}
 
 	struct sigaction sig;
 	sig.sa_handler = catcher; /* signal handler is "catcher" */
@@ -109,12 +357,30 @@ int startThreads(void) {
 	while (running)
 		sleep(1);
 	
-	/* thread join from plugins threads till all the sending threads */
-	for (t = 0; t < pluginCount; t++) {
-		pthread_join(threads[t], NULL);
+	/* thread join from the configuration thread, which may start plugins, 
+	   and the plugins threads till all the sending threads */
+	pthread_join(conf_thread, NULL);
+	if (use_wheel) {
+		for (t = 0; t < num_samplers; t++) {
+			pthread_join(threads[t], NULL);
+		}
+	} else {
+		for (t = 0; t < pluginCount; t++) {
+			if (sampler_started[t]) {
+				pthread_join(threads[t], NULL);
+			}
+		}
+	}
+	sampling_done = 1;
+	for (t = 0; t < num_publishers; t++) {
+		pthread_join(publishers[t], NULL);
 	}
 
+	for (t = 0; t < pluginCount; t++) {
+		SampleRing_free(rings[t]);
+	}
 	cleanup_plugins(pdstate);
+	free(hooks);
 	PluginManager_free(pm);
 	free(pluginLocation);
 	return SUCCESS;
@@ -127,81 +393,1389 @@ static void catcher(int signo)
 	log_info("Signal %d catched.\n", signo);
 }
 
-/* entry for all threads */
-static void* entryThreads(void *arg) 
+/* entry for the sampling thread of a plugin */
+static void* samplerEntry(void *arg) 
 {
-	int *typeT = (int*) arg;
-	if(*typeT < pluginCount) {
-		gatherMetric(*typeT);
-	}
-	else {
-		checkConf();
-	}
+	ThreadSetup_apply(&thread_setups[THREAD_SAMPLER], thread_classes[THREAD_SAMPLER]);
+	gatherMetric((int) (intptr_t) arg);
+	return NULL;
+}
+
+/* entry for the timer wheel threads */
+static void* wheelEntry(void *arg) 
+{
+	ThreadSetup_apply(&thread_setups[THREAD_SAMPLER], thread_classes[THREAD_SAMPLER]);
+	wheelScheduler((int) (intptr_t) arg);
+	return NULL;
+}
+
+/* entry for the publisher threads */
+static void* publisherEntry(void *arg) 
+{
+	ThreadSetup_apply(&thread_setups[THREAD_PUBLISHER], thread_classes[THREAD_PUBLISHER]);
+	publishMetrics((int) (intptr_t) arg);
+	return NULL;
+}
+
+/* entry for the configuration thread */
+static void* confEntry(void *arg) 
+{
+	ThreadSetup_apply(&thread_setups[THREAD_CONF], thread_classes[THREAD_CONF]);
+	checkConf();
 	return NULL;
 }
 
-/* timings update if mf_config.ini has been modified */
+/* start the sampling thread of a plugin
+   return 1 on success; 0 otherwise */
+static int start_sampler(int num)
+{
+	int ret = pthread_create(&threads[num], NULL, samplerEntry, (void *) (intptr_t) num);
+	if (ret) {
+		log_error("pthread_create() failed for %s.\n", strerror(ret));
+		return FAILURE;
+	}
+	sampler_started[num] = 1;
+	return SUCCESS;
+}
+
+/* timings update if mf_config.ini has been modified;
+   changes are detected by inotify, or by checking the file periodically if inotify is not available */
 static int checkConf(void) 
 {
+	if (watchConf() == SUCCESS) {
+		return SUCCESS;
+	}
+
+	char wait_some_seconds[20] = {'\0'};
+	mfp_get_value("timings", "update_configuration", wait_some_seconds);
+	int seconds = atoi(wait_some_seconds);
+	if (seconds <= 0) {
+		seconds = 1;
+	}
+	while (running) {
+		int i;
+		for (i = 0; i < seconds && running; i++) {
+			sleep(1);
+		}
+		if (running) {
+			reload_conf();
+			sync_plugins(NULL, 0);
+		}
+	}
+	return SUCCESS;
+}
+
+/* wait for inotify events of the directory of mf_config.ini, since editors often replace the file,
+   and of the plugins directory, where plugins may be added, removed or replaced 
+   return 1 once the agent is stopping; 0 if inotify is not available */
+static int watchConf(void)
+{
+	char events[4096] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+	char conf_dir[256] = {'\0'};
+	char conf_name[256] = {'\0'};
+	char *replaced[256];
+	int i;
+
+	/* dirname() and basename() may modify their argument */
+	strncpy(conf_dir, confFile, sizeof(conf_dir) - 1);
+	strncpy(conf_name, confFile, sizeof(conf_name) - 1);
+	char *dir = dirname(conf_dir);
+	char *name = basename(conf_name);
+
+	int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (fd < 0) {
+		log_warn("inotify_init1() failed (%s), checking %s periodically\n", strerror(errno), confFile);
+		return FAILURE;
+	}
+	int conf_wd = inotify_add_watch(fd, dir, IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE);
+	if (conf_wd < 0) {
+		log_warn("inotify_add_watch() failed for %s (%s), checking %s periodically\n", dir, strerror(errno), confFile);
+		close(fd);
+		return FAILURE;
+	}
+	int plugin_wd = inotify_add_watch(fd, pluginLocation, IN_CLOSE_WRITE | IN_MOVED_TO | IN_DELETE | IN_MOVED_FROM);
+	if (plugin_wd < 0) {
+		log_warn("inotify_add_watch() failed for %s (%s), plugins are not loaded at run-time\n", pluginLocation, strerror(errno));
+	}
+	log_info("Watching %s and %s for changes\n", confFile, pluginLocation);
+
 	while (running) {
-		mfp_parse(confFile);
-		char wait_some_seconds[20] = {'\0'};
-		mfp_get_value("timings", "update_configuration", wait_some_seconds);
-		sleep(atoi(wait_some_seconds));
+		struct pollfd pfd = { .fd = fd, .events = POLLIN };
+		if (poll(&pfd, 1, CONF_POLL_MS) <= 0) {
+			continue;
+		}
 
-		/* update sleep_tims for all plugins */
-		init_timings();
+		int modified = 0;
+		int plugins_modified = 0;
+		int num_replaced = 0;
+		ssize_t len;
+		while ((len = read(fd, events, sizeof(events))) > 0) {
+			char *ptr = events;
+			while (ptr < events + len) {
+				const struct inotify_event *event = (const struct inotify_event *) ptr;
+				ptr += sizeof(struct inotify_event) + event->len;
+				if (event->len == 0) {
+					continue;
+				}
+				if (event->wd == conf_wd && strcmp(event->name, name) == 0) {
+					modified = 1;
+				}
+				if (event->wd != plugin_wd) {
+					continue;
+				}
+				/* a plugin has been added, removed, or replaced */
+				char *last_dot = strrchr(event->name, '.');
+				if (!last_dot || strcmp(last_dot, ".so") != 0) {
+					continue;
+				}
+				plugins_modified = 1;
+				if ((event->mask & (IN_CLOSE_WRITE | IN_MOVED_TO)) && num_replaced < 256) {
+					replaced[num_replaced] = strndup(event->name, last_dot - event->name);
+					num_replaced++;
+				}
+			}
+		}
+		if (modified) {
+			plugins_modified |= reload_conf();
+		}
+		if (plugins_modified) {
+			sync_plugins(replaced, num_replaced);
+		}
+		for (i = 0; i < num_replaced; i++) {
+			free(replaced[i]);
+		}
 	}
+	close(fd);
 	return SUCCESS;
 }
 
-/* each plugin gathers its metrics at a specific rate and send the json-formatted metrics to mf_server */
+/* parse mf_config.ini again, and update the timings if their section has changed 
+   return 1 if the plugins section has changed; 0 otherwise */
+static int reload_conf(void)
+{
+	int i, plugins_changed = 0;
+	mfp_data *changed = malloc(sizeof(mfp_data));
+	if (mfp_reload(confFile, changed) != SUCCESS) {
+		free(changed);
+		return 0;
+	}
+	for (i = 0; i < changed->size; i++) {
+		log_info("Configuration section %s %s\n", changed->keys[i], changed->values[i]);
+		if (strcmp(changed->keys[i], "timings") == 0) {
+			/* update timings for all plugins */
+			init_timings();
+		}
+		if (strcmp(changed->keys[i], "adaptive") == 0) {
+			init_adaptive();
+		}
+		if (strcmp(changed->keys[i], "plugins") == 0) {
+			plugins_changed = 1;
+		}
+	}
+	mfp_data_free(changed);
+	return plugins_changed;
+}
+
+/* start the plugins which have been switched on or added to the plugins directory,
+   stop those which have been switched off or removed, and restart the replaced ones */
+static void sync_plugins(char **replaced, int num_replaced)
+{
+	char *names[256];
+	int i, j, num;
+
+	int count = list_plugins(pluginLocation, names, 256);
+	if (count < 0) {
+		return;
+	}
+	if (count < 256 && agent_self_enabled()) {
+		names[count++] = strdup(AGENT_SELF_NAME);
+	}
+
+	for (num = 0; num < pluginCount; num++) {
+		if (plugins_name[num] == NULL || get_state(num) != PLUGIN_RUNNING) {
+			continue;
+		}
+		int keep = 0;
+		for (i = 0; i < count; i++) {
+			if (strcmp(names[i], plugins_name[num]) == 0) {
+				keep = 1;
+			}
+		}
+		for (j = 0; j < num_replaced; j++) {
+			if (strcmp(replaced[j], plugins_name[num]) == 0) {
+				keep = 0;
+			}
+		}
+		if (!keep) {
+			stop_plugin(num);
+		}
+	}
+
+	for (i = 0; i < count && running; i++) {
+		if (find_plugin_slot(names[i]) < 0) {
+			start_plugin(names[i]);
+		}
+	}
+	for (i = 0; i < count; i++) {
+		free(names[i]);
+	}
+}
+
+/* load a plugin while the agent is running, and start sampling it 
+   return 1 on success; 0 otherwise */
+static int start_plugin(const char *name)
+{
+	int num = load_slot(name);
+	if (num < 0) {
+		return FAILURE;
+	}
+	memset(&hooks[num], 0, sizeof(PluginHookType));
+	PluginManager_get_hook_type(pm, &hooks[num]);
+	AgentStats_reset(num, name);
+
+	/* reset the state of the slot, which may have been used by another plugin */
+	missed_ticks[num] = 0;
+	late_ticks[num] = 0;
+	adaptive_on[num] = 0;
+	adaptive_seen[num] = 0;
+	memset(&adaptive_applied[num], 0, sizeof(AdaptiveConf));
+	if (init_ring(num) != SUCCESS) {
+		unload_plugin_slot(num);
+		return FAILURE;
+	}
+	init_timings();
+	init_adaptive();
+
+	/* the sampling and publisher threads take the plugin on from here */
+	set_state(num, PLUGIN_RUNNING);
+	if (use_wheel) {
+		__atomic_add_fetch(&plugins_generation, 1, __ATOMIC_RELEASE);
+	} else {
+		if (sampler_started[num]) {
+			/* thread of the previous plugin of this slot */
+			pthread_join(threads[num], NULL);
+			sampler_started[num] = 0;
+		}
+		if (start_sampler(num) != SUCCESS) {
+			stop_plugin(num);
+			return FAILURE;
+		}
+	}
+	log_info("Started plugin %s (#%d)\n", name, num);
+	return SUCCESS;
+}
+
+/* stop sampling a plugin, send its remaining samples, and unload it;
+   the other plugins are not affected */
+static void stop_plugin(int num)
+{
+	log_info("Stopping plugin %s (#%d)\n", plugins_name[num], num);
+	set_state(num, PLUGIN_STOPPING);
+	if (use_wheel) {
+		__atomic_add_fetch(&plugins_generation, 1, __ATOMIC_RELEASE);
+		/* the timer wheel thread cancels the timer of the plugin and acknowledges, 
+		   once it sees the new generation, i.e. within WHEEL_IDLE_NS */
+		if (wait_state(num, PLUGIN_DRAINING) != SUCCESS) {
+			return;
+		}
+	} else {
+		if (sampler_started[num]) {
+			pthread_join(threads[num], NULL);
+			sampler_started[num] = 0;
+		}
+		set_state(num, PLUGIN_DRAINING);
+	}
+	if (wait_state(num, PLUGIN_DRAINED) != SUCCESS) {
+		return;
+	}
+
+	/* neither the sampling nor the publisher threads access the slot anymore */
+	SampleRing_free(rings[num]);
+	rings[num] = NULL;
+	unload_plugin_slot(num);
+	memset(&hooks[num], 0, sizeof(PluginHookType));
+	AgentStats_reset(num, "");
+	set_state(num, PLUGIN_EMPTY);
+}
+
+/* load a plugin from the plugins directory, or the built-in plugin, into a free slot 
+   return the slot of the plugin; -1 on failure */
+static int load_slot(const char *name)
+{
+	if (strcmp(name, AGENT_SELF_NAME) == 0) {
+		return load_builtin_plugin(name, init_mf_plugin_agent_self, shutdown_mf_plugin_agent_self, pm);
+	}
+	return load_plugin_slot(pluginLocation, name, pm);
+}
+
+/* check if the built-in plugin is not switched off in mf_config.ini */
+static int agent_self_enabled(void)
+{
+	char value[20] = {'\0'};
+	mfp_get_value("plugins", AGENT_SELF_NAME, value);
+	return strcmp(value, "off") != 0;
+}
+
+/* get the state of a plugin slot */
+static int get_state(int num)
+{
+	return __atomic_load_n(&plugin_state[num], __ATOMIC_ACQUIRE);
+}
+
+/* set the state of a plugin slot, after all changes of the slot are done */
+static void set_state(int num, int state)
+{
+	__atomic_store_n(&plugin_state[num], state, __ATOMIC_RELEASE);
+}
+
+/* wait until a plugin slot reaches or passes the given state, the slot may move on 
+   (e.g. from PLUGIN_DRAINING to PLUGIN_DRAINED) between two polls 
+   return 1 on success; 0 if the agent is stopping */
+static int wait_state(int num, int state)
+{
+	struct timespec poll_time = { 0, PLUGIN_STOP_POLL_NS };
+	while (get_state(num) < state) {
+		if (!running) {
+			return FAILURE;
+		}
+		nanosleep(&poll_time, NULL);
+	}
+	return SUCCESS;
+}
+
+/* each plugin gathers its metrics at a specific rate and hands them to its publisher thread */
 static int gatherMetric(int num) 
 {
-	int i;
-	long timings = sleep_tims[num].tv_sec * 10e8 + sleep_tims[num].tv_nsec;
+	PluginSampler sampler;
+	long timings = plugin_interval(num);
 
 	log_info("Gather metrics of plugin %s (#%d) with update interval of %ld ns\n", plugins_name[num], num, timings);
 
-	char *json_array = calloc(JSON_LEN * bulk_size, sizeof(char));
-	json_array[0] = '[';
-	char msg[JSON_LEN] = {'\0'};
-	char static_json[512] = {'\0'};
+	sampler_init(&sampler, num);
 
-	sprintf(static_json, "{\"WorkflowID\":\"%s\",\"ExperimentID\":\"%s\",\"TaskID\":\"%s\",\"host\":\"%s\",", 
-		application_id, experiment_id, task_id, platform_id);
+	while (running && get_state(num) == PLUGIN_RUNNING) {
+		sample_plugin(num);
+		if(wait_next_tick(num, &sampler.deadline) != SUCCESS) {
+			/* sleep was interrupted because the agent is stopping */
+			break;
+		}
+	}
+	return SUCCESS;
+}
+
+/* runs the hooks of all plugins assigned to this thread (num % wheel_threads == id)
+   from a timer wheel, instead of running one thread per plugin */
+static int wheelScheduler(int id)
+{
+	int i;
+	struct timespec start, now;
+	unsigned long long tick, next_tick;
+	unsigned generation = 0;
 
+	PluginSampler *samplers = calloc(256, sizeof(PluginSampler));
+	TimerWheelEntry *entries = calloc(256, sizeof(TimerWheelEntry));
+	int *armed = calloc(256, sizeof(int));
+	TimerWheel *tw = TimerWheel_new();
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
 	while (running) {
+		/* pick up the plugins started since the last round, they start on the next tick; 
+		   the timers of the plugins being stopped are cancelled right away */
+		unsigned current = __atomic_load_n(&plugins_generation, __ATOMIC_ACQUIRE);
+		if (current != generation) {
+			generation = current;
+			int count = __atomic_load_n(&pluginCount, __ATOMIC_ACQUIRE);
+			for (i = id; i < count; i += wheel_threads) {
+				if (get_state(i) == PLUGIN_STOPPING) {
+					/* acknowledge, instead of waiting until the plugin is due the next time */
+					if (armed[i]) {
+						TimerWheel_remove(tw, &entries[i]);
+						armed[i] = 0;
+					}
+					set_state(i, PLUGIN_DRAINING);
+					continue;
+				}
+				if (armed[i] || get_state(i) != PLUGIN_RUNNING) {
+					continue;
+				}
+				log_info("Gather metrics of plugin %s (#%d) on scheduler thread #%d\n", plugins_name[i], i, id);
+				sampler_init(&samplers[i], i);
+				entries[i].id = i;
+				TimerWheel_add(tw, &entries[i], tw->now + 1);
+				samplers[i].deadline = start;
+				samplers[i].deadline.tv_sec += ((tw->now + 1) * WHEEL_TICK_NS) / NSEC_PER_SEC;
+				samplers[i].deadline.tv_nsec += ((tw->now + 1) * WHEEL_TICK_NS) % NSEC_PER_SEC;
+				if (samplers[i].deadline.tv_nsec >= NSEC_PER_SEC) {
+					samplers[i].deadline.tv_sec++;
+					samplers[i].deadline.tv_nsec -= NSEC_PER_SEC;
+				}
+				armed[i] = 1;
+			}
+		}
 
-		for(i=0; i<bulk_size; i++) {
-			memset(msg, '\0', JSON_LEN * sizeof(char));
-			char *json = hooks[num]();	//malloc of json in hooks[num]()
-			if(json != NULL) {
-				sprintf(msg, "%s%s},", static_json, json);
-				strcat(json_array, msg);
-				free(json);
-			}
-			if(nanosleep(&sleep_tims[num], NULL) != 0) {
-				/*nano sleep failed,  in case that
-				  the call is interrupted by a signal handler or encounters an error */
-				break;
-			};
+		/* sleep until the tick of the earliest deadline, but not longer than WHEEL_IDLE_NS */
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		tick = ((unsigned long long) (now.tv_sec - start.tv_sec) * NSEC_PER_SEC + (now.tv_nsec - start.tv_nsec)) / WHEEL_TICK_NS;
+		unsigned long long idle_tick = tick + WHEEL_IDLE_NS / WHEEL_TICK_NS;
+		if (!TimerWheel_next_expiry(tw, &next_tick) || next_tick > idle_tick) {
+			next_tick = idle_tick;
+		}
+		struct timespec wakeup = start;
+		wakeup.tv_sec += (next_tick * WHEEL_TICK_NS) / NSEC_PER_SEC;
+		wakeup.tv_nsec += (next_tick * WHEEL_TICK_NS) % NSEC_PER_SEC;
+		if (wakeup.tv_nsec >= NSEC_PER_SEC) {
+			wakeup.tv_sec++;
+			wakeup.tv_nsec -= NSEC_PER_SEC;
+		}
+		int ret = clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &wakeup, NULL);
+		if (!running) {
+			break;
+		}
+		if (ret != 0 && ret != EINTR) {
+			log_error("clock_nanosleep() failed for scheduler thread #%d: %s\n", id, strerror(ret));
+			break;
+		}
+
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		tick = ((unsigned long long) (now.tv_sec - start.tv_sec) * NSEC_PER_SEC + (now.tv_nsec - start.tv_nsec)) / WHEEL_TICK_NS;
+
+		TimerWheelEntry *expired = TimerWheel_advance(tw, tick);
+		while (expired != NULL) {
+			TimerWheelEntry *next = expired->next;
+			PluginSampler *sampler = &samplers[expired->id];
+
+			if (get_state(sampler->num) != PLUGIN_RUNNING) {
+				/* the plugin is being stopped; acknowledge and do not re-arm the timer */
+				armed[sampler->num] = 0;
+				set_state(sampler->num, PLUGIN_DRAINING);
+				expired = next;
+				continue;
+			}
+
+			check_wakeup(sampler->num, &sampler->deadline);
+			sample_plugin(sampler->num);
+
+			/* re-arm the timer on the tick of the next deadline */
+			next_deadline(sampler->num, &sampler->deadline);
+			unsigned long long deadline_ns = (unsigned long long) (sampler->deadline.tv_sec - start.tv_sec) * NSEC_PER_SEC 
+				+ (sampler->deadline.tv_nsec - start.tv_nsec);
+			TimerWheel_add(tw, expired, (deadline_ns + WHEEL_TICK_NS - 1) / WHEEL_TICK_NS);
+			expired = next;
+		}
+	}
+
+	TimerWheel_free(tw);
+	free(armed);
+	free(entries);
+	free(samplers);
+	return SUCCESS;
+}
+
+/* drains the rings of all plugins assigned to this thread (num % num_publishers == id),
+   and sends the json-formatted metrics to mf_server once bulk_size samples are collected */
+static int publishMetrics(int id)
+{
+	int i;
+	PluginBulk *bulks = calloc(256, sizeof(PluginBulk));
+	struct timespec idle = { 0, PUBLISHER_IDLE_NS };
+	AsyncPublisher *async = NULL;
+	PublisherSpool *spool = open_spool(id);
+
+	if (async_requests > 0) {
+		async = publisher_async_new(async_requests);
+	}
+
+	for (;;) {
+		/* read the flag before draining, so that no sample committed before the stop is missed */
+		int stopping = sampling_done;
+		int drained = 0;
+		int count = __atomic_load_n(&pluginCount, __ATOMIC_ACQUIRE);
+
+		for (i = id; i < count; i += num_publishers) {
+			/* read the state before draining, so that all samples of a stopped plugin are drained */
+			int state = get_state(i);
+			if (state != PLUGIN_RUNNING && state != PLUGIN_STOPPING && state != PLUGIN_DRAINING) {
+				continue;
+			}
+			if (bulks[i].json_array == NULL) {
+				bulk_init(&bulks[i], i);
+				bulks[i].async = async;
+				bulks[i].spool = spool;
+			}
+
+			void *slot;
+			while ((slot = SampleRing_peek(rings[i])) != NULL) {
+				if (hooks[i].sample_hook != NULL) {
+					bulk_append_sample(&bulks[i], slot);
+				} else {
+					bulk_append(&bulks[i], slot);
+				}
+				SampleRing_release(rings[i]);
+				drained++;
+				if (bulks[i].count >= bulk_size) {
+					bulk_publish(&bulks[i]);
+				}
+			}
+			AgentStats_dropped(i, SampleRing_dropped(rings[i]));
+
+			if (state == PLUGIN_DRAINING) {
+				/* send what is left of the stopped plugin, and hand the slot back */
+				bulk_publish(&bulks[i]);
+				bulk_free(&bulks[i]);
+				set_state(i, PLUGIN_DRAINED);
+			}
+		}
+
+		if (stopping) {
+			break;
+		}
+		replay_spool(spool, async);
+		if (async != NULL && publisher_async_poll(async, 0) > 0) {
+			/* wait for the requests in flight instead of sleeping */
+			if (drained == 0) {
+				publisher_async_poll(async, PUBLISHER_IDLE_NS / 1000000);
+			}
+		} else if (drained == 0) {
+			nanosleep(&idle, NULL);
+		}
+	}
+
+	/* send what is left */
+	for (i = id; i < pluginCount; i += num_publishers) {
+		if (bulks[i].json_array != NULL) {
+			bulk_publish(&bulks[i]);
+			bulk_free(&bulks[i]);
+		}
+	}
+	/* wait for the requests in flight; the spooled bulks are kept for the next run */
+	publisher_async_free(async);
+	close_spool(spool);
+	free(bulks);
+	return SUCCESS;
+}
+
+/* parse mf_config.ini to select the scheduler mode */
+static void init_scheduler(void)
+{
+	char value[20] = {'\0'};
+	mfp_get_value("generic", "scheduler", value);
+	use_wheel = (strcmp(value, "wheel") == 0);
+
+	if (!use_wheel) {
+		num_samplers = pluginCount;
+		return;
+	}
+
+	memset(value, '\0', sizeof(value));
+	mfp_get_value("generic", "scheduler_threads", value);
+	wheel_threads = atoi(value);
+	if (wheel_threads <= 0) {
+		wheel_threads = 1;
+	}
+	if (wheel_threads > pluginCount && pluginCount > 0) {
+		wheel_threads = pluginCount;
+	}
+	num_samplers = wheel_threads;
+	log_info("Using timer wheel scheduler with %d thread(s) for %d plugins\n", wheel_threads, pluginCount);
+}
+
+/* parse the [threads] section of mf_config.ini, with options named <class>_<option>, 
+   e.g. sampler_cpus = 0-1 */
+static void init_thread_setups(void)
+{
+	int i, t;
+
+	for (t = 0; t < THREAD_CLASSES; t++) {
+		ThreadSetup_init(&thread_setups[t]);
+	}
+	mfp_data *data = malloc(sizeof(mfp_data));
+	mfp_get_data("threads", data);
+	for (i = 0; i < data->size; i++) {
+		for (t = 0; t < THREAD_CLASSES; t++) {
+			size_t len = strlen(thread_classes[t]);
+			if (strncmp(data->keys[i], thread_classes[t], len) != 0 || data->keys[i][len] != '_') {
+				continue;
+			}
+			if (ThreadSetup_set(&thread_setups[t], data->keys[i] + len + 1, data->values[i]) != SUCCESS) {
+				log_warn("Invalid setting %s = %s in section threads\n", data->keys[i], data->values[i]);
+			}
+			break;
+		}
+		if (t == THREAD_CLASSES) {
+			log_warn("Unknown setting %s in section threads\n", data->keys[i]);
+		}
+	}
+	mfp_data_free(data);
+}
+
+/* parse mf_config.ini to get the ring size and number of publisher threads, and create the rings */
+static void init_rings(void)
+{
+	int i;
+	char value[20] = {'\0'};
+	mfp_get_value("generic", "ring_size", value);
+	ring_size = atol(value);
+	if (ring_size <= 0) {
+		ring_size = DEFAULT_RING_SIZE;
+	}
+
+	memset(value, '\0', sizeof(value));
+	mfp_get_value("generic", "publisher_threads", value);
+	num_publishers = atoi(value);
+	if (num_publishers <= 0) {
+		num_publishers = 1;
+	}
+	if (num_publishers > pluginCount && pluginCount > 0) {
+		num_publishers = pluginCount;
+	}
+
+	memset(value, '\0', sizeof(value));
+	mfp_get_value("generic", "async_requests", value);
+	async_requests = atoi(value);
+	if (async_requests < 0) {
+		async_requests = 0;
+	}
+
+	for (i = 0; i < pluginCount; i++) {
+		if (init_ring(i) != SUCCESS) {
+			exit(FAILURE);
+		}
+	}
+	log_info("Using %d publisher thread(s) with %ld samples buffered per plugin and %d request(s) in flight\n", 
+		num_publishers, ring_size, async_requests);
+}
+
+/* parse mf_config.ini to get the spool settings */
+static void init_spool(void)
+{
+	char value[256] = {'\0'};
+	mfp_get_value("generic", "spool_dir", value);
+	if (value[0] == '\0') {
+		spool_dir[0] = '\0';
+		log_info("Spooling is off, bulks which cannot be sent are dropped\n");
+		return;
+	}
+	/* relative paths are taken relative to the directory of the agent */
+	int len;
+	if (value[0] == '/') {
+		len = snprintf(spool_dir, sizeof(spool_dir), "%s", value);
+	} else {
+		len = snprintf(spool_dir, sizeof(spool_dir), "%s/%s", pwd, value);
+	}
+	if (len < 0 || (size_t) len >= sizeof(spool_dir)) {
+		log_error("Spool directory %s is too long, spooling is off\n", value);
+		spool_dir[0] = '\0';
+		return;
+	}
+
+	spool_max_size = (size_t) get_generic_long("spool_max_mb", DEFAULT_SPOOL_MAX_MB) << 20;
+	spool_segment_size = (size_t) get_generic_long("spool_segment_mb", DEFAULT_SPOOL_SEGMENT_MB) << 20;
+	spool_sync = (int) get_generic_long("spool_sync", DEFAULT_SPOOL_SYNC);
+	spool_replay_ns = get_generic_long("spool_replay_interval", DEFAULT_SPOOL_REPLAY_MS) * 1000000LL;
+	spool_retry_ns = get_generic_long("spool_retry", DEFAULT_SPOOL_RETRY_S) * (long long) NSEC_PER_SEC;
+	log_info("Spooling up to %zu MB in %s, replayed every %lld ms\n", 
+		spool_max_size >> 20, spool_dir, spool_replay_ns / 1000000);
+}
+
+/* parse mf_config.ini to get the format of the bulks, which is json unless MessagePack or columns 
+   are selected */
+static void init_wire_format(void)
+{
+	char value[20] = {'\0'};
+	mfp_get_value("generic", "wire_format", value);
+	if (strcmp(value, "columns") == 0) {
+		wire_format = PUBLISH_COLUMNS;
+		log_info("Sending the samples of sample hooks as columns, unless the server refuses them\n");
+		return;
+	}
+	if (strcmp(value, "msgpack") != 0) {
+		wire_format = PUBLISH_JSON;
+		return;
+	}
+	wire_format = PUBLISH_MSGPACK;
+
+	const char *keys[STATIC_FIELDS] = { "WorkflowID", "ExperimentID", "TaskID", "host" };
+	const char *values[STATIC_FIELDS] = { application_id, experiment_id, task_id, platform_id };
+	char *p = static_msgpack;
+	int i;
+	for (i = 0; i < STATIC_FIELDS; i++) {
+		p = msgpack_write_str(p, keys[i], strlen(keys[i]));
+		p = msgpack_write_str(p, values[i], strlen(values[i]));
+	}
+	static_msgpack_len = p - static_msgpack;
+	log_info("Sending the samples of sample hooks as MessagePack, unless the server refuses it\n");
+}
+
+/* get a positive number of the generic section, or the default value if it is not set */
+static long get_generic_long(const char *key, long default_value)
+{
+	char value[20] = {'\0'};
+	mfp_get_value("generic", key, value);
+	long ret = atol(value);
+	return (ret > 0) ? ret : default_value;
+}
+
+/* create the ring of a plugin 
+   return 1 on success; 0 otherwise */
+static int init_ring(int num)
+{
+	/* plugins with sample hooks hand over binary samples, which are serialized by the publisher */
+	size_t elem_size = (hooks[num].sample_hook != NULL) ? sizeof(Plugin_sample) : JSON_LEN;
+	rings[num] = SampleRing_new(ring_size, elem_size);
+	if (rings[num] == NULL) {
+		log_error("Cannot allocate the sample ring of plugin %s\n", plugins_name[num]);
+		return FAILURE;
+	}
+	return SUCCESS;
+}
+
+/* start the deadline of the plugin now */
+static void sampler_init(PluginSampler *sampler, int num)
+{
+	sampler->num = num;
+	update_adaptive(num);
+	used_intervals[num] = plugin_interval(num);
+	clock_gettime(CLOCK_MONOTONIC, &sampler->deadline);
+}
+
+/* call the plugin hook and push the sample into the ring of the plugin;
+   sample hooks write directly into the ring slot, legacy hooks return a string to be copied */
+static void sample_plugin(int num)
+{
+	char *slot;
+
+	if (hooks[num].sample_hook != NULL) {
+		update_adaptive(num);
+		Plugin_sample *sample = SampleRing_reserve(rings[num]);
+		if (sample == NULL) {
+			/* ring is full, the sample is counted as dropped */
+			return;
+		}
+		sample->plugin_id = num;
+		sample->interval = used_intervals[num];
+		sample->json = NULL;
+		long long start = AgentStats_now();
+		int ret = hooks[num].sample_hook(sample);
+		AgentStats_hook(num, AgentStats_now() - start);
+		if (ret) {
+			if (adaptive_on[num]) {
+				AdaptiveSampler_update(&adaptive[num], &sample->metrics);
+			}
+			SampleRing_commit(rings[num]);
+		}
+		return;
+	}
+
+	if (hooks[num].hook == NULL) {
+		return;
+	}
+	long long start = AgentStats_now();
+	char *json = hooks[num].hook();	//malloc of json in the legacy hook
+	AgentStats_hook(num, AgentStats_now() - start);
+	if(json == NULL) {
+		return;
+	}
+	/* a cut json would be invalid, longer samples are dropped */
+	size_t len = strlen(json);
+	if (len >= JSON_LEN) {
+		log_warn("Plugin %s: dropped a sample of %zu bytes, samples are limited to %d bytes\n",
+			plugins_name[num], len, JSON_LEN - 1);
+		SampleRing_drop(rings[num]);
+		free(json);
+		return;
+	}
+	slot = SampleRing_reserve(rings[num]);
+	if (slot != NULL) {
+		memcpy(slot, json, len + 1);
+		SampleRing_commit(rings[num]);
+	}
+	free(json);
+}
+
+/* prepare an empty bulk for the given plugin */
+static void bulk_init(PluginBulk *bulk, int num)
+{
+	bulk->num = num;
+	bulk->size = JSON_LEN * bulk_size;
+	bulk->json_array = calloc(bulk->size, sizeof(char));
+	bulk_start(bulk);
+	bulk->reported_missed = 0;
+	bulk->reported_late = 0;
+	bulk->reported_dropped = 0;
+}
+
+/* start an empty array; samples of sample hooks are sent as MessagePack or columns if selected, 
+   legacy samples are json already */
+static void bulk_start(PluginBulk *bulk)
+{
+	bulk->count = 0;
+	bulk->format = PUBLISH_JSON;
+	if (hooks[bulk->num].sample_hook != NULL) {
+		bulk->format = __atomic_load_n(&wire_format, __ATOMIC_RELAXED);
+	}
+	if (bulk->format == PUBLISH_MSGPACK) {
+		/* the number of samples is filled in by bulk_publish() */
+		msgpack_write_array32(bulk->json_array, 0);
+		bulk->len = MSGPACK_ARRAY32_LEN;
+	} else if (bulk->format == PUBLISH_COLUMNS) {
+		/* the static fields head the batch, without the opening brace of static_json */
+		if (bulk->columns == NULL) {
+			bulk->columns = columns_new();
+		}
+		columns_begin(bulk->columns);
+		columns_header(bulk->columns, static_json + 1, static_json_len - 1);
+		bulk->type = NULL;
+		bulk->len = 0;
+	} else {
+		bulk->json_array[0] = '[';
+		bulk->json_array[1] = '\0';
+		bulk->len = 1;
+	}
+}
+
+/* append the json-formatted metrics of one sample to the bulk */
+static void bulk_append(PluginBulk *bulk, const char *json)
+{
+	MF_json out;
+	long long start = AgentStats_now();
+
+	mf_json_attach(&out, bulk->json_array, bulk->len, bulk->size);
+	mf_json_raw(&out, static_json, static_json_len);
+	mf_json_str(&out, json);
+	mf_json_literal(&out, "},");
+	bulk->json_array = out.buf;
+	bulk->len = out.len;
+	bulk->size = out.size;
+	bulk->count++;
+	AgentStats_serialize(bulk->num, AgentStats_now() - start);
+}
+
+/* serialize one binary sample directly into the bulk; this is the only place 
+   where samples of sample hooks are formatted */
+static void bulk_append_sample(PluginBulk *bulk, const Plugin_sample *sample)
+{
+	int i;
+	char *json;
+	char timestamp[MF_JSON_NUMBER_LEN];
+	long long start = AgentStats_now();
+
+	if (bulk->format == PUBLISH_COLUMNS && bulk->count > 0 && bulk->type != sample->type && 
+		strcmp(bulk->type, sample->type) != 0) {
+		/* the type is part of the header of the columns, a sample of another type starts a new bulk */
+		bulk_publish(bulk);
+	}
+	if (bulk->format == PUBLISH_COLUMNS) {
+		bulk_append_columns(bulk, sample);
+		AgentStats_serialize(bulk->num, AgentStats_now() - start);
+		return;
+	}
+	if (bulk->format == PUBLISH_MSGPACK) {
+		/* the same fields as in json; only the timestamp is formatted, as it is a string in json */
+		size_t type_len = strlen(sample->type);
+		size_t need = MSGPACK_MAP_MAX + static_msgpack_len + MSGPACK_STR_MAX(4) + MSGPACK_STR_MAX(type_len) +
+			MSGPACK_STR_MAX(15) + MSGPACK_STR_MAX(sizeof(timestamp)) + MSGPACK_STR_MAX(20) + MSGPACK_INT_MAX;
+		for (i = 0; i < sample->metrics.num_events; i++) {
+			need += MSGPACK_STR_MAX(strlen(sample->metrics.events[i])) + MSGPACK_DOUBLE_LEN;
+		}
+		bulk_reserve(bulk, need);
+		json = bulk->json_array + bulk->len;
+		json = msgpack_write_map(json, STATIC_FIELDS + 3 + sample->metrics.num_events);
+		memcpy(json, static_msgpack, static_msgpack_len);
+		json += static_msgpack_len;
+		json = msgpack_write_str(json, "type", 4);
+		json = msgpack_write_str(json, sample->type, type_len);
+		json = msgpack_write_str(json, "local_timestamp", 15);
+		/* a timestamp too long for a number is left empty, as by mf_json_number() */
+		int timestamp_len = mf_json_fixed(timestamp, sample->timestamp, 1);
+		if (timestamp_len < 0 || (size_t) timestamp_len >= sizeof(timestamp)) {
+			timestamp_len = 0;
+		}
+		json = msgpack_write_str(json, timestamp, timestamp_len);
+		json = msgpack_write_str(json, "sampling_interval_ns", 20);
+		json = msgpack_write_int(json, sample->interval);
+		for (i = 0; i < sample->metrics.num_events; i++) {
+			json = msgpack_write_str(json, sample->metrics.events[i], strlen(sample->metrics.events[i]));
+			json = msgpack_write_double(json, sample->metrics.values[i]);
+		}
+		bulk->len = json - bulk->json_array;
+		bulk->count++;
+		AgentStats_serialize(bulk->num, AgentStats_now() - start);
+		return;
+	}
+
+	/* with a template of the plugin, the type and the names are copied as they were escaped at init */
+	const MF_json_template *template = sample->json;
+	MF_json out;
+	mf_json_attach(&out, bulk->json_array, bulk->len, bulk->size);
+	mf_json_raw(&out, static_json, static_json_len);
+	if (template != NULL) {
+		mf_json_template_type(&out, template);
+	} else {
+		mf_json_literal(&out, "\"type\":\"");
+		mf_json_escaped(&out, sample->type);
+		mf_json_literal(&out, "\"");
+	}
+	mf_json_literal(&out, ",\"local_timestamp\":\"");
+	mf_json_number(&out, sample->timestamp, 1);
+	mf_json_literal(&out, "\",\"sampling_interval_ns\":");
+	mf_json_long(&out, sample->interval);
+	for (i = 0; i < sample->metrics.num_events; i++) {
+		if (template != NULL) {
+			mf_json_template_metric(&out, template, sample->keys[i], sample->metrics.values[i]);
+		} else {
+			mf_json_metric(&out, sample->metrics.events[i], sample->metrics.values[i]);
+		}
+	}
+	mf_json_literal(&out, "},");
+	bulk->json_array = out.buf;
+	bulk->len = out.len;
+	bulk->size = out.size;
+	bulk->count++;
+	AgentStats_serialize(bulk->num, AgentStats_now() - start);
+}
+
+/* append one binary sample as a row of the columns, whose header gets the type of the first sample */
+static void bulk_append_columns(PluginBulk *bulk, const Plugin_sample *sample)
+{
+	const MF_json_template *template = sample->json;
+	char value[MF_JSON_NUMBER_LEN + 2];
+	MF_json key = { 0 };
+	int i;
+
+	if (bulk->count == 0) {
+		bulk->type = sample->type;
+		if (template != NULL) {
+			columns_header(bulk->columns, template->text, template->type_len);
+		} else {
+			mf_json_init(&key, 64);
+			mf_json_literal(&key, "\"type\":\"");
+			mf_json_escaped(&key, sample->type);
+			mf_json_literal(&key, "\"");
+			columns_header(bulk->columns, key.buf, key.len);
+			mf_json_free(&key);
+		}
+	}
+
+	/* values too long for a number, which mf_json_metric() leaves out as well, are null */
+	columns_row(bulk->columns);
+	value[0] = '"';
+	i = mf_json_fixed(value + 1, sample->timestamp, 1);
+	if (i >= 0 && i < MF_JSON_NUMBER_LEN) {
+		value[i + 1] = '"';
+		columns_value(bulk->columns, "\"local_timestamp\"", 17, value, i + 2);
+	}
+	columns_value(bulk->columns, "\"sampling_interval_ns\"", 22, value, 
+		snprintf(value, sizeof(value), "%ld", sample->interval));
+
+	/* with a template of the plugin, the keys are its fragments ,"<metric>": without the punctuation */
+	if (template == NULL) {
+		mf_json_init(&key, 64);
+	}
+	for (i = 0; i < sample->metrics.num_events; i++) {
+		int value_len = mf_json_fixed(value, sample->metrics.values[i], 3);
+		if (value_len < 0 || value_len >= MF_JSON_NUMBER_LEN) {
+			continue;
+		}
+		if (template != NULL) {
+			int k = sample->keys[i];
+			columns_value(bulk->columns, template->text + template->key_start[k] + 1, template->key_len[k] - 2, 
+				value, value_len);
+		} else {
+			mf_json_truncate(&key, 0);
+			mf_json_literal(&key, "\"");
+			mf_json_escaped(&key, sample->metrics.events[i]);
+			mf_json_literal(&key, "\"");
+			columns_value(bulk->columns, key.buf, key.len, value, value_len);
+		}
+	}
+	if (template == NULL) {
+		mf_json_free(&key);
+	}
+	bulk->count++;
+}
+
+/* make sure the bulk has room for another len characters */
+static void bulk_reserve(PluginBulk *bulk, size_t len)
+{
+	if (bulk->len + len < bulk->size) {
+		return;
+	}
+	while (bulk->len + len >= bulk->size) {
+		bulk->size *= 2;
+	}
+	bulk->json_array = realloc(bulk->json_array, bulk->size);
+}
+
+/* send the collected metrics to mf_server and reset the bulk;
+   bulks which cannot be sent are spooled */
+static void bulk_publish(PluginBulk *bulk)
+{
+	if (bulk->count > 0) {
+		if (bulk->format == PUBLISH_MSGPACK) {
+			msgpack_write_array32(bulk->json_array, bulk->count);
+		} else if (bulk->format == PUBLISH_COLUMNS) {
+			bulk->len = columns_write(bulk->columns, &bulk->json_array, &bulk->size);
+			debug("Columns sent are :\n%s\n", bulk->json_array);
+		} else {
+			bulk->json_array[bulk->len - 1] = ']';
+			debug("JSON sent is :\n%s\n", bulk->json_array);
+		}
+		long long start = AgentStats_now();
+		if (bulk->spool != NULL && bulk->spool->down) {
+			/* queue up behind the spooled bulks, until they are all replayed */
+			spool_bulk(bulk->spool, bulk->json_array, bulk->len);
+		} else if (bulk->async != NULL) {
+			/* hand the json array over to the request, and continue with a new one */
+			PublishRequest *request = malloc(sizeof(PublishRequest));
+			request->num = bulk->num;
+			request->format = bulk->format;
+			request->json_array = bulk->json_array;
+			request->len = bulk->len;
+			request->start = start;
+			request->async = bulk->async;
+			request->spool = bulk->spool;
+			if (publish_bulk_async(bulk->async, metrics_publish_URL, request->json_array, request->len, 
+				request->format, publish_done, request) == SUCCESS) {
+				bulk->json_array = malloc(bulk->size);
+			} else {
+				/* not sent, e.g. while the circuit breaker of the publisher is open */
+				free(request);
+				spool_bulk(bulk->spool, bulk->json_array, bulk->len);
+			}
+		} else {
+			int ret = publish_bulk(metrics_publish_URL, bulk->json_array, bulk->len, bulk->format);
+			if (ret == PUBLISH_UNSUPPORTED) {
+				resend_json(bulk->spool, NULL, bulk->num, bulk->json_array, bulk->len);
+			} else if (ret != SUCCESS) {
+				spool_bulk(bulk->spool, bulk->json_array, bulk->len);
+			}
+			AgentStats_publish(bulk->num, AgentStats_now() - start, bulk->len);
 		}
-		json_array[strlen(json_array) -1] = ']';
-		json_array[strlen(json_array)] = '\0';
-		debug("JSON sent is :\n%s\n", json_array);
-		publish_json(metrics_publish_URL, json_array);
-		memset(json_array, '\0', JSON_LEN * bulk_size * sizeof(char));
-		json_array[0] = '[';
-		
 	}
+	bulk_start(bulk);
+	report_ticks(bulk);
+}
+
+/* free the memory of the bulk of a plugin which is stopped, or at the end */
+static void bulk_free(PluginBulk *bulk)
+{
+	free(bulk->json_array);
+	bulk->json_array = NULL;
+	columns_free(bulk->columns);
+	bulk->columns = NULL;
+}
+
+/* called by the publisher thread when an asynchronous request is completed */
+static void publish_done(int success, void *userdata)
+{
+	PublishRequest *request = (PublishRequest *) userdata;
+	AgentStats_publish(request->num, AgentStats_now() - request->start, request->len);
+	if (success == PUBLISH_UNSUPPORTED) {
+		resend_json(request->spool, request->async, request->num, request->json_array, request->len);
+	} else if (success != SUCCESS) {
+		spool_bulk(request->spool, request->json_array, request->len);
+	}
+	free(request->json_array);
+	free(request);
+}
 
-	if(json_array != NULL) {
-		free(json_array);
+/* the server has refused a MessagePack or columnar bulk: switch all bulks to json, and send this 
+   one again as json; it is spooled if it cannot be sent */
+static void resend_json(PublisherSpool *ps, AsyncPublisher *async, int num, const char *data, size_t len)
+{
+	char *json;
+	size_t json_len;
+
+	refuse_format();
+	if (!convert_json(data, len, &json, &json_len)) {
+		log_error("Cannot convert a bulk of %zu bytes into json\n", len);
+		return;
+	}
+	if (async != NULL) {
+		PublishRequest *request = malloc(sizeof(PublishRequest));
+		request->num = num;
+		request->format = PUBLISH_JSON;
+		request->json_array = json;
+		request->len = json_len;
+		request->start = AgentStats_now();
+		request->async = async;
+		request->spool = ps;
+		if (publish_bulk_async(async, metrics_publish_URL, json, json_len, PUBLISH_JSON, 
+			publish_done, request) == SUCCESS) {
+			return;
+		}
+		free(request);
+		spool_bulk(ps, json, json_len);
+	} else if (publish_json(metrics_publish_URL, json) != SUCCESS) {
+		spool_bulk(ps, json, json_len);
 	}
+	free(json);
+}
+
+/* fall back to json for all bulks started from now on
+   return 1 if MessagePack or columns were in use until now; otherwise return 0 */
+static int refuse_format(void)
+{
+	int format = __atomic_exchange_n(&wire_format, PUBLISH_JSON, __ATOMIC_RELAXED);
+	if (format == PUBLISH_JSON) {
+		return FAILURE;
+	}
+	log_warn("Server %s does not accept %s, sending json from now on\n", metrics_publish_URL, 
+		(format == PUBLISH_MSGPACK) ? "MessagePack" : "columns");
 	return SUCCESS;
 }
 
+/* convert a MessagePack or columnar bulk into json, telling the format by its first bytes
+   return 1 on success; otherwise return 0 */
+static int convert_json(const char *data, size_t len, char **json, size_t *json_len)
+{
+	if (columns_is_batch(data, len)) {
+		return columns_to_json(data, len, json, json_len);
+	}
+	return msgpack_to_json(data, len, json, json_len);
+}
+
+/* open the spool of a publisher thread in its own directory
+   return the spool; NULL if spooling is off or the spool cannot be opened */
+static PublisherSpool *open_spool(int id)
+{
+	char dir[SPOOL_PATH_LEN];
+
+	if (spool_dir[0] == '\0') {
+		return NULL;
+	}
+	int len = snprintf(dir, sizeof(dir), "%s/publisher_%d", spool_dir, id);
+	if (len < 0 || (size_t) len >= sizeof(dir)) {
+		log_error("Spool directory %s/publisher_%d is too long, spooling is off\n", spool_dir, id);
+		return NULL;
+	}
+	Spool *spool = Spool_open(dir, spool_max_size, spool_segment_size, spool_sync);
+	if (spool == NULL) {
+		return NULL;
+	}
+	PublisherSpool *ps = calloc(1, sizeof(PublisherSpool));
+	ps->id = id;
+	ps->spool = spool;
+	report_spool(ps);
+	return ps;
+}
+
+/* close the spool, after the requests in flight are completed */
+static void close_spool(PublisherSpool *ps)
+{
+	if (ps == NULL) {
+		return;
+	}
+	if (ps->spool->records > 0) {
+		log_info("Keeping %llu spooled bulks in %s for the next run\n", ps->spool->records, ps->spool->dir);
+	}
+	Spool_close(ps->spool);
+	free(ps);
+}
+
+/* append a bulk which could not be sent to the spool; from now on, new bulks are spooled 
+   as well until all spooled bulks are replayed, which keeps them in order */
+static void spool_bulk(PublisherSpool *ps, const char *json, size_t len)
+{
+	if (ps == NULL) {
+		return;
+	}
+	if (!ps->down) {
+		log_warn("Cannot send to %s, spooling bulks in %s\n", metrics_publish_URL, ps->spool->dir);
+		ps->down = 1;
+		ps->failing = 1;
+		ps->next_ns = AgentStats_now() + spool_retry_ns;
+	}
+	if (Spool_append(ps->spool, json, len) != SUCCESS) {
+		debug("Spool %s is full, dropping a bulk of %zu bytes\n", ps->spool->dir, len);
+	}
+	report_spool(ps);
+}
+
+/* send the oldest spooled bulk; only one bulk is replayed at a time, and not more often than 
+   every spool_replay_interval, so that the replay does not swamp the server once it is back */
+static void replay_spool(PublisherSpool *ps, AsyncPublisher *async)
+{
+	size_t len;
+
+	if (ps == NULL || ps->in_flight || AgentStats_now() < ps->next_ns) {
+		return;
+	}
+	if (ps->spool->records == 0) {
+		/* all spooled bulks are sent, or nothing could be spooled; send the next bulk directly */
+		ps->down = 0;
+		return;
+	}
+	char *data = Spool_peek(ps->spool, &len);
+	if (data == NULL) {
+		return;
+	}
+	int format = PUBLISH_JSON;
+	if (msgpack_is_array(data, len)) {
+		format = PUBLISH_MSGPACK;
+	} else if (columns_is_batch(data, len)) {
+		format = PUBLISH_COLUMNS;
+	}
+	if (format != PUBLISH_JSON && __atomic_load_n(&wire_format, __ATOMIC_RELAXED) != format) {
+		/* spooled before the server refused the format, or by a previous run */
+		if (!convert_json(data, len, &ps->converted, &len)) {
+			log_error("Dropping a malformed spooled bulk of %zu bytes\n", len);
+			Spool_consume(ps->spool);
+			report_spool(ps);
+			return;
+		}
+		data = ps->converted;
+		format = PUBLISH_JSON;
+	}
+	if (async != NULL) {
+		/* the spool keeps the peeked bulk until it is consumed by replay_done() */
+		ps->in_flight = 1;
+		if (publish_bulk_async(async, metrics_publish_URL, data, len, format, replay_done, ps) != SUCCESS) {
+			replay_done(FAILURE, ps);
+		}
+	} else {
+		replay_done(publish_bulk(metrics_publish_URL, data, len, format), ps);
+	}
+}
+
+/* called when a replayed bulk is sent, or could not be sent */
+static void replay_done(int success, void *userdata)
+{
+	PublisherSpool *ps = (PublisherSpool *) userdata;
+	long long now = AgentStats_now();
+
+	ps->in_flight = 0;
+	free(ps->converted);
+	ps->converted = NULL;
+	if (success == PUBLISH_UNSUPPORTED) {
+		/* keep the bulk, it is converted into json by the next replay */
+		refuse_format();
+		return;
+	}
+	if (success == SUCCESS) {
+		/* new bulks are still spooled behind the older ones, until replay_spool() finds 
+		   the spool empty */
+		Spool_consume(ps->spool);
+		if (ps->failing) {
+			log_info("Server is reachable again, replaying %llu spooled bulks\n", ps->spool->records);
+			ps->failing = 0;
+		}
+		ps->next_ns = now + spool_replay_ns;
+	} else {
+		ps->down = 1;
+		ps->failing = 1;
+		ps->next_ns = now + spool_retry_ns;
+	}
+	report_spool(ps);
+}
+
+/* publish the size and lag of the spool */
+static void report_spool(PublisherSpool *ps)
+{
+	AgentStats_spool(ps->id, ps->spool->size, ps->spool->records, Spool_oldest(ps->spool), ps->spool->dropped);
+}
+
+/* advance the absolute deadline by one sampling interval;
+   if the deadline has already passed, the whole intervals elapsed in the meantime are 
+   counted as missed ticks and the next sample is due right away as a late tick 
+   return 1 if the deadline lies in the future; 0 otherwise */
+static int next_deadline(int num, struct timespec *deadline)
+{
+	struct timespec now;
+	long interval = plugin_interval(num);
+	long long lag;
+
+	if (interval <= 0) {
+		interval = 1;
+	}
+	used_intervals[num] = interval;
+	deadline->tv_sec += interval / NSEC_PER_SEC;
+	deadline->tv_nsec += interval % NSEC_PER_SEC;
+	if (deadline->tv_nsec >= NSEC_PER_SEC) {
+		deadline->tv_sec++;
+		deadline->tv_nsec -= NSEC_PER_SEC;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	lag = (long long) (now.tv_sec - deadline->tv_sec) * NSEC_PER_SEC + (now.tv_nsec - deadline->tv_nsec);
+	if (lag < 0) {
+		return SUCCESS;
+	}
+
+	long long skipped = lag / interval;
+	missed_ticks[num] += skipped;
+	late_ticks[num]++;
+	/* move the deadline to the latest tick not in the future */
+	deadline->tv_sec += (skipped * interval) / NSEC_PER_SEC;
+	deadline->tv_nsec += (skipped * interval) % NSEC_PER_SEC;
+	if (deadline->tv_nsec >= NSEC_PER_SEC) {
+		deadline->tv_sec++;
+		deadline->tv_nsec -= NSEC_PER_SEC;
+	}
+	return FAILURE;
+}
+
+/* count a late tick, if the wake-up for the deadline was delayed by the scheduler */
+static void check_wakeup(int num, const struct timespec *deadline)
+{
+	struct timespec now;
+	long interval = plugin_interval(num);
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	long long lag = (long long) (now.tv_sec - deadline->tv_sec) * NSEC_PER_SEC + (now.tv_nsec - deadline->tv_nsec);
+	if (lag > interval / LATE_TICK_FRACTION) {
+		late_ticks[num]++;
+	}
+}
+
+/* sleep until the next deadline of the plugin is reached
+   return 1 on success; 0 if the agent is stopping */
+static int wait_next_tick(int num, struct timespec *deadline)
+{
+	int ret;
+
+	if (next_deadline(num, deadline) != SUCCESS) {
+		/* already late, sample right away */
+		return running ? SUCCESS : FAILURE;
+	}
+
+	do {
+		ret = clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, deadline, NULL);
+	} while (ret == EINTR && running);
+
+	if (!running) {
+		return FAILURE;
+	}
+	if (ret != 0) {
+		log_error("clock_nanosleep() failed for plugin %s: %s\n", plugins_name[num], strerror(ret));
+		return FAILURE;
+	}
+
+	check_wakeup(num, deadline);
+	return SUCCESS;
+}
+
+/* report missed and late ticks and dropped samples of a plugin, if they changed since the last report */
+static void report_ticks(PluginBulk *bulk)
+{
+	int num = bulk->num;
+	unsigned long long dropped = SampleRing_dropped(rings[num]);
+
+	if (missed_ticks[num] != bulk->reported_missed || late_ticks[num] != bulk->reported_late) {
+		log_warn("Plugin %s: %ld missed and %ld late ticks so far (+%ld missed, +%ld late)\n",
+			plugins_name[num], missed_ticks[num], late_ticks[num],
+			missed_ticks[num] - bulk->reported_missed, late_ticks[num] - bulk->reported_late);
+		bulk->reported_missed = missed_ticks[num];
+		bulk->reported_late = late_ticks[num];
+	}
+	if (dropped != bulk->reported_dropped) {
+		log_warn("Plugin %s: %llu samples dropped so far, ring occupancy %zu of %zu (high-water mark %zu)\n",
+			plugins_name[num], dropped, SampleRing_size(rings[num]), rings[num]->capacity,
+			rings[num]->high_watermark);
+		bulk->reported_dropped = dropped;
+	}
+}
+
 /* parse mf_cconfig.ini to get all timing information */
 static void init_timings(void)
 {
@@ -217,20 +1791,112 @@ static void init_timings(void)
 		char value[20] = {'\0'};
 		char *ptr;
 		mfp_get_value("timings", plugins_name[i], value);
-		if (value[0] == '\0') {
-			timings[i] = default_timing;
-		} else {
-			timings[i] = strtol(value, &ptr, 10);
-			log_info("Timing for plugin %s is %ldns\n", plugins_name[i], timings[i]);
+		long timing = default_timing;
+		if (value[0] != '\0') {
+			timing = strtol(value, &ptr, 10);
+			log_info("Timing for plugin %s is %ldns\n", plugins_name[i], timing);
+		}
 
-			/* update the sleep_tims for the plugin */
-			if (timings[i] >= 10e8) {
-				sleep_tims[i].tv_sec = timings[i] / 10e8;
-				sleep_tims[i].tv_nsec = timings[i] % (long) 10e8;
-			} else {
-				sleep_tims[i].tv_sec = 0;
-				sleep_tims[i].tv_nsec = timings[i];
+		/* the sampling threads read the interval concurrently */
+		__atomic_store_n(&timings[i], timing, __ATOMIC_RELAXED);
+	}
+}
+
+/* get the current sampling interval of the plugin in ns;
+   only called by the sampling thread of the plugin */
+static long plugin_interval(int num)
+{
+	if (adaptive_on[num]) {
+		return adaptive[num].interval;
+	}
+	return __atomic_load_n(&timings[num], __ATOMIC_RELAXED);
+}
+
+/* parse the [adaptive] section of mf_config.ini, e.g. 
+   mf_plugin_RAPL_power = 100000000ns,5000000000ns enables adaptive sampling between 0.1 s and 5 s */
+static void init_adaptive(void)
+{
+	int i, j;
+	AdaptiveConf conf[256];
+	double threshold = DEFAULT_ADAPTIVE_THRESHOLD;
+	double weight = DEFAULT_ADAPTIVE_WEIGHT;
+
+	memset(conf, 0, sizeof(conf));
+	mfp_data *data = malloc(sizeof(mfp_data));
+	mfp_get_data("adaptive", data);
+	for (i = 0; i < data->size; i++) {
+		if (strcmp(data->keys[i], "threshold") == 0) {
+			threshold = atof(data->values[i]);
+			continue;
+		}
+		if (strcmp(data->keys[i], "weight") == 0) {
+			weight = atof(data->values[i]);
+			continue;
+		}
+		for (j = 0; j < pluginCount; j++) {
+			if (plugins_name[j] == NULL || strcmp(data->keys[i], plugins_name[j]) != 0) {
+				continue;
+			}
+			char *ptr;
+			long min_interval = strtol(data->values[i], &ptr, 10);
+			ptr = strchr(ptr, ',');
+			if (min_interval <= 0 || ptr == NULL) {
+				/* "off", or no valid range */
+				break;
 			}
+			long max_interval = strtol(ptr + 1, NULL, 10);
+			if (hooks[j].sample_hook == NULL) {
+				log_warn("Plugin %s does not hand over binary samples, adaptive sampling is not supported\n", plugins_name[j]);
+				break;
+			}
+			conf[j].enabled = 1;
+			conf[j].min_interval = min_interval;
+			conf[j].max_interval = max_interval;
+			log_info("Adaptive sampling for plugin %s between %ldns and %ldns\n", plugins_name[j], min_interval, max_interval);
 		}
 	}
+	mfp_data_free(data);
+
+	if (weight <= 0.0 || weight > 1.0) {
+		weight = DEFAULT_ADAPTIVE_WEIGHT;
+	}
+
+	/* publish the settings, the sampling threads pick them up on their next tick */
+	__atomic_add_fetch(&adaptive_seq, 1, __ATOMIC_ACQ_REL);
+	memcpy(adaptive_conf, conf, sizeof(conf));
+	adaptive_threshold = threshold;
+	adaptive_weight = weight;
+	__atomic_add_fetch(&adaptive_seq, 1, __ATOMIC_RELEASE);
+}
+
+/* apply changed [adaptive] settings to the plugin; called by its sampling thread */
+static void update_adaptive(int num)
+{
+	unsigned seq = __atomic_load_n(&adaptive_seq, __ATOMIC_ACQUIRE);
+	if (seq == adaptive_seen[num] || (seq & 1)) {
+		return;
+	}
+	AdaptiveConf conf = adaptive_conf[num];
+	double threshold = adaptive_threshold;
+	double weight = adaptive_weight;
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	if (__atomic_load_n(&adaptive_seq, __ATOMIC_RELAXED) != seq) {
+		/* the settings are being written, try again on the next tick */
+		return;
+	}
+
+	adaptive_seen[num] = seq;
+	if (conf.enabled == adaptive_applied[num].enabled && conf.min_interval == adaptive_applied[num].min_interval 
+		&& conf.max_interval == adaptive_applied[num].max_interval && threshold == adaptive_applied_threshold[num] && weight == adaptive_applied_weight[num]) {
+		/* the settings of this plugin did not change, keep its state */
+		return;
+	}
+	adaptive_applied[num] = conf;
+	adaptive_applied_threshold[num] = threshold;
+	adaptive_applied_weight[num] = weight;
+	adaptive_on[num] = conf.enabled;
+	if (conf.enabled) {
+		AdaptiveSampler_init(&adaptive[num], conf.min_interval, conf.max_interval, 
+			__atomic_load_n(&timings[num], __ATOMIC_RELAXED), threshold, weight);
+	}
 }
\ No newline at end of file
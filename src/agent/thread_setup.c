@@ -0,0 +1,169 @@
+/*
+ * Copyright 2014, 2015 High Performance Computing Center, Stuttgart
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define _GNU_SOURCE			/* pthread_setaffinity_np(), SCHED_BATCH, SCHED_IDLE */
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include "thread_setup.h"
+#include "mf_debug.h"		//functions like log_error(), log_info()...
+
+#define SUCCESS 1
+#define FAILURE 0
+/* word and bit of a cpu in the bit mask */
+#define CPU_WORD(cpu) ((cpu) / (8 * sizeof(unsigned long)))
+#define CPU_BIT(cpu) (1UL << ((cpu) % (8 * sizeof(unsigned long))))
+
+/*******************************************************************************
+ * Variable Declarations
+ ******************************************************************************/
+/* names of the scheduling policies in mf_config.ini */
+static const char *policy_names[] = { "other", "batch", "idle", "fifo", "rr" };
+static const int policies[] = { SCHED_OTHER, SCHED_BATCH, SCHED_IDLE, SCHED_FIFO, SCHED_RR };
+
+/*******************************************************************************
+ * Forward Declarations
+ ******************************************************************************/
+static int parse_cpus(ThreadSetup *setup, const char *value);
+
+/*******************************************************************************
+ * Functions implementation
+ ******************************************************************************/
+/* keep everything inherited */
+void ThreadSetup_init(ThreadSetup *setup)
+{
+	memset(setup, 0, sizeof(ThreadSetup));
+	setup->policy = SCHED_OTHER;
+}
+
+/* set one option of the thread class */
+int ThreadSetup_set(ThreadSetup *setup, const char *option, const char *value)
+{
+	int i;
+	char *end;
+
+	if (strcmp(option, "cpus") == 0) {
+		return parse_cpus(setup, value);
+	}
+	if (strcmp(option, "policy") == 0) {
+		for (i = 0; i < sizeof(policies) / sizeof(policies[0]); i++) {
+			if (strcmp(value, policy_names[i]) == 0) {
+				setup->set_policy = 1;
+				setup->policy = policies[i];
+				return SUCCESS;
+			}
+		}
+		return FAILURE;
+	}
+	if (strcmp(option, "priority") == 0) {
+		setup->priority = strtol(value, &end, 10);
+		return (end != value && *end == '\0') ? SUCCESS : FAILURE;
+	}
+	if (strcmp(option, "nice") == 0) {
+		setup->nice = strtol(value, &end, 10);
+		setup->set_nice = (end != value && *end == '\0');
+		return setup->set_nice ? SUCCESS : FAILURE;
+	}
+	return FAILURE;
+}
+
+/* apply the settings to the calling thread; each setting is tried, even if another one fails */
+int ThreadSetup_apply(const ThreadSetup *setup, const char *thread_class)
+{
+	int i, ret, result = SUCCESS;
+
+	if (setup->num_cpus > 0) {
+		cpu_set_t cpus;
+		CPU_ZERO(&cpus);
+		for (i = 0; i < THREAD_SETUP_MAX_CPUS && i < CPU_SETSIZE; i++) {
+			if (setup->cpus[CPU_WORD(i)] & CPU_BIT(i)) {
+				CPU_SET(i, &cpus);
+			}
+		}
+		ret = pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &cpus);
+		if (ret) {
+			log_warn("Cannot set the cpu affinity of the %s thread: %s\n", thread_class, strerror(ret));
+			result = FAILURE;
+		}
+	}
+
+	if (setup->set_policy) {
+		struct sched_param param;
+		memset(&param, 0, sizeof(param));
+		if (setup->policy == SCHED_FIFO || setup->policy == SCHED_RR) {
+			param.sched_priority = setup->priority;
+		}
+		ret = pthread_setschedparam(pthread_self(), setup->policy, &param);
+		if (ret) {
+			log_warn("Cannot set the scheduling policy of the %s thread: %s\n", thread_class, strerror(ret));
+			result = FAILURE;
+		}
+	}
+
+	/* on Linux, the nice level is an attribute of each thread */
+	if (setup->set_nice) {
+		if (setpriority(PRIO_PROCESS, (id_t) syscall(SYS_gettid), setup->nice) != 0) {
+			log_warn("Cannot set the nice level of the %s thread: %s\n", thread_class, strerror(errno));
+			result = FAILURE;
+		}
+	}
+	return result;
+}
+
+/* parse a list of cpus like "0,2-3"; an empty list keeps the inherited affinity */
+static int parse_cpus(ThreadSetup *setup, const char *value)
+{
+	const char *ptr = value;
+	char *end;
+
+	memset(setup->cpus, 0, sizeof(setup->cpus));
+	setup->num_cpus = 0;
+	while (*ptr != '\0') {
+		long first = strtol(ptr, &end, 10);
+		long last = first;
+		if (end == ptr || first < 0) {
+			return FAILURE;
+		}
+		ptr = end;
+		if (*ptr == '-') {
+			last = strtol(ptr + 1, &end, 10);
+			if (end == ptr + 1 || last < first) {
+				return FAILURE;
+			}
+			ptr = end;
+		}
+		if (last >= THREAD_SETUP_MAX_CPUS) {
+			return FAILURE;
+		}
+		for (; first <= last; first++) {
+			if (!(setup->cpus[CPU_WORD(first)] & CPU_BIT(first))) {
+				setup->cpus[CPU_WORD(first)] |= CPU_BIT(first);
+				setup->num_cpus++;
+			}
+		}
+		if (*ptr == ',') {
+			ptr++;
+		} else if (*ptr != '\0') {
+			return FAILURE;
+		}
+	}
+	return SUCCESS;
+}
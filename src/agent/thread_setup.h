@@ -0,0 +1,63 @@
+/*
+ * Copyright 2014, 2015 High Performance Computing Center, Stuttgart
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef THREAD_SETUP_H_
+#define THREAD_SETUP_H_
+
+/* highest number of cpus, which can be used in a cpu list */
+#define THREAD_SETUP_MAX_CPUS 1024
+#define THREAD_SETUP_CPU_WORDS (THREAD_SETUP_MAX_CPUS / (8 * sizeof(unsigned long)))
+
+/**
+ * @brief CPU affinity and scheduling settings of a class of agent threads
+ *
+ * The settings are applied by each thread to itself when it starts, so that
+ * the sampling, publisher and configuration threads can be kept away from the
+ * cores of the monitored application, e.g. on a housekeeping CPU set.
+ */
+typedef struct ThreadSetup_t {
+	int num_cpus;			/* number of cpus in the set; 0 keeps the inherited affinity */
+	unsigned long cpus[THREAD_SETUP_CPU_WORDS];	/* bit mask of the cpus */
+	int set_policy;			/* set if the scheduling policy is to be changed */
+	int policy;				/* SCHED_OTHER, SCHED_BATCH, SCHED_IDLE, SCHED_FIFO or SCHED_RR */
+	int priority;			/* static priority for SCHED_FIFO and SCHED_RR */
+	int set_nice;			/* set if the nice level is to be changed */
+	int nice;
+} ThreadSetup;
+
+/**
+ * @brief Initializes the settings, which keep everything inherited from the agent
+ */
+void ThreadSetup_init(ThreadSetup *setup);
+
+/**
+ * @brief Sets one option from its textual value
+ *
+ * The options are "cpus" (a list like 0,2-3), "policy" (other, batch, idle,
+ * fifo or rr), "priority" and "nice".
+ *
+ * @returns 1 on success; 0 if the option or value is invalid
+ */
+int ThreadSetup_set(ThreadSetup *setup, const char *option, const char *value);
+
+/**
+ * @brief Applies the settings to the calling thread
+ *
+ * @returns 1 on success; 0 if any of the settings could not be applied
+ */
+int ThreadSetup_apply(const ThreadSetup *setup, const char *thread_class);
+
+#endif /* THREAD_SETUP_H_ */
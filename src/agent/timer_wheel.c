@@ -0,0 +1,174 @@
+/*
+ * Copyright 2014, 2015 High Performance Computing Center, Stuttgart
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdlib.h>
+#include "timer_wheel.h"
+
+#define TW_MASK (TW_SLOTS - 1)
+/* largest distance in ticks which can be stored in the wheel */
+#define TW_MAX_DELTA ((1ULL << (TW_LEVELS * TW_SLOT_BITS)) - 1)
+
+/*******************************************************************************
+ * Forward Declarations
+ ******************************************************************************/
+static void place_entry(TimerWheel *tw, TimerWheelEntry *entry);
+static void cascade(TimerWheel *tw, int level);
+
+/*******************************************************************************
+ * Functions implementation
+ ******************************************************************************/
+/* Create an empty timer wheel */
+TimerWheel* TimerWheel_new(void)
+{
+	TimerWheel *tw = calloc(1, sizeof(TimerWheel));
+	return tw;
+}
+
+/* Free the timer wheel, entries are owned by the caller */
+void TimerWheel_free(TimerWheel *tw)
+{
+	free(tw);
+}
+
+/* Add an entry which expires at the given tick */
+void TimerWheel_add(TimerWheel *tw, TimerWheelEntry *entry, unsigned long long expires)
+{
+	if (expires <= tw->now) {
+		expires = tw->now + 1;
+	}
+	entry->expires = expires;
+	place_entry(tw, entry);
+	tw->count++;
+}
+
+/* Remove an entry from whichever slot it has been placed or cascaded to */
+int TimerWheel_remove(TimerWheel *tw, TimerWheelEntry *entry)
+{
+	int level, index;
+
+	for (level = 0; level < TW_LEVELS; level++) {
+		for (index = 0; index < TW_SLOTS; index++) {
+			TimerWheelEntry **link;
+			for (link = &tw->slots[level][index]; *link != NULL; link = &(*link)->next) {
+				if (*link == entry) {
+					*link = entry->next;
+					entry->next = NULL;
+					tw->count--;
+					return 1;
+				}
+			}
+		}
+	}
+	return 0;
+}
+
+/* Advance the wheel tick by tick up to the given tick, collecting all expired entries */
+TimerWheelEntry* TimerWheel_advance(TimerWheel *tw, unsigned long long until)
+{
+	TimerWheelEntry *expired = NULL;
+	int level;
+
+	while (tw->now < until) {
+		tw->now++;
+
+		/* cascade the upper levels, whenever the level below wraps around */
+		for (level = 1; level < TW_LEVELS; level++) {
+			if ((tw->now & ((1ULL << (level * TW_SLOT_BITS)) - 1)) != 0) {
+				break;
+			}
+			cascade(tw, level);
+		}
+
+		int index = tw->now & TW_MASK;
+		TimerWheelEntry *entry = tw->slots[0][index];
+		tw->slots[0][index] = NULL;
+		while (entry != NULL) {
+			TimerWheelEntry *next = entry->next;
+			entry->next = expired;
+			expired = entry;
+			tw->count--;
+			entry = next;
+		}
+
+		/* nothing left, jump directly to the target tick */
+		if (tw->count == 0) {
+			tw->now = until;
+		}
+	}
+	return expired;
+}
+
+/* Get the earliest expiry of all entries in the wheel */
+int TimerWheel_next_expiry(TimerWheel *tw, unsigned long long *expires)
+{
+	int level, index, found = 0;
+	unsigned long long min = 0;
+
+	for (level = 0; level < TW_LEVELS; level++) {
+		for (index = 0; index < TW_SLOTS; index++) {
+			TimerWheelEntry *entry;
+			for (entry = tw->slots[level][index]; entry != NULL; entry = entry->next) {
+				if (!found || entry->expires < min) {
+					min = entry->expires;
+					found = 1;
+				}
+			}
+		}
+	}
+	if (found) {
+		*expires = min;
+	}
+	return found;
+}
+
+/* Link an entry into the slot of the lowest level that covers its expiry */
+static void place_entry(TimerWheel *tw, TimerWheelEntry *entry)
+{
+	unsigned long long expires = entry->expires;
+	unsigned long long delta = expires - tw->now;
+	int level = 0;
+
+	if (expires < tw->now) {
+		expires = tw->now;
+		delta = 0;
+	}
+	/* entries too far in the future are parked at the end of the top level */
+	if (delta > TW_MAX_DELTA) {
+		expires = tw->now + TW_MAX_DELTA;
+		delta = TW_MAX_DELTA;
+	}
+	while (level < TW_LEVELS - 1 && delta >= (1ULL << ((level + 1) * TW_SLOT_BITS))) {
+		level++;
+	}
+
+	int index = (expires >> (level * TW_SLOT_BITS)) & TW_MASK;
+	entry->next = tw->slots[level][index];
+	tw->slots[level][index] = entry;
+}
+
+/* Move all entries of the current slot of the given level to the levels below */
+static void cascade(TimerWheel *tw, int level)
+{
+	int index = (tw->now >> (level * TW_SLOT_BITS)) & TW_MASK;
+	TimerWheelEntry *entry = tw->slots[level][index];
+	tw->slots[level][index] = NULL;
+
+	while (entry != NULL) {
+		TimerWheelEntry *next = entry->next;
+		place_entry(tw, entry);
+		entry = next;
+	}
+}
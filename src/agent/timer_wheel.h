@@ -0,0 +1,86 @@
+/*
+ * Copyright 2014, 2015 High Performance Computing Center, Stuttgart
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef TIMER_WHEEL_H_
+#define TIMER_WHEEL_H_
+
+#define TW_LEVELS 4
+#define TW_SLOT_BITS 6
+#define TW_SLOTS (1 << TW_SLOT_BITS)
+
+/**
+ * @brief Timer registered in a timer wheel
+ *
+ * Entries are owned by the caller; the wheel only links them into its slots.
+ */
+typedef struct TimerWheelEntry_t {
+	unsigned long long expires;		/* expiry in ticks */
+	int id;							/* caller-defined identifier, e.g. the plug-in number */
+	struct TimerWheelEntry_t *next;
+} TimerWheelEntry;
+
+/**
+ * @brief Hierarchical timer wheel with TW_LEVELS levels of TW_SLOTS slots each
+ *
+ * Level 0 has a resolution of one tick; each further level covers TW_SLOTS
+ * times the range of the level below. Entries are cascaded down a level when
+ * the lower level wraps around.
+ */
+typedef struct TimerWheel_t {
+	unsigned long long now;			/* last processed tick */
+	int count;						/* number of entries in the wheel */
+	TimerWheelEntry *slots[TW_LEVELS][TW_SLOTS];
+} TimerWheel;
+
+/**
+ * @brief Creates an empty timer wheel starting at tick 0
+ */
+TimerWheel* TimerWheel_new(void);
+
+/**
+ * @brief Frees the timer wheel; the entries are not freed
+ */
+void TimerWheel_free(TimerWheel *tw);
+
+/**
+ * @brief Adds an entry to the wheel, which expires at the given tick
+ *
+ * Entries which expire at or before the current tick fire on the next tick.
+ */
+void TimerWheel_add(TimerWheel *tw, TimerWheelEntry *entry, unsigned long long expires);
+
+/**
+ * @brief Removes an entry from the wheel before it expires
+ *
+ * @returns 1 if the entry has been in the wheel; 0 otherwise
+ */
+int TimerWheel_remove(TimerWheel *tw, TimerWheelEntry *entry);
+
+/**
+ * @brief Advances the wheel up to the given tick
+ *
+ * @returns a list of the expired entries, linked by their next pointer
+ */
+TimerWheelEntry* TimerWheel_advance(TimerWheel *tw, unsigned long long until);
+
+/**
+ * @brief Gets the earliest expiry of all entries in the wheel
+ *
+ * @returns 1 if the wheel holds any entry; 0 otherwise
+ */
+int TimerWheel_next_expiry(TimerWheel *tw, unsigned long long *expires);
+
+#endif /* TIMER_WHEEL_H_ */
@@ -1,13 +1,16 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <errno.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <unistd.h>
 #include <time.h>
 #include <dirent.h>
 #include <pthread.h>
+#include <sys/wait.h>
 #include "publisher.h"
+#include "forward.h"
 #include "resources_monitor.h"
 #include "disk_monitor.h"
 #include "power_monitor.h"
@@ -29,6 +32,23 @@ char parameters_name[9][32] = {"MAX_CPU_POWER", "MIN_CPU_POWER",
 	                           "E_NET_SND_PER_KB", "E_NET_RCV_PER_KB"};
 float parameters_value[9];
 
+/* upload of the data files by mf_send(), set by mf_send_option() */
+typedef struct send_job_t {
+	char *metric_URL;
+	char *application_id;
+	char *component_id;
+	char *platform_id;
+	char *experiment_id;
+	char (*files)[256];					//names of the data files
+	int num_files;
+	int next;							//next file to upload
+	int failed;							//files which could not be uploaded
+	pthread_mutex_t lock;
+} send_job;
+
+static int send_workers = 4;
+static int send_detach = 0;
+
 char DataPath[256];
 pthread_t threads[MAX_NUM_METRICS];
 int num_threads;
@@ -41,6 +61,9 @@ FILE *logFile;
  ******************************************************************************/
 static int api_prepare(char *Data_path);
 static void *MonitorStart(void *arg);
+static int list_data_files(char (**files)[256]);
+static void send_files(send_job *job);
+static void *SendStart(void *arg);
 int get_config_parameters(char *server, char *platform_id);
 
 int mf_user_metric_with_timestamp(char *user_defined_time_stamp, char *metric_name, char *value)
@@ -166,46 +189,193 @@ char *mf_send(char *server, char *application_id, char *component_id, char *plat
 
 	/*malloc variables for send metrics */
 	char *metric_URL = calloc(256, sizeof(char));
-	char *static_string = calloc(256, sizeof(char));
-	char *filename = calloc(256, sizeof(char));
-
 	sprintf(metric_URL, "%s/v1/phantom_mf/metrics", server);
 
-	DIR *dir = opendir(DataPath);
-	if(dir == NULL) {
+	send_job job = { metric_URL, application_id, component_id, platform_id, experiment_id };
+	job.num_files = list_data_files(&job.files);
+	if(job.num_files < 0) {
 		printf("Error: Cannot open directory %s\n", DataPath);
+		free(metric_URL);
 		return NULL;
 	}
+	pthread_mutex_init(&job.lock, NULL);
 
-	struct dirent *drp = readdir(dir);
-
-	while(drp != NULL) {
+	if(send_detach) {
+		/* upload in a grandchild which is not waited for, so that the application can exit meanwhile */
+		fflush(stdout);
+		if(logFile != NULL) {
+			fflush(logFile);
+		}
+		pid_t child = fork();
+		if(child == 0) {
+			if(fork() == 0) {
+				setsid();
+				/* the connections of the inherited curl handle and aggregator socket belong to the application */
+				publisher_forget_handle();
+				forward_forget_socket();
+				send_files(&job);
+				if(logFile != NULL) {
+					fclose(logFile);
+				}
+				fflush(stdout);
+				_exit(job.failed > 0);
+			}
+			_exit(0);
+		}
+		if(child < 0) {
+			printf("ERROR: fork failed for %s, sending the data files now\n", strerror(errno));
+			send_files(&job);
+		}
+		else {
+			waitpid(child, NULL, 0);
+		}
+	}
+	else {
+		send_files(&job);
+	}
 
-		sprintf(filename, "%s/%s", DataPath, drp->d_name);
-		sprintf(static_string, "\"WorkflowID\":\"%s\", \"TaskID\":\"%s\", \"ExperimentID\":\"%s\", \"type\":\"%s\", \"host\":\"%s\"",
-			application_id, component_id, experiment_id, drp->d_name, platform_id);
-		
-		publish_file(metric_URL, static_string, filename);
+	pthread_mutex_destroy(&job.lock);
+	free(job.files);
+	free(metric_URL);
+	if(logFile != NULL) {
+		fclose(logFile);
+		logFile = NULL;
+	}
+	return experiment_id;
+}
 
-		/*remove the file if user unset keep_local_data_flag */
-		if(keep_local_data_flag == 0) {
-			unlink(filename);
+/*
+Set an option of mf_send: "workers" is the number of files uploaded at the same time,
+"detach" ("on" or "off") lets mf_send return before the upload is finished.
+Other options are passed to the publisher, e.g. "compression".
+Return 1 on success; 0 if the value is invalid; -1 if the option is unknown
+*/
+int mf_send_option(const char *name, const char *value)
+{
+	if(name == NULL || value == NULL) {
+		return 0;
+	}
+	if(strcmp(name, "workers") == 0) {
+		char *end;
+		long workers = strtol(value, &end, 10);
+		if(*value == '\0' || *end != '\0' || workers < 1 || workers > MAX_SEND_WORKERS) {
+			return 0;
+		}
+		send_workers = (int) workers;
+		return 1;
+	}
+	if(strcmp(name, "detach") == 0) {
+		if(strcmp(value, "on") == 0) {
+			send_detach = 1;
+		}
+		else if(strcmp(value, "off") == 0) {
+			send_detach = 0;
 		}
+		else {
+			return 0;
+		}
+		return 1;
+	}
+	return publisher_set_option(name, value);
+}
+
+/*
+Collect the names of the regular files in DataPath
+Return the number of files, or -1 if the directory cannot be read
+*/
+static int list_data_files(char (**files)[256])
+{
+	int num = 0, size = 16;
+	char filename[512];
+	struct stat st;
 
-		/*get the next entry */
-		drp = readdir(dir);
-		memset(static_string, '\0', 256);	
-		memset(filename, '\0', 256);	
+	DIR *dir = opendir(DataPath);
+	if(dir == NULL) {
+		return -1;
 	}
+	*files = malloc(size * sizeof(**files));
 
+	struct dirent *drp;
+	while((drp = readdir(dir)) != NULL) {
+		snprintf(filename, sizeof(filename), "%s/%s", DataPath, drp->d_name);
+		if(stat(filename, &st) != 0 || !S_ISREG(st.st_mode) || strlen(drp->d_name) >= 256) {
+			continue;
+		}
+		if(num == size) {
+			size *= 2;
+			*files = realloc(*files, size * sizeof(**files));
+		}
+		strcpy((*files)[num++], drp->d_name);
+	}
 	closedir(dir);
-	fclose(logFile);
+	return num;
+}
 
+/*
+Upload the data files with up to send_workers threads; the calling thread uploads as well.
+Remove the data directory afterwards if user unset keep_local_data_flag
+*/
+static void send_files(send_job *job)
+{
+	int t, num_workers = send_workers;
+	if(num_workers > job->num_files) {
+		num_workers = job->num_files;
+	}
+	pthread_t workers[MAX_SEND_WORKERS];
+
+	for (t = 1; t < num_workers; t++) {
+		if(pthread_create(&workers[t], NULL, SendStart, job) != 0) {
+			break;
+		}
+	}
+	SendStart(job);
+	while (--t > 0) {
+		pthread_join(workers[t], NULL);
+	}
+
+	if(job->failed > 0) {
+		printf("ERROR: %d of %d data files could not be sent, they are kept in %s\n",
+			job->failed, job->num_files, DataPath);
+	}
 	/*remove the data directory if user unset keep_local_data_flag */
-	if(keep_local_data_flag == 0) {
+	if(keep_local_data_flag == 0 && job->failed == 0) {
 		rmdir(DataPath);
 	}
-	return experiment_id;
+}
+
+/*
+Upload the files of the job one after the other, until none is left
+*/
+static void *SendStart(void *arg)
+{
+	send_job *job = (send_job *) arg;
+	char static_string[1024];
+	char filename[512];
+
+	for (;;) {
+		pthread_mutex_lock(&job->lock);
+		int i = job->next++;
+		pthread_mutex_unlock(&job->lock);
+		if(i >= job->num_files) {
+			break;
+		}
+
+		snprintf(filename, sizeof(filename), "%s/%s", DataPath, job->files[i]);
+		snprintf(static_string, sizeof(static_string), "\"WorkflowID\":\"%s\", \"TaskID\":\"%s\", \"ExperimentID\":\"%s\", \"type\":\"%s\", \"host\":\"%s\"",
+			job->application_id, job->component_id, job->experiment_id, job->files[i], job->platform_id);
+
+		if(publish_file(job->metric_URL, static_string, filename) == 0) {
+			pthread_mutex_lock(&job->lock);
+			job->failed++;
+			pthread_mutex_unlock(&job->lock);
+			continue;
+		}
+		/*remove the file if user unset keep_local_data_flag */
+		if(keep_local_data_flag == 0) {
+			unlink(filename);
+		}
+	}
+	return NULL;
 }
 
 /*
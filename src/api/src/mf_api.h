@@ -3,6 +3,7 @@
 
 #define MAX_NUM_METRICS      3
 #define NAME_LENGTH          32
+#define MAX_SEND_WORKERS     64
 
 
 typedef struct metrics_t {
@@ -39,4 +40,12 @@ Return the execution_id
 */
 char *mf_send(char *server, char *application_id, char *component_id, char *platform_id);
 
+/*
+Set an option of mf_send: "workers" is the number of files uploaded at the same time,
+"detach" ("on" or "off") lets mf_send return before the upload is finished.
+Other options are passed to the publisher, e.g. "compression".
+Return 1 on success; 0 if the value is invalid; -1 if the option is unknown
+*/
+int mf_send_option(const char *name, const char *value);
+
 #endif /* _MF_API_H */
\ No newline at end of file
@@ -50,7 +50,7 @@ extern FILE *logFile;
 
 #define clean_errno() (errno == 0 ? "None" : strerror(errno))
 
-#define log_error(M, ...) fprintf(logFile, "[ERROR] (%s:%d) " M " -- %s\n", __FILE__, __LINE__, clean_errno(), ##__VA_ARGS__)
+#define log_error(M, ...) fprintf(logFile, "[ERROR] (%s:%d: errno: %s) " M "\n", __FILE__, __LINE__, clean_errno(), ##__VA_ARGS__)
 
 #define log_warn(M, ...) fprintf(logFile, "[WARN] (%s:%d: errno: %s) " M "\n", __FILE__, __LINE__, clean_errno(), ##__VA_ARGS__)
 
@@ -23,47 +23,151 @@
 
 #include <apr.h>
 #include <apr_hash.h>
+#include <apr_tables.h>
 #include <apr_strings.h>
 #include <apr_general.h>
+#include <pthread.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sched.h>
 
 #include "../libs/ini/ini.h"
 #include "mf_debug.h"
 #include "mf_parser.h"
 
-#define MAKE_DUP(s) apr_pstrdup(mp, s)
+/* a key-value pair of a section */
+typedef struct mfp_entry_t {
+    const char *key;
+    const char *value;
+} mfp_entry;
 
-static apr_pool_t *mp;
-static apr_hash_t *ht_config;
-static int ht_initialized = 0;
+/* one section of the configuration; shared by all snapshots as long as it does not change */
+typedef struct mfp_section_t {
+    apr_pool_t *pool;
+    apr_hash_t *values;             /* key -> mfp_entry */
+    apr_array_header_t *entries;    /* mfp_entry* in the order of the file */
+    int refs;                       /* number of snapshots referencing the section */
+} mfp_section;
+
+/* immutable view of the whole configuration, which is read without locking */
+typedef struct mfp_snapshot_t {
+    apr_pool_t *pool;
+    apr_hash_t *sections;           /* section name -> mfp_section */
+    int refs;                       /* number of readers, plus one while the snapshot is current */
+} mfp_snapshot;
+
+/* sections read from the configuration file by ini_parse() */
+typedef struct mfp_parse_state_t {
+    apr_pool_t *pool;
+    apr_hash_t *sections;           /* section name -> mfp_section */
+} mfp_parse_state;
+
+static mfp_snapshot *current = NULL;
+/* number of readers between loading the current snapshot and referencing it */
+static int acquiring = 0;
+/* serializes all writers and the freeing of snapshots; readers only block to free the last one they used */
+static pthread_mutex_t writer_lock = PTHREAD_MUTEX_INITIALIZER;
+static int apr_initialized = 0;
 
 static int handle_parser(void*, const char*, const char*, const char*);
+static mfp_snapshot* snapshot_acquire(void);
+static void snapshot_release(mfp_snapshot *snapshot);
+static mfp_snapshot* snapshot_new(mfp_snapshot *base, const char *skip);
+static void snapshot_publish(mfp_snapshot *snapshot);
+static void snapshot_free(mfp_snapshot *snapshot);
+static mfp_section* section_new(void);
+static mfp_section* section_copy(const mfp_section *section);
+static void section_release(mfp_section *section);
+static void section_set(mfp_section *section, const char *key, const char *value);
+static mfp_section* section_get(mfp_snapshot *snapshot, const char *name);
+static int section_equal(const mfp_section *a, const mfp_section *b);
+static void changed_add(mfp_data *changed, const char *section, const char *how);
 
 /* Parses a given file */
 int
 mfp_parse(const char* filename)
 {
-    /* Initialize a hash table */
-    apr_initialize();
-    apr_pool_create(&mp, NULL);
-    ht_config = apr_hash_make(mp);
-    ht_initialized = 1;
+    return mfp_reload(filename, NULL);
+}
+
+/* Parses a given file, and replaces only the sections which changed */
+int
+mfp_reload(const char* filename, mfp_data* changed)
+{
+    apr_hash_index_t *ht_index;
+    mfp_parse_state state;
+
+    pthread_mutex_lock(&writer_lock);
+    if (!apr_initialized) {
+        apr_initialize();
+        apr_initialized = 1;
+    }
+    if (changed != NULL) {
+        changed->size = 0;
+    }
 
-    /* Parse a INI file and write the name: value into a harsh table created */
-    int error = ini_parse(filename, handle_parser, ht_config);
+    /* Parse a INI file and write the name: value into the sections of the parse state */
+    apr_pool_create(&state.pool, NULL);
+    state.sections = apr_hash_make(state.pool);
+    int error = ini_parse(filename, handle_parser, &state);
     if (error < 0) {
         log_error("mfp_parse(const char*) Can't load %s", filename);
+        for (ht_index = apr_hash_first(state.pool, state.sections); ht_index; ht_index = apr_hash_next(ht_index)) {
+            mfp_section *section;
+            apr_hash_this(ht_index, NULL, NULL, (void**)&section);
+            section_release(section);
+        }
+        apr_pool_destroy(state.pool);
+        pthread_mutex_unlock(&writer_lock);
         return 0;
     }
 
+    /* keep the sections which did not change, so that only the changed ones are replaced */
+    mfp_snapshot *snapshot = snapshot_new(NULL, NULL);
+    for (ht_index = apr_hash_first(state.pool, state.sections); ht_index; ht_index = apr_hash_next(ht_index)) {
+        const char *name;
+        mfp_section *section;
+        apr_hash_this(ht_index, (const void**)&name, NULL, (void**)&section);
+
+        mfp_section *old = section_get(current, name);
+        if (old != NULL && section_equal(old, section)) {
+            section_release(section);
+            section = old;
+            section->refs++;
+        } else {
+            debug("mfp_reload(..) -- Section changed: %s", name);
+            changed_add(changed, name, (old == NULL) ? "added" : "changed");
+        }
+        apr_hash_set(snapshot->sections, apr_pstrdup(snapshot->pool, name), APR_HASH_KEY_STRING, section);
+    }
+    if (current != NULL) {
+        for (ht_index = apr_hash_first(state.pool, current->sections); ht_index; ht_index = apr_hash_next(ht_index)) {
+            const char *name;
+            apr_hash_this(ht_index, (const void**)&name, NULL, NULL);
+            if (apr_hash_get(snapshot->sections, name, APR_HASH_KEY_STRING) == NULL) {
+                debug("mfp_reload(..) -- Section removed: %s", name);
+                changed_add(changed, name, "removed");
+            }
+        }
+    }
+    apr_pool_destroy(state.pool);
+
+    snapshot_publish(snapshot);
+    pthread_mutex_unlock(&writer_lock);
     return 1;
 }
 
-/* Sets or overwrites the value for a given section and key */
+/* Collects the parsed name: value pairs in the parse state */
 static int
 handle_parser(void* user, const char* section, const char* name, const char* value)
 {
-    mfp_set_value(section, name, value);
+    mfp_parse_state *state = user;
+    mfp_section *ht_values = apr_hash_get(state->sections, section, APR_HASH_KEY_STRING);
+    if (ht_values == NULL) {
+        ht_values = section_new();
+        apr_hash_set(state->sections, apr_pstrdup(state->pool, section), APR_HASH_KEY_STRING, ht_values);
+    }
+    section_set(ht_values, name, value);
     return 1;
 }
 
@@ -71,78 +175,91 @@ handle_parser(void* user, const char* section, const char* name, const char* val
 void
 mfp_set_value(const char* section, const char* key, const char* value)
 {
-    if (!ht_initialized) {
+    pthread_mutex_lock(&writer_lock);
+    if (current == NULL) {
+        pthread_mutex_unlock(&writer_lock);
         return;
     }
 
-    apr_hash_t *ht_values = apr_hash_get(ht_config, section, APR_HASH_KEY_STRING);
-    if (ht_values == NULL) {
+    /* copy the section, and publish it in a new snapshot sharing all other sections */
+    mfp_section *old = section_get(current, section);
+    mfp_section *ht_values;
+    if (old == NULL) {
         debug("mfp_set_value(..) -- Created new hash_table for section: %s", section);
-        ht_values = apr_hash_make(mp);
+        ht_values = section_new();
+    } else {
+        ht_values = section_copy(old);
     }
 
     debug("mfp_set_value(..) -- Set new values <%s,%s>", key, value);
-    apr_hash_set(ht_values, MAKE_DUP(key), APR_HASH_KEY_STRING, MAKE_DUP(value));
-    apr_hash_set(ht_config, MAKE_DUP(section), APR_HASH_KEY_STRING, ht_values);
+    section_set(ht_values, key, value);
+
+    mfp_snapshot *snapshot = snapshot_new(current, section);
+    apr_hash_set(snapshot->sections, apr_pstrdup(snapshot->pool, section), APR_HASH_KEY_STRING, ht_values);
+    snapshot_publish(snapshot);
+    pthread_mutex_unlock(&writer_lock);
 }
 
 /* Returns a stored value for the given section and key */
 void
 mfp_get_value(const char* section, const char* key, char *ret_val)
 {
-    if (!ht_initialized) {
+    mfp_snapshot *snapshot = snapshot_acquire();
+    if (snapshot == NULL) {
         return;
     }
 
-    apr_hash_t *ht_values = apr_hash_get(ht_config, section, APR_HASH_KEY_STRING);
+    mfp_section *ht_values = section_get(snapshot, section);
     if (ht_values == NULL) {
         log_error("mfp_get_value(const char*, const char*) Key does not exist: <%s:%s>", section, key);
+        snapshot_release(snapshot);
         return;
     }
-    const char *ht_key = apr_hash_get(ht_values, key, APR_HASH_KEY_STRING);
-    if (ht_key == NULL) {
+    mfp_entry *entry = apr_hash_get(ht_values->values, key, APR_HASH_KEY_STRING);
+    if (entry == NULL) {
         log_error("mfp_get_value(const char*, const char*) Key does not exist: <%s:%s>", section, key);
+        snapshot_release(snapshot);
         return;
     }
-    strcpy(ret_val, ht_key);
+    strcpy(ret_val, entry->value);
+    snapshot_release(snapshot);
 }
 
 /* Filters the data based on the given filter */
 void
 mfp_get_data_filtered_by_value(const char* section, mfp_data* data, const char* filter_by_value)
 {
-    if (!ht_initialized) {
+    mfp_snapshot *snapshot = snapshot_acquire();
+    if (snapshot == NULL) {
         return;
     }
 
-    apr_hash_index_t *ht_index;
-    apr_hash_t *ht_section;
+    int i;
     data->size = 0;
-    ht_section = apr_hash_get(ht_config, section, APR_HASH_KEY_STRING);
+    mfp_section *ht_section = section_get(snapshot, section);
     if (ht_section == NULL) {
         log_error("mfp_get_data(const char*, mfp_data*) Section does not exist: %s", section);
+        snapshot_release(snapshot);
         return;
     }
-    for (ht_index = apr_hash_first(NULL, ht_section); ht_index; ht_index = apr_hash_next(ht_index)) {
-        const char *key;
-        const char *value;
-
-        apr_hash_this(ht_index, (const void**)&key, NULL, (void**)&value);
+    for (i = 0; i < ht_section->entries->nelts && data->size < 256; i++) {
+        const mfp_entry *entry = APR_ARRAY_IDX(ht_section->entries, i, mfp_entry*);
 
         // filter keys by value
         if (filter_by_value != NULL) {
-            if (strcmp(value, filter_by_value) != 0) {
+            if (strcmp(entry->value, filter_by_value) != 0) {
                 continue;
             }
         }
 
         data->keys[data->size] = malloc(sizeof(char) * 256);
-        strcpy(data->keys[data->size], key);
+        strcpy(data->keys[data->size], entry->key);
         data->values[data->size] = malloc(sizeof(char) * 256);
-        strcpy(data->values[data->size], value);
+        strcpy(data->values[data->size], entry->value);
 
         data->size++;
     }
+    snapshot_release(snapshot);
 }
 
 /* Returns the entire data stored for a given section */
@@ -168,9 +285,194 @@ mfp_data_free(mfp_data* data)
 void
 mfp_parse_clean()
 {
-    if (!ht_initialized) {
+    pthread_mutex_lock(&writer_lock);
+    if (!apr_initialized) {
+        pthread_mutex_unlock(&writer_lock);
         return;
     }
-    apr_pool_destroy(mp);
+    snapshot_publish(NULL);
     apr_terminate();
-}
\ No newline at end of file
+    apr_initialized = 0;
+    pthread_mutex_unlock(&writer_lock);
+}
+
+/* Returns the current snapshot, which stays valid until it is released by snapshot_release() */
+static mfp_snapshot*
+snapshot_acquire(void)
+{
+    /* a writer does not drop the reference of a replaced snapshot while readers may still
+       reference it, i.e. as long as acquiring was not 0 since the snapshot has been replaced */
+    __atomic_add_fetch(&acquiring, 1, __ATOMIC_SEQ_CST);
+    mfp_snapshot *snapshot = __atomic_load_n(&current, __ATOMIC_SEQ_CST);
+    if (snapshot != NULL) {
+        __atomic_add_fetch(&snapshot->refs, 1, __ATOMIC_SEQ_CST);
+    }
+    __atomic_sub_fetch(&acquiring, 1, __ATOMIC_SEQ_CST);
+    return snapshot;
+}
+
+/* Drops the reference of a reader; the last reader of a replaced snapshot frees it */
+static void
+snapshot_release(mfp_snapshot *snapshot)
+{
+    if (__atomic_sub_fetch(&snapshot->refs, 1, __ATOMIC_SEQ_CST) == 0) {
+        /* the references to the sections are only changed by writers */
+        pthread_mutex_lock(&writer_lock);
+        snapshot_free(snapshot);
+        pthread_mutex_unlock(&writer_lock);
+    }
+}
+
+/* Creates a snapshot sharing all sections of the base snapshot, except the skipped one */
+static mfp_snapshot*
+snapshot_new(mfp_snapshot *base, const char *skip)
+{
+    apr_pool_t *pool;
+    apr_hash_index_t *ht_index;
+
+    apr_pool_create(&pool, NULL);
+    mfp_snapshot *snapshot = apr_pcalloc(pool, sizeof(mfp_snapshot));
+    snapshot->pool = pool;
+    snapshot->sections = apr_hash_make(pool);
+    snapshot->refs = 1;
+    if (base == NULL) {
+        return snapshot;
+    }
+
+    for (ht_index = apr_hash_first(pool, base->sections); ht_index; ht_index = apr_hash_next(ht_index)) {
+        const char *name;
+        mfp_section *section;
+        apr_hash_this(ht_index, (const void**)&name, NULL, (void**)&section);
+        if (skip != NULL && strcmp(name, skip) == 0) {
+            continue;
+        }
+        section->refs++;
+        apr_hash_set(snapshot->sections, apr_pstrdup(pool, name), APR_HASH_KEY_STRING, section);
+    }
+    return snapshot;
+}
+
+/* Swaps the current snapshot atomically; the old one is freed by its last reader */
+static void
+snapshot_publish(mfp_snapshot *snapshot)
+{
+    mfp_snapshot *old = current;
+    __atomic_store_n(&current, snapshot, __ATOMIC_SEQ_CST);
+    if (old == NULL) {
+        return;
+    }
+
+    /* wait until the readers which loaded the old snapshot have referenced it */
+    while (__atomic_load_n(&acquiring, __ATOMIC_SEQ_CST) != 0) {
+        sched_yield();
+    }
+    if (__atomic_sub_fetch(&old->refs, 1, __ATOMIC_SEQ_CST) == 0) {
+        snapshot_free(old);
+    }
+}
+
+/* Frees a snapshot and all sections not referenced by other snapshots */
+static void
+snapshot_free(mfp_snapshot *snapshot)
+{
+    apr_hash_index_t *ht_index;
+    for (ht_index = apr_hash_first(snapshot->pool, snapshot->sections); ht_index; ht_index = apr_hash_next(ht_index)) {
+        mfp_section *section;
+        apr_hash_this(ht_index, NULL, NULL, (void**)&section);
+        section_release(section);
+    }
+    apr_pool_destroy(snapshot->pool);
+}
+
+/* Creates an empty section with its own pool */
+static mfp_section*
+section_new(void)
+{
+    apr_pool_t *pool;
+    apr_pool_create(&pool, NULL);
+    mfp_section *section = apr_pcalloc(pool, sizeof(mfp_section));
+    section->pool = pool;
+    section->values = apr_hash_make(pool);
+    section->entries = apr_array_make(pool, 16, sizeof(mfp_entry*));
+    section->refs = 1;
+    return section;
+}
+
+/* Creates a private copy of a section */
+static mfp_section*
+section_copy(const mfp_section *section)
+{
+    int i;
+    mfp_section *copy = section_new();
+    for (i = 0; i < section->entries->nelts; i++) {
+        const mfp_entry *entry = APR_ARRAY_IDX(section->entries, i, mfp_entry*);
+        section_set(copy, entry->key, entry->value);
+    }
+    return copy;
+}
+
+/* Drops one reference to a section, and frees it if it is not used anymore */
+static void
+section_release(mfp_section *section)
+{
+    if (--section->refs == 0) {
+        apr_pool_destroy(section->pool);
+    }
+}
+
+/* Sets or overwrites a value of a section, which is not published yet */
+static void
+section_set(mfp_section *section, const char *key, const char *value)
+{
+    mfp_entry *entry = apr_hash_get(section->values, key, APR_HASH_KEY_STRING);
+    if (entry == NULL) {
+        entry = apr_palloc(section->pool, sizeof(mfp_entry));
+        entry->key = apr_pstrdup(section->pool, key);
+        APR_ARRAY_PUSH(section->entries, mfp_entry*) = entry;
+        apr_hash_set(section->values, entry->key, APR_HASH_KEY_STRING, entry);
+    }
+    entry->value = apr_pstrdup(section->pool, value);
+}
+
+/* Returns the section of the given name, or NULL */
+static mfp_section*
+section_get(mfp_snapshot *snapshot, const char *name)
+{
+    if (snapshot == NULL) {
+        return NULL;
+    }
+    return apr_hash_get(snapshot->sections, name, APR_HASH_KEY_STRING);
+}
+
+/* Returns 1 if both sections hold the same key-value pairs in the same order; 0 otherwise */
+static int
+section_equal(const mfp_section *a, const mfp_section *b)
+{
+    int i;
+    if (a->entries->nelts != b->entries->nelts) {
+        return 0;
+    }
+    for (i = 0; i < a->entries->nelts; i++) {
+        const mfp_entry *entry_a = APR_ARRAY_IDX(a->entries, i, mfp_entry*);
+        const mfp_entry *entry_b = APR_ARRAY_IDX(b->entries, i, mfp_entry*);
+        if (strcmp(entry_a->key, entry_b->key) != 0 || strcmp(entry_a->value, entry_b->value) != 0) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/* Records a changed section, if the caller asked for them */
+static void
+changed_add(mfp_data *changed, const char *section, const char *how)
+{
+    if (changed == NULL || changed->size >= 256) {
+        return;
+    }
+    changed->keys[changed->size] = malloc(sizeof(char) * 256);
+    strncpy(changed->keys[changed->size], section, 255);
+    changed->keys[changed->size][255] = '\0';
+    changed->values[changed->size] = malloc(sizeof(char) * 256);
+    strcpy(changed->values[changed->size], how);
+    changed->size++;
+}
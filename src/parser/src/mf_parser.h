@@ -36,14 +36,27 @@ typedef struct {
 /**
  * @brief Parses a given file.
  *
- * It should be noted that each time this function is called, the internal data
- * structure is cleared in advanced. This might currently result in some
- * inconsistencies while accessing the data in a concurrent setting.
+ * The parsed configuration is published as an immutable snapshot, which
+ * replaces the previous one atomically. Concurrent readers keep using the
+ * previous snapshot until they are done; its last reader frees it.
+ * If the file cannot be parsed, the previous configuration is kept.
  *
  * @return 1 if successful; 0 otherwise.
  */
 int mfp_parse(const char* filename);
 
+/**
+ * @brief Parses a given file again, and replaces only the changed sections.
+ *
+ * Sections which did not change are shared with the previous snapshot. The
+ * names of the added, changed, and removed sections are stored as keys in
+ * changed, with the values "added", "changed", and "removed"; changed may be
+ * NULL.
+ *
+ * @return 1 if successful; 0 otherwise.
+ */
+int mfp_reload(const char* filename, mfp_data* changed);
+
 /**
  * @brief Returns a stored value for the given section and key.
  *
@@ -19,6 +19,7 @@
 #include <time.h>
 #include <iio.h>
 #include "mf_Board_power_connector.h"
+#include <mf_json.h>
 
 #define SUCCESS 1
 #define FAILURE 0
@@ -29,6 +30,8 @@
 /*******************************************************************************
  * Variable Declarations
  ******************************************************************************/
+static MF_json_template json_template;
+
 struct my_channel {
 	char label[128];
 	char unit[128];
@@ -70,6 +73,8 @@ void reset_my_channels_value();
  */
 int mf_Board_power_init(Plugin_metrics *data, char **events, size_t num_events, char *acme_name)
 {
+	int i, ii;
+
 	if(!mf_acme_is_enabled(acme_name)) {
 		return FAILURE;
 	}
@@ -77,6 +82,16 @@ int mf_Board_power_init(Plugin_metrics *data, char **events, size_t num_events,
 	if(!create_EventSets(data, events, num_events)) {
 		return FAILURE;
 	}
+
+	/* select the metrics of the given events once, in the order of the events */
+	mf_json_template_init(&json_template, "Board_power");
+	for (i = 0; i < num_events; i++) {
+		for (ii = 0; ii < data->num_events; ii++) {
+			if (strcmp(events[i], data->events[ii]) == 0) {
+				mf_json_template_add(&json_template, ii, data->events[ii]);
+			}
+		}
+	}
 	return SUCCESS;
 }
 
@@ -111,32 +126,58 @@ int mf_Board_power_sample(Plugin_metrics *data){
  *  json string contains: plugin name, timestamps, metrics_name and metrics_value
  *
  */
-void mf_Board_power_to_json(Plugin_metrics *data, char **events, size_t num_events, char *json)
+void mf_Board_power_to_json(Plugin_metrics *data, char *json)
 {
 	struct timespec timestamp;
-    char tmp[128] = {'\0'};
+    MF_json out;
     int i, ii;
     /*
      * prepares the json string, including current timestamp, and name of the plugin
      */
-    sprintf(json, "\"type\":\"Board_power\"");
+    mf_json_init_fixed(&out, json, JSON_MAX_LEN);
+    mf_json_template_type(&out, &json_template);
     clock_gettime(CLOCK_REALTIME, &timestamp);
     double ts = timestamp.tv_sec * 1.0e3 + (double)(timestamp.tv_nsec / 1.0e6); // in millisecond
-    sprintf(tmp, ",\"local_timestamp\":\"%.1f\"", ts);
-    strcat(json, tmp);
+    mf_json_literal(&out, ",\"local_timestamp\":\"");
+    mf_json_number(&out, ts, 1);
+    mf_json_literal(&out, "\"");
 
     /*
-     * filters the sampled data with respect to metrics given
+     * appends the metrics selected at init, with the names prepared in the template
      */
-	for (i = 0; i < num_events; i++) {
-		for(ii = 0; ii < data->num_events; ii++) {
-			/* if metrics' name matches, append the metrics to the json string */
-			if(strcmp(events[i], data->events[ii]) == 0) {
-				sprintf(tmp, ",\"%s\":%.3f", data->events[ii], data->values[ii]);
-				strcat(json, tmp);
-			}
-		}
+	for (i = 0; i < json_template.num_metrics; i++) {
+		ii = json_template.index[i];
+		mf_json_template_metric(&out, &json_template, i, data->values[ii]);
+	}
+}
+
+/** @brief Selects the sampled metrics to be published into a Plugin_sample
+ *
+ *  the sample contains: plugin name, timestamp, and the names and values of the metrics selected at init,
+ *  whose json fragments the plugin prepared once in a template;
+ *  it is serialized by the agent only when it is published
+ *
+ */
+void mf_Board_power_to_sample(Plugin_metrics *data, Plugin_sample *sample)
+{
+	struct timespec timestamp;
+	int i, ii, n = 0;
+	sample->type = json_template.type;
+	sample->json = &json_template;
+	clock_gettime(CLOCK_REALTIME, &timestamp);
+	sample->timestamp = timestamp.tv_sec * 1.0e3 + (double)(timestamp.tv_nsec / 1.0e6); // in millisecond
+
+	/*
+	 * adds the metrics selected at init to the sample, with the index of their names in the template
+	 */
+	for (i = 0; i < json_template.num_metrics; i++) {
+		ii = json_template.index[i];
+		sample->metrics.events[n] = data->events[ii];
+		sample->metrics.values[n] = data->values[ii];
+		sample->keys[n] = i;
+		n++;
 	}
+	sample->metrics.num_events = n;
 }
 
 /** @brief Stops the plugin
@@ -76,7 +76,7 @@ int main(int argc, char** argv)
          * and required metrics.
          */
         char *json = calloc(JSON_MAX_LEN, sizeof(char));
-        mf_Board_power_to_json(monitoring_data, argv, argc, json);
+        mf_Board_power_to_json(monitoring_data, json);
         
         /*
          * Display and free the json string
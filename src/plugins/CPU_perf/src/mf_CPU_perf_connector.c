@@ -19,6 +19,7 @@
 #include <time.h>
 #include <papi.h>
 #include "mf_CPU_perf_connector.h"
+#include <mf_json.h>
 
 #define SUCCESS 1
 #define FAILURE 0
@@ -27,6 +28,7 @@
 /*******************************************************************************
  * Variable Declarations
  ******************************************************************************/
+static MF_json_template json_template;
 static int DEFAULT_CPU_COMPONENT = 0;
 const int PAPI_EVENTS[PAPI_EVENTS_NUM] = {PAPI_FP_INS, PAPI_FP_OPS, PAPI_TOT_INS};
 const char CPU_perf_metrics[PAPI_EVENTS_NUM][16] = {"MFLIPS", "MFLOPS", "MIPS"};
@@ -116,6 +118,16 @@ int mf_CPU_perf_init(Plugin_metrics *data, char **events, size_t num_events, int
 	}
 	data->num_events = jj;
 
+	/* select the metrics of the given events once, in the order of the events */
+	mf_json_template_init(&json_template, "CPU_perf");
+	for (i = 0; i < num_events; i++) {
+		for (ii = 0; ii < data->num_events; ii++) {
+			if (strstr(data->events[ii], events[i]) != NULL) {
+				mf_json_template_add(&json_template, ii, data->events[ii]);
+			}
+		}
+	}
+
 	/* Start counting events */
 	before_time = PAPI_get_real_nsec();
 	
@@ -165,37 +177,68 @@ int mf_CPU_perf_sample(Plugin_metrics *data, int num_cores)
  *  json string contains: plugin name, timestamps, metrics_name and metrics_value
  *
  */
-void mf_CPU_perf_to_json(Plugin_metrics *data, char **events, size_t num_events, char *json)
+void mf_CPU_perf_to_json(Plugin_metrics *data, char *json)
 {
 	struct timespec timestamp;
-    char tmp[128] = {'\0'};
+    MF_json out;
     int i, ii;
     /*
      * prepares the json string, including current timestamp, and name of the plugin
      */
-    sprintf(json, "\"type\":\"CPU_perf\"");
+    mf_json_init_fixed(&out, json, JSON_MAX_LEN);
+    mf_json_template_type(&out, &json_template);
     clock_gettime(CLOCK_REALTIME, &timestamp);
     double ts = timestamp.tv_sec * 1.0e3 + (double)(timestamp.tv_nsec / 1.0e6); // in millisecond
-    sprintf(tmp, ",\"local_timestamp\":\"%.1f\"", ts);
-    strcat(json, tmp);
+    mf_json_literal(&out, ",\"local_timestamp\":\"");
+    mf_json_number(&out, ts, 1);
+    mf_json_literal(&out, "\"");
 
     /*
-     * filters the sampled data with respect to metrics given
+     * appends the metrics selected at init, with the names prepared in the template
      */
-	for (i = 0; i < num_events; i++) {
-		for(ii = 0; ii < data->num_events; ii++) {
-			/* if metrics' name matches, append the metrics to the json string */
-			if((strstr(data->events[ii], events[i]) != NULL) && (data->values[ii] > 0.0)) {
-				sprintf(tmp, ",\"%s\":%.3f", data->events[ii], data->values[ii]);
-				strcat(json, tmp);
-			}
+	for (i = 0; i < json_template.num_metrics; i++) {
+		ii = json_template.index[i];
+		if(data->values[ii] > 0.0) {
+			mf_json_template_metric(&out, &json_template, i, data->values[ii]);
+		}
+	}
+}
+
+/** @brief Selects the sampled metrics to be published into a Plugin_sample
+ *
+ *  the sample contains: plugin name, timestamp, and the names and values of the metrics selected at init,
+ *  whose json fragments the plugin prepared once in a template;
+ *  it is serialized by the agent only when it is published
+ *
+ */
+void mf_CPU_perf_to_sample(Plugin_metrics *data, Plugin_sample *sample)
+{
+	struct timespec timestamp;
+	int i, ii, n = 0;
+	sample->type = json_template.type;
+	sample->json = &json_template;
+	clock_gettime(CLOCK_REALTIME, &timestamp);
+	sample->timestamp = timestamp.tv_sec * 1.0e3 + (double)(timestamp.tv_nsec / 1.0e6); // in millisecond
+
+	/*
+	 * adds the metrics selected at init to the sample, with the index of their names in the template
+	 */
+	for (i = 0; i < json_template.num_metrics; i++) {
+		ii = json_template.index[i];
+		if(data->values[ii] > 0.0) {
+			sample->metrics.events[n] = data->events[ii];
+			sample->metrics.values[n] = data->values[ii];
+			sample->keys[n] = i;
+			n++;
 		}
 	}
+	sample->metrics.num_events = n;
 }
 
 /** @brief Stops the plugin
  *
- *  This methods stops papi counters gracefully;
+ *  This methods stops papi counters gracefully; only the EventSets of this
+ *  plugin are destroyed, since other plugins may still use the PAPI library
  *
  */
 void mf_CPU_perf_shutdown(int num_cores)
@@ -220,7 +263,6 @@ void mf_CPU_perf_shutdown(int num_cores)
     	    fprintf(stderr, "Couldn't destroy PAPI EventSet: %s", error);
     	}
 	}
-	PAPI_shutdown();
 }
 
 /* Load the PAPI library */
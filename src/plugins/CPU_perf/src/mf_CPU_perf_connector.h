@@ -35,15 +35,27 @@ int mf_CPU_perf_sample(Plugin_metrics *data, int num_cores);
 
 /** @brief Formats the sampling data into a json string
  *
- *  json string contains: plugin name, timestamps, metrics_name and metrics_value
+ *  json string contains: plugin name, timestamps, metrics_name and metrics_value;
+ *  json holds JSON_MAX_LEN bytes, metrics which do not fit are left out
  *
  */
-void mf_CPU_perf_to_json(Plugin_metrics *data, char **events, size_t num_events, char *json);
+void mf_CPU_perf_to_json(Plugin_metrics *data, char *json);
+
+
+/** @brief Selects the sampled metrics to be published into a Plugin_sample
+ *
+ *  the sample contains: plugin name, timestamp, and the names and values of the metrics selected at init,
+ *  whose json fragments the plugin prepared once in a template;
+ *  it is serialized by the agent only when it is published
+ *
+ */
+void mf_CPU_perf_to_sample(Plugin_metrics *data, Plugin_sample *sample);
 
 
 /** @brief Stops the plugin
  *
- *  This methods shuts down gracefully for sampling.
+ *  This methods shuts down gracefully for sampling; it destroys the EventSets
+ *  of the plugin, but leaves the PAPI library to be shut down by its last user.
  */
 void mf_CPU_perf_shutdown(int num_cores);
 
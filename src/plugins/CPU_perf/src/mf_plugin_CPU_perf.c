@@ -17,6 +17,7 @@
 #include <stdlib.h> /* malloc etc */
 #include <string.h>
 #include <time.h>
+#include <papi.h> /* PAPI_shutdown */
 #include <plugin_manager.h> /* mf_plugin_xxx_hook */
 #include <mf_parser.h> /* mfp_data */
 #include <mf_debug.h>
@@ -34,7 +35,7 @@ int num_cores = 1;
 /*******************************************************************************
  * Forward Declarations
  ******************************************************************************/
-char* mf_plugin_CPU_perf_hook();
+int mf_plugin_CPU_perf_hook(Plugin_sample *sample);
 
 /*******************************************************************************
  * Functions implementation
@@ -62,8 +63,10 @@ init_mf_plugin_CPU_perf(PluginManager *pm)
      * initialize the monitoring data
      */
     monitoring_data = malloc(sizeof(Plugin_metrics));
+    PluginManager_library_acquire("papi");
     int ret = mf_CPU_perf_init(monitoring_data, conf_data->keys, conf_data->size, num_cores);
     if(ret == 0) {
+        PluginManager_library_release("papi");
         char plugin_name[] = "CPU_perf";
         log_error("Plugin %s init function failed.\n", plugin_name);
         return ret;
@@ -72,14 +75,15 @@ init_mf_plugin_CPU_perf(PluginManager *pm)
     /*
      * if init succeed; register the plugin hook to the plugin manager
      */
-    PluginManager_register_hook(pm, "mf_plugin_CPU_perf", mf_plugin_CPU_perf_hook);
+    PluginManager_register_sample_hook(pm, "mf_plugin_CPU_perf", mf_plugin_CPU_perf_hook);
     is_initialized = 1;
     return ret;
 }
 
-/* the hook function, sample the metrics and convert to a json-formatted string */
-char*
-mf_plugin_CPU_perf_hook()
+/* the hook function, sample the metrics and hand them to the agent as a binary sample 
+   @return 1 if a sample was taken; 0 otherwise */
+int
+mf_plugin_CPU_perf_hook(Plugin_sample *sample)
 {
     if (is_initialized) {
         /*
@@ -88,14 +92,45 @@ mf_plugin_CPU_perf_hook()
         mf_CPU_perf_sample(monitoring_data, num_cores);
 
         /*
-         * Prepares a json string, including current timestamp, name of the plugin,
-         * and required metrics.
+         * Selects the required metrics into the sample, including current timestamp
+         * and name of the plugin; the agent serializes the sample when publishing.
          */
-        char *json = calloc(JSON_MAX_LEN, sizeof(char));
-        mf_CPU_perf_to_json(monitoring_data, conf_data->keys, conf_data->size, json);
+        mf_CPU_perf_to_sample(monitoring_data, sample);
 
-        return json;
+        return 1;
     } else {
-        return NULL;
+        return 0;
     }
-}
\ No newline at end of file
+}
+
+/* Shut down the plugin before it is unloaded by the agent;
+   the hook is not called anymore at this point */
+extern void
+shutdown_mf_plugin_CPU_perf(void)
+{
+    int i;
+    if (!is_initialized) {
+        return;
+    }
+    is_initialized = 0;
+
+    /*
+     * stop the sampling of the connector; the PAPI library is shut down
+     * only by the last plugin using it
+     */
+    mf_CPU_perf_shutdown(num_cores);
+    if (PluginManager_library_release("papi") == 0) {
+        PAPI_shutdown();
+    }
+
+    /*
+     * free the monitoring data and the configuration
+     */
+    for (i = 0; i < monitoring_data->num_events; i++) {
+        free(monitoring_data->events[i]);
+    }
+    free(monitoring_data);
+    monitoring_data = NULL;
+    mfp_data_free(conf_data);
+    conf_data = NULL;
+}
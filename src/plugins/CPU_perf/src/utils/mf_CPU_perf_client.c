@@ -18,6 +18,7 @@
 #include <stdio.h>
 #include <signal.h>
 #include <time.h>
+#include <papi.h>
 
 #include "mf_CPU_perf_connector.h"
 #include "plugin_utils.h"
@@ -76,7 +77,7 @@ int main(int argc, char** argv)
          * and required metrics.
          */
         char *json = calloc(JSON_MAX_LEN, sizeof(char));
-        mf_CPU_perf_to_json(monitoring_data, argv, argc, json);
+        mf_CPU_perf_to_json(monitoring_data, json);
         
         /*
          * Display and free the json string
@@ -91,6 +92,7 @@ int main(int argc, char** argv)
 static void my_exit_handler(int s)
 {
     mf_CPU_perf_shutdown(num_cores);
+    PAPI_shutdown();
     puts("Bye bye!\n");
     exit(0);
 }
\ No newline at end of file
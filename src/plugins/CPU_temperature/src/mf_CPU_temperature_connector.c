@@ -19,6 +19,7 @@
 #include <time.h>
 #include <sensors.h>
 #include "mf_CPU_temperature_connector.h"
+#include <mf_json.h>
 
 #define SUCCESS 1
 #define FAILURE 0
@@ -26,6 +27,7 @@
 /*******************************************************************************
  * Variable Declarations
  ******************************************************************************/
+static MF_json_template json_template;
 typedef struct requested_features_t {
     const sensors_chip_name **chip;
     const sensors_subfeature **subfeature;
@@ -144,6 +146,12 @@ int mf_CPU_temperature_init(Plugin_metrics *data, char **events, size_t num_even
     	features_list->data->num_events = event_i;
     }
 
+	/* all metrics are published */
+	mf_json_template_init(&json_template, "CPU_temperature");
+	for (event_i = 0; event_i < data->num_events; event_i++) {
+		mf_json_template_add(&json_template, event_i, data->events[event_i]);
+	}
+
 	return SUCCESS;
 }
 
@@ -171,24 +179,55 @@ int mf_CPU_temperature_sample(Plugin_metrics *data)
 void mf_CPU_temperature_to_json(Plugin_metrics *data, char *json)
 {
 	struct timespec timestamp;
-    char tmp[128] = {'\0'};
-    int i;
+    MF_json out;
+    int i, ii;
     /*
      * prepares the json string, including current timestamp, and name of the plugin
      */
-    sprintf(json, "\"type\":\"CPU_temperature\"");
+    mf_json_init_fixed(&out, json, JSON_MAX_LEN);
+    mf_json_template_type(&out, &json_template);
     clock_gettime(CLOCK_REALTIME, &timestamp);
     double ts = timestamp.tv_sec * 1.0e3 + (double)(timestamp.tv_nsec / 1.0e6); // in millisecond
-    sprintf(tmp, ",\"local_timestamp\":\"%.1f\"", ts);
-    strcat(json, tmp);
+    mf_json_literal(&out, ",\"local_timestamp\":\"");
+    mf_json_number(&out, ts, 1);
+    mf_json_literal(&out, "\"");
 
     /*
-     * prepend metrics names and values into the json string
+     * appends the metrics selected at init, with the names prepared in the template
      */
-	for (i = 0; i < data->num_events; i++) {
-		sprintf(tmp, ",\"%s\":%.3f", data->events[i], data->values[i]);
-		strcat(json, tmp);
+	for (i = 0; i < json_template.num_metrics; i++) {
+		ii = json_template.index[i];
+		mf_json_template_metric(&out, &json_template, i, data->values[ii]);
+	}
+}
+
+/** @brief Selects the sampled metrics to be published into a Plugin_sample
+ *
+ *  the sample contains: plugin name, timestamp, and the names and values of the metrics selected at init,
+ *  whose json fragments the plugin prepared once in a template;
+ *  it is serialized by the agent only when it is published
+ *
+ */
+void mf_CPU_temperature_to_sample(Plugin_metrics *data, Plugin_sample *sample)
+{
+	struct timespec timestamp;
+	int i, ii, n = 0;
+	sample->type = json_template.type;
+	sample->json = &json_template;
+	clock_gettime(CLOCK_REALTIME, &timestamp);
+	sample->timestamp = timestamp.tv_sec * 1.0e3 + (double)(timestamp.tv_nsec / 1.0e6); // in millisecond
+
+	/*
+	 * adds the metrics selected at init to the sample, with the index of their names in the template
+	 */
+	for (i = 0; i < json_template.num_metrics; i++) {
+		ii = json_template.index[i];
+		sample->metrics.events[n] = data->events[ii];
+		sample->metrics.values[n] = data->values[ii];
+		sample->keys[n] = i;
+		n++;
 	}
+	sample->metrics.num_events = n;
 }
 
 /** @brief Stops the plugin
@@ -21,6 +21,7 @@
 #include <dirent.h>
 #include <ctype.h>
 #include "mf_Linux_resources_connector.h"
+#include <mf_json.h>
 
 #define SUCCESS 1
 #define FAILURE 0
@@ -40,6 +41,7 @@
 /*******************************************************************************
  * Variable Declarations
  ******************************************************************************/
+static MF_json_template json_template;
 /* flag indicates which events are given as input */
 unsigned int flag = 0;
 /* time in seconds */
@@ -136,6 +138,12 @@ int mf_Linux_resources_init(Plugin_metrics *data, char **events, size_t num_even
     	i++;
 	}
 	data->num_events = i;
+
+	/* all metrics are published, when their values are valid */
+	mf_json_template_init(&json_template, "Linux_resources");
+	for (i = 0; i < data->num_events; i++) {
+		mf_json_template_add(&json_template, i, data->events[i]);
+	}
 	return SUCCESS;
 }
 
@@ -213,25 +221,55 @@ int mf_Linux_resources_sample(Plugin_metrics *data)
  */
 void mf_Linux_resources_to_json(Plugin_metrics *data, char *json)
 {
-    char tmp[128] = {'\0'};
-    int i;
+    MF_json out;
+    int i, ii;
     /*
      * prepares the json string, including current timestamp, and name of the plugin
      */
-    sprintf(json, "\"type\":\"Linux_resources\"");
-    sprintf(tmp, ",\"local_timestamp\":\"%.1f\"", after_time * 1.0e3);
-    strcat(json, tmp);
+    mf_json_init_fixed(&out, json, JSON_MAX_LEN);
+    mf_json_template_type(&out, &json_template);
+    mf_json_literal(&out, ",\"local_timestamp\":\"");
+    mf_json_number(&out, after_time * 1.0e3, 1);
+    mf_json_literal(&out, "\"");
 
     /*
-     * filters the sampled data with respect to metrics values
+     * appends the metrics selected at init, with the names prepared in the template
      */
-	for (i = 0; i < data->num_events; i++) {
-		/* if metrics' value >= 0.0, append the metrics to the json string */
-		if(data->values[i] >= 0.0) {
-			sprintf(tmp, ",\"%s\":%.3f", data->events[i], data->values[i]);
-			strcat(json, tmp);
+	for (i = 0; i < json_template.num_metrics; i++) {
+		ii = json_template.index[i];
+		if(data->values[ii] >= 0.0) {
+			mf_json_template_metric(&out, &json_template, i, data->values[ii]);
+		}
+	}
+}
+
+/** @brief Selects the sampled metrics to be published into a Plugin_sample
+ *
+ *  the sample contains: plugin name, timestamp, and the names and values of the metrics selected at init,
+ *  whose json fragments the plugin prepared once in a template;
+ *  it is serialized by the agent only when it is published
+ *
+ */
+void mf_Linux_resources_to_sample(Plugin_metrics *data, Plugin_sample *sample)
+{
+	int i, ii, n = 0;
+	sample->type = json_template.type;
+	sample->json = &json_template;
+	sample->timestamp = after_time * 1.0e3;
+
+	/*
+	 * adds the metrics selected at init to the sample, with the index of their names in the template
+	 */
+	for (i = 0; i < json_template.num_metrics; i++) {
+		ii = json_template.index[i];
+		if(data->values[ii] >= 0.0) {
+			sample->metrics.events[n] = data->events[ii];
+			sample->metrics.values[n] = data->values[ii];
+			sample->keys[n] = i;
+			n++;
 		}
 	}
+	sample->metrics.num_events = n;
 }
 
 /* Adds events to the data->events, if the events are valid */
@@ -24,6 +24,7 @@
 #include <asm/unistd.h>
 #include <linux/perf_event.h>
 #include "mf_Linux_sys_power_connector.h"
+#include <mf_json.h>
 
 /***********************************************************************
  CPU Specification
@@ -73,6 +74,7 @@
 /*******************************************************************************
  * Variable Declarations
  ******************************************************************************/
+static MF_json_template json_template;
 /* flag indicates which events are given as input */
 unsigned int flag = 0;
 /* time in seconds */
@@ -206,6 +208,16 @@ int mf_Linux_sys_power_init(Plugin_metrics *data, char **events, size_t num_even
 	}
 
 	data->num_events = i;
+
+	/* select the metrics once: memory and disk power only with the statistics they need */
+	mf_json_template_init(&json_template, "Linux_sys_power");
+	for (i = 0; i < data->num_events; i++) {
+		if(strcmp(data->events[i], "estimated_memory_power") == 0 && !(flag & HAS_RAM_STAT))
+			continue;
+		if(strcmp(data->events[i], "estimated_disk_power") == 0 && !(flag & HAS_IO_STAT))
+			continue;
+		mf_json_template_add(&json_template, i, data->events[i]);
+	}
 	
 	/* get the before timestamp in second */
 	struct timespec timestamp;
@@ -318,33 +330,55 @@ int mf_Linux_sys_power_sample(Plugin_metrics *data)
  */
 void mf_Linux_sys_power_to_json(Plugin_metrics *data, char *json)
 {
-    char tmp[128] = {'\0'};
-    int i;
+    MF_json out;
+    int i, ii;
     /*
      * prepares the json string, including current timestamp, and name of the plugin
      */
-    sprintf(json, "\"type\":\"Linux_sys_power\"");
-    sprintf(tmp, ",\"local_timestamp\":\"%.1f\"", after_time * 1.0e3);
-    strcat(json, tmp);
+    mf_json_init_fixed(&out, json, JSON_MAX_LEN);
+    mf_json_template_type(&out, &json_template);
+    mf_json_literal(&out, ",\"local_timestamp\":\"");
+    mf_json_number(&out, after_time * 1.0e3, 1);
+    mf_json_literal(&out, "\"");
 
     /*
-     * filters the sampled data with respect to metrics values
+     * appends the metrics selected at init, with the names prepared in the template
      */
-	for (i = 0; i < data->num_events; i++) {
-		/* if metrics' name is power_CPU, but flag do not HAS_CPU_STAT, ignore the value*/
-		if(strcmp(data->events[i], "estimated_memory_power") == 0 && !(flag & HAS_RAM_STAT))
-			continue;
-
-		/* if metrics' name is power_mem, but flag do not HAS_RAM_STAT, ignore the value*/
-		if(strcmp(data->events[i], "estimated_disk_power") == 0 && !(flag & HAS_IO_STAT))
-			continue;
+	for (i = 0; i < json_template.num_metrics; i++) {
+		ii = json_template.index[i];
+		if(data->values[ii] >= 0.0) {
+			mf_json_template_metric(&out, &json_template, i, data->values[ii]);
+		}
+	}
+}
 
-		/* if metrics' value >= 0.0, append the metrics to the json string */
-		if(data->values[i] >= 0.0) {
-			sprintf(tmp, ",\"%s\":%.3f", data->events[i], data->values[i]);
-			strcat(json, tmp);
+/** @brief Selects the sampled metrics to be published into a Plugin_sample
+ *
+ *  the sample contains: plugin name, timestamp, and the names and values of the metrics selected at init,
+ *  whose json fragments the plugin prepared once in a template;
+ *  it is serialized by the agent only when it is published
+ *
+ */
+void mf_Linux_sys_power_to_sample(Plugin_metrics *data, Plugin_sample *sample)
+{
+	int i, ii, n = 0;
+	sample->type = json_template.type;
+	sample->json = &json_template;
+	sample->timestamp = after_time * 1.0e3;
+
+	/*
+	 * adds the metrics selected at init to the sample, with the index of their names in the template
+	 */
+	for (i = 0; i < json_template.num_metrics; i++) {
+		ii = json_template.index[i];
+		if(data->values[ii] >= 0.0) {
+			sample->metrics.events[n] = data->events[ii];
+			sample->metrics.values[n] = data->values[ii];
+			sample->keys[n] = i;
+			n++;
 		}
 	}
+	sample->metrics.num_events = n;
 }
 
 
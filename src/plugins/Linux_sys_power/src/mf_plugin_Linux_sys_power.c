@@ -34,7 +34,7 @@ int is_initialized = 0;
 /*******************************************************************************
  * Forward Declarations
  ******************************************************************************/
-char* mf_plugin_Linux_sys_power_hook();
+int mf_plugin_Linux_sys_power_hook(Plugin_sample *sample);
 
 /*******************************************************************************
  * Functions implementation
@@ -64,14 +64,15 @@ init_mf_plugin_Linux_sys_power(PluginManager *pm)
     /*
      * if init succeed; register the plugin hook to the plugin manager
      */
-    PluginManager_register_hook(pm, "mf_plugin_Linux_sys_power", mf_plugin_Linux_sys_power_hook);
+    PluginManager_register_sample_hook(pm, "mf_plugin_Linux_sys_power", mf_plugin_Linux_sys_power_hook);
     is_initialized = 1;
     return ret;
 }
 
-/* the hook function, sample the metrics and convert to a json-formatted string */
-char*
-mf_plugin_Linux_sys_power_hook()
+/* the hook function, sample the metrics and hand them to the agent as a binary sample 
+   @return 1 if a sample was taken; 0 otherwise */
+int
+mf_plugin_Linux_sys_power_hook(Plugin_sample *sample)
 {
     if (is_initialized) {
         /*
@@ -80,14 +81,36 @@ mf_plugin_Linux_sys_power_hook()
         mf_Linux_sys_power_sample(monitoring_data);
 
         /*
-         * Prepares a json string, including current timestamp, name of the plugin,
-         * and required metrics.
+         * Selects the required metrics into the sample, including current timestamp
+         * and name of the plugin; the agent serializes the sample when publishing.
          */
-        char *json = calloc(JSON_MAX_LEN, sizeof(char));
-        mf_Linux_sys_power_to_json(monitoring_data, json);
+        mf_Linux_sys_power_to_sample(monitoring_data, sample);
 
-        return json;
+        return 1;
     } else {
-        return NULL;
+        return 0;
     }
-}
\ No newline at end of file
+}
+
+/* Shut down the plugin before it is unloaded by the agent;
+   the hook is not called anymore at this point */
+extern void
+shutdown_mf_plugin_Linux_sys_power(void)
+{
+    int i;
+    if (!is_initialized) {
+        return;
+    }
+    is_initialized = 0;
+
+    /*
+     * free the monitoring data and the configuration
+     */
+    for (i = 0; i < monitoring_data->num_events; i++) {
+        free(monitoring_data->events[i]);
+    }
+    free(monitoring_data);
+    monitoring_data = NULL;
+    mfp_data_free(conf_data);
+    conf_data = NULL;
+}
@@ -19,6 +19,7 @@
 #include <time.h>
 #include <nvml.h>
 #include "mf_NVML_connector.h"
+#include <mf_json.h>
 
 #define SUCCESS 1
 #define FAILURE 0
@@ -27,6 +28,7 @@
 /*******************************************************************************
  * Variable Declarations
  ******************************************************************************/
+static MF_json_template json_template;
 unsigned int devices_count = 0;
 nvmlDevice_t **devices = NULL; 
 const char NVML_metrics[NVML_EVENTS_NUM][32] = {
@@ -79,6 +81,16 @@ int mf_NVML_init(Plugin_metrics *data, char **events, size_t num_events)
     }
     data->num_events = k;
 
+    /* select the metrics of the given events once, in the order of the events */
+    mf_json_template_init(&json_template, "NVML");
+    for (i = 0; i < num_events; i++) {
+    	for (k = 0; k < data->num_events; k++) {
+    		if (strcmp(events[i], strchr(data->events[k], ':') + 1) == 0) {
+    			mf_json_template_add(&json_template, k, data->events[k]);
+    		}
+    	}
+    }
+
     /* get device handle for each GPU device */
     devices = calloc(devices_count, sizeof(nvmlDevice_t *));
     for(i = 0; i < devices_count; i++) {
@@ -176,35 +188,62 @@ int mf_NVML_sample(Plugin_metrics *data)
  *  json string contains: plugin name, timestamps, metrics_name and metrics_value
  *
  */
-void mf_NVML_to_json(Plugin_metrics *data, char **events, size_t num_events, char *json)
+void mf_NVML_to_json(Plugin_metrics *data, char *json)
 {
 	struct timespec timestamp;
-    char tmp[128] = {'\0'};
-    char *sub_part;
+    MF_json out;
     int i, ii;
     /*
      * prepares the json string, including current timestamp, and name of the plugin
      */
-    sprintf(json, "\"type\":\"NVML\"");
+    mf_json_init_fixed(&out, json, JSON_MAX_LEN);
+    mf_json_template_type(&out, &json_template);
     clock_gettime(CLOCK_REALTIME, &timestamp);
     double ts = timestamp.tv_sec * 1.0e3 + (double)(timestamp.tv_nsec / 1.0e6); // in millisecond
-    sprintf(tmp, ",\"local_timestamp\":\"%.1f\"", ts);
-    strcat(json, tmp);
+    mf_json_literal(&out, ",\"local_timestamp\":\"");
+    mf_json_number(&out, ts, 1);
+    mf_json_literal(&out, "\"");
 
     /*
-     * filters the sampled data with respect to metrics given
+     * appends the metrics selected at init, with the names prepared in the template
      */
-	for (i = 0; i < num_events; i++) {
-		for(ii = 0; ii < data->num_events; ii++) {
-			/* if metrics' name matches, append the metrics to the json string */
-            sub_part = strstr(data->events[ii], ":");
-            sub_part++;
-			if(strcmp(events[i], sub_part) == 0 && (data->values[ii] >= 0.0)) {
-				sprintf(tmp, ",\"%s\":%.3f", data->events[ii], data->values[ii]);
-				strcat(json, tmp);
-			}
+	for (i = 0; i < json_template.num_metrics; i++) {
+		ii = json_template.index[i];
+		if(data->values[ii] >= 0.0) {
+			mf_json_template_metric(&out, &json_template, i, data->values[ii]);
+		}
+	}
+}
+
+/** @brief Selects the sampled metrics to be published into a Plugin_sample
+ *
+ *  the sample contains: plugin name, timestamp, and the names and values of the metrics selected at init,
+ *  whose json fragments the plugin prepared once in a template;
+ *  it is serialized by the agent only when it is published
+ *
+ */
+void mf_NVML_to_sample(Plugin_metrics *data, Plugin_sample *sample)
+{
+	struct timespec timestamp;
+	int i, ii, n = 0;
+	sample->type = json_template.type;
+	sample->json = &json_template;
+	clock_gettime(CLOCK_REALTIME, &timestamp);
+	sample->timestamp = timestamp.tv_sec * 1.0e3 + (double)(timestamp.tv_nsec / 1.0e6); // in millisecond
+
+	/*
+	 * adds the metrics selected at init to the sample, with the index of their names in the template
+	 */
+	for (i = 0; i < json_template.num_metrics; i++) {
+		ii = json_template.index[i];
+		if(data->values[ii] >= 0.0) {
+			sample->metrics.events[n] = data->events[ii];
+			sample->metrics.values[n] = data->values[ii];
+			sample->keys[n] = i;
+			n++;
 		}
 	}
+	sample->metrics.num_events = n;
 }
 
 /** @brief Stops the plugin
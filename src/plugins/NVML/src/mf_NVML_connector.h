@@ -35,10 +35,21 @@ int mf_NVML_sample(Plugin_metrics *data);
 
 /** @brief Formats the sampling data into a json string
  *
- *  json string contains: plugin name, timestamps, metrics_name and metrics_value
+ *  json string contains: plugin name, timestamps, metrics_name and metrics_value;
+ *  json holds JSON_MAX_LEN bytes, metrics which do not fit are left out
  *
  */
-void mf_NVML_to_json(Plugin_metrics *data, char **events, size_t num_events, char *json);
+void mf_NVML_to_json(Plugin_metrics *data, char *json);
+
+
+/** @brief Selects the sampled metrics to be published into a Plugin_sample
+ *
+ *  the sample contains: plugin name, timestamp, and the names and values of the metrics selected at init,
+ *  whose json fragments the plugin prepared once in a template;
+ *  it is serialized by the agent only when it is published
+ *
+ */
+void mf_NVML_to_sample(Plugin_metrics *data, Plugin_sample *sample);
 
 
 /** @brief Stops the plugin
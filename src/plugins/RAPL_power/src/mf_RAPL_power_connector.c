@@ -21,6 +21,7 @@
 #include <hwloc.h>
 #include <papi.h>
 #include "mf_RAPL_power_connector.h"
+#include <mf_json.h>
 
 #define SUCCESS 1
 #define FAILURE 0
@@ -28,6 +29,7 @@
 /*******************************************************************************
  * Variable Declarations
  ******************************************************************************/
+static MF_json_template json_template;
 double before_time, after_time;  /* time in seconds */
 int EventSet = PAPI_NULL;
 int num_sockets = 0;
@@ -116,25 +118,55 @@ int mf_RAPL_power_sample(Plugin_metrics *data)
  */
 void mf_RAPL_power_to_json(Plugin_metrics *data, char *json)
 {
-    char tmp[128] = {'\0'};
-    int i;
+    MF_json out;
+    int i, ii;
     /*
      * prepares the json string, including current timestamp, and name of the plugin
      */
-    sprintf(json, "\"type\":\"RAPL_power\"");
-    sprintf(tmp, ",\"local_timestamp\":\"%.1f\"", after_time * 1.0e3);
-    strcat(json, tmp);
+    mf_json_init_fixed(&out, json, JSON_MAX_LEN);
+    mf_json_template_type(&out, &json_template);
+    mf_json_literal(&out, ",\"local_timestamp\":\"");
+    mf_json_number(&out, after_time * 1.0e3, 1);
+    mf_json_literal(&out, "\"");
 
     /*
-     * filters the sampled data with respect to metrics values
+     * appends the metrics selected at init, with the names prepared in the template
      */
-	for (i = 0; i < data->num_events; i++) {
-		/* if metrics' value >= 0.0, append the metrics to the json string */
-		if(data->values[i] >= 0.0) {
-			sprintf(tmp, ",\"%s\":%.3f", data->events[i], data->values[i]);
-			strcat(json, tmp);
+	for (i = 0; i < json_template.num_metrics; i++) {
+		ii = json_template.index[i];
+		if(data->values[ii] >= 0.0) {
+			mf_json_template_metric(&out, &json_template, i, data->values[ii]);
+		}
+	}
+}
+
+/** @brief Selects the sampled metrics to be published into a Plugin_sample
+ *
+ *  the sample contains: plugin name, timestamp, and the names and values of the metrics selected at init,
+ *  whose json fragments the plugin prepared once in a template;
+ *  it is serialized by the agent only when it is published
+ *
+ */
+void mf_RAPL_power_to_sample(Plugin_metrics *data, Plugin_sample *sample)
+{
+	int i, ii, n = 0;
+	sample->type = json_template.type;
+	sample->json = &json_template;
+	sample->timestamp = after_time * 1.0e3;
+
+	/*
+	 * adds the metrics selected at init to the sample, with the index of their names in the template
+	 */
+	for (i = 0; i < json_template.num_metrics; i++) {
+		ii = json_template.index[i];
+		if(data->values[ii] >= 0.0) {
+			sample->metrics.events[n] = data->events[ii];
+			sample->metrics.values[n] = data->values[ii];
+			sample->keys[n] = i;
+			n++;
 		}
 	}
+	sample->metrics.num_events = n;
 }
 
 /* initialize RAPL counters prepare eventset and start counters */
@@ -194,6 +226,12 @@ int rapl_init(Plugin_metrics *data, char **events, size_t num_events)
 		}
 	}
 	data->num_events = ii;
+
+	/* all metrics are published, when their values are valid */
+	mf_json_template_init(&json_template, "RAPL_power");
+	for (i = 0; i < data->num_events; i++) {
+		mf_json_template_add(&json_template, i, data->events[i]);
+	}
 	/* set dominator for DRAM energy values based on different CPU model */
 	denominator = rapl_get_denominator();
 
@@ -206,6 +244,38 @@ int rapl_init(Plugin_metrics *data, char **events, size_t num_events)
 
 }
 
+/** @brief Stops the plugin
+ *
+ *  This methods stops papi counters gracefully; only the EventSet of this
+ *  plugin is destroyed, since other plugins may still use the PAPI library
+ *
+ */
+void mf_RAPL_power_shutdown(void)
+{
+    if (EventSet == PAPI_NULL) {
+        return;
+    }
+
+    int ret = PAPI_stop(EventSet, NULL);
+    if (ret != PAPI_OK) {
+        char *error = PAPI_strerror(ret);
+        fprintf(stderr, "Couldn't stop PAPI EventSet: %s", error);
+    }
+
+    ret = PAPI_cleanup_eventset(EventSet);
+    if (ret != PAPI_OK) {
+        char *error = PAPI_strerror(ret);
+        fprintf(stderr, "Couldn't cleanup PAPI EventSet: %s", error);
+    }
+
+    ret = PAPI_destroy_eventset(&EventSet);
+    if (ret != PAPI_OK) {
+        char *error = PAPI_strerror(ret);
+        fprintf(stderr, "Couldn't destroy PAPI EventSet: %s", error);
+    }
+    EventSet = PAPI_NULL;
+}
+
 /* Load the PAPI library */
 int load_papi_library(void)
 {
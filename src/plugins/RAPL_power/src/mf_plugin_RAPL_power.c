@@ -17,6 +17,7 @@
 #include <stdlib.h> /* malloc etc */
 #include <string.h>
 #include <time.h>
+#include <papi.h> /* PAPI_shutdown */
 #include <mf_debug.h>
 #include <plugin_manager.h> /* mf_plugin_xxx_hook */
 #include <mf_parser.h> /* mfp_data */
@@ -33,7 +34,7 @@ int is_initialized = 0;
 /*******************************************************************************
  * Forward Declarations
  ******************************************************************************/
-char* mf_plugin_RAPL_power_hook();
+int mf_plugin_RAPL_power_hook(Plugin_sample *sample);
 
 /*******************************************************************************
  * Functions implementation
@@ -54,8 +55,10 @@ init_mf_plugin_RAPL_power(PluginManager *pm)
      * initialize the monitoring data
      */
     monitoring_data = malloc(sizeof(Plugin_metrics));
+    PluginManager_library_acquire("papi");
     int ret = mf_RAPL_power_init(monitoring_data, conf_data->keys, conf_data->size);
     if(ret == 0) {
+        PluginManager_library_release("papi");
         char plugin_name[] = "RAPL_power";
         log_error("Plugin %s init function failed.\n", plugin_name);
         return ret;
@@ -63,14 +66,15 @@ init_mf_plugin_RAPL_power(PluginManager *pm)
     /*
      * if init succeed; register the plugin hook to the plugin manager
      */
-    PluginManager_register_hook(pm, "mf_plugin_RAPL_power", mf_plugin_RAPL_power_hook);
+    PluginManager_register_sample_hook(pm, "mf_plugin_RAPL_power", mf_plugin_RAPL_power_hook);
     is_initialized = 1;
     return ret;
 }
 
-/* the hook function, sample the metrics and convert to a json-formatted string */
-char*
-mf_plugin_RAPL_power_hook()
+/* the hook function, sample the metrics and hand them to the agent as a binary sample 
+   @return 1 if a sample was taken; 0 otherwise */
+int
+mf_plugin_RAPL_power_hook(Plugin_sample *sample)
 {
     if (is_initialized) {
         /*
@@ -79,14 +83,45 @@ mf_plugin_RAPL_power_hook()
         mf_RAPL_power_sample(monitoring_data);
 
         /*
-         * Prepares a json string, including current timestamp, name of the plugin,
-         * and required metrics.
+         * Selects the required metrics into the sample, including current timestamp
+         * and name of the plugin; the agent serializes the sample when publishing.
          */
-        char *json = calloc(JSON_MAX_LEN, sizeof(char));
-        mf_RAPL_power_to_json(monitoring_data, json);
+        mf_RAPL_power_to_sample(monitoring_data, sample);
 
-        return json;
+        return 1;
     } else {
-        return NULL;
+        return 0;
     }
-}
\ No newline at end of file
+}
+
+/* Shut down the plugin before it is unloaded by the agent;
+   the hook is not called anymore at this point */
+extern void
+shutdown_mf_plugin_RAPL_power(void)
+{
+    int i;
+    if (!is_initialized) {
+        return;
+    }
+    is_initialized = 0;
+
+    /*
+     * stop the sampling of the connector; the PAPI library is shut down
+     * only by the last plugin using it
+     */
+    mf_RAPL_power_shutdown();
+    if (PluginManager_library_release("papi") == 0) {
+        PAPI_shutdown();
+    }
+
+    /*
+     * free the monitoring data and the configuration
+     */
+    for (i = 0; i < monitoring_data->num_events; i++) {
+        free(monitoring_data->events[i]);
+    }
+    free(monitoring_data);
+    monitoring_data = NULL;
+    mfp_data_free(conf_data);
+    conf_data = NULL;
+}
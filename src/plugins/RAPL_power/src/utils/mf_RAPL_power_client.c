@@ -18,6 +18,7 @@
 #include <stdio.h>
 #include <signal.h>
 #include <time.h>
+#include <papi.h>
 
 #include "mf_RAPL_power_connector.h"
 #include "plugin_utils.h"
@@ -90,6 +91,8 @@ int main(int argc, char** argv)
 /* Exit handler */
 static void my_exit_handler(int s)
 {
+    mf_RAPL_power_shutdown();
+    PAPI_shutdown();
     puts("Bye bye!\n");
     exit(0);
 }
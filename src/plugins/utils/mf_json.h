@@ -0,0 +1,457 @@
+/*
+ * Copyright (C) 2015-2017 University of Stuttgart
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef _MF_JSON_H
+#define _MF_JSON_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "plugin_utils.h"
+
+/* longest text of a number written by mf_json_metric() and mf_json_long() */
+#define MF_JSON_NUMBER_LEN 64
+/* values from this magnitude on are formatted by snprintf() */
+#define MF_JSON_FIXED_MAX 1e15
+/* room for the fragments of a template: the type and every metric escaped */
+#define MF_JSON_TEMPLATE_LEN (MAX_EVENTS_NUMBER * (2 * MAX_EVENTS_LEN + 8) + 128)
+
+/** @brief cursor-based writer of json text, shared by the agent and the plugins
+ *
+ * Text is appended at the cursor, so that nothing written before is scanned
+ * again, and it is kept terminated by '\0'. A growable writer owns its buffer
+ * and doubles it as needed. A fixed writer writes into a buffer of the caller:
+ * a piece which does not fit is dropped as a whole and overflow is set, so the
+ * text stays valid up to the last piece written.
+ */
+typedef struct MF_json_t
+{
+    char *buf;
+    size_t len;             /* length of the text */
+    size_t size;            /* size of the buffer */
+    int growable;
+    int overflow;
+} MF_json;
+
+/** @brief Starts a growable writer with a buffer of size bytes
+ *
+ * @return 1 on success; 0 if the buffer cannot be allocated
+ */
+static inline int mf_json_init(MF_json *j, size_t size)
+{
+    j->size = (size > 0) ? size : 64;
+    j->buf = malloc(j->size);
+    j->len = 0;
+    j->growable = 1;
+    j->overflow = 0;
+    if (j->buf == NULL) {
+        j->size = 0;
+        return 0;
+    }
+    j->buf[0] = '\0';
+    return 1;
+}
+
+/** @brief Starts a fixed writer into the caller's buffer of size bytes
+ */
+static inline void mf_json_init_fixed(MF_json *j, char *buf, size_t size)
+{
+    j->buf = buf;
+    j->size = size;
+    j->len = 0;
+    j->growable = 0;
+    j->overflow = 0;
+    if (size > 0) {
+        buf[0] = '\0';
+    }
+}
+
+/** @brief Continues a growable buffer of len bytes of text, e.g. the bulk of the agent
+ */
+static inline void mf_json_attach(MF_json *j, char *buf, size_t len, size_t size)
+{
+    j->buf = buf;
+    j->len = len;
+    j->size = size;
+    j->growable = 1;
+    j->overflow = 0;
+}
+
+/** @brief Makes room for another len bytes plus the terminating '\0'
+ *
+ * @return 1 if there is room; 0 if a fixed buffer is full or memory runs out
+ */
+static inline int mf_json_reserve(MF_json *j, size_t len)
+{
+    if (j->len + len < j->size) {
+        return 1;
+    }
+    if (!j->growable) {
+        j->overflow = 1;
+        return 0;
+    }
+    size_t size = (j->size > 0) ? j->size : 64;
+    while (j->len + len >= size) {
+        size *= 2;
+    }
+    char *buf = realloc(j->buf, size);
+    if (buf == NULL) {
+        j->overflow = 1;
+        return 0;
+    }
+    j->buf = buf;
+    j->size = size;
+    return 1;
+}
+
+/** @brief Appends len bytes of text as they are
+ */
+static inline void mf_json_raw(MF_json *j, const char *s, size_t len)
+{
+    if (!mf_json_reserve(j, len)) {
+        return;
+    }
+    memcpy(j->buf + j->len, s, len);
+    j->len += len;
+    j->buf[j->len] = '\0';
+}
+
+/** @brief Appends a string literal as it is
+ */
+#define mf_json_literal(j, s) mf_json_raw((j), (s), sizeof(s) - 1)
+
+/** @brief Appends a string as it is
+ */
+static inline void mf_json_str(MF_json *j, const char *s)
+{
+    mf_json_raw(j, s, strlen(s));
+}
+
+/** @brief Returns the length of s escaped as the contents of a json string
+ */
+static inline size_t mf_json_escaped_len(const char *s)
+{
+    size_t len = 0;
+
+    for (; *s != '\0'; s++) {
+        unsigned char c = (unsigned char) *s;
+        len += (c == '"' || c == '\\') ? 2 : (c < 0x20) ? 6 : 1;
+    }
+    return len;
+}
+
+/** @brief Writes s escaped as the contents of a json string, without quotes and '\0'
+ *
+ * out holds mf_json_escaped_len(s) bytes; this is the only place where names
+ * are escaped, for the fragments of templates as well as for the writer.
+ *
+ * @return the end of the escaped text
+ */
+static inline char *mf_json_escape(char *out, const char *s)
+{
+    static const char hex[] = "0123456789abcdef";
+
+    for (; *s != '\0'; s++) {
+        unsigned char c = (unsigned char) *s;
+        if (c == '"' || c == '\\') {
+            *out++ = '\\';
+            *out++ = (char) c;
+        } else if (c < 0x20) {
+            memcpy(out, "\\u00", 4);
+            out[4] = hex[c >> 4];
+            out[5] = hex[c & 0xf];
+            out += 6;
+        } else {
+            *out++ = (char) c;
+        }
+    }
+    return out;
+}
+
+/** @brief Appends a string escaped as the contents of a json string, without the quotes
+ */
+static inline void mf_json_escaped(MF_json *j, const char *s)
+{
+    size_t len = mf_json_escaped_len(s);
+
+    if (!mf_json_reserve(j, len)) {
+        return;
+    }
+    mf_json_escape(j->buf + j->len, s);
+    j->len += len;
+    j->buf[j->len] = '\0';
+}
+
+static inline void mf_json_char(MF_json *j, char c)
+{
+    mf_json_raw(j, &c, 1);
+}
+
+/** @brief Formats value with 0 to 3 decimals into buf, exactly like printf("%.*f")
+ *
+ * The value is scaled in integer arithmetic: its binary mantissa times
+ * 10^decimals fits into 64 bits, and the part shifted out decides the rounding,
+ * half to even like glibc. Values of MF_JSON_FIXED_MAX or more, infinities
+ * and NaN are left to snprintf(). buf holds MF_JSON_NUMBER_LEN bytes.
+ *
+ * @return the length of the text, which is terminated by '\0'; like snprintf(),
+ *         the length the text would have had if it does not fit into buf
+ */
+static inline int mf_json_fixed(char *buf, double value, int decimals)
+{
+    static const uint64_t scales[4] = { 1, 10, 100, 1000 };
+    uint64_t bits, mantissa, q;
+    char digits[24];
+    int exponent, n = 0, len = 0;
+
+    if (decimals < 0 || decimals > 3 || !(value > -MF_JSON_FIXED_MAX && value < MF_JSON_FIXED_MAX)) {
+        return snprintf(buf, MF_JSON_NUMBER_LEN, "%.*f", decimals, value);
+    }
+    memcpy(&bits, &value, sizeof(bits));
+    exponent = (int) ((bits >> 52) & 0x7ff);
+    mantissa = bits & ((1ULL << 52) - 1);
+    if (exponent == 0) {
+        exponent = -1074;
+    } else {
+        mantissa |= 1ULL << 52;
+        exponent -= 1075;
+    }
+
+    /* q = value * 10^decimals, rounded half to even */
+    q = mantissa * scales[decimals];
+    if (exponent >= 0) {
+        q <<= exponent;
+    } else if (exponent > -64) {
+        int shift = -exponent;
+        uint64_t rest = q & ((1ULL << shift) - 1);
+        uint64_t half = 1ULL << (shift - 1);
+        q >>= shift;
+        if (rest > half || (rest == half && (q & 1))) {
+            q++;
+        }
+    } else {
+        /* less than half of the last decimal */
+        q = 0;
+    }
+
+    if (bits >> 63) {
+        buf[len++] = '-';
+    }
+    do {
+        digits[n++] = (char) ('0' + q % 10);
+        q /= 10;
+    } while (q > 0 || n <= decimals);
+    while (n > decimals) {
+        buf[len++] = digits[--n];
+    }
+    if (decimals > 0) {
+        buf[len++] = '.';
+        while (n > 0) {
+            buf[len++] = digits[--n];
+        }
+    }
+    buf[len] = '\0';
+    return len;
+}
+
+/** @brief Appends value with 0 to 3 decimals; a value too long for a number is left out
+ */
+static inline void mf_json_number(MF_json *j, double value, int decimals)
+{
+    char number[MF_JSON_NUMBER_LEN];
+    int number_len = mf_json_fixed(number, value, decimals);
+
+    if (number_len < 0 || (size_t) number_len >= sizeof(number)) {
+        j->overflow = 1;
+        return;
+    }
+    mf_json_raw(j, number, number_len);
+}
+
+/** @brief Appends ,"name":value with three decimals, as one piece; the name is escaped
+ */
+static inline void mf_json_metric(MF_json *j, const char *name, double value)
+{
+    char number[MF_JSON_NUMBER_LEN];
+    size_t name_len = mf_json_escaped_len(name);
+    int number_len = mf_json_fixed(number, value, 3);
+
+    if (number_len < 0 || (size_t) number_len >= sizeof(number) || !mf_json_reserve(j, name_len + number_len + 4)) {
+        j->overflow = 1;
+        return;
+    }
+    char *p = j->buf + j->len;
+    *p++ = ',';
+    *p++ = '"';
+    p = mf_json_escape(p, name);
+    *p++ = '"';
+    *p++ = ':';
+    memcpy(p, number, number_len);
+    p += number_len;
+    *p = '\0';
+    j->len = p - j->buf;
+}
+
+/** @brief Appends the fragment ,"name": of key_len bytes and value with three decimals, as one piece
+ */
+static inline void mf_json_key_metric(MF_json *j, const char *key, size_t key_len, double value)
+{
+    char number[MF_JSON_NUMBER_LEN];
+    int number_len = mf_json_fixed(number, value, 3);
+
+    if (number_len < 0 || (size_t) number_len >= sizeof(number) || !mf_json_reserve(j, key_len + number_len)) {
+        j->overflow = 1;
+        return;
+    }
+    memcpy(j->buf + j->len, key, key_len);
+    memcpy(j->buf + j->len + key_len, number, number_len);
+    j->len += key_len + number_len;
+    j->buf[j->len] = '\0';
+}
+
+/** @brief Appends an integer
+ */
+static inline void mf_json_long(MF_json *j, long value)
+{
+    char number[MF_JSON_NUMBER_LEN];
+    mf_json_raw(j, number, snprintf(number, sizeof(number), "%ld", value));
+}
+
+/** @brief Drops the text after the first len bytes, e.g. a trailing comma
+ */
+static inline void mf_json_truncate(MF_json *j, size_t len)
+{
+    if (len < j->len) {
+        j->len = len;
+        j->buf[len] = '\0';
+    }
+}
+
+/** @brief Frees the buffer of a growable writer
+ */
+static inline void mf_json_free(MF_json *j)
+{
+    if (j->growable) {
+        free(j->buf);
+    }
+    j->buf = NULL;
+    j->len = j->size = 0;
+}
+
+/** @brief json fragments of a plugin, built once at init
+ *
+ * The template holds the fragment "type":"<plugin>" and, for each metric the
+ * plugin publishes, the fragment ,"<metric>": together with the index of the
+ * metric in the plugin's Plugin_metrics; names are escaped once, here. A
+ * sample is then written by copying the fragments and formatting the values,
+ * without scanning or matching metric names. The fragments are kept within
+ * the template, which needs no cleanup.
+ */
+typedef struct MF_json_template_t
+{
+    const char *type;                       /* name of the plugin */
+    size_t type_len;                        /* the type fragment starts the text */
+    int num_metrics;
+    int index[MAX_EVENTS_NUMBER];           /* metric in the Plugin_metrics, in order of publication */
+    unsigned int key_start[MAX_EVENTS_NUMBER];
+    unsigned int key_len[MAX_EVENTS_NUMBER];
+    size_t len;
+    char text[MF_JSON_TEMPLATE_LEN];
+} MF_json_template;
+
+/* appends s to the text of the template, escaped as a json string */
+static inline int mf_json_template_escape(MF_json_template *t, const char *s)
+{
+    size_t len = mf_json_escaped_len(s);
+
+    if (t->len + len >= sizeof(t->text)) {
+        return 0;
+    }
+    mf_json_escape(t->text + t->len, s);
+    t->len += len;
+    return 1;
+}
+
+/* appends s to the text of the template as it is */
+static inline int mf_json_template_text(MF_json_template *t, const char *s)
+{
+    size_t len = strlen(s);
+
+    if (t->len + len >= sizeof(t->text)) {
+        return 0;
+    }
+    memcpy(t->text + t->len, s, len);
+    t->len += len;
+    return 1;
+}
+
+/** @brief Starts a template of the plugin type, without metrics
+ *
+ * type has to stay valid as long as the template is used, e.g. a literal.
+ *
+ * @return 1 on success; 0 if the type is too long
+ */
+static inline int mf_json_template_init(MF_json_template *t, const char *type)
+{
+    t->type = type;
+    t->num_metrics = 0;
+    t->len = 0;
+    if (!mf_json_template_text(t, "\"type\":\"") || !mf_json_template_escape(t, type) ||
+            !mf_json_template_text(t, "\"")) {
+        t->type_len = 0;
+        return 0;
+    }
+    t->type_len = t->len;
+    return 1;
+}
+
+/** @brief Adds the metric name, which is metric index of the plugin's Plugin_metrics
+ *
+ * @return 1 on success; 0 if the template is full
+ */
+static inline int mf_json_template_add(MF_json_template *t, int index, const char *name)
+{
+    size_t start = t->len;
+
+    if (t->num_metrics == MAX_EVENTS_NUMBER) {
+        return 0;
+    }
+    if (!mf_json_template_text(t, ",\"") || !mf_json_template_escape(t, name) || !mf_json_template_text(t, "\":")) {
+        t->len = start;
+        return 0;
+    }
+    t->index[t->num_metrics] = index;
+    t->key_start[t->num_metrics] = start;
+    t->key_len[t->num_metrics] = t->len - start;
+    t->num_metrics++;
+    return 1;
+}
+
+/** @brief Appends the fragment "type":"<plugin>"
+ */
+static inline void mf_json_template_type(MF_json *j, const MF_json_template *t)
+{
+    mf_json_raw(j, t->text, t->type_len);
+}
+
+/** @brief Appends ,"<metric>":value for the k-th metric of the template
+ */
+static inline void mf_json_template_metric(MF_json *j, const MF_json_template *t, int k, double value)
+{
+    mf_json_key_metric(j, t->text + t->key_start[k], t->key_len[k], value);
+}
+
+#endif /* _MF_JSON_H */
@@ -28,8 +28,32 @@
 typedef struct Plugin_metrics_t
 {
     char *events[MAX_EVENTS_NUMBER];
-    float values[MAX_EVENTS_NUMBER];
+    double values[MAX_EVENTS_NUMBER];
     int num_events;
 } Plugin_metrics;
 
+struct MF_json_template_t;
+
+/** @brief data structure to hand over one sample of a plugin to the agent
+ *
+ * The sample holds the name of the plugin, the timestamp in milliseconds, the
+ * sampling interval and the selected metrics. The metric names point to the
+ * plugin's own Plugin_metrics, which stay valid as long as the plugin is
+ * loaded; the agent serializes the sample into json only when it is published.
+ * A plugin with a json template of mf_json.h may set json, and keys to the
+ * metric of the template for each metric, so that the agent copies the
+ * fragments of the template instead of formatting the names; json is NULL
+ * otherwise.
+ */
+typedef struct Plugin_sample_t
+{
+    const char *type;
+    double timestamp;
+    int plugin_id;
+    long interval;          /* sampling interval in ns, set by the agent */
+    Plugin_metrics metrics;
+    const struct MF_json_template_t *json;
+    unsigned char keys[MAX_EVENTS_NUMBER];
+} Plugin_sample;
+
 #endif /* _PLUGIN_UTILS_H */
\ No newline at end of file
@@ -0,0 +1,543 @@
+/*
+ * Copyright (C) 2014-2015 University of Stuttgart
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "columns.h"
+
+#define SUCCESS 1
+#define FAILED  0
+/* start of every batch written by columns_write() */
+#define COLUMNS_MAGIC "{\"header\":{"
+#define COLUMNS_MAGIC_LEN 11
+
+ /*******************************************************************************
+ * Variables Declarations
+ ******************************************************************************/
+/* values of one key, each one followed by ',' */
+typedef struct Column_t {
+    char *key;                      /* json string, with its quotes */
+    size_t key_len;
+    size_t key_size;
+    char *values;
+    size_t len;
+    size_t size;
+    long rows;                      /* rows up to the last one with a value */
+} Column;
+
+struct ColumnBatch_t {
+    char *header;                   /* members of the header, without braces */
+    size_t header_len;
+    size_t header_size;
+    Column *columns;
+    int num_columns;
+    int max_columns;                /* allocated columns, kept for the next batch */
+    long rows;
+    int next;                       /* column of the previous key in the row, plus one */
+};
+
+/* output of columns_to_json() */
+typedef struct JsonOutput_t {
+    char *json;
+    size_t len;
+    size_t size;
+} JsonOutput;
+
+/*******************************************************************************
+ * Forward Declarations
+ ******************************************************************************/
+static Column *find_column(ColumnBatch *c, const char *key, size_t key_len);
+static void grow(char **buf, size_t *size, size_t need);
+static void put(char **buf, size_t *len, size_t *size, const char *s, size_t n);
+static const char *skip_space(const char *p, const char *end);
+static const char *skip_string(const char *p, const char *end);
+static const char *skip_value(const char *p, const char *end);
+static int expect(const char **p, const char *end, char c);
+static int expect_key(const char **p, const char *end, const char *key);
+static int parse_columns(const char **p, const char *end, ColumnView *view);
+static void append(JsonOutput *out, const char *s, size_t len);
+
+/*******************************************************************************
+ * Functions implementation
+ ******************************************************************************/
+ColumnBatch *columns_new(void)
+{
+    return calloc(1, sizeof(ColumnBatch));
+}
+
+void columns_free(ColumnBatch *c)
+{
+    int i;
+
+    if (c == NULL) {
+        return;
+    }
+    for (i = 0; i < c->max_columns; i++) {
+        free(c->columns[i].key);
+        free(c->columns[i].values);
+    }
+    free(c->columns);
+    free(c->header);
+    free(c);
+}
+
+void columns_begin(ColumnBatch *c)
+{
+    c->header_len = 0;
+    c->num_columns = 0;
+    c->rows = 0;
+    c->next = 0;
+}
+
+void columns_header(ColumnBatch *c, const char *members, size_t len)
+{
+    const char *end = members + len;
+
+    while (members < end && (*members == ',' || *members == ' ' || *members == '\t' ||
+        *members == '\r' || *members == '\n')) {
+        members++;
+    }
+    while (end > members && (end[-1] == ',' || end[-1] == ' ' || end[-1] == '\t' ||
+        end[-1] == '\r' || end[-1] == '\n')) {
+        end--;
+    }
+    if (members == end) {
+        return;
+    }
+    if (c->header_len > 0) {
+        put(&c->header, &c->header_len, &c->header_size, ",", 1);
+    }
+    put(&c->header, &c->header_len, &c->header_size, members, end - members);
+}
+
+void columns_row(ColumnBatch *c)
+{
+    c->rows++;
+    c->next = 0;
+}
+
+int columns_value(ColumnBatch *c, const char *key, size_t key_len, const char *value, size_t value_len)
+{
+    if (c->rows == 0) {
+        return FAILED;
+    }
+    Column *column = find_column(c, key, key_len);
+    if (column->rows == c->rows) {
+        return FAILED;
+    }
+    /* the rows in between have no value for the key */
+    while (column->rows < c->rows - 1) {
+        put(&column->values, &column->len, &column->size, "null,", 5);
+        column->rows++;
+    }
+    grow(&column->values, &column->size, column->len + value_len + 1);
+    memcpy(column->values + column->len, value, value_len);
+    column->len += value_len;
+    column->values[column->len++] = ',';
+    column->rows = c->rows;
+    return SUCCESS;
+}
+
+/* parse "key":value pairs, separated by commas */
+int columns_add_line(ColumnBatch *c, const char *line, size_t len)
+{
+    const char *p = line, *end = line + len;
+
+    columns_row(c);
+    p = skip_space(p, end);
+    while (p < end) {
+        const char *key = p;
+        if (*p != '"' || (p = skip_string(p, end)) == NULL) {
+            return FAILED;
+        }
+        size_t key_len = p - key;
+        if (!expect(&p, end, ':')) {
+            return FAILED;
+        }
+        p = skip_space(p, end);
+        const char *value = p;
+        if ((p = skip_value(p, end)) == NULL ||
+            !columns_value(c, key, key_len, value, p - value)) {
+            return FAILED;
+        }
+        p = skip_space(p, end);
+        if (p < end) {
+            if (*p != ',') {
+                return FAILED;
+            }
+            p = skip_space(p + 1, end);
+        }
+    }
+    return SUCCESS;
+}
+
+long columns_rows(const ColumnBatch *c)
+{
+    return c->rows;
+}
+
+size_t columns_write(ColumnBatch *c, char **buf, size_t *size)
+{
+    char rows[32];
+    int rows_len = sprintf(rows, "%ld", c->rows);
+    size_t need = COLUMNS_MAGIC_LEN + c->header_len + rows_len + 32;
+    int i;
+
+    for (i = 0; i < c->num_columns; i++) {
+        Column *column = &c->columns[i];
+        need += column->key_len + column->len + 5 * (c->rows - column->rows) + 4;
+    }
+    grow(buf, size, need);
+
+    char *p = *buf;
+    memcpy(p, COLUMNS_MAGIC, COLUMNS_MAGIC_LEN);
+    p += COLUMNS_MAGIC_LEN;
+    if (c->header_len > 0) {
+        memcpy(p, c->header, c->header_len);
+        p += c->header_len;
+    }
+    memcpy(p, "},\"rows\":", 9);
+    p += 9;
+    memcpy(p, rows, rows_len);
+    p += rows_len;
+    memcpy(p, ",\"columns\":{", 12);
+    p += 12;
+    for (i = 0; i < c->num_columns; i++) {
+        Column *column = &c->columns[i];
+        long r;
+        if (i > 0) {
+            *p++ = ',';
+        }
+        memcpy(p, column->key, column->key_len);
+        p += column->key_len;
+        *p++ = ':';
+        *p++ = '[';
+        memcpy(p, column->values, column->len);
+        p += column->len;
+        /* the last rows have no value for the key */
+        for (r = column->rows; r < c->rows; r++) {
+            memcpy(p, "null,", 5);
+            p += 5;
+        }
+        p[-1] = ']';
+    }
+    *p++ = '}';
+    *p++ = '}';
+    *p = '\0';
+    return p - *buf;
+}
+
+int columns_is_batch(const char *data, size_t len)
+{
+    return len >= COLUMNS_MAGIC_LEN && memcmp(data, COLUMNS_MAGIC, COLUMNS_MAGIC_LEN) == 0;
+}
+
+/* parse a columnar batch, whose parts are referred to by the view */
+int columns_parse(const char *data, size_t len, ColumnView *view)
+{
+    const char *p = data, *end = data + len;
+    const char *number;
+
+    memset(view, 0, sizeof(ColumnView));
+    if (!expect(&p, end, '{') || !expect_key(&p, end, "header")) {
+        return FAILED;
+    }
+    p = skip_space(p, end);
+    const char *header = p;
+    if (p == end || *p != '{' || (p = skip_value(p, end)) == NULL) {
+        return FAILED;
+    }
+    /* the members of the header, without braces and whitespace around them */
+    const char *members_end = p - 1;
+    view->header.start = skip_space(header + 1, members_end);
+    while (members_end > view->header.start && (members_end[-1] == ' ' || members_end[-1] == '\t' ||
+        members_end[-1] == '\r' || members_end[-1] == '\n')) {
+        members_end--;
+    }
+    view->header.len = members_end - view->header.start;
+
+    if (!expect(&p, end, ',') || !expect_key(&p, end, "rows")) {
+        return FAILED;
+    }
+    p = skip_space(p, end);
+    /* each value takes two bytes at least, which bounds the rows of well-formed data */
+    for (view->rows = 0, number = p; p < end && *p >= '0' && *p <= '9' && (size_t) view->rows <= len / 2; p++) {
+        view->rows = view->rows * 10 + (*p - '0');
+    }
+    if (p == number || (size_t) view->rows > len / 2) {
+        return FAILED;
+    }
+    if (!expect(&p, end, ',') || !expect_key(&p, end, "columns") || !parse_columns(&p, end, view) ||
+        !expect(&p, end, '}') || skip_space(p, end) != end || (view->rows > 0 && view->num_columns == 0)) {
+        columns_view_free(view);
+        return FAILED;
+    }
+    return SUCCESS;
+}
+
+void columns_view_free(ColumnView *view)
+{
+    int i;
+
+    for (i = 0; i < view->num_columns; i++) {
+        free(view->columns[i].values);
+    }
+    free(view->columns);
+    view->columns = NULL;
+    view->num_columns = 0;
+}
+
+/* convert a columnar batch into the json array of its rows */
+int columns_to_json(const char *data, size_t len, char **json, size_t *json_len)
+{
+    ColumnView view;
+    long r;
+    int i;
+
+    if (!columns_parse(data, len, &view)) {
+        return FAILED;
+    }
+    JsonOutput out = { malloc(len * 2 + 64), 0, len * 2 + 64 };
+    append(&out, "[", 1);
+    for (r = 0; r < view.rows; r++) {
+        int first = (view.header.len == 0);
+        append(&out, (r == 0) ? "{" : ",{", (r == 0) ? 1 : 2);
+        append(&out, view.header.start, view.header.len);
+        for (i = 0; i < view.num_columns; i++) {
+            ColumnSpan *value = &view.columns[i].values[r];
+            if (value->len == 4 && memcmp(value->start, "null", 4) == 0) {
+                continue;
+            }
+            if (!first) {
+                append(&out, ",", 1);
+            }
+            first = 0;
+            append(&out, view.columns[i].key.start, view.columns[i].key.len);
+            append(&out, ":", 1);
+            append(&out, value->start, value->len);
+        }
+        append(&out, "}", 1);
+    }
+    append(&out, "]", 1);
+    out.json[out.len] = '\0';
+    columns_view_free(&view);
+    *json = out.json;
+    *json_len = out.len;
+    return SUCCESS;
+}
+
+/* get the column of the key, which is created if the batch has none yet */
+static Column *find_column(ColumnBatch *c, const char *key, size_t key_len)
+{
+    int i = c->next;
+    Column *column;
+
+    if (i >= c->num_columns || c->columns[i].key_len != key_len || memcmp(c->columns[i].key, key, key_len) != 0) {
+        for (i = 0; i < c->num_columns; i++) {
+            if (c->columns[i].key_len == key_len && memcmp(c->columns[i].key, key, key_len) == 0) {
+                break;
+            }
+        }
+    }
+    c->next = i + 1;
+    if (i < c->num_columns) {
+        return &c->columns[i];
+    }
+
+    if (c->num_columns == c->max_columns) {
+        c->max_columns = (c->max_columns > 0) ? 2 * c->max_columns : 16;
+        c->columns = realloc(c->columns, c->max_columns * sizeof(Column));
+        memset(c->columns + c->num_columns, 0, (c->max_columns - c->num_columns) * sizeof(Column));
+    }
+    /* the memory of the column is reused from a previous batch */
+    column = &c->columns[c->num_columns++];
+    column->key_len = 0;
+    put(&column->key, &column->key_len, &column->key_size, key, key_len);
+    column->len = 0;
+    column->rows = 0;
+    return column;
+}
+
+/* make sure the buffer has room for need characters and a terminating '\0' */
+static void grow(char **buf, size_t *size, size_t need)
+{
+    if (need < *size) {
+        return;
+    }
+    size_t n = (*size > 0) ? *size : 256;
+    while (need >= n) {
+        n *= 2;
+    }
+    *buf = realloc(*buf, n);
+    *size = n;
+}
+
+static void put(char **buf, size_t *len, size_t *size, const char *s, size_t n)
+{
+    grow(buf, size, *len + n);
+    memcpy(*buf + *len, s, n);
+    *len += n;
+}
+
+static const char *skip_space(const char *p, const char *end)
+{
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n')) {
+        p++;
+    }
+    return p;
+}
+
+/* skip the string starting at p
+   return the position behind its closing quote; NULL if it is not closed */
+static const char *skip_string(const char *p, const char *end)
+{
+    for (p++; p < end; p++) {
+        if (*p == '\\') {
+            p++;
+        } else if (*p == '"') {
+            return p + 1;
+        }
+    }
+    return NULL;
+}
+
+/* skip the value starting at p, which is not checked beyond its extent
+   return the position behind it; NULL if it is not closed */
+static const char *skip_value(const char *p, const char *end)
+{
+    const char *start = p;
+    long depth = 0;
+
+    if (p == end) {
+        return NULL;
+    }
+    if (*p == '"') {
+        return skip_string(p, end);
+    }
+    if (*p != '{' && *p != '[') {
+        while (p < end && *p != ',' && *p != '}' && *p != ']' && *p != ' ' && *p != '\t' &&
+            *p != '\r' && *p != '\n') {
+            p++;
+        }
+        return (p > start) ? p : NULL;
+    }
+    while (p < end) {
+        if (*p == '"') {
+            if ((p = skip_string(p, end)) == NULL) {
+                return NULL;
+            }
+            continue;
+        }
+        if (*p == '{' || *p == '[') {
+            depth++;
+        } else if (*p == '}' || *p == ']') {
+            if (--depth == 0) {
+                return p + 1;
+            }
+        }
+        p++;
+    }
+    return NULL;
+}
+
+/* skip whitespace and the character c
+   return 1 if it is there; otherwise return 0 */
+static int expect(const char **p, const char *end, char c)
+{
+    *p = skip_space(*p, end);
+    if (*p == end || **p != c) {
+        return FAILED;
+    }
+    (*p)++;
+    return SUCCESS;
+}
+
+/* skip whitespace, the given key in quotes and the colon
+   return 1 if they are there; otherwise return 0 */
+static int expect_key(const char **p, const char *end, const char *key)
+{
+    size_t len = strlen(key);
+
+    *p = skip_space(*p, end);
+    if ((size_t) (end - *p) < len + 2 || (*p)[0] != '"' || memcmp(*p + 1, key, len) != 0 || (*p)[len + 1] != '"') {
+        return FAILED;
+    }
+    *p += len + 2;
+    return expect(p, end, ':');
+}
+
+/* parse the object of columns, each of which has to have a value for each row
+   return 1 on success; otherwise return 0 */
+static int parse_columns(const char **p, const char *end, ColumnView *view)
+{
+    int max_columns = 0;
+
+    if (!expect(p, end, '{')) {
+        return FAILED;
+    }
+    *p = skip_space(*p, end);
+    if (*p < end && **p == '}') {
+        (*p)++;
+        return SUCCESS;
+    }
+    for (;;) {
+        long r;
+        *p = skip_space(*p, end);
+        if (*p == end || **p != '"') {
+            return FAILED;
+        }
+        if (view->num_columns == max_columns) {
+            max_columns = (max_columns > 0) ? 2 * max_columns : 16;
+            view->columns = realloc(view->columns, max_columns * sizeof(ColumnValues));
+        }
+        ColumnValues *column = &view->columns[view->num_columns++];
+        column->key.start = *p;
+        column->values = malloc((view->rows > 0 ? view->rows : 1) * sizeof(ColumnSpan));
+        if ((*p = skip_string(*p, end)) == NULL) {
+            return FAILED;
+        }
+        column->key.len = *p - column->key.start;
+        if (!expect(p, end, ':') || !expect(p, end, '[')) {
+            return FAILED;
+        }
+        for (r = 0; r < view->rows; r++) {
+            if (r > 0 && !expect(p, end, ',')) {
+                return FAILED;
+            }
+            *p = skip_space(*p, end);
+            column->values[r].start = *p;
+            if ((*p = skip_value(*p, end)) == NULL) {
+                return FAILED;
+            }
+            column->values[r].len = *p - column->values[r].start;
+        }
+        if (!expect(p, end, ']')) {
+            return FAILED;
+        }
+        *p = skip_space(*p, end);
+        if (*p < end && **p == ',') {
+            (*p)++;
+            continue;
+        }
+        return expect(p, end, '}');
+    }
+}
+
+static void append(JsonOutput *out, const char *s, size_t len)
+{
+    put(&out->json, &out->len, &out->size, s, len);
+}
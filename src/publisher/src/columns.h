@@ -0,0 +1,148 @@
+/*
+ * Copyright (C) 2014-2015 University of Stuttgart
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef COLUMNS_H_
+#define COLUMNS_H_
+
+#include <stddef.h>
+
+/*
+ * Columnar encoding of a bulk of rows, i.e. of a json array of objects.
+ *
+ * The members which are the same in all rows, like WorkflowID or host, are
+ * sent once in the header; every other key becomes a column, which holds the
+ * values of all rows in order:
+ *
+ *   {"header":{"WorkflowID":"w","host":"h","type":"T"},"rows":2,
+ *    "columns":{"local_timestamp":["1.0","2.0"],"CPU_usage":[1.500,null]}}
+ *
+ * null stands for a row without a value for the key; such a row is decoded
+ * without the key, so that the rows of a bulk may have different keys. Values
+ * are kept as the json text they are given in.
+ */
+typedef struct ColumnBatch_t ColumnBatch;
+
+/**
+ * @brief Creates an empty batch.
+ */
+ColumnBatch *columns_new(void);
+
+/**
+ * @brief Frees the batch.
+ */
+void columns_free(ColumnBatch *c);
+
+/**
+ * @brief Empties the batch; its memory is kept for the next one.
+ */
+void columns_begin(ColumnBatch *c);
+
+/**
+ * @brief Appends members, e.g. "\"host\":\"h\"", to the header.
+ *
+ * Leading and trailing whitespace and commas are dropped.
+ */
+void columns_header(ColumnBatch *c, const char *members, size_t len);
+
+/**
+ * @brief Starts the next row.
+ */
+void columns_row(ColumnBatch *c);
+
+/**
+ * @brief Appends the value of a key to the current row.
+ *
+ * The key is a json string with its quotes; the value is json text. Keys are
+ * looked up at the position they had in the previous row first, so that rows
+ * with the same keys in the same order are cheap to append.
+ *
+ * @return 1 on success; 0 if no row is started or the row has a value for the key already
+ */
+int columns_value(ColumnBatch *c, const char *key, size_t key_len, const char *value, size_t value_len);
+
+/**
+ * @brief Appends a row given as json members, e.g. "\"a\":1, \"b\":\"x\"".
+ *
+ * @return 1 on success; 0 if the line is not a list of members
+ */
+int columns_add_line(ColumnBatch *c, const char *line, size_t len);
+
+/**
+ * @brief Returns the number of rows of the batch.
+ */
+long columns_rows(const ColumnBatch *c);
+
+/**
+ * @brief Writes the batch into *buf, which is grown to *size if needed.
+ *
+ * The text is terminated by '\0'.
+ *
+ * @return the length of the text
+ */
+size_t columns_write(ColumnBatch *c, char **buf, size_t *size);
+
+/* part of the data of a batch parsed by columns_parse() */
+typedef struct ColumnSpan_t {
+    const char *start;
+    size_t len;
+} ColumnSpan;
+
+/* the key of a column and its value in each row, null for a row without value */
+typedef struct ColumnValues_t {
+    ColumnSpan key;
+    ColumnSpan *values;
+} ColumnValues;
+
+/* a batch parsed by columns_parse(), whose spans point into its data */
+typedef struct ColumnView_t {
+    ColumnSpan header;              /* members of the header, without braces */
+    long rows;
+    ColumnValues *columns;
+    int num_columns;
+} ColumnView;
+
+/**
+ * @brief Parses a columnar batch; the data has to stay valid while the view is used.
+ *
+ * @return 1 on success, the view has to be freed with columns_view_free() then;
+ * 0 if the data is malformed
+ */
+int columns_parse(const char *data, size_t len, ColumnView *view);
+
+/**
+ * @brief Frees the columns of the view.
+ */
+void columns_view_free(ColumnView *view);
+
+/**
+ * @brief Checks if the data starts like a batch written by columns_write().
+ *
+ * @return 1 if it does; 0 otherwise
+ */
+int columns_is_batch(const char *data, size_t len);
+
+/**
+ * @brief Converts a columnar batch into the json array of its rows.
+ *
+ * Each row starts with the members of the header, followed by the non-null
+ * values of the columns in their order, so a bulk of the agent is converted
+ * into exactly the text the agent writes in the row format. The json text is
+ * terminated by '\0' and has to be freed by the caller.
+ *
+ * @return 1 on success; 0 if the data is malformed
+ */
+int columns_to_json(const char *data, size_t len, char **json, size_t *json_len);
+#endif
@@ -0,0 +1,267 @@
+/*
+ * Copyright (C) 2014-2015 University of Stuttgart
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+#include "mf_debug.h"
+#include "compress.h"
+
+#define SUCCESS 1
+#define FAILED  0
+/* size of the input chunks read from the source */
+#define COMPRESS_CHUNK 16384
+/* window bits of zlib to write a gzip header and trailer */
+#define GZIP_WINDOW_BITS (15 + 16)
+
+ /*******************************************************************************
+ * Variables Declarations
+ ******************************************************************************/
+struct Compressor_t {
+    int codec;
+    compress_source source;
+    void *arg;
+    char in[COMPRESS_CHUNK];
+    size_t in_len;
+    size_t in_pos;
+    int in_done;            /* set when the source is exhausted */
+    int finished;           /* set when the stream is completely written */
+#ifdef HAVE_ZLIB
+    z_stream zs;
+#endif
+#ifdef HAVE_ZSTD
+    ZSTD_CStream *zcs;
+#endif
+};
+
+/*******************************************************************************
+ * Forward Declarations
+ ******************************************************************************/
+static int compress_chunk(Compressor *c, char *out, size_t size, size_t *produced);
+
+/*******************************************************************************
+ * Functions implementation
+ ******************************************************************************/
+/* get the codec of the given name */
+int compress_codec(const char *name)
+{
+    if (name == NULL || *name == '\0' || strcmp(name, "none") == 0 || strcmp(name, "off") == 0) {
+        return COMPRESS_NONE;
+    }
+#ifdef HAVE_ZLIB
+    if (strcmp(name, "gzip") == 0) {
+        return COMPRESS_GZIP;
+    }
+#endif
+#ifdef HAVE_ZSTD
+    if (strcmp(name, "zstd") == 0) {
+        return COMPRESS_ZSTD;
+    }
+#endif
+    return -1;
+}
+
+/* get the Content-Encoding of the codec */
+const char *compress_encoding(int codec)
+{
+    switch (codec) {
+    case COMPRESS_GZIP:
+        return "gzip";
+    case COMPRESS_ZSTD:
+        return "zstd";
+    default:
+        return NULL;
+    }
+}
+
+/* create a compressor reading from the source */
+Compressor *compressor_new(int codec, int level, compress_source source, void *arg)
+{
+    Compressor *c = calloc(1, sizeof(Compressor));
+    c->codec = codec;
+    c->source = source;
+    c->arg = arg;
+
+    switch (codec) {
+    case COMPRESS_NONE:
+        return c;
+#ifdef HAVE_ZLIB
+    case COMPRESS_GZIP:
+        if (deflateInit2(&c->zs, (level > 0) ? level : Z_DEFAULT_COMPRESSION, Z_DEFLATED, 
+            GZIP_WINDOW_BITS, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+            log_error("Cannot initialize gzip compression");
+            break;
+        }
+        return c;
+#endif
+#ifdef HAVE_ZSTD
+    case COMPRESS_ZSTD:
+        c->zcs = ZSTD_createCStream();
+        if (c->zcs == NULL || ZSTD_isError(ZSTD_initCStream(c->zcs, (level > 0) ? level : 3))) {
+            log_error("Cannot initialize zstd compression");
+            ZSTD_freeCStream(c->zcs);
+            break;
+        }
+        return c;
+#endif
+    default:
+        log_error("Unknown compression codec %d", codec);
+        break;
+    }
+    free(c);
+    return NULL;
+}
+
+/* fill out with compressed data, reading chunks from the source as needed */
+size_t compressor_read(Compressor *c, char *out, size_t size)
+{
+    size_t produced = 0;
+
+    while (produced < size && !c->finished) {
+        if (c->in_pos == c->in_len && !c->in_done) {
+            c->in_len = c->source(c->in, COMPRESS_CHUNK, c->arg);
+            c->in_pos = 0;
+            c->in_done = (c->in_len == 0);
+        }
+        if (compress_chunk(c, out, size, &produced) != SUCCESS) {
+            return COMPRESS_ERROR;
+        }
+    }
+    return produced;
+}
+
+/* free the compressor */
+void compressor_free(Compressor *c)
+{
+    if (c == NULL) {
+        return;
+    }
+#ifdef HAVE_ZLIB
+    if (c->codec == COMPRESS_GZIP) {
+        deflateEnd(&c->zs);
+    }
+#endif
+#ifdef HAVE_ZSTD
+    if (c->codec == COMPRESS_ZSTD) {
+        ZSTD_freeCStream(c->zcs);
+    }
+#endif
+    free(c);
+}
+
+/* compress a buffer at once */
+int compress_buffer(int codec, int level, const char *data, size_t len, char **out, size_t *out_len)
+{
+    CompressMemory src = { data, len, 0 };
+    Compressor *c = compressor_new(codec, level, compress_memory_source, &src);
+    if (c == NULL) {
+        return FAILED;
+    }
+
+    size_t size = len / 4 + 64;
+    size_t n, total = 0;
+    char *buffer = malloc(size);
+    while ((n = compressor_read(c, buffer + total, size - total)) > 0) {
+        if (n == COMPRESS_ERROR) {
+            free(buffer);
+            compressor_free(c);
+            return FAILED;
+        }
+        total += n;
+        if (total == size) {
+            size *= 2;
+            buffer = realloc(buffer, size);
+        }
+    }
+    compressor_free(c);
+    *out = buffer;
+    *out_len = total;
+    return SUCCESS;
+}
+
+/* compress the pending input into out + *produced, and finish the stream once the input is exhausted */
+static int compress_chunk(Compressor *c, char *out, size_t size, size_t *produced)
+{
+    switch (c->codec) {
+#ifdef HAVE_ZLIB
+    case COMPRESS_GZIP: {
+        c->zs.next_in = (Bytef *) c->in + c->in_pos;
+        c->zs.avail_in = c->in_len - c->in_pos;
+        c->zs.next_out = (Bytef *) out + *produced;
+        c->zs.avail_out = size - *produced;
+        int ret = deflate(&c->zs, c->in_done ? Z_FINISH : Z_NO_FLUSH);
+        if (ret == Z_STREAM_ERROR) {
+            log_error("gzip compression failed");
+            return FAILED;
+        }
+        c->in_pos = c->in_len - c->zs.avail_in;
+        *produced = size - c->zs.avail_out;
+        c->finished = (ret == Z_STREAM_END);
+        return SUCCESS;
+    }
+#endif
+#ifdef HAVE_ZSTD
+    case COMPRESS_ZSTD: {
+        ZSTD_outBuffer output = { out, size, *produced };
+        size_t ret;
+        if (c->in_done) {
+            ret = ZSTD_endStream(c->zcs, &output);
+            c->finished = (ret == 0);
+        } else {
+            ZSTD_inBuffer input = { c->in, c->in_len, c->in_pos };
+            ret = ZSTD_compressStream(c->zcs, &output, &input);
+            c->in_pos = input.pos;
+        }
+        if (ZSTD_isError(ret)) {
+            log_error("zstd compression failed: %s", ZSTD_getErrorName(ret));
+            return FAILED;
+        }
+        *produced = output.pos;
+        return SUCCESS;
+    }
+#endif
+    default: {
+        /* no compression, copy the input */
+        size_t n = c->in_len - c->in_pos;
+        if (n > size - *produced) {
+            n = size - *produced;
+        }
+        memcpy(out + *produced, c->in + c->in_pos, n);
+        c->in_pos += n;
+        *produced += n;
+        c->finished = c->in_done;
+        return SUCCESS;
+    }
+    }
+}
+
+/* read from the memory buffer */
+size_t compress_memory_source(char *buffer, size_t size, void *arg)
+{
+    CompressMemory *src = (CompressMemory *) arg;
+    size_t n = src->len - src->pos;
+    if (n > size) {
+        n = size;
+    }
+    memcpy(buffer, src->data + src->pos, n);
+    src->pos += n;
+    return n;
+}
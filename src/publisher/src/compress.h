@@ -0,0 +1,99 @@
+/*
+ * Copyright (C) 2014-2015 University of Stuttgart
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef COMPRESS_H_
+#define COMPRESS_H_
+
+#include <stddef.h>
+
+/* codecs of the request bodies */
+#define COMPRESS_NONE 0
+#define COMPRESS_GZIP 1
+#define COMPRESS_ZSTD 2
+
+/* returned by compressor_read() on failure */
+#define COMPRESS_ERROR ((size_t) -1)
+
+/**
+ * @brief Reads up to size bytes of uncompressed data into buffer.
+ *
+ * @return the number of bytes read; 0 at the end of the data
+ */
+typedef size_t (*compress_source)(char *buffer, size_t size, void *arg);
+
+/**
+ * @brief Memory buffer to be read by compress_memory_source().
+ */
+typedef struct CompressMemory_t {
+    const char *data;
+    size_t len;
+    size_t pos;
+} CompressMemory;
+
+/**
+ * @brief Streaming compressor, which pulls its input from a source on demand.
+ *
+ * Only one chunk of the input is held in memory at a time, so large uploads
+ * can be compressed while they are sent.
+ */
+typedef struct Compressor_t Compressor;
+
+/**
+ * @brief Returns the codec of the given name (none, gzip or zstd).
+ *
+ * @return the codec; -1 if it is unknown or not compiled in
+ */
+int compress_codec(const char *name);
+
+/**
+ * @brief Returns the value of the Content-Encoding header of the codec; NULL for none.
+ */
+const char *compress_encoding(int codec);
+
+/**
+ * @brief Creates a compressor reading from the given source.
+ *
+ * The level is passed to the codec; 0 selects its default level.
+ *
+ * @return the compressor; NULL on failure
+ */
+Compressor *compressor_new(int codec, int level, compress_source source, void *arg);
+
+/**
+ * @brief Reads up to size bytes of compressed data.
+ *
+ * @return the number of bytes; 0 at the end of the stream; COMPRESS_ERROR on failure
+ */
+size_t compressor_read(Compressor *c, char *out, size_t size);
+
+/**
+ * @brief Frees the compressor.
+ */
+void compressor_free(Compressor *c);
+
+/**
+ * @brief Source reading from a CompressMemory buffer.
+ */
+size_t compress_memory_source(char *buffer, size_t size, void *arg);
+
+/**
+ * @brief Compresses len bytes of data into a new buffer, which has to be freed by the caller.
+ *
+ * @return 1 on success; 0 otherwise
+ */
+int compress_buffer(int codec, int level, const char *data, size_t len, char **out, size_t *out_len);
+
+#endif /* COMPRESS_H_ */
@@ -0,0 +1,192 @@
+/*
+ * Copyright (C) 2014-2015 University of Stuttgart
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "mf_debug.h"
+#include "publisher.h"
+#include "forward.h"
+
+#define SUCCESS 1
+#define FAILED  0
+
+ /*******************************************************************************
+ * Variables Declarations
+ ******************************************************************************/
+static pthread_once_t forward_once = PTHREAD_ONCE_INIT;
+/* connection of each thread to the aggregator, stored as descriptor + 1 */
+static pthread_key_t socket_key;
+
+/*******************************************************************************
+ * Forward Declarations
+ ******************************************************************************/
+static void init_forward_once(void);
+static int get_socket(const char *path);
+static void drop_socket(void);
+static void close_socket(void *arg);
+static int send_all(int fd, const char *data, size_t len);
+
+/*******************************************************************************
+ * Functions implementation
+ ******************************************************************************/
+int forward_bulk(const char *path, const char *URL, const char *data, size_t len, int format)
+{
+    char header[FORWARD_HEADER_MAX + FORWARD_URL_MAX];
+    size_t URL_len = strlen(URL);
+    int attempt;
+
+    if (URL_len > FORWARD_URL_MAX || len > FORWARD_DATA_MAX) {
+        log_error("forward_bulk bulk of %zu bytes for %s is too large", len, URL);
+        return FAILED;
+    }
+    int header_len = snprintf(header, FORWARD_HEADER_MAX, "%s %d %zu %zu\n", FORWARD_MAGIC, format, URL_len, len);
+    memcpy(header + header_len, URL, URL_len);
+
+    for (attempt = 0; attempt < 2; attempt++) {
+        int fd = get_socket(path);
+        if (fd < 0) {
+            return FAILED;
+        }
+        if (!send_all(fd, header, header_len + URL_len)) {
+            /* the aggregator has closed the connection, e.g. as it was restarted */
+            drop_socket();
+            continue;
+        }
+        char ack;
+        ssize_t n;
+        if (!send_all(fd, data, len)) {
+            break;
+        }
+        do {
+            n = recv(fd, &ack, 1, 0);
+        } while (n < 0 && errno == EINTR);
+        if (n != 1) {
+            break;
+        }
+        if (ack != FORWARD_ACCEPTED) {
+            log_warn("forward_bulk the aggregator has rejected a bulk of %zu bytes", len);
+            return FAILED;
+        }
+        return SUCCESS;
+    }
+    /* the bulk may or may not have been taken over; it is reported as failed, not sent twice */
+    log_error("forward_bulk connection to the aggregator at %s lost", path);
+    drop_socket();
+    return FAILED;
+}
+
+int forward_parse_header(const char *line, int *format, size_t *URL_len, size_t *len)
+{
+    char magic[8];
+    unsigned long long u, l;
+
+    if (sscanf(line, "%7s %d %llu %llu", magic, format, &u, &l) != 4 || strcmp(magic, FORWARD_MAGIC) != 0) {
+        return FAILED;
+    }
+    if (*format < PUBLISH_JSON || *format > PUBLISH_GORILLA || u == 0 || u > FORWARD_URL_MAX ||
+        l == 0 || l > FORWARD_DATA_MAX) {
+        return FAILED;
+    }
+    *URL_len = (size_t) u;
+    *len = (size_t) l;
+    return SUCCESS;
+}
+
+static void init_forward_once(void)
+{
+    pthread_key_create(&socket_key, close_socket);
+}
+
+/* Get the connection of the calling thread to the aggregator, which is opened on first use
+   return the socket; -1 if the aggregator cannot be reached */
+static int get_socket(const char *path)
+{
+    struct sockaddr_un addr;
+
+    pthread_once(&forward_once, init_forward_once);
+    intptr_t s = (intptr_t) pthread_getspecific(socket_key);
+    if (s > 0) {
+        return (int) (s - 1);
+    }
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        log_error("forward_bulk socket path %s is too long", path);
+        return -1;
+    }
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        log_error("forward_bulk cannot create socket");
+        return -1;
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+    if (connect(fd, (struct sockaddr *) &addr, sizeof(addr)) != 0) {
+        log_error("forward_bulk cannot connect to the aggregator at %s", path);
+        close(fd);
+        return -1;
+    }
+    pthread_setspecific(socket_key, (void *) (intptr_t) (fd + 1));
+    return fd;
+}
+
+/* Drop the connection the calling thread inherited by fork(); frames and answers of both processes 
+   would interleave on it otherwise */
+void forward_forget_socket(void)
+{
+    pthread_once(&forward_once, init_forward_once);
+    drop_socket();
+}
+
+/* Close the connection of the calling thread */
+static void drop_socket(void)
+{
+    void *s = pthread_getspecific(socket_key);
+    if (s != NULL) {
+        pthread_setspecific(socket_key, NULL);
+        close_socket(s);
+    }
+}
+
+/* Close the connection of a thread, when it exits */
+static void close_socket(void *arg)
+{
+    close((int) ((intptr_t) arg - 1));
+}
+
+/* Write all len bytes, without raising SIGPIPE if the aggregator is gone
+   return 1 on success; otherwise return 0 */
+static int send_all(int fd, const char *data, size_t len)
+{
+    while (len > 0) {
+        ssize_t n = send(fd, data, len, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return FAILED;
+        }
+        data += n;
+        len -= n;
+    }
+    return SUCCESS;
+}
@@ -0,0 +1,67 @@
+/*
+ * Copyright (C) 2014-2015 University of Stuttgart
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FORWARD_H_
+#define FORWARD_H_
+
+#include <stddef.h>
+
+/*
+ * Protocol between the publisher and the node-local aggregator mf_aggregator,
+ * over a UNIX domain socket. Each bulk is sent as one frame:
+ *
+ *   "MF1 <format> <length of URL> <length of data>\n" URL data
+ *
+ * which the aggregator answers with FORWARD_ACCEPTED once it has taken the
+ * bulk over, or with FORWARD_REJECTED, e.g. if too much data is waiting for
+ * the server already.
+ */
+#define FORWARD_MAGIC "MF1"
+#define FORWARD_ACCEPTED '+'
+#define FORWARD_REJECTED '-'
+/* longest header line, URL and data of a frame */
+#define FORWARD_HEADER_MAX 64
+#define FORWARD_URL_MAX 1024
+#define FORWARD_DATA_MAX (256L << 20)
+
+/**
+ * @brief Hands len bytes of data in the given format, to be sent to the URL,
+ * over to the aggregator listening on the socket at path.
+ *
+ * Each thread keeps its connection to the aggregator open; a connection closed
+ * by the aggregator in the meantime is opened again once.
+ *
+ * @return 1 if the aggregator has accepted the data; 0 otherwise
+ */
+int forward_bulk(const char *path, const char *URL, const char *data, size_t len, int format);
+
+/**
+ * @brief Parses the header line of a frame, without its newline.
+ *
+ * @return 1 if the header is valid; 0 otherwise
+ */
+int forward_parse_header(const char *line, int *format, size_t *URL_len, size_t *len);
+
+/**
+ * @brief Drops the connection to the aggregator which the calling thread
+ * inherited by fork(), without using it.
+ *
+ * Only the descriptor of the calling process is closed, the connection of the
+ * parent stays open; the next bulk of the thread opens a connection of its own.
+ */
+void forward_forget_socket(void);
+
+#endif /* FORWARD_H_ */
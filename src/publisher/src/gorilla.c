@@ -0,0 +1,601 @@
+/*
+ * Copyright (C) 2014-2015 University of Stuttgart
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <limits.h>
+#include "columns.h"
+#include "gorilla.h"
+
+#define SUCCESS 1
+#define FAILED  0
+#define GORILLA_MAGIC "MFG1"
+#define GORILLA_MAGIC_LEN 4
+#define GORILLA_KIND_MASK 0x0f
+/* fixed-point numbers whose mantissa has more digits are kept as text */
+#define GORILLA_MAX_DIGITS 18
+#define GORILLA_MAX_DECIMALS 9
+/* longest text of a fixed-point number: sign, digits, point and quotes */
+#define GORILLA_NUMBER_LEN (GORILLA_MAX_DIGITS + 4)
+
+ /*******************************************************************************
+ * Variables Declarations
+ ******************************************************************************/
+/* growable output of the encoder and the decoder */
+typedef struct Output_t {
+    char *buf;
+    size_t len;
+    size_t size;
+} Output;
+
+/* bit stream written into an output, most significant bit first */
+typedef struct BitWriter_t {
+    Output *out;
+    uint64_t acc;                   /* bits not written yet, in the low bits */
+    int bits;                       /* number of them, less than 8 between calls */
+} BitWriter;
+
+typedef struct BitReader_t {
+    const unsigned char *pos;
+    const unsigned char *end;
+    unsigned int acc;               /* current byte */
+    int bits;                       /* bits of it left */
+} BitReader;
+
+/*******************************************************************************
+ * Forward Declarations
+ ******************************************************************************/
+static void encode_column(Output *out, Output *stream, const ColumnValues *column, long rows, int64_t *mantissas);
+static int numeric_column(const ColumnValues *column, long rows, int64_t *mantissas, int *kind, int *decimals);
+static int parse_fixed(const ColumnSpan *value, int quoted, int64_t *mantissa, int *decimals);
+static int format_fixed(char *buf, int64_t mantissa, int decimals, int quoted);
+static uint64_t difference(int kind, uint64_t value, uint64_t *last, uint64_t *last_delta);
+static int difference_bits(uint64_t difference);
+static void put_difference(BitWriter *w, uint64_t difference);
+static int get_difference(BitReader *r, uint64_t *difference);
+static int decode_column(const unsigned char **pos, const unsigned char *end, long rows, Output *out);
+static int is_null(const ColumnSpan *value);
+static void put_bits(BitWriter *w, uint64_t v, int n);
+static void flush_bits(BitWriter *w);
+static int get_bits(BitReader *r, int n, uint64_t *v);
+static void put_varint(Output *out, uint64_t v);
+static int get_varint(const unsigned char **pos, const unsigned char *end, uint64_t *v);
+static void reserve(Output *out, size_t len);
+static void append(Output *out, const char *s, size_t len);
+
+/*******************************************************************************
+ * Functions implementation
+ ******************************************************************************/
+int gorilla_encode(const char *batch, size_t len, char **data, size_t *data_len)
+{
+    ColumnView view;
+    int i;
+
+    if (!columns_parse(batch, len, &view)) {
+        return FAILED;
+    }
+    Output out = { malloc(len / 4 + 256), 0, len / 4 + 256 };
+    Output stream = { NULL, 0, 0 };
+    int64_t *mantissas = malloc((view.rows > 0 ? view.rows : 1) * sizeof(int64_t));
+
+    append(&out, GORILLA_MAGIC, GORILLA_MAGIC_LEN);
+    put_varint(&out, view.rows);
+    put_varint(&out, view.num_columns);
+    put_varint(&out, view.header.len);
+    append(&out, view.header.start, view.header.len);
+    for (i = 0; i < view.num_columns; i++) {
+        encode_column(&out, &stream, &view.columns[i], view.rows, mantissas);
+    }
+    free(mantissas);
+    free(stream.buf);
+    columns_view_free(&view);
+    *data = out.buf;
+    *data_len = out.len;
+    return SUCCESS;
+}
+
+int gorilla_is_encoded(const char *data, size_t len)
+{
+    return len >= GORILLA_MAGIC_LEN && memcmp(data, GORILLA_MAGIC, GORILLA_MAGIC_LEN) == 0;
+}
+
+int gorilla_decode(const char *data, size_t len, char **batch, size_t *batch_len)
+{
+    const unsigned char *pos = (const unsigned char *) data + GORILLA_MAGIC_LEN;
+    const unsigned char *end = (const unsigned char *) data + len;
+    uint64_t rows, num_columns, header_len, i;
+    char number[32];
+
+    if (!gorilla_is_encoded(data, len) || !get_varint(&pos, end, &rows) || !get_varint(&pos, end, &num_columns) ||
+        !get_varint(&pos, end, &header_len) || header_len > (uint64_t) (end - pos) ||
+        rows > (uint64_t) LONG_MAX / 8 || (rows > 0 && num_columns == 0)) {
+        return FAILED;
+    }
+    Output out = { malloc(len * 8 + 256), 0, len * 8 + 256 };
+    append(&out, "{\"header\":{", 11);
+    append(&out, (const char *) pos, header_len);
+    pos += header_len;
+    append(&out, "},\"rows\":", 9);
+    append(&out, number, sprintf(number, "%llu", (unsigned long long) rows));
+    append(&out, ",\"columns\":{", 12);
+    for (i = 0; i < num_columns; i++) {
+        if (i > 0) {
+            append(&out, ",", 1);
+        }
+        if (!decode_column(&pos, end, (long) rows, &out)) {
+            free(out.buf);
+            return FAILED;
+        }
+    }
+    if (pos != end) {
+        free(out.buf);
+        return FAILED;
+    }
+    append(&out, "}}", 2);
+    out.buf[out.len] = '\0';
+    *batch = out.buf;
+    *batch_len = out.len;
+    return SUCCESS;
+}
+
+/* write the key, the kind and the values of a column */
+static void encode_column(Output *out, Output *stream, const ColumnValues *column, long rows, int64_t *mantissas)
+{
+    int kind, decimals = 0;
+    long r, present = 0;
+
+    put_varint(out, column->key.len);
+    append(out, column->key.start, column->key.len);
+    for (r = 0; r < rows; r++) {
+        present += !is_null(&column->values[r]);
+    }
+    if (!numeric_column(column, rows, mantissas, &kind, &decimals)) {
+        kind = GORILLA_RAW;
+    }
+    if (present < rows) {
+        kind |= GORILLA_NULLS;
+    }
+    reserve(out, 2);
+    out->buf[out->len++] = (char) kind;
+    if ((kind & GORILLA_KIND_MASK) != GORILLA_RAW) {
+        out->buf[out->len++] = (char) decimals;
+    }
+    if (kind & GORILLA_NULLS) {
+        size_t bytes = (rows + 7) / 8;
+        reserve(out, bytes);
+        memset(out->buf + out->len, 0, bytes);
+        for (r = 0; r < rows; r++) {
+            if (!is_null(&column->values[r])) {
+                out->buf[out->len + r / 8] |= (char) (0x80 >> (r % 8));
+            }
+        }
+        out->len += bytes;
+    }
+
+    if ((kind & GORILLA_KIND_MASK) == GORILLA_RAW) {
+        for (r = 0; r < rows; r++) {
+            if (!is_null(&column->values[r])) {
+                put_varint(out, column->values[r].len);
+                append(out, column->values[r].start, column->values[r].len);
+            }
+        }
+        return;
+    }
+    /* the mantissas of the values, which numeric_column() has collected */
+    BitWriter w = { stream, 0, 0 };
+    uint64_t last = 0, last_delta = 0;
+    stream->len = 0;
+    for (r = 0; r < present; r++) {
+        put_difference(&w, difference(kind & GORILLA_KIND_MASK, (uint64_t) mantissas[r], &last, &last_delta));
+    }
+    flush_bits(&w);
+    put_varint(out, stream->len);
+    append(out, stream->buf, stream->len);
+}
+
+/* check if the values of a column are fixed-point numbers with the same decimals, and collect their
+   mantissas; the kind of differences is the one which takes fewer bits
+   return 1 if the column can be encoded as numbers; otherwise return 0 */
+static int numeric_column(const ColumnValues *column, long rows, int64_t *mantissas, int *kind, int *decimals)
+{
+    uint64_t last = 0, last_delta = 0, last2 = 0, last2_delta = 0;
+    unsigned long long bits = 0, bits2 = 0;
+    long r, n = 0;
+    int quoted = -1;
+
+    for (r = 0; r < rows; r++) {
+        const ColumnSpan *value = &column->values[r];
+        int d;
+        if (is_null(value)) {
+            continue;
+        }
+        if (quoted < 0) {
+            quoted = (value->len > 0 && value->start[0] == '"');
+        }
+        if (!parse_fixed(value, quoted, &mantissas[n], &d) || (n > 0 && d != *decimals)) {
+            return FAILED;
+        }
+        *decimals = d;
+        bits += difference_bits(difference(GORILLA_DELTA, (uint64_t) mantissas[n], &last, &last_delta));
+        bits2 += difference_bits(difference(GORILLA_DELTA2, (uint64_t) mantissas[n], &last2, &last2_delta));
+        n++;
+    }
+    if (n == 0) {
+        /* a column without values has no numbers either */
+        *decimals = 0;
+        quoted = 0;
+    }
+    *kind = ((bits2 < bits) ? GORILLA_DELTA2 : GORILLA_DELTA) | (quoted ? GORILLA_QUOTED : 0);
+    return SUCCESS;
+}
+
+/* parse a json number like -12.345, or a string of it if quoted, into its mantissa and decimals
+   return 1 if format_fixed() writes the number back as the same text; otherwise return 0 */
+static int parse_fixed(const ColumnSpan *value, int quoted, int64_t *mantissa, int *decimals)
+{
+    const char *p = value->start, *end = value->start + value->len;
+    char text[GORILLA_NUMBER_LEN + 1];
+    uint64_t m = 0;
+    int digits = 0, negative = 0;
+
+    if (value->len > GORILLA_NUMBER_LEN) {
+        return FAILED;
+    }
+    if (quoted) {
+        if (value->len < 2 || *p != '"' || end[-1] != '"') {
+            return FAILED;
+        }
+        p++;
+        end--;
+    }
+    if (p < end && *p == '-') {
+        negative = 1;
+        p++;
+    }
+    *decimals = -1;
+    for (; p < end; p++) {
+        if (*p == '.' && *decimals < 0) {
+            *decimals = 0;
+            continue;
+        }
+        if (*p < '0' || *p > '9' || ++digits > GORILLA_MAX_DIGITS) {
+            return FAILED;
+        }
+        m = m * 10 + (*p - '0');
+        if (*decimals >= 0) {
+            (*decimals)++;
+        }
+    }
+    if (*decimals < 0) {
+        *decimals = 0;
+    }
+    if (digits == 0 || *decimals > GORILLA_MAX_DECIMALS) {
+        return FAILED;
+    }
+    *mantissa = negative ? -(int64_t) m : (int64_t) m;
+    /* e.g. 1.50 and -0.000 are written back differently, their columns are kept as text */
+    int len = format_fixed(text, *mantissa, *decimals, quoted);
+    return (size_t) len == value->len && memcmp(text, value->start, len) == 0;
+}
+
+/* write the mantissa with the given decimals, e.g. 12345 with 3 decimals as 12.345
+   return the length of the text */
+static int format_fixed(char *buf, int64_t mantissa, int decimals, int quoted)
+{
+    char digits[GORILLA_NUMBER_LEN];
+    uint64_t u = (mantissa < 0) ? -(uint64_t) mantissa : (uint64_t) mantissa;
+    char *p = buf;
+    int n = 0;
+
+    /* at least one digit before the point */
+    do {
+        digits[n++] = (char) ('0' + u % 10);
+        u /= 10;
+    } while (u > 0 || n <= decimals);
+
+    if (quoted) {
+        *p++ = '"';
+    }
+    if (mantissa < 0) {
+        *p++ = '-';
+    }
+    while (n > 0) {
+        if (n == decimals) {
+            *p++ = '.';
+        }
+        *p++ = digits[--n];
+    }
+    if (quoted) {
+        *p++ = '"';
+    }
+    return p - buf;
+}
+
+/* get the difference to encode for the next value, which is the difference to the last value for
+   GORILLA_DELTA, and the difference of that to the last one for GORILLA_DELTA2; both start at 0 */
+static uint64_t difference(int kind, uint64_t value, uint64_t *last, uint64_t *last_delta)
+{
+    uint64_t delta = value - *last;
+    uint64_t ret = (kind == GORILLA_DELTA2) ? delta - *last_delta : delta;
+    *last = value;
+    *last_delta = delta;
+    return ret;
+}
+
+/* map differences of small magnitude to small numbers: 0, -1, 1, -2, ... to 0, 1, 2, 3, ... */
+static uint64_t zigzag(uint64_t v)
+{
+    return (v << 1) ^ (uint64_t) ((int64_t) v >> 63);
+}
+
+static uint64_t unzigzag(uint64_t z)
+{
+    return (z >> 1) ^ (uint64_t) -(int64_t) (z & 1);
+}
+
+/* get the number of bits put_difference() writes for the difference */
+static int difference_bits(uint64_t difference)
+{
+    uint64_t z = zigzag(difference);
+
+    if (z == 0) {
+        return 1;
+    }
+    if (z < (1 << 7)) {
+        return 2 + 7;
+    }
+    if (z < (1 << 9)) {
+        return 3 + 9;
+    }
+    if (z < (1 << 12)) {
+        return 4 + 12;
+    }
+    return (z < (1ULL << 32)) ? 5 + 32 : 5 + 64;
+}
+
+static void put_difference(BitWriter *w, uint64_t difference)
+{
+    uint64_t z = zigzag(difference);
+
+    if (z == 0) {
+        put_bits(w, 0, 1);
+    } else if (z < (1 << 7)) {
+        put_bits(w, 0x2, 2);
+        put_bits(w, z, 7);
+    } else if (z < (1 << 9)) {
+        put_bits(w, 0x6, 3);
+        put_bits(w, z, 9);
+    } else if (z < (1 << 12)) {
+        put_bits(w, 0xe, 4);
+        put_bits(w, z, 12);
+    } else if (z < (1ULL << 32)) {
+        put_bits(w, 0x1e, 5);
+        put_bits(w, z, 32);
+    } else {
+        put_bits(w, 0x1f, 5);
+        put_bits(w, z, 64);
+    }
+}
+
+/* read a difference written by put_difference()
+   return 1 on success; 0 at the end of the stream */
+static int get_difference(BitReader *r, uint64_t *difference)
+{
+    static const int bits[] = { 0, 7, 9, 12, 32, 64 };
+    uint64_t bit, z = 0;
+    int ones = 0;
+
+    while (ones < 5) {
+        if (!get_bits(r, 1, &bit)) {
+            return FAILED;
+        }
+        if (bit == 0) {
+            break;
+        }
+        ones++;
+    }
+    if (ones > 0 && !get_bits(r, bits[ones], &z)) {
+        return FAILED;
+    }
+    *difference = unzigzag(z);
+    return SUCCESS;
+}
+
+/* decode one column into the text of columns_write()
+   return 1 on success; otherwise return 0 */
+static int decode_column(const unsigned char **pos, const unsigned char *end, long rows, Output *out)
+{
+    const unsigned char *bitmap = NULL;
+    uint64_t key_len, len;
+    int kind, decimals = 0;
+    long r;
+
+    if (!get_varint(pos, end, &key_len) || key_len > (uint64_t) (end - *pos)) {
+        return FAILED;
+    }
+    append(out, (const char *) *pos, key_len);
+    append(out, ":[", 2);
+    *pos += key_len;
+    if (*pos == end) {
+        return FAILED;
+    }
+    kind = *(*pos)++;
+    if ((kind & ~(GORILLA_KIND_MASK | GORILLA_QUOTED | GORILLA_NULLS)) != 0 ||
+        (kind & GORILLA_KIND_MASK) > GORILLA_DELTA2) {
+        return FAILED;
+    }
+    if ((kind & GORILLA_KIND_MASK) != GORILLA_RAW) {
+        if (*pos == end || (decimals = *(*pos)++) > GORILLA_MAX_DECIMALS) {
+            return FAILED;
+        }
+    }
+    if (kind & GORILLA_NULLS) {
+        if ((uint64_t) (end - *pos) < (uint64_t) (rows + 7) / 8) {
+            return FAILED;
+        }
+        bitmap = *pos;
+        *pos += (rows + 7) / 8;
+    }
+
+    BitReader reader = { NULL, NULL, 0, 0 };
+    if ((kind & GORILLA_KIND_MASK) != GORILLA_RAW) {
+        if (!get_varint(pos, end, &len) || len > (uint64_t) (end - *pos)) {
+            return FAILED;
+        }
+        reader.pos = *pos;
+        reader.end = *pos + len;
+        *pos += len;
+    }
+    uint64_t last = 0, last_delta = 0;
+    for (r = 0; r < rows; r++) {
+        if (r > 0) {
+            append(out, ",", 1);
+        }
+        if (bitmap != NULL && !(bitmap[r / 8] & (0x80 >> (r % 8)))) {
+            append(out, "null", 4);
+            continue;
+        }
+        if ((kind & GORILLA_KIND_MASK) == GORILLA_RAW) {
+            if (!get_varint(pos, end, &len) || len > (uint64_t) (end - *pos)) {
+                return FAILED;
+            }
+            append(out, (const char *) *pos, len);
+            *pos += len;
+            continue;
+        }
+        uint64_t e;
+        if (!get_difference(&reader, &e)) {
+            return FAILED;
+        }
+        if ((kind & GORILLA_KIND_MASK) == GORILLA_DELTA2) {
+            last_delta += e;
+            last += last_delta;
+        } else {
+            last += e;
+        }
+        reserve(out, GORILLA_NUMBER_LEN);
+        out->len += format_fixed(out->buf + out->len, (int64_t) last, decimals, kind & GORILLA_QUOTED);
+    }
+    append(out, "]", 1);
+    return SUCCESS;
+}
+
+static int is_null(const ColumnSpan *value)
+{
+    return value->len == 4 && memcmp(value->start, "null", 4) == 0;
+}
+
+/* write the n low bits of v */
+static void put_bits(BitWriter *w, uint64_t v, int n)
+{
+    if (n > 32) {
+        put_bits(w, v >> 32, n - 32);
+        n = 32;
+    }
+    w->acc = (w->acc << n) | (v & ((1ULL << n) - 1));
+    w->bits += n;
+    reserve(w->out, 8);
+    while (w->bits >= 8) {
+        w->bits -= 8;
+        w->out->buf[w->out->len++] = (char) (w->acc >> w->bits);
+    }
+    w->acc &= (1ULL << w->bits) - 1;
+}
+
+/* write the last bits, padded with zeros to a whole byte */
+static void flush_bits(BitWriter *w)
+{
+    if (w->bits > 0) {
+        put_bits(w, 0, 8 - w->bits);
+    }
+}
+
+/* read n bits into v
+   return 1 on success; 0 at the end of the stream */
+static int get_bits(BitReader *r, int n, uint64_t *v)
+{
+    uint64_t x = 0;
+
+    while (n > 0) {
+        if (r->bits == 0) {
+            if (r->pos == r->end) {
+                return FAILED;
+            }
+            r->acc = *r->pos++;
+            r->bits = 8;
+        }
+        int take = (n < r->bits) ? n : r->bits;
+        x = (x << take) | ((r->acc >> (r->bits - take)) & ((1u << take) - 1));
+        r->bits -= take;
+        n -= take;
+    }
+    *v = x;
+    return SUCCESS;
+}
+
+static void put_varint(Output *out, uint64_t v)
+{
+    reserve(out, 10);
+    while (v >= 0x80) {
+        out->buf[out->len++] = (char) (v | 0x80);
+        v >>= 7;
+    }
+    out->buf[out->len++] = (char) v;
+}
+
+/* read a varint
+   return 1 on success; otherwise return 0 */
+static int get_varint(const unsigned char **pos, const unsigned char *end, uint64_t *v)
+{
+    int shift;
+
+    *v = 0;
+    for (shift = 0; shift < 64 && *pos < end; shift += 7) {
+        unsigned char c = *(*pos)++;
+        *v |= (uint64_t) (c & 0x7f) << shift;
+        if (!(c & 0x80)) {
+            return SUCCESS;
+        }
+    }
+    return FAILED;
+}
+
+/* make sure the output has room for another len bytes and a terminating '\0' */
+static void reserve(Output *out, size_t len)
+{
+    if (out->len + len < out->size) {
+        return;
+    }
+    if (out->size == 0) {
+        out->size = 256;
+    }
+    while (out->len + len >= out->size) {
+        out->size *= 2;
+    }
+    out->buf = realloc(out->buf, out->size);
+}
+
+static void append(Output *out, const char *s, size_t len)
+{
+    if (len == 0) {
+        return;
+    }
+    reserve(out, len);
+    memcpy(out->buf + out->len, s, len);
+    out->len += len;
+}
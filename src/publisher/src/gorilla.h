@@ -0,0 +1,80 @@
+/*
+ * Copyright (C) 2014-2015 University of Stuttgart
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef GORILLA_H_
+#define GORILLA_H_
+
+#include <stddef.h>
+
+/*
+ * Time-series encoding of a columnar batch of columns.h, after the Gorilla
+ * encoding of timestamps.
+ *
+ * Each column whose values are decimal numbers with the same number of
+ * decimals, like the metric values and the timestamps of the agent, is
+ * encoded as a bit stream of the differences of their fixed-point mantissas:
+ * either of successive values, or of successive differences (delta-of-delta),
+ * whichever is shorter. A difference of zero takes one bit, so a regular
+ * timestamp or a value which does not change costs one bit per sample, and
+ * small differences take 9 to 16 bits. Other columns, e.g. of strings, are
+ * kept as json text. The decoder writes back the exact text of the batch.
+ *
+ * The encoding is
+ *
+ *   "MFG1" rows columns header_len header (column)*
+ *   column: key_len key kind [decimals] [bitmap] values
+ *
+ * with numbers as unsigned LEB128 varints. kind is GORILLA_RAW, GORILLA_DELTA
+ * or GORILLA_DELTA2, or'ed with GORILLA_QUOTED for numbers in json strings
+ * and GORILLA_NULLS if some rows have no value (null); then a bitmap of
+ * (rows + 7) / 8 bytes tells the rows with a value, starting at the most
+ * significant bit. The values are the length of the bit stream and the
+ * stream for numbers, or the length and text of each value otherwise. In the
+ * stream, a difference is written zigzag-encoded as '0' if it is zero, or
+ * as '10', '110', '1110', '11110' or '11111' followed by 7, 9, 12, 32 or 64
+ * bits, most significant bit first.
+ */
+#define GORILLA_RAW     0
+#define GORILLA_DELTA   1
+#define GORILLA_DELTA2  2
+#define GORILLA_QUOTED  0x10
+#define GORILLA_NULLS   0x20
+
+/**
+ * @brief Encodes a columnar batch.
+ *
+ * The encoding has to be freed by the caller.
+ *
+ * @return 1 on success; 0 if the batch is malformed
+ */
+int gorilla_encode(const char *batch, size_t len, char **data, size_t *data_len);
+
+/**
+ * @brief Checks if the data starts like an encoding of gorilla_encode().
+ *
+ * @return 1 if it does; 0 otherwise
+ */
+int gorilla_is_encoded(const char *data, size_t len);
+
+/**
+ * @brief Decodes the columnar batch, written like by columns_write().
+ *
+ * The text is terminated by '\0' and has to be freed by the caller.
+ *
+ * @return 1 on success; 0 if the data is malformed
+ */
+int gorilla_decode(const char *data, size_t len, char **batch, size_t *batch_len);
+#endif
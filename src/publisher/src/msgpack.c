@@ -0,0 +1,405 @@
+/*
+ * Copyright (C) 2014-2015 University of Stuttgart
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "msgpack.h"
+
+#define SUCCESS 1
+#define FAILED  0
+/* deepest nesting of arrays and maps accepted by msgpack_to_json() */
+#define MSGPACK_MAX_DEPTH 32
+/* longest text of a float with "%.3f": sign, the 309 digits of DBL_MAX, point and decimals */
+#define MSGPACK_NUMBER_LEN 320
+
+ /*******************************************************************************
+ * Variables Declarations
+ ******************************************************************************/
+/* input and output of msgpack_to_json() */
+typedef struct JsonWriter_t {
+    const unsigned char *pos;
+    const unsigned char *end;
+    char *json;
+    size_t len;
+    size_t size;
+} JsonWriter;
+
+/*******************************************************************************
+ * Forward Declarations
+ ******************************************************************************/
+static char *write_be(char *p, unsigned char type, uint64_t v, int bytes);
+static uint64_t read_be(const unsigned char *p, int bytes);
+static int convert_value(JsonWriter *w, int depth);
+static int convert_str(JsonWriter *w, size_t len);
+static int convert_array(JsonWriter *w, size_t n, int depth);
+static int convert_map(JsonWriter *w, size_t n, int depth);
+static int read_length(JsonWriter *w, int bytes, size_t *n);
+static int convert_float(JsonWriter *w, double d);
+static void reserve(JsonWriter *w, size_t len);
+static void append(JsonWriter *w, const char *s, size_t len);
+
+/*******************************************************************************
+ * Functions implementation
+ ******************************************************************************/
+char *msgpack_write_array32(char *p, uint32_t n)
+{
+    return write_be(p, 0xdd, n, 4);
+}
+
+char *msgpack_write_map(char *p, uint32_t n)
+{
+    if (n < 16) {
+        *p++ = (char) (0x80 | n);
+        return p;
+    }
+    if (n <= 0xffff) {
+        return write_be(p, 0xde, n, 2);
+    }
+    return write_be(p, 0xdf, n, 4);
+}
+
+char *msgpack_write_str(char *p, const char *s, size_t len)
+{
+    if (len < 32) {
+        *p++ = (char) (0xa0 | len);
+    } else if (len <= 0xff) {
+        p = write_be(p, 0xd9, len, 1);
+    } else if (len <= 0xffff) {
+        p = write_be(p, 0xda, len, 2);
+    } else {
+        p = write_be(p, 0xdb, len, 4);
+    }
+    memcpy(p, s, len);
+    return p + len;
+}
+
+char *msgpack_write_int(char *p, long long v)
+{
+    if (v >= 0) {
+        if (v < 128) {
+            *p++ = (char) v;
+            return p;
+        }
+        if (v <= 0xff) {
+            return write_be(p, 0xcc, v, 1);
+        }
+        if (v <= 0xffff) {
+            return write_be(p, 0xcd, v, 2);
+        }
+        if (v <= 0xffffffffLL) {
+            return write_be(p, 0xce, v, 4);
+        }
+        return write_be(p, 0xcf, v, 8);
+    }
+    if (v >= -32) {
+        *p++ = (char) v;
+        return p;
+    }
+    if (v >= -128) {
+        return write_be(p, 0xd0, (uint64_t) v, 1);
+    }
+    if (v >= -32768) {
+        return write_be(p, 0xd1, (uint64_t) v, 2);
+    }
+    if (v >= -2147483648LL) {
+        return write_be(p, 0xd2, (uint64_t) v, 4);
+    }
+    return write_be(p, 0xd3, (uint64_t) v, 8);
+}
+
+char *msgpack_write_double(char *p, double v)
+{
+    uint64_t bits;
+    memcpy(&bits, &v, sizeof(bits));
+    return write_be(p, 0xcb, bits, 8);
+}
+
+/* json texts of the publisher start with '[' or '{', MessagePack arrays with 0x90-0x9f, 0xdc or 0xdd */
+int msgpack_is_array(const char *data, size_t len)
+{
+    if (len == 0) {
+        return FAILED;
+    }
+    unsigned char c = (unsigned char) data[0];
+    return (c >= 0x90 && c <= 0x9f) || c == 0xdc || c == 0xdd;
+}
+
+/* convert MessagePack data into json */
+int msgpack_to_json(const char *data, size_t len, char **json, size_t *json_len)
+{
+    JsonWriter w = { (const unsigned char *) data, (const unsigned char *) data + len, NULL, 0, 0 };
+
+    w.size = len * 2 + 64;
+    w.json = malloc(w.size);
+    if (convert_value(&w, 0) != SUCCESS || w.pos != w.end) {
+        free(w.json);
+        return FAILED;
+    }
+    w.json[w.len] = '\0';
+    *json = w.json;
+    *json_len = w.len;
+    return SUCCESS;
+}
+
+/* write the type byte and v as big-endian number of the given bytes */
+static char *write_be(char *p, unsigned char type, uint64_t v, int bytes)
+{
+    int i;
+
+    *p++ = (char) type;
+    for (i = bytes - 1; i >= 0; i--) {
+        *p++ = (char) (v >> (8 * i));
+    }
+    return p;
+}
+
+/* read a big-endian number of the given bytes */
+static uint64_t read_be(const unsigned char *p, int bytes)
+{
+    uint64_t v = 0;
+    int i;
+
+    for (i = 0; i < bytes; i++) {
+        v = (v << 8) | p[i];
+    }
+    return v;
+}
+
+/* convert the next value
+   return 1 on success; otherwise return 0 */
+static int convert_value(JsonWriter *w, int depth)
+{
+    char number[64];
+    size_t n;
+
+    if (w->pos >= w->end || depth > MSGPACK_MAX_DEPTH) {
+        return FAILED;
+    }
+    unsigned char type = *w->pos++;
+    size_t left = w->end - w->pos;
+
+    if (type <= 0x7f) {
+        append(w, number, sprintf(number, "%d", type));
+        return SUCCESS;
+    }
+    if (type >= 0xe0) {
+        append(w, number, sprintf(number, "%d", (signed char) type));
+        return SUCCESS;
+    }
+    if (type >= 0x80 && type <= 0x8f) {
+        return convert_map(w, type & 0x0f, depth);
+    }
+    if (type >= 0x90 && type <= 0x9f) {
+        return convert_array(w, type & 0x0f, depth);
+    }
+    if (type >= 0xa0 && type <= 0xbf) {
+        return convert_str(w, type & 0x1f);
+    }
+
+    switch (type) {
+    case 0xc0:
+        append(w, "null", 4);
+        return SUCCESS;
+    case 0xc2:
+        append(w, "false", 5);
+        return SUCCESS;
+    case 0xc3:
+        append(w, "true", 4);
+        return SUCCESS;
+    case 0xca: {
+        if (left < 4) {
+            return FAILED;
+        }
+        uint32_t bits = (uint32_t) read_be(w->pos, 4);
+        float f;
+        memcpy(&f, &bits, sizeof(f));
+        w->pos += 4;
+        return convert_float(w, f);
+    }
+    case 0xcb: {
+        if (left < 8) {
+            return FAILED;
+        }
+        uint64_t bits = read_be(w->pos, 8);
+        double d;
+        memcpy(&d, &bits, sizeof(d));
+        w->pos += 8;
+        return convert_float(w, d);
+    }
+    case 0xcc:
+    case 0xcd:
+    case 0xce:
+    case 0xcf: {
+        int bytes = 1 << (type - 0xcc);
+        if (left < (size_t) bytes) {
+            return FAILED;
+        }
+        append(w, number, sprintf(number, "%llu", (unsigned long long) read_be(w->pos, bytes)));
+        w->pos += bytes;
+        return SUCCESS;
+    }
+    case 0xd0:
+    case 0xd1:
+    case 0xd2:
+    case 0xd3: {
+        int bytes = 1 << (type - 0xd0);
+        if (left < (size_t) bytes) {
+            return FAILED;
+        }
+        /* sign-extend the number */
+        uint64_t v = read_be(w->pos, bytes);
+        int shift = 64 - 8 * bytes;
+        long long s = (long long) (v << shift) >> shift;
+        append(w, number, sprintf(number, "%lld", s));
+        w->pos += bytes;
+        return SUCCESS;
+    }
+    case 0xd9:
+    case 0xda:
+    case 0xdb:
+        return read_length(w, 1 << (type - 0xd9), &n) && convert_str(w, n);
+    case 0xdc:
+    case 0xdd:
+        return read_length(w, (type == 0xdc) ? 2 : 4, &n) && convert_array(w, n, depth);
+    case 0xde:
+    case 0xdf:
+        return read_length(w, (type == 0xde) ? 2 : 4, &n) && convert_map(w, n, depth);
+    default:
+        /* binary and extension types have no json counterpart */
+        return FAILED;
+    }
+}
+
+/* write a float with 3 decimals, like the json encoder of the agent
+   return 1 on success; otherwise return 0 */
+static int convert_float(JsonWriter *w, double d)
+{
+    char number[MSGPACK_NUMBER_LEN];
+    int len = snprintf(number, sizeof(number), "%.3f", d);
+
+    if (len < 0 || (size_t) len >= sizeof(number)) {
+        return FAILED;
+    }
+    append(w, number, len);
+    return SUCCESS;
+}
+
+/* convert a string of len bytes, escaping the characters json requires */
+static int convert_str(JsonWriter *w, size_t len)
+{
+    size_t i;
+
+    if ((size_t) (w->end - w->pos) < len) {
+        return FAILED;
+    }
+    reserve(w, len + 2);
+    w->json[w->len++] = '"';
+    for (i = 0; i < len; i++) {
+        unsigned char c = w->pos[i];
+        if (c == '"' || c == '\\') {
+            char escaped[2] = { '\\', (char) c };
+            append(w, escaped, 2);
+        } else if (c < 0x20) {
+            char escaped[8];
+            append(w, escaped, sprintf(escaped, "\\u%04x", c));
+        } else {
+            reserve(w, 1);
+            w->json[w->len++] = (char) c;
+        }
+    }
+    append(w, "\"", 1);
+    w->pos += len;
+    return SUCCESS;
+}
+
+/* convert an array of n values */
+static int convert_array(JsonWriter *w, size_t n, int depth)
+{
+    size_t i;
+
+    append(w, "[", 1);
+    for (i = 0; i < n; i++) {
+        if (i > 0) {
+            append(w, ",", 1);
+        }
+        if (convert_value(w, depth + 1) != SUCCESS) {
+            return FAILED;
+        }
+    }
+    append(w, "]", 1);
+    return SUCCESS;
+}
+
+/* convert a map of n key/value pairs, whose keys have to be strings */
+static int convert_map(JsonWriter *w, size_t n, int depth)
+{
+    size_t i;
+
+    append(w, "{", 1);
+    for (i = 0; i < n; i++) {
+        if (i > 0) {
+            append(w, ",", 1);
+        }
+        if (w->pos >= w->end) {
+            return FAILED;
+        }
+        unsigned char type = *w->pos;
+        if (!((type >= 0xa0 && type <= 0xbf) || (type >= 0xd9 && type <= 0xdb))) {
+            return FAILED;
+        }
+        if (convert_value(w, depth + 1) != SUCCESS) {
+            return FAILED;
+        }
+        append(w, ":", 1);
+        if (convert_value(w, depth + 1) != SUCCESS) {
+            return FAILED;
+        }
+    }
+    append(w, "}", 1);
+    return SUCCESS;
+}
+
+/* read the length of a string, array or map
+   return 1 on success; otherwise return 0 */
+static int read_length(JsonWriter *w, int bytes, size_t *n)
+{
+    if ((size_t) (w->end - w->pos) < (size_t) bytes) {
+        return FAILED;
+    }
+    *n = (size_t) read_be(w->pos, bytes);
+    w->pos += bytes;
+    return SUCCESS;
+}
+
+/* make sure the json has room for another len characters and the terminating '\0' */
+static void reserve(JsonWriter *w, size_t len)
+{
+    if (w->len + len < w->size) {
+        return;
+    }
+    while (w->len + len >= w->size) {
+        w->size *= 2;
+    }
+    w->json = realloc(w->json, w->size);
+}
+
+static void append(JsonWriter *w, const char *s, size_t len)
+{
+    reserve(w, len);
+    memcpy(w->json + w->len, s, len);
+    w->len += len;
+}
@@ -0,0 +1,82 @@
+/*
+ * Copyright (C) 2014-2015 University of Stuttgart
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MSGPACK_H_
+#define MSGPACK_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* size of an array header written by msgpack_write_array32() */
+#define MSGPACK_ARRAY32_LEN 5
+/* upper bounds of the encoded size of a map header, a string of len bytes, an integer and a double */
+#define MSGPACK_MAP_MAX 5
+#define MSGPACK_STR_MAX(len) ((len) + 5)
+#define MSGPACK_INT_MAX 9
+#define MSGPACK_DOUBLE_LEN 9
+
+/*
+ * The writers encode one value at p, which has to have room for its upper
+ * bound, and return the position behind it.
+ */
+
+/**
+ * @brief Writes an array header of n elements, always in the 32 bit form.
+ *
+ * The fixed size allows to write the header first and to patch the number of
+ * elements once they are known.
+ */
+char *msgpack_write_array32(char *p, uint32_t n);
+
+/**
+ * @brief Writes a map header of n key/value pairs.
+ */
+char *msgpack_write_map(char *p, uint32_t n);
+
+/**
+ * @brief Writes a string of len bytes.
+ */
+char *msgpack_write_str(char *p, const char *s, size_t len);
+
+/**
+ * @brief Writes an integer in its shortest form.
+ */
+char *msgpack_write_int(char *p, long long v);
+
+/**
+ * @brief Writes a 64 bit float.
+ */
+char *msgpack_write_double(char *p, double v);
+
+/**
+ * @brief Checks if the data starts like a MessagePack array rather than a json text.
+ *
+ * @return 1 if it does; 0 otherwise
+ */
+int msgpack_is_array(const char *data, size_t len);
+
+/**
+ * @brief Converts MessagePack data into json, formatted like the bulks of the agent.
+ *
+ * Maps are written as objects, whose keys have to be strings; floats are
+ * written with three decimals. The json text is terminated by '\0' and has to
+ * be freed by the caller.
+ *
+ * @return 1 on success; 0 if the data is malformed or holds binary or extension types
+ */
+int msgpack_to_json(const char *data, size_t len, char **json, size_t *json_len);
+
+#endif /* MSGPACK_H_ */
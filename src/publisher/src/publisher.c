@@ -16,16 +16,135 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <curl/curl.h>
 #include "mf_debug.h"
 #include "publisher.h"
+#include "compress.h"
+#include "forward.h"
+#include "columns.h"
+#include "gorilla.h"
 
 #define SUCCESS 1
 #define FAILED  0
+#define UNKNOWN -1
+#define RETRY   2
+/* states of the circuit breaker */
+#define BREAKER_CLOSED    0     /* requests are sent */
+#define BREAKER_OPEN      1     /* requests fail at once, until the next probe */
+#define BREAKER_HALF_OPEN 2     /* one request probes the server */
+/* parts of a record written by publish_file(): {static_string, line} */
+#define PART_NEXT   0           /* the next record is picked, or the batch is closed */
+#define PART_OPEN   1
+#define PART_STATIC 2
+#define PART_SEP    3
+#define PART_LINE   4
+#define PART_CLOSE  5
+#define PART_END    6           /* closing bracket of the batch */
+#define PART_DONE   7
+/* time publish_json_async() waits for a request to complete, when too many are in flight */
+#define ASYNC_WAIT_MS 100
+/* number of completed easy handles kept for the next requests */
+#define ASYNC_MAX_IDLE 64
  /*******************************************************************************
  * Variables Declarations
  ******************************************************************************/
 struct curl_slist *headers = NULL;
+/* headers of the requests, indexed by format and codec */
+static struct curl_slist *encoded_headers[PUBLISH_GORILLA + 1][COMPRESS_ZSTD + 1];
+static const char *content_types[PUBLISH_GORILLA + 1] = { "application/json", "application/msgpack", 
+    "application/x-mf-columns+json", "application/x-mf-gorilla" };
+static pthread_once_t curl_once = PTHREAD_ONCE_INIT;
+
+/* long-lived curl handle of each thread, which keeps its connection to the server open */
+static pthread_key_t handle_key;
+
+/* transport options, set by publisher_set_option() before publishing */
+static int reuse_connections = 1;
+static long keep_alive = 1;
+static long keep_alive_idle = 60;        /* in s */
+static long keep_alive_interval = 60;    /* in s */
+static long tcp_nodelay = 1;
+static long http_version = CURL_HTTP_VERSION_NONE;
+static char *unix_socket = NULL;
+
+/* compression of the request bodies */
+static int compression = COMPRESS_NONE;
+static int compression_level = 0;
+static int column_gorilla = 0;          /* set while bulks of columns are encoded by gorilla.h */
+
+/* size of the batches of publish_file(), 0 for no limit */
+static long file_batch_bytes = 1048576;
+static long file_batch_records = 0;
+static int file_columns = 0;            /* set while the batches of files are sent as columns */
+/* socket of the node-local aggregator, which takes the bulks over instead of the server */
+static char *aggregator = NULL;
+
+/* timeouts, retries and circuit breaker, set by publisher_set_option() */
+static long connect_timeout = 5000;     /* in ms */
+static long request_timeout = 0;        /* in ms, 0 for no timeout */
+static long retries = 2;
+static long retry_backoff = 100;        /* in ms, doubled with each retry */
+static long retry_backoff_max = 5000;   /* in ms */
+static long breaker_threshold = 5;      /* failed requests in a row which open the breaker, 0 for off */
+static long breaker_interval = 10;      /* in s between two probes while the breaker is open */
+
+/* circuit breaker, shared by all threads */
+static pthread_mutex_t breaker_lock = PTHREAD_MUTEX_INITIALIZER;
+static int breaker_state = BREAKER_CLOSED;
+static long breaker_failures = 0;
+static long long breaker_until = 0;     /* time of the next probe in ns */
+
+/* seed of the jitter of each thread */
+static __thread unsigned int jitter_seed = 0;
+
+/* asynchronous publisher, driven by the thread which owns it */
+struct AsyncPublisher_t {
+    CURLM *multi;
+    int max_in_flight;
+    int in_flight;                  /* requests sent or waiting for a retry */
+    CURL *idle[ASYNC_MAX_IDLE];     /* completed handles, reused with their settings */
+    int num_idle;
+    struct AsyncRequest_t *retries; /* failed requests, waiting for their next attempt */
+    struct AsyncRequest_t *forwarded;   /* requests handed to the aggregator, to be called back */
+    struct AsyncRequest_t **forwarded_tail;
+};
+
+/* request in flight, attached to its easy handle */
+typedef struct AsyncRequest_t {
+    publish_callback callback;
+    void *userdata;
+    char *body;                     /* encoded or compressed message, if any */
+    int format;                     /* of the body */
+    const char *data;               /* message as given, sent again as columns if gorilla is refused */
+    size_t len;
+    CURL *curl;
+    int attempt;
+    int result;                     /* of a request handed to the aggregator */
+    long long retry_at;             /* time of the next attempt in ns */
+    struct AsyncRequest_t *next;
+} AsyncRequest;
+
+/* batch of lines of a file mapped into memory, written as json array by batch_read() */
+typedef struct FileBatch_t {
+    const char *pos;                /* next line of the file */
+    const char *end;
+    const char *start;              /* first line of the batch, to start over for a retry */
+    const char *static_string;
+    size_t static_len;
+    long records;                   /* records written into the batch so far */
+    size_t bytes;                   /* bytes of their lines */
+    const char *line;               /* record being written, and its part */
+    size_t line_len;
+    int part;
+    size_t offset;
+} FileBatch;
 
 /*******************************************************************************
  * Forward Declarations
@@ -35,11 +154,44 @@ int check_message(char *message);
 void init_curl(void);
 CURL *prepare_publish(char *URL, char *message);
 CURL *prepare_query(char* URL);
+static void init_curl_once(void);
+static CURL *get_handle(void);
+static CURL *new_handle(void);
+static void finish_requests(AsyncPublisher *ap);
+static long start_retries(AsyncPublisher *ap);
+static void release_handle(CURL *curl);
+static void free_handle(void *curl);
+static int compress_message(const char *message, size_t len, char **body, size_t *body_len);
+static int prepare_body(const char *message, size_t len, int *format, char **body, size_t *body_len);
+static int refuse_gorilla(const char *URL);
+static int check_format(CURL *curl, int format);
+static int forward_file(char *URL, FileBatch *batch);
+static int publish_file_columns(char *URL, FileBatch *batch);
+static int publish_batch(char *URL, FileBatch *batch);
+static void finish_forwarded(AsyncPublisher *ap);
+static int batch_begin(FileBatch *batch);
+static void batch_rewind(FileBatch *batch);
+static int batch_next_line(FileBatch *batch);
+static int batch_columns(FileBatch *batch, ColumnBatch *columns);
+static size_t batch_read(char *buffer, size_t size, void *arg);
+static int perform_batch(CURL *curl, FileBatch *batch);
+static size_t read_batch(char *buffer, size_t size, size_t nmemb, void *userp);
+static size_t read_compressed(char *buffer, size_t size, size_t nmemb, void *userp);
+static int perform(CURL *curl, const char *what);
+static int check_attempt(CURL *curl, CURLcode response, int attempt, const char *what);
+static int is_transient(CURLcode response, long status);
+static long backoff(int attempt);
+static int breaker_allow(void);
+static int breaker_closed(void);
+static void breaker_report(int success);
+static void breaker_cancel(void);
+static void wait_backoff(int attempt);
+static long long now_ns(void);
+static int parse_count(const char *value, long *ret);
+static int parse_switch(const char *value, long *ret);
+static int parse_long(const char *value, long *ret);
 static size_t get_stream_data(void *buffer, size_t size, size_t nmemb, char *stream);
-
-#ifdef NDEBUG
 static size_t write_non_data(void *buffer, size_t size, size_t nmemb, void *userp);
-#endif
 
 /* send query to the given URL, read back the response string
    return 1 on success; otherwise return 0 */
@@ -56,16 +208,13 @@ int query_json(char *URL, char *response_str)
     
     curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, get_stream_data);
     curl_easy_setopt(curl, CURLOPT_WRITEDATA, response_str);
-    CURLcode response = curl_easy_perform(curl);
+    int ret = perform(curl, "query_json");
 
-    if (response != CURLE_OK) {
-        const char *error_msg = curl_easy_strerror(response);
-        log_error("create_new_experiment %s", error_msg);
+    release_handle(curl);
+    if (ret != SUCCESS) {
         return FAILED;
     }
 
-    curl_easy_cleanup(curl);
-
     if(response_str == NULL) {
         return FAILED;
     }
@@ -76,10 +225,23 @@ int query_json(char *URL, char *response_str)
    return 1 on success; otherwise return 0 */
 int publish_json(char *URL, char *message)
 {
-    if (!check_URL(URL) || !check_message(message)) {
+    if (!check_message(message)) {
         return FAILED;
     }
-    CURL *curl = prepare_publish(URL, message);
+    return publish_bulk(URL, message, strlen(message), PUBLISH_JSON);
+}
+
+/* publish len bytes of data in the given format using libcurl
+   return 1 on success; -1 if the server does not accept the format; otherwise return 0 */
+int publish_bulk(char *URL, const char *data, size_t len, int format)
+{
+    if (!check_URL(URL) || data == NULL || len == 0 || format < PUBLISH_JSON || format > PUBLISH_GORILLA) {
+        return FAILED;
+    }
+    if (aggregator != NULL) {
+        return forward_bulk(aggregator, URL, data, len, format);
+    }
+    CURL *curl = prepare_publish(URL, NULL);
     if (curl == NULL) {
         return FAILED;
     }
@@ -88,92 +250,97 @@ int publish_json(char *URL, char *message)
     curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_non_data);
     #endif
 
-    CURLcode response = curl_easy_perform(curl);
-
-    if (response != CURLE_OK) {
-        const char *error_msg = curl_easy_strerror(response);
-        log_error("publish(char *, Message) %s", error_msg);
+    char *body = NULL;
+    size_t body_len = len;
+    int body_format = format;
+    if (!prepare_body(data, len, &body_format, &body, &body_len)) {
+        release_handle(curl);
         return FAILED;
     }
+    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, encoded_headers[body_format][compression]);
+    curl_easy_setopt(curl, CURLOPT_POSTFIELDS, (body != NULL) ? body : data);
+    curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE, (long) body_len);
 
-    curl_easy_cleanup(curl);
-    return SUCCESS;
+    int ret = perform(curl, "publish(char *, Message)");
+    if (ret == SUCCESS) {
+        ret = check_format(curl, body_format);
+    }
+    release_handle(curl);
+    free(body);
+    if (ret == PUBLISH_UNSUPPORTED && body_format == PUBLISH_GORILLA && format == PUBLISH_COLUMNS && 
+        refuse_gorilla(URL)) {
+        return publish_bulk(URL, data, len, PUBLISH_COLUMNS);
+    }
+    return ret;
 }
 
 /* publish a file with given filename and URL 
-   each line is read and combined with the given static string, formatted into json, and sent via libcurl
+   each line is combined with the given static string, formatted into json, and streamed via libcurl 
+   in batches of file_batch_bytes or file_batch_records; the file is mapped into memory, and lines 
+   may be of any length; with file_format columns, the static string and the keys of each batch are 
+   sent once, in a columnar batch
    return 1 on success; otherwise return 0 */
 int publish_file(char *URL, char *static_string, char *filename)
 {
+    struct stat st;
+
     if (!check_URL(URL) || !check_message(static_string) || !check_message(filename)) {
         return FAILED;
     }
     /*open the file, which contains data for publishing */
-    int i = 0;
-    FILE *fp;
-    char line[320];
-    char *message = calloc(10 * 320, sizeof(char));
-    
-    /* int curl with meaningless message */
-    CURL *curl = prepare_publish(URL, message);
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        log_error("Could not open file %s\n", filename);
+        if (fd >= 0) {
+            close(fd);
+        }
+        return FAILED;
+    }
+    if (st.st_size == 0) {
+        close(fd);
+        return SUCCESS;
+    }
+    char *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        log_error("Could not map file %s\n", filename);
+        return FAILED;
+    }
+    madvise(data, st.st_size, MADV_SEQUENTIAL);
+
+    FileBatch batch = { data, data + st.st_size };
+    batch.static_string = static_string;
+    batch.static_len = strlen(static_string);
+    if (aggregator != NULL) {
+        int ret = forward_file(URL, &batch);
+        munmap(data, st.st_size);
+        return ret;
+    }
+    if (__atomic_load_n(&file_columns, __ATOMIC_RELAXED)) {
+        int ret = publish_file_columns(URL, &batch);
+        munmap(data, st.st_size);
+        return ret;
+    }
+
+    CURL *curl = prepare_publish(URL, NULL);
     if (curl == NULL) {
+        munmap(data, st.st_size);
         return FAILED;
     }
     #ifdef NDEBUG
     curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_non_data);
     #endif
-    
-    fp = fopen(filename, "r");
-    if(fp == NULL) {
-        log_error("Could not open file %s\n", filename);
-        return FAILED;
-    }
-
-    /* read the lines in the file and send the message for each 10 lines */
-    while(fgets(line, 320, fp) != NULL) {
-        line[strlen(line) - 1] = '\0';
-        switch(i) {
-            case 0:
-                sprintf(message, "[{%s, %s}", static_string, line);
-                i++;
-                break;
-            case 9:
-                sprintf(message + strlen(message), ",{%s, %s}]", static_string, line);
-                curl_easy_setopt(curl, CURLOPT_POSTFIELDS, message);
-                curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE, (long ) strlen(message));
-                CURLcode response = curl_easy_perform(curl);
-
-                if (response != CURLE_OK) {
-                    const char *error_msg = curl_easy_strerror(response);
-                    log_error("publish(char *, Message) %s", error_msg);
-                    return FAILED;
-                }
-                /* reset i and message for following sending */
-                i = 0;
-                memset(message, '\0', 10*320);
-                break;
-            default:
-                sprintf(message + strlen(message), ",{%s, %s}", static_string, line);
-                i++;
-                break;
-        }
-    }
-    /* send the final few lines in the file */
-    if(i > 0) {
-        strcat(message, "]");
-        curl_easy_setopt(curl, CURLOPT_POSTFIELDS, message);
-        curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE, (long ) strlen(message));
-        CURLcode response = curl_easy_perform(curl);
 
-        if (response != CURLE_OK) {
-            const char *error_msg = curl_easy_strerror(response);
-            log_error("publish(char *, Message) %s", error_msg);
-            return FAILED;
-        }
+    /* send one batch after the other, each one as a chunked upload */
+    int ret = SUCCESS;
+    while (ret == SUCCESS && batch_begin(&batch)) {
+        ret = perform_batch(curl, &batch);
     }
-    /* clean the curl handle */
-    curl_easy_cleanup(curl);
-    return SUCCESS;
+
+    /* hand the curl handle back, its connection is kept for the next request */
+    release_handle(curl);
+    munmap(data, st.st_size);
+    return ret;
 }
 
 /* create new experiment for specific application
@@ -188,21 +355,428 @@ int create_new_experiment(char *URL, char *message, char *experiment_id)
     if (curl == NULL) {
         return FAILED;
     }
-    
+    /* the message is small and sent as it is */
+    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
     curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, get_stream_data);
     curl_easy_setopt(curl, CURLOPT_WRITEDATA, experiment_id);
-    CURLcode response = curl_easy_perform(curl);
+    int ret = perform(curl, "create_new_experiment");
+    release_handle(curl);
+    return ret;
+}
+
+/* Set a transport option; options have to be set before publishing starts
+   return 1 on success; 0 if the value is invalid; -1 if the option is unknown */
+int publisher_set_option(const char *name, const char *value)
+{
+    if (strcmp(name, "reuse_connections") == 0) {
+        long on;
+        if (!parse_switch(value, &on)) {
+            return FAILED;
+        }
+        reuse_connections = (int) on;
+        return SUCCESS;
+    }
+    if (strcmp(name, "keep_alive") == 0) {
+        return parse_switch(value, &keep_alive);
+    }
+    if (strcmp(name, "keep_alive_idle") == 0) {
+        return parse_long(value, &keep_alive_idle);
+    }
+    if (strcmp(name, "keep_alive_interval") == 0) {
+        return parse_long(value, &keep_alive_interval);
+    }
+    if (strcmp(name, "tcp_nodelay") == 0) {
+        return parse_switch(value, &tcp_nodelay);
+    }
+    if (strcmp(name, "http_version") == 0) {
+        if (strcmp(value, "default") == 0) {
+            http_version = CURL_HTTP_VERSION_NONE;
+        } else if (strcmp(value, "1.0") == 0) {
+            http_version = CURL_HTTP_VERSION_1_0;
+        } else if (strcmp(value, "1.1") == 0) {
+            http_version = CURL_HTTP_VERSION_1_1;
+        } else if (strcmp(value, "2") == 0) {
+            http_version = CURL_HTTP_VERSION_2_0;
+    #if LIBCURL_VERSION_NUM >= 0x073100
+        } else if (strcmp(value, "2-prior-knowledge") == 0) {
+            http_version = CURL_HTTP_VERSION_2_PRIOR_KNOWLEDGE;
+    #endif
+        } else {
+            return FAILED;
+        }
+        return SUCCESS;
+    }
+    if (strcmp(name, "unix_socket") == 0) {
+    #if LIBCURL_VERSION_NUM >= 0x072800
+        free(unix_socket);
+        unix_socket = (value[0] != '\0') ? strdup(value) : NULL;
+        return SUCCESS;
+    #else
+        log_error("unix_socket requires libcurl 7.40.0 or newer");
+        return FAILED;
+    #endif
+    }
+    if (strcmp(name, "aggregator") == 0) {
+        free(aggregator);
+        aggregator = (value[0] != '\0') ? strdup(value) : NULL;
+        return SUCCESS;
+    }
+    if (strcmp(name, "file_batch_bytes") == 0) {
+        return parse_count(value, &file_batch_bytes);
+    }
+    if (strcmp(name, "file_batch_records") == 0) {
+        return parse_count(value, &file_batch_records);
+    }
+    if (strcmp(name, "file_format") == 0) {
+        if (strcmp(value, "rows") != 0 && strcmp(value, "columns") != 0) {
+            return FAILED;
+        }
+        file_columns = (strcmp(value, "columns") == 0);
+        return SUCCESS;
+    }
+    if (strcmp(name, "column_codec") == 0) {
+        if (strcmp(value, "none") != 0 && strcmp(value, "gorilla") != 0) {
+            return FAILED;
+        }
+        column_gorilla = (strcmp(value, "gorilla") == 0);
+        return SUCCESS;
+    }
+    if (strcmp(name, "connect_timeout") == 0) {
+        return parse_long(value, &connect_timeout);
+    }
+    if (strcmp(name, "request_timeout") == 0) {
+        return parse_count(value, &request_timeout);
+    }
+    if (strcmp(name, "retries") == 0) {
+        return parse_count(value, &retries);
+    }
+    if (strcmp(name, "retry_backoff") == 0) {
+        return parse_long(value, &retry_backoff);
+    }
+    if (strcmp(name, "retry_backoff_max") == 0) {
+        return parse_long(value, &retry_backoff_max);
+    }
+    if (strcmp(name, "breaker_threshold") == 0) {
+        return parse_count(value, &breaker_threshold);
+    }
+    if (strcmp(name, "breaker_interval") == 0) {
+        return parse_long(value, &breaker_interval);
+    }
+    if (strcmp(name, "compression") == 0) {
+        int codec = compress_codec(value);
+        if (codec < 0) {
+            log_error("Compression %s is unknown or not supported by this build", value);
+            return FAILED;
+        }
+        compression = codec;
+        return SUCCESS;
+    }
+    if (strcmp(name, "compression_level") == 0) {
+        long level;
+        if (strcmp(value, "0") == 0 || strcmp(value, "default") == 0) {
+            compression_level = 0;
+            return SUCCESS;
+        }
+        if (!parse_long(value, &level) || level > 22) {
+            return FAILED;
+        }
+        compression_level = (int) level;
+        return SUCCESS;
+    }
+    return UNKNOWN;
+}
+
+/* Clean up the curl handle of the calling thread; 
+   handles of other threads are cleaned up when the threads exit */
+void publisher_cleanup(void)
+{
+    if (headers == NULL) {
+        return;
+    }
+    CURL *curl = pthread_getspecific(handle_key);
+    if (curl != NULL) {
+        pthread_setspecific(handle_key, NULL);
+        curl_easy_cleanup(curl);
+    }
+}
+
+/* Drop the curl handle the calling thread inherited by fork(); cleaning it up would shut down 
+   the connection of the parent */
+void publisher_forget_handle(void)
+{
+    if (headers == NULL) {
+        return;
+    }
+    pthread_setspecific(handle_key, NULL);
+}
+
+/* Create an asynchronous publisher with at most max_in_flight concurrent requests */
+AsyncPublisher *publisher_async_new(int max_in_flight)
+{
+    init_curl();
+    AsyncPublisher *ap = calloc(1, sizeof(AsyncPublisher));
+    ap->multi = curl_multi_init();
+    if (ap->multi == NULL) {
+        log_error("Cannot create curl multi handle");
+        free(ap);
+        return NULL;
+    }
+    ap->max_in_flight = (max_in_flight > 0) ? max_in_flight : 1;
+    ap->forwarded_tail = &ap->forwarded;
+
+    #ifdef CURLPIPE_MULTIPLEX
+    /* send the requests as streams of one connection, if the server supports HTTP/2 */
+    curl_multi_setopt(ap->multi, CURLMOPT_PIPELINING, CURLPIPE_MULTIPLEX);
+    #endif
+    return ap;
+}
+
+/* Start sending the json-formatted message of len bytes; the message has to stay valid until the 
+   callback is called by publisher_async_poll(); waits if max_in_flight requests are in flight already
+   return 1 if the request is started; otherwise return 0, the callback is not called then */
+int publish_json_async(AsyncPublisher *ap, char *URL, char *message, size_t len, 
+    publish_callback callback, void *userdata)
+{
+    if (!check_message(message)) {
+        return FAILED;
+    }
+    return publish_bulk_async(ap, URL, message, len, PUBLISH_JSON, callback, userdata);
+}
+
+/* Start sending len bytes of data in the given format, like publish_json_async()
+   return 1 if the request is started; otherwise return 0, the callback is not called then */
+int publish_bulk_async(AsyncPublisher *ap, char *URL, const char *data, size_t len, int format,
+    publish_callback callback, void *userdata)
+{
+    CURL *curl;
+
+    if (!check_URL(URL) || data == NULL || len == 0 || format < PUBLISH_JSON || format > PUBLISH_GORILLA) {
+        return FAILED;
+    }
+    while (ap->in_flight >= ap->max_in_flight) {
+        publisher_async_poll(ap, ASYNC_WAIT_MS);
+    }
+    if (aggregator != NULL) {
+        /* the aggregator takes the bulk over at once; the callback is called by the next poll */
+        AsyncRequest *request = calloc(1, sizeof(AsyncRequest));
+        request->callback = callback;
+        request->userdata = userdata;
+        request->result = forward_bulk(aggregator, URL, data, len, format);
+        *ap->forwarded_tail = request;
+        ap->forwarded_tail = &request->next;
+        ap->in_flight++;
+        return SUCCESS;
+    }
+    if (!breaker_allow()) {
+        return FAILED;
+    }
+
+    if (ap->num_idle > 0) {
+        curl = ap->idle[--ap->num_idle];
+    } else {
+        curl = new_handle();
+        if (curl == NULL) {
+            breaker_cancel();
+            return FAILED;
+        }
+        curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_non_data);
+        #if LIBCURL_VERSION_NUM >= 0x072b00
+        /* rather wait for a connection which can be multiplexed, than open a new one */
+        curl_easy_setopt(curl, CURLOPT_PIPEWAIT, 1L);
+        #endif
+    }
 
-    if (response != CURLE_OK) {
-        const char *error_msg = curl_easy_strerror(response);
-        log_error("create_new_experiment %s", error_msg);
+    AsyncRequest *request = calloc(1, sizeof(AsyncRequest));
+    request->callback = callback;
+    request->userdata = userdata;
+    request->curl = curl;
+    request->format = format;
+    request->data = data;
+    request->len = len;
+    if (!prepare_body(data, len, &request->format, &request->body, &len)) {
+        breaker_cancel();
+        free(request);
+        curl_easy_cleanup(curl);
         return FAILED;
     }
+    if (request->format == format) {
+        request->data = NULL;
+    }
+    curl_easy_setopt(curl, CURLOPT_PRIVATE, request);
+    curl_easy_setopt(curl, CURLOPT_URL, URL);
+    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, encoded_headers[request->format][compression]);
+    curl_easy_setopt(curl, CURLOPT_POSTFIELDS, (request->body != NULL) ? request->body : data);
+    curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE, (long) len);
 
-    curl_easy_cleanup(curl);
+    CURLMcode ret = curl_multi_add_handle(ap->multi, curl);
+    if (ret != CURLM_OK) {
+        log_error("publish_json_async %s", curl_multi_strerror(ret));
+        breaker_cancel();
+        free(request->body);
+        free(request);
+        curl_easy_cleanup(curl);
+        return FAILED;
+    }
+    ap->in_flight++;
     return SUCCESS;
 }
 
+/* Make progress on the requests in flight, waiting up to timeout_ms for network activity, 
+   and call the callbacks of the completed requests
+   return the number of requests still in flight */
+int publisher_async_poll(AsyncPublisher *ap, int timeout_ms)
+{
+    int running;
+
+    if (ap->in_flight == 0) {
+        return 0;
+    }
+    finish_forwarded(ap);
+    long next_retry_ms = start_retries(ap);
+    curl_multi_perform(ap->multi, &running);
+    finish_requests(ap);
+    if (ap->in_flight > 0 && timeout_ms > 0 && ap->forwarded == NULL) {
+        /* wake up for the next retry */
+        if (next_retry_ms >= 0 && next_retry_ms < timeout_ms) {
+            timeout_ms = (int) next_retry_ms;
+        }
+        if (running > 0) {
+            curl_multi_wait(ap->multi, NULL, 0, timeout_ms, NULL);
+        } else {
+            /* only retries are waiting */
+            struct timespec wait = { timeout_ms / 1000, (timeout_ms % 1000) * 1000000L };
+            nanosleep(&wait, NULL);
+        }
+        curl_multi_perform(ap->multi, &running);
+        finish_requests(ap);
+    }
+    return ap->in_flight;
+}
+
+/* Wait for all requests in flight, and free the publisher */
+void publisher_async_free(AsyncPublisher *ap)
+{
+    int i;
+
+    if (ap == NULL) {
+        return;
+    }
+    while (publisher_async_poll(ap, ASYNC_WAIT_MS) > 0) {
+        ;
+    }
+    for (i = 0; i < ap->num_idle; i++) {
+        curl_easy_cleanup(ap->idle[i]);
+    }
+    curl_multi_cleanup(ap->multi);
+    free(ap);
+}
+
+/* Call the callbacks of completed requests, and keep their handles for the next requests;
+   requests which failed for a transient reason are retried after a backoff */
+static void finish_requests(AsyncPublisher *ap)
+{
+    CURLMsg *msg;
+    int remaining;
+
+    while ((msg = curl_multi_info_read(ap->multi, &remaining)) != NULL) {
+        if (msg->msg != CURLMSG_DONE) {
+            continue;
+        }
+        CURL *curl = msg->easy_handle;
+        CURLcode response = msg->data.result;
+        AsyncRequest *request = NULL;
+        curl_easy_getinfo(curl, CURLINFO_PRIVATE, (char **) &request);
+        curl_multi_remove_handle(ap->multi, curl);
+
+        int ret = check_attempt(curl, response, (request != NULL) ? request->attempt : retries, 
+            "publish_json_async");
+        if (ret == RETRY) {
+            request->attempt++;
+            request->retry_at = now_ns() + backoff(request->attempt) * 1000000LL;
+            request->next = ap->retries;
+            ap->retries = request;
+            continue;
+        }
+        if (ret == SUCCESS && request != NULL) {
+            ret = check_format(curl, request->format);
+        }
+        char *URL = NULL;
+        if (ret == PUBLISH_UNSUPPORTED && request != NULL && request->data != NULL) {
+            /* the bulk is sent again as columns; its URL is copied before the handle is reused */
+            curl_easy_getinfo(curl, CURLINFO_EFFECTIVE_URL, &URL);
+            URL = (URL != NULL) ? strdup(URL) : NULL;
+        }
+        ap->in_flight--;
+        if (ap->num_idle < ASYNC_MAX_IDLE) {
+            ap->idle[ap->num_idle++] = curl;
+        } else {
+            curl_easy_cleanup(curl);
+        }
+        if (request != NULL) {
+            if (URL != NULL && refuse_gorilla(URL) && publish_bulk_async(ap, URL, request->data, request->len, 
+                PUBLISH_COLUMNS, request->callback, request->userdata)) {
+                /* its callback is called when the columns are answered */
+            } else if (request->callback != NULL) {
+                request->callback(ret, request->userdata);
+            }
+            free(URL);
+            free(request->body);
+            free(request);
+        }
+    }
+}
+
+/* Call the callbacks of the requests handed to the aggregator */
+static void finish_forwarded(AsyncPublisher *ap)
+{
+    AsyncRequest *request = ap->forwarded;
+
+    /* callbacks may start new requests, which are called back by the next poll */
+    ap->forwarded = NULL;
+    ap->forwarded_tail = &ap->forwarded;
+    while (request != NULL) {
+        AsyncRequest *next = request->next;
+        ap->in_flight--;
+        if (request->callback != NULL) {
+            request->callback(request->result, request->userdata);
+        }
+        free(request);
+        request = next;
+    }
+}
+
+/* Send the requests whose backoff has expired again
+   return the time in ms until the next retry; -1 if there is none */
+static long start_retries(AsyncPublisher *ap)
+{
+    AsyncRequest **prev = &ap->retries;
+    long long now = now_ns();
+    long long next = -1;
+
+    while (*prev != NULL) {
+        AsyncRequest *request = *prev;
+        if (request->retry_at > now) {
+            if (next < 0 || request->retry_at - now < next) {
+                next = request->retry_at - now;
+            }
+            prev = &request->next;
+            continue;
+        }
+        *prev = request->next;
+        /* give up, if the server has been found unreachable in the meantime */
+        if (!breaker_closed() || curl_multi_add_handle(ap->multi, request->curl) != CURLM_OK) {
+            ap->in_flight--;
+            curl_easy_cleanup(request->curl);
+            if (request->callback != NULL) {
+                request->callback(FAILED, request->userdata);
+            }
+            free(request->body);
+            free(request);
+        }
+    }
+    return (next < 0) ? -1 : (long) (next / 1000000LL);
+}
+
 /* Check if the url is set 
    return 1 on success; otherwise return 0 */
 int check_URL(char *URL)
@@ -227,56 +801,667 @@ int check_message(char *message)
     return SUCCESS;
 }
 
-/* Initialize libcurl; set headers format */
+/* Initialize libcurl; set headers format; safe to be called by several threads */
 void init_curl(void)
 {
-    if (headers != NULL ) {
-        return;
+    pthread_once(&curl_once, init_curl_once);
+}
+
+/* Prepare for using libcurl to write */
+CURL *prepare_publish(char *URL, char *message)
+{
+    CURL *curl = get_handle();
+    if (curl == NULL) {
+        return NULL;
+    }
+    curl_easy_setopt(curl, CURLOPT_URL, URL);
+    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, encoded_headers[PUBLISH_JSON][compression]);
+    if (message != NULL) {
+        curl_easy_setopt(curl, CURLOPT_POSTFIELDS, message);
+        curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE, (long ) strlen(message));
+    }
+    return curl;
+}
+
+/* Prepare for using libcurl to read */
+CURL *prepare_query(char* URL)
+{
+    CURL *curl = get_handle();
+    if (curl == NULL) {
+        return NULL;
     }
+    curl_easy_setopt(curl, CURLOPT_URL, URL);
+    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
+    curl_easy_setopt(curl, CURLOPT_HTTPGET, 1L);
+    return curl;
+}
+
+/* Initialize libcurl once per process */
+static void init_curl_once(void)
+{
     curl_global_init(CURL_GLOBAL_ALL);
     headers = curl_slist_append(headers, "Accept: application/json");
     headers = curl_slist_append(headers, "Content-Type: application/json");
     headers = curl_slist_append(headers, "charsets: utf-8");
+
+    /* the headers with the Content-Type of each format, plus the Content-Encoding of each codec */
+    int format, codec;
+    encoded_headers[PUBLISH_JSON][COMPRESS_NONE] = headers;
+    for (format = PUBLISH_JSON; format <= PUBLISH_GORILLA; format++) {
+        for (codec = COMPRESS_NONE; codec <= COMPRESS_ZSTD; codec++) {
+            char line[64];
+            struct curl_slist **h = &encoded_headers[format][codec];
+            if (*h != NULL) {
+                continue;
+            }
+            *h = curl_slist_append(*h, "Accept: application/json");
+            snprintf(line, sizeof(line), "Content-Type: %s", content_types[format]);
+            *h = curl_slist_append(*h, line);
+            if (format == PUBLISH_JSON || format == PUBLISH_COLUMNS) {
+                *h = curl_slist_append(*h, "charsets: utf-8");
+            }
+            if (codec != COMPRESS_NONE) {
+                snprintf(line, sizeof(line), "Content-Encoding: %s", compress_encoding(codec));
+                *h = curl_slist_append(*h, line);
+            }
+        }
+    }
+    pthread_key_create(&handle_key, free_handle);
 }
 
-/* Prepare for using libcurl to write */
-CURL *prepare_publish(char *URL, char *message)
+/* Get the curl handle of the calling thread, which is created with the transport options on first use;
+   the options of the previous request are reset, but its connection is kept open */
+static CURL *get_handle(void)
 {
     init_curl();
-    CURL *curl = curl_easy_init();
-    curl_easy_setopt(curl, CURLOPT_URL, URL);
-    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
-    curl_easy_setopt(curl, CURLOPT_POSTFIELDS, message);
-    curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE, (long ) strlen(message));
-    
-    #ifdef DEBUG
-    curl_easy_setopt(curl, CURLOPT_VERBOSE, 1L);
-    #endif
+    CURL *curl = reuse_connections ? pthread_getspecific(handle_key) : NULL;
+    if (curl != NULL) {
+        /* response handling and the source of the body differ between the requests */
+        curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, NULL);
+        curl_easy_setopt(curl, CURLOPT_WRITEDATA, stdout);
+        curl_easy_setopt(curl, CURLOPT_READFUNCTION, NULL);
+        curl_easy_setopt(curl, CURLOPT_READDATA, stdin);
+        return curl;
+    }
 
+    curl = new_handle();
+    if (curl != NULL && reuse_connections) {
+        pthread_setspecific(handle_key, curl);
+    }
     return curl;
 }
 
-/* Prepare for using libcurl to read */
-CURL *prepare_query(char* URL)
+/* Create a curl handle with the transport options */
+static CURL *new_handle(void)
 {
-    init_curl();
     CURL *curl = curl_easy_init();
-    curl_easy_setopt(curl, CURLOPT_URL, URL);
+    if (curl == NULL) {
+        log_error("Cannot create curl handle");
+        return NULL;
+    }
     curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
+    curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);
+    curl_easy_setopt(curl, CURLOPT_TCP_KEEPALIVE, keep_alive);
+    curl_easy_setopt(curl, CURLOPT_TCP_KEEPIDLE, keep_alive_idle);
+    curl_easy_setopt(curl, CURLOPT_TCP_KEEPINTVL, keep_alive_interval);
+    curl_easy_setopt(curl, CURLOPT_TCP_NODELAY, tcp_nodelay);
+    curl_easy_setopt(curl, CURLOPT_HTTP_VERSION, http_version);
+    curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT_MS, connect_timeout);
+    curl_easy_setopt(curl, CURLOPT_TIMEOUT_MS, request_timeout);
+    #if LIBCURL_VERSION_NUM >= 0x072800
+    if (unix_socket != NULL) {
+        curl_easy_setopt(curl, CURLOPT_UNIX_SOCKET_PATH, unix_socket);
+    }
+    #endif
     #ifdef DEBUG
     curl_easy_setopt(curl, CURLOPT_VERBOSE, 1L);
     #endif
-
     return curl;
 }
 
+/* Hand the curl handle back after a request */
+static void release_handle(CURL *curl)
+{
+    if (!reuse_connections) {
+        curl_easy_cleanup(curl);
+    }
+}
+
+/* Clean up the curl handle of a thread, when it exits */
+static void free_handle(void *curl)
+{
+    curl_easy_cleanup((CURL *) curl);
+}
+
+/* Compress the message with the configured codec into a new buffer; *body is NULL without compression
+   return 1 on success; otherwise return 0 */
+static int compress_message(const char *message, size_t len, char **body, size_t *body_len)
+{
+    *body = NULL;
+    if (compression == COMPRESS_NONE) {
+        return SUCCESS;
+    }
+    if (!compress_buffer(compression, compression_level, message, len, body, body_len)) {
+        log_error("Cannot compress message of %zu bytes", len);
+        return FAILED;
+    }
+    return SUCCESS;
+}
+
+/* Encode a bulk of columns with the column codec, and compress the message with the configured codec 
+   into a new buffer; *body is NULL if the message is sent as it is, and *format is the one of the body
+   return 1 on success; otherwise return 0 */
+static int prepare_body(const char *message, size_t len, int *format, char **body, size_t *body_len)
+{
+    char *encoded = NULL;
+
+    if (*format == PUBLISH_COLUMNS && __atomic_load_n(&column_gorilla, __ATOMIC_RELAXED)) {
+        /* a malformed batch is left to the server */
+        if (gorilla_encode(message, len, &encoded, body_len)) {
+            message = encoded;
+            len = *body_len;
+            *format = PUBLISH_GORILLA;
+        }
+    }
+    if (!compress_message(message, len, body, body_len)) {
+        free(encoded);
+        return FAILED;
+    }
+    if (*body == NULL) {
+        *body = encoded;
+    } else {
+        free(encoded);
+    }
+    return SUCCESS;
+}
+
+/* Stop encoding bulks of columns by gorilla.h, since the server does not accept it
+   return 1, so that the bulk is sent as columns again */
+static int refuse_gorilla(const char *URL)
+{
+    if (__atomic_exchange_n(&column_gorilla, 0, __ATOMIC_RELAXED)) {
+        log_warn("Server %s does not accept gorilla, sending columns from now on", URL);
+    }
+    return SUCCESS;
+}
+
+/* Check if the server has accepted the format of a request, which it has answered
+   return 1 if it has; -1 if it does not support the format (HTTP status 415) */
+static int check_format(CURL *curl, int format)
+{
+    long status = 0;
+
+    if (format == PUBLISH_JSON) {
+        return SUCCESS;
+    }
+    curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &status);
+    return (status == 415) ? PUBLISH_UNSUPPORTED : SUCCESS;
+}
+
+/* Hand the file over to the aggregator, one batch after the other
+   return 1 on success; otherwise return 0 */
+static int forward_file(char *URL, FileBatch *batch)
+{
+    size_t size = (file_batch_bytes > 0) ? file_batch_bytes + 65536 : 1048576;
+    char *buffer = malloc(size);
+    int ret = SUCCESS;
+
+    while (ret == SUCCESS && batch_begin(batch)) {
+        size_t len = 0, n;
+        while ((n = batch_read(buffer + len, size - len, batch)) > 0) {
+            len += n;
+            if (len == size) {
+                size *= 2;
+                buffer = realloc(buffer, size);
+            }
+        }
+        ret = forward_bulk(aggregator, URL, buffer, len, PUBLISH_JSON);
+    }
+    free(buffer);
+    return ret;
+}
+
+/* Send the file one batch after the other, each one encoded as columns; a batch with a line which is 
+   not a list of json members is sent as rows, and so are all batches once the server does not 
+   accept columns
+   return 1 on success; otherwise return 0 */
+static int publish_file_columns(char *URL, FileBatch *batch)
+{
+    ColumnBatch *columns = columns_new();
+    char *buffer = NULL;
+    size_t size = 0;
+    int ret = SUCCESS;
+
+    while (ret == SUCCESS && batch_begin(batch)) {
+        if (__atomic_load_n(&file_columns, __ATOMIC_RELAXED) && batch_columns(batch, columns)) {
+            size_t len = columns_write(columns, &buffer, &size);
+            ret = publish_bulk(URL, buffer, len, PUBLISH_COLUMNS);
+            if (ret != PUBLISH_UNSUPPORTED) {
+                continue;
+            }
+            if (__atomic_exchange_n(&file_columns, 0, __ATOMIC_RELAXED)) {
+                log_warn("Server %s does not accept columns, sending files as rows from now on", URL);
+            }
+        }
+        ret = publish_batch(URL, batch);
+    }
+    columns_free(columns);
+    free(buffer);
+    return ret;
+}
+
+/* Send one batch of the file as json array with a chunked upload
+   return 1 on success; otherwise return 0 */
+static int publish_batch(char *URL, FileBatch *batch)
+{
+    CURL *curl = prepare_publish(URL, NULL);
+    if (curl == NULL) {
+        return FAILED;
+    }
+    #ifdef NDEBUG
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_non_data);
+    #endif
+    int ret = perform_batch(curl, batch);
+    release_handle(curl);
+    return ret;
+}
+
+/* Start the next batch of the file, skipping empty lines
+   return 1 if there is a line left; otherwise return 0 */
+static int batch_begin(FileBatch *batch)
+{
+    while (batch->pos < batch->end && (*batch->pos == '\n' || *batch->pos == '\r')) {
+        batch->pos++;
+    }
+    batch->start = batch->pos;
+    batch_rewind(batch);
+    return batch->pos < batch->end;
+}
+
+/* Start writing the batch from its first line */
+static void batch_rewind(FileBatch *batch)
+{
+    batch->pos = batch->start;
+    batch->records = 0;
+    batch->bytes = 0;
+    batch->part = PART_NEXT;
+    batch->offset = 0;
+}
+
+/* Pick the next line of the batch, which ends once file_batch_records lines or file_batch_bytes 
+   bytes of lines are picked; empty lines are skipped
+   return 1 if a line is picked; 0 at the end of the batch */
+static int batch_next_line(FileBatch *batch)
+{
+    while (batch->pos < batch->end && (*batch->pos == '\n' || *batch->pos == '\r')) {
+        batch->pos++;
+    }
+    if (batch->pos == batch->end || 
+        (file_batch_records > 0 && batch->records >= file_batch_records) ||
+        (file_batch_bytes > 0 && batch->bytes >= (size_t) file_batch_bytes)) {
+        return FAILED;
+    }
+    const char *eol = memchr(batch->pos, '\n', batch->end - batch->pos);
+    batch->line = batch->pos;
+    batch->line_len = (eol != NULL ? eol : batch->end) - batch->pos;
+    if (batch->line[batch->line_len - 1] == '\r') {
+        batch->line_len--;
+    }
+    batch->pos = (eol != NULL) ? eol + 1 : batch->end;
+    batch->records++;
+    batch->bytes += batch->line_len;
+    return SUCCESS;
+}
+
+/* Encode the lines of the batch as columns, with the static string as header
+   return 1 on success; 0 if a line is not a list of json members */
+static int batch_columns(FileBatch *batch, ColumnBatch *columns)
+{
+    columns_begin(columns);
+    columns_header(columns, batch->static_string, batch->static_len);
+    while (batch_next_line(batch)) {
+        if (!columns_add_line(columns, batch->line, batch->line_len)) {
+            debug("Sending a batch as rows, as its line %ld is not a list of json members", batch->records);
+            return FAILED;
+        }
+    }
+    return SUCCESS;
+}
+
+/* Write the next bytes of the json array of the batch; source of the compressor and of read_batch()
+   return the number of bytes written; 0 at the end of the batch */
+static size_t batch_read(char *buffer, size_t size, void *arg)
+{
+    FileBatch *batch = (FileBatch *) arg;
+    size_t n = 0;
+
+    while (n < size && batch->part != PART_DONE) {
+        const char *part = NULL;
+        size_t len = 0;
+
+        switch (batch->part) {
+        case PART_NEXT:
+            batch->part = batch_next_line(batch) ? PART_OPEN : PART_END;
+            continue;
+        case PART_OPEN:
+            part = (batch->records == 1) ? "[{" : ",{";
+            len = 2;
+            break;
+        case PART_STATIC:
+            part = batch->static_string;
+            len = batch->static_len;
+            break;
+        case PART_SEP:
+            part = ", ";
+            len = 2;
+            break;
+        case PART_LINE:
+            part = batch->line;
+            len = batch->line_len;
+            break;
+        case PART_CLOSE:
+            part = "}";
+            len = 1;
+            break;
+        case PART_END:
+            part = "]";
+            len = 1;
+            break;
+        }
+
+        size_t copy = len - batch->offset;
+        if (copy > size - n) {
+            copy = size - n;
+        }
+        memcpy(buffer + n, part + batch->offset, copy);
+        batch->offset += copy;
+        n += copy;
+        if (batch->offset == len) {
+            batch->offset = 0;
+            batch->part = (batch->part == PART_CLOSE) ? PART_NEXT : batch->part + 1;
+        }
+    }
+    return n;
+}
+
+/* Send the batch with a chunked upload; with compression, the batch is compressed while it is sent, 
+   so that neither the json array nor its compressed copy is held in memory
+   return 1 on success; otherwise return 0 */
+static int perform_batch(CURL *curl, FileBatch *batch)
+{
+    int attempt, ret = RETRY;
+
+    curl_easy_setopt(curl, CURLOPT_POST, 1L);
+    curl_easy_setopt(curl, CURLOPT_POSTFIELDS, NULL);
+    curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE, -1L);
+    for (attempt = 0; ret == RETRY; attempt++) {
+        Compressor *c = NULL;
+        if (attempt > 0) {
+            wait_backoff(attempt);
+        }
+        if (!breaker_allow()) {
+            return FAILED;
+        }
+        /* each attempt starts over at the first line of the batch */
+        batch_rewind(batch);
+        if (compression == COMPRESS_NONE) {
+            curl_easy_setopt(curl, CURLOPT_READFUNCTION, read_batch);
+            curl_easy_setopt(curl, CURLOPT_READDATA, batch);
+        } else {
+            c = compressor_new(compression, compression_level, batch_read, batch);
+            if (c == NULL) {
+                breaker_cancel();
+                return FAILED;
+            }
+            curl_easy_setopt(curl, CURLOPT_READFUNCTION, read_compressed);
+            curl_easy_setopt(curl, CURLOPT_READDATA, c);
+        }
+        ret = check_attempt(curl, curl_easy_perform(curl), attempt, "publish_file");
+        compressor_free(c);
+    }
+    return ret;
+}
+
+/* Callback function of libcurl to read the body of a chunked upload from a batch */
+static size_t read_batch(char *buffer, size_t size, size_t nmemb, void *userp)
+{
+    return batch_read(buffer, size * nmemb, userp);
+}
+
+/* Callback function of libcurl to read the body of a chunked upload from a compressor */
+static size_t read_compressed(char *buffer, size_t size, size_t nmemb, void *userp)
+{
+    size_t n = compressor_read((Compressor *) userp, buffer, size * nmemb);
+    if (n == COMPRESS_ERROR) {
+        return CURL_READFUNC_ABORT;
+    }
+    return n;
+}
+
+/* Send the request prepared on the handle, and retry it after a backoff if it fails for a transient reason
+   return 1 on success; otherwise return 0 */
+static int perform(CURL *curl, const char *what)
+{
+    int attempt, ret = RETRY;
+
+    for (attempt = 0; ret == RETRY; attempt++) {
+        if (attempt > 0) {
+            wait_backoff(attempt);
+        }
+        if (!breaker_allow()) {
+            return FAILED;
+        }
+        ret = check_attempt(curl, curl_easy_perform(curl), attempt, what);
+    }
+    return ret;
+}
+
+/* Check the outcome of an attempt and report it to the circuit breaker; 
+   before a retry, the synchronous publisher waits for the backoff
+   return 1 on success; 2 if the request should be retried; 0 otherwise */
+static int check_attempt(CURL *curl, CURLcode response, int attempt, const char *what)
+{
+    long status = 0;
+
+    curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &status);
+    if (response == CURLE_OK && status < 500) {
+        breaker_report(SUCCESS);
+        return SUCCESS;
+    }
+    if (!is_transient(response, status)) {
+        breaker_cancel();
+        log_error("%s %s", what, curl_easy_strerror(response));
+        return FAILED;
+    }
+    breaker_report(FAILED);
+    if (attempt < retries && breaker_closed()) {
+        return RETRY;
+    }
+    /* while the breaker is open, the outage has been logged already when it opened */
+    if (!breaker_closed()) {
+        debug("%s %s (HTTP status %ld)", what, curl_easy_strerror(response), status);
+    } else {
+        log_warn("%s %s (HTTP status %ld) after %d attempts", what, curl_easy_strerror(response), 
+            status, attempt + 1);
+    }
+    return FAILED;
+}
+
+/* Wait for the backoff before the given retry of a synchronous request */
+static void wait_backoff(int attempt)
+{
+    long ms = backoff(attempt);
+    struct timespec wait = { ms / 1000, (ms % 1000) * 1000000L };
+    nanosleep(&wait, NULL);
+}
+
+/* Check if a failure may go away by itself, like a refused connection or a restarting server
+   return 1 if the request should be retried; otherwise return 0 */
+static int is_transient(CURLcode response, long status)
+{
+    switch (response) {
+    case CURLE_OK:
+        return status >= 500;
+    case CURLE_COULDNT_RESOLVE_HOST:
+    case CURLE_COULDNT_CONNECT:
+    case CURLE_OPERATION_TIMEDOUT:
+    case CURLE_SEND_ERROR:
+    case CURLE_RECV_ERROR:
+    case CURLE_GOT_NOTHING:
+    case CURLE_PARTIAL_FILE:
+        return SUCCESS;
+    default:
+        return FAILED;
+    }
+}
+
+/* Get the backoff in ms before the given retry: retry_backoff doubled with each retry and bounded 
+   by retry_backoff_max, of which a random part of up to one half is taken off as jitter */
+static long backoff(int attempt)
+{
+    long ms = retry_backoff;
+    int i;
+
+    for (i = 1; i < attempt && ms < retry_backoff_max; i++) {
+        ms *= 2;
+    }
+    if (ms > retry_backoff_max) {
+        ms = retry_backoff_max;
+    }
+    if (jitter_seed == 0) {
+        jitter_seed = (unsigned int) now_ns() ^ (unsigned int) (size_t) &jitter_seed;
+    }
+    return ms - (long) (rand_r(&jitter_seed) % (ms / 2 + 1));
+}
+
+/* Check if a request may be sent; once the probe interval of the open breaker has passed, 
+   the request of the calling thread is let through as a probe
+   return 1 if the request may be sent; otherwise return 0 */
+static int breaker_allow(void)
+{
+    int allow = SUCCESS;
+
+    if (breaker_threshold == 0) {
+        return SUCCESS;
+    }
+    pthread_mutex_lock(&breaker_lock);
+    if (breaker_state == BREAKER_HALF_OPEN) {
+        allow = FAILED;
+    } else if (breaker_state == BREAKER_OPEN) {
+        if (now_ns() >= breaker_until) {
+            breaker_state = BREAKER_HALF_OPEN;
+        } else {
+            allow = FAILED;
+        }
+    }
+    pthread_mutex_unlock(&breaker_lock);
+    return allow;
+}
+
+/* Check if the breaker is closed, i.e. the server is considered reachable */
+static int breaker_closed(void)
+{
+    int closed;
+
+    pthread_mutex_lock(&breaker_lock);
+    closed = (breaker_state == BREAKER_CLOSED);
+    pthread_mutex_unlock(&breaker_lock);
+    return closed;
+}
+
+/* Report the outcome of a request to the breaker, which opens after breaker_threshold 
+   transient failures in a row, or if the probe fails, and closes after a success */
+static void breaker_report(int success)
+{
+    if (breaker_threshold == 0) {
+        return;
+    }
+    pthread_mutex_lock(&breaker_lock);
+    if (success) {
+        if (breaker_state != BREAKER_CLOSED) {
+            log_info("Server is reachable again, resuming requests");
+        }
+        breaker_state = BREAKER_CLOSED;
+        breaker_failures = 0;
+    } else {
+        breaker_failures++;
+        if (breaker_state == BREAKER_HALF_OPEN || breaker_failures >= breaker_threshold) {
+            if (breaker_state == BREAKER_CLOSED) {
+                log_error("Server is unreachable after %ld failed requests, probing it every %ld s", 
+                    breaker_failures, breaker_interval);
+            }
+            breaker_state = BREAKER_OPEN;
+            breaker_until = now_ns() + breaker_interval * 1000000000LL;
+        }
+    }
+    pthread_mutex_unlock(&breaker_lock);
+}
+
+/* Hand back the probe of the breaker, if the request could not be sent at all */
+static void breaker_cancel(void)
+{
+    pthread_mutex_lock(&breaker_lock);
+    if (breaker_state == BREAKER_HALF_OPEN) {
+        breaker_state = BREAKER_OPEN;
+        breaker_until = now_ns();
+    }
+    pthread_mutex_unlock(&breaker_lock);
+}
+
+/* Get the time of the monotonic clock in ns */
+static long long now_ns(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (long long) now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+/* parse on or off
+   return 1 on success; otherwise return 0 */
+static int parse_switch(const char *value, long *ret)
+{
+    if (strcmp(value, "on") == 0) {
+        *ret = 1;
+        return SUCCESS;
+    }
+    if (strcmp(value, "off") == 0) {
+        *ret = 0;
+        return SUCCESS;
+    }
+    return FAILED;
+}
+
+/* parse a positive number
+   return 1 on success; otherwise return 0 */
+static int parse_long(const char *value, long *ret)
+{
+    char *end;
+    long number = strtol(value, &end, 10);
+    if (end == value || *end != '\0' || number <= 0) {
+        return FAILED;
+    }
+    *ret = number;
+    return SUCCESS;
+}
+
+/* parse a number, which may be 0
+   return 1 on success; otherwise return 0 */
+static int parse_count(const char *value, long *ret)
+{
+    char *end;
+    long number = strtol(value, &end, 10);
+    if (end == value || *end != '\0' || number < 0) {
+        return FAILED;
+    }
+    *ret = number;
+    return SUCCESS;
+}
+
 /* Callback function for writing with libcurl */
-#ifdef NDEBUG
 static size_t write_non_data(void *buffer, size_t size, size_t nmemb, void *userp)
 {
     return size * nmemb;
 }
-#endif
 
 /* Callback function to get stream data during writing */
 static size_t get_stream_data(void *buffer, size_t size, size_t nmemb, char *stream) 
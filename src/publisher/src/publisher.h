@@ -17,6 +17,17 @@
 #ifndef PUBLISHER_H_
 #define PUBLISHER_H_
 
+#include <stddef.h>
+
+/* formats of the bodies of publish_bulk() and publish_bulk_async(), sent as Content-Type */
+#define PUBLISH_JSON    0       /* application/json */
+#define PUBLISH_MSGPACK 1       /* application/msgpack */
+#define PUBLISH_COLUMNS 2       /* application/x-mf-columns+json, a batch of columns.h */
+#define PUBLISH_GORILLA 3       /* application/x-mf-gorilla, a batch of columns.h encoded by gorilla.h */
+
+/* result of a request whose format the server does not accept (HTTP status 415) */
+#define PUBLISH_UNSUPPORTED -1
+
 int query_json(char *URL, char *response);
 
 /**
@@ -26,7 +37,118 @@ int query_json(char *URL, char *response);
  */
 int publish_json(char *URL, char *message);
 
+/**
+ * @brief Sends len bytes of data in the given format to the given URL via cURL.
+ *
+ * @return 1 if successful; PUBLISH_UNSUPPORTED if the server does not accept
+ * the format; 0 otherwise
+ */
+int publish_bulk(char *URL, const char *data, size_t len, int format);
+
 int publish_file(char *URL, char *static_string, char *filename);
 
 int create_new_experiment(char *URL, char *message, char *experiment_id);
+
+/**
+ * @brief Sets an option of the transport to the server.
+ *
+ * Each thread keeps one curl handle, whose connection is reused by the next
+ * requests of the thread. Options are applied to handles created afterwards, so
+ * they have to be set before publishing starts. The options are
+ * reuse_connections, keep_alive and tcp_nodelay (on or off), keep_alive_idle
+ * and keep_alive_interval (in s), http_version (default, 1.0, 1.1, 2 or
+ * 2-prior-knowledge) and unix_socket (path of a UNIX domain socket).
+ * Request bodies are compressed with compression (none, gzip or zstd) at
+ * compression_level (0 for the default level of the codec).
+ * Requests time out after connect_timeout and request_timeout (in ms), and
+ * transient failures are retried up to retries times after a backoff of
+ * retry_backoff ms, doubled with each retry up to retry_backoff_max, with
+ * jitter. After breaker_threshold failed requests in a row, the circuit
+ * breaker opens: requests fail at once, and one request every
+ * breaker_interval s probes whether the server is back.
+ * publish_file() sends a file in batches of file_batch_bytes bytes of lines
+ * or file_batch_records lines, whichever is reached first (0 for no limit);
+ * with file_format columns (default rows), each batch is sent as one
+ * columnar batch, which names the static fields and the keys once, unless
+ * the server does not accept it.
+ * With column_codec gorilla (default none), bulks in the columns format are
+ * sent in the time-series encoding of gorilla.h; if the server does not
+ * accept it, they are sent as columns again.
+ * With aggregator set to the socket of a node-local mf_aggregator, the bulks
+ * of publish_bulk(), publish_bulk_async() and publish_file() are handed over
+ * to it instead of being sent to the server; experiments are still created,
+ * and queries sent, by the process itself.
+ *
+ * @return 1 if successful; 0 if the value is invalid; -1 if the option is unknown
+ */
+int publisher_set_option(const char *name, const char *value);
+
+/**
+ * @brief Cleans up the curl handle of the calling thread.
+ */
+void publisher_cleanup(void);
+
+/**
+ * @brief Drops the curl handle which the calling thread inherited by fork(), without using it.
+ *
+ * The connection of the handle still belongs to the parent process, so the
+ * handle is neither reused nor cleaned up; the next request of the thread
+ * opens a connection of its own.
+ */
+void publisher_forget_handle(void);
+
+/**
+ * @brief Called when an asynchronous request is completed, with 1 on success;
+ * PUBLISH_UNSUPPORTED if the server does not accept the format; 0 otherwise.
+ *
+ * The callback may start new requests.
+ */
+typedef void (*publish_callback)(int success, void *userdata);
+
+/**
+ * @brief Asynchronous publisher, which keeps many requests in flight at once.
+ *
+ * The publisher is built on the curl multi interface; with HTTP/2, the requests
+ * are multiplexed over one connection. It is not thread-safe: the thread which
+ * creates it starts the requests and polls for their completion.
+ */
+typedef struct AsyncPublisher_t AsyncPublisher;
+
+/**
+ * @brief Creates an asynchronous publisher with at most max_in_flight concurrent requests.
+ */
+AsyncPublisher *publisher_async_new(int max_in_flight);
+
+/**
+ * @brief Starts sending len bytes of message to the given URL via cURL.
+ *
+ * The message has to stay valid until the callback is called. If max_in_flight
+ * requests are in flight already, the function waits for one to complete.
+ *
+ * @return 1 if the request is started; 0 otherwise, the callback is not called then
+ */
+int publish_json_async(AsyncPublisher *ap, char *URL, char *message, size_t len, 
+    publish_callback callback, void *userdata);
+
+/**
+ * @brief Starts sending len bytes of data in the given format, like publish_json_async().
+ *
+ * @return 1 if the request is started; 0 otherwise, the callback is not called then
+ */
+int publish_bulk_async(AsyncPublisher *ap, char *URL, const char *data, size_t len, int format,
+    publish_callback callback, void *userdata);
+
+/**
+ * @brief Makes progress on the requests in flight, and calls the callbacks of completed requests.
+ *
+ * Waits up to timeout_ms for network activity, if requests are in flight.
+ *
+ * @return the number of requests still in flight
+ */
+int publisher_async_poll(AsyncPublisher *ap, int timeout_ms);
+
+/**
+ * @brief Waits for all requests in flight, and frees the publisher.
+ */
+void publisher_async_free(AsyncPublisher *ap);
 #endif
\ No newline at end of file
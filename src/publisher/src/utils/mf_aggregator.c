@@ -0,0 +1,519 @@
+/*
+ * Copyright (C) 2014-2015 University of Stuttgart
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Node-local aggregator of the bulks of many processes.
+ *
+ * mf_aggregator [-s socket] [-b batch bytes] [-i flush interval ms] [-q queue MB] [-o name=value ...]
+ *
+ * Processes using mf_api, and the agent, hand their bulks over to the
+ * aggregator with the publisher option aggregator = <socket>, instead of each
+ * sending them to the server on its own. The aggregator merges the bulks of all
+ * processes for the same URL into one json array, which is sent once it holds
+ * batch bytes or the flush interval has passed; MessagePack and columnar
+ * bulks are converted into json. One thread sends the batches over one connection,
+ * compressed with gzip unless other publisher options are given with -o.
+ * Once more than queue MB wait for the server, bulks are rejected, so that the
+ * processes keep them themselves. SIGINT or SIGTERM sends what is left and
+ * stops the aggregator.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <signal.h>
+#include <poll.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "publisher.h"
+#include "msgpack.h"
+#include "columns.h"
+#include "gorilla.h"
+#include "forward.h"
+
+#define SUCCESS 1
+#define FAILED  0
+#define NSEC_PER_SEC 1000000000LL
+/* buffer of the frames read from a process */
+#define CLIENT_BUFFER 65536
+/* wait after the server has failed to take a batch, in ms */
+#define RETRY_WAIT 1000
+
+/*******************************************************************************
+ * Variables Declarations
+ ******************************************************************************/
+/* json array of the bulks for one URL */
+typedef struct Batch_t {
+    char URL[FORWARD_URL_MAX + 1];
+    char *json;
+    size_t len;
+    size_t size;
+    long bulks;
+    long long opened;               /* time the first bulk was added, in ns */
+    struct Batch_t *next;
+} Batch;
+
+/* connection of one process, served by its own thread */
+typedef struct Client_t {
+    int fd;
+    char buffer[CLIENT_BUFFER];
+    size_t len;
+    size_t pos;
+} Client;
+
+FILE *logFile;
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t ready;
+static Batch *open_batches = NULL;  /* batches being filled, one per URL */
+static Batch *queue = NULL;         /* batches waiting to be sent, oldest first */
+static Batch **queue_tail = &queue;
+static size_t queued = 0;           /* bytes of all batches */
+static volatile sig_atomic_t stop = 0;
+static int stopping = 0;            /* stop, as seen under the lock */
+
+static size_t batch_bytes = 1048576;
+static long flush_interval = 1000;  /* in ms */
+static size_t max_queued = 256L << 20;
+
+/* statistics, under the lock */
+static unsigned long long bulks_in = 0;
+static unsigned long long bytes_in = 0;
+static unsigned long long bulks_rejected = 0;
+static unsigned long long batches_sent = 0;
+static unsigned long long bytes_sent = 0;
+static unsigned long long bulks_lost = 0;
+
+/*******************************************************************************
+ * Forward Declarations
+ ******************************************************************************/
+static void catcher(int signo);
+static void *serve(void *arg);
+static void *send_batches(void *arg);
+static int add_bulk(const char *URL, const char *json, size_t len);
+static void close_batches(int all);
+static void queue_batch(Batch **prev);
+static int read_frame(Client *c, char *URL, char **data, size_t *len, int *format);
+static int fill(Client *c);
+static int read_exact(Client *c, char *dst, size_t len);
+static long long now_ns(void);
+static void usage(const char *name);
+
+/* mf_aggregator main function */
+int main(int argc, char** argv)
+{
+    const char *path = "/tmp/mf_aggregator.sock";
+    struct sockaddr_un addr;
+    int opt;
+
+    logFile = stderr;
+    /* batches are compressed by default, if the publisher is built with zlib */
+    publisher_set_option("compression", "gzip");
+    while ((opt = getopt(argc, argv, "s:b:i:q:o:h")) != -1) {
+        switch (opt) {
+        case 's':
+            path = optarg;
+            break;
+        case 'b':
+            batch_bytes = (size_t) atol(optarg);
+            break;
+        case 'i':
+            flush_interval = atol(optarg);
+            break;
+        case 'q':
+            max_queued = (size_t) atol(optarg) << 20;
+            break;
+        case 'o': {
+            char *value = strchr(optarg, '=');
+            if (value == NULL) {
+                usage(argv[0]);
+                return 1;
+            }
+            *value++ = '\0';
+            if (strcmp(optarg, "aggregator") == 0 || publisher_set_option(optarg, value) != SUCCESS) {
+                fprintf(stderr, "Error: Invalid publisher option %s = %s\n", optarg, value);
+                return 1;
+            }
+            break;
+        }
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (batch_bytes == 0 || flush_interval <= 0 || max_queued == 0 || strlen(path) >= sizeof(addr.sun_path)) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    int listener = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+    unlink(path);
+    if (listener < 0 || bind(listener, (struct sockaddr *) &addr, sizeof(addr)) != 0 || listen(listener, 1024) != 0) {
+        fprintf(stderr, "Error: Cannot listen on %s: %s\n", path, strerror(errno));
+        return 1;
+    }
+
+    struct sigaction sig;
+    memset(&sig, 0, sizeof(sig));
+    sig.sa_handler = catcher;
+    sigemptyset(&sig.sa_mask);
+    sigaction(SIGTERM, &sig, NULL);
+    sigaction(SIGINT, &sig, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    /* the sender waits on the monotonic clock */
+    pthread_condattr_t cond_attr;
+    pthread_condattr_init(&cond_attr);
+    pthread_condattr_setclock(&cond_attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&ready, &cond_attr);
+    pthread_t sender;
+    pthread_create(&sender, NULL, send_batches, NULL);
+
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    while (!stop) {
+        struct pollfd pfd = { listener, POLLIN, 0 };
+        if (poll(&pfd, 1, 100) <= 0) {
+            continue;
+        }
+        int fd = accept(listener, NULL, NULL);
+        if (fd < 0) {
+            continue;
+        }
+        Client *c = calloc(1, sizeof(Client));
+        pthread_t thread;
+        c->fd = fd;
+        if (pthread_create(&thread, &attr, serve, c) != 0) {
+            close(fd);
+            free(c);
+        }
+    }
+    close(listener);
+    unlink(path);
+
+    /* the sender sends what is left, no more bulks are accepted */
+    pthread_mutex_lock(&lock);
+    stopping = 1;
+    pthread_cond_signal(&ready);
+    pthread_mutex_unlock(&lock);
+    pthread_join(sender, NULL);
+
+    pthread_mutex_lock(&lock);
+    printf("%llu bulks (%llu bytes) taken over, %llu rejected; %llu batches (%llu bytes) sent; %llu bulks lost\n",
+        bulks_in, bytes_in, bulks_rejected, batches_sent, bytes_sent, bulks_lost);
+    pthread_mutex_unlock(&lock);
+    publisher_cleanup();
+    return (bulks_lost == 0) ? 0 : 1;
+}
+
+static void catcher(int signo)
+{
+    stop = 1;
+}
+
+/* Take the bulks of one process over, until it closes the connection */
+static void *serve(void *arg)
+{
+    Client *c = (Client *) arg;
+    char URL[FORWARD_URL_MAX + 1];
+    char *data, *json;
+    size_t len, json_len;
+    int format;
+
+    while (read_frame(c, URL, &data, &len, &format)) {
+        int ret = FAILED;
+        if (format == PUBLISH_GORILLA && gorilla_decode(data, len, &json, &json_len)) {
+            /* go on with the columnar batch which has been encoded */
+            free(data);
+            data = json;
+            len = json_len;
+            format = PUBLISH_COLUMNS;
+        }
+        if (format == PUBLISH_MSGPACK) {
+            if (msgpack_to_json(data, len, &json, &json_len)) {
+                ret = add_bulk(URL, json, json_len);
+                free(json);
+            }
+        } else if (format == PUBLISH_COLUMNS) {
+            if (columns_to_json(data, len, &json, &json_len)) {
+                ret = add_bulk(URL, json, json_len);
+                free(json);
+            }
+        } else if (format == PUBLISH_JSON) {
+            ret = add_bulk(URL, data, len);
+        }
+        free(data);
+
+        char ack = (ret == SUCCESS) ? FORWARD_ACCEPTED : FORWARD_REJECTED;
+        if (send(c->fd, &ack, 1, MSG_NOSIGNAL) != 1) {
+            break;
+        }
+    }
+    close(c->fd);
+    free(c);
+    return NULL;
+}
+
+/* Send the batches which are full or due, one after the other */
+static void *send_batches(void *arg)
+{
+    long long retry_at = 0;
+
+    pthread_mutex_lock(&lock);
+    for (;;) {
+        long long now = now_ns();
+        close_batches(stopping);
+        if (queue == NULL || (retry_at > now && !stopping)) {
+            if (queue == NULL && open_batches == NULL && stopping) {
+                break;
+            }
+            /* wake up for the next retry, or for the next batch which may be due */
+            long long wait = (queue != NULL) ? retry_at : now + flush_interval * 1000000LL / 4;
+            struct timespec until = { wait / NSEC_PER_SEC, wait % NSEC_PER_SEC };
+            pthread_cond_timedwait(&ready, &lock, &until);
+            continue;
+        }
+
+        Batch *batch = queue;
+        queue = batch->next;
+        if (queue == NULL) {
+            queue_tail = &queue;
+        }
+        pthread_mutex_unlock(&lock);
+        int ret = publish_bulk(batch->URL, batch->json, batch->len, PUBLISH_JSON);
+        pthread_mutex_lock(&lock);
+
+        if (ret != SUCCESS && !stopping) {
+            /* keep the batch first in line, and try again later */
+            batch->next = queue;
+            queue = batch;
+            if (batch->next == NULL) {
+                queue_tail = &batch->next;
+            }
+            retry_at = now_ns() + RETRY_WAIT * 1000000LL;
+            continue;
+        }
+        if (ret == SUCCESS) {
+            batches_sent++;
+            bytes_sent += batch->len;
+        } else {
+            fprintf(stderr, "Error: %ld bulks for %s are lost\n", batch->bulks, batch->URL);
+            bulks_lost += batch->bulks;
+        }
+        retry_at = 0;
+        queued -= batch->size;
+        free(batch->json);
+        free(batch);
+    }
+    pthread_mutex_unlock(&lock);
+    return NULL;
+}
+
+/* Add the records of a json bulk, an array of objects or one object, to the batch of the URL
+   return 1 on success; 0 if the bulk is malformed or too much is queued already */
+static int add_bulk(const char *URL, const char *json, size_t len)
+{
+    /* the records of an array are added without its brackets */
+    while (len > 0 && (*json == ' ' || *json == '\t' || *json == '\r' || *json == '\n')) {
+        json++;
+        len--;
+    }
+    while (len > 0 && (json[len - 1] == ' ' || json[len - 1] == '\t' || json[len - 1] == '\r' ||
+        json[len - 1] == '\n')) {
+        len--;
+    }
+    if (len >= 2 && json[0] == '[' && json[len - 1] == ']') {
+        json++;
+        len -= 2;
+    } else if (len < 2 || json[0] != '{' || json[len - 1] != '}') {
+        return FAILED;
+    }
+
+    pthread_mutex_lock(&lock);
+    if (stopping || queued + len + 2 > max_queued) {
+        bulks_rejected++;
+        pthread_mutex_unlock(&lock);
+        return FAILED;
+    }
+    bulks_in++;
+    bytes_in += len;
+    if (len == 0) {
+        pthread_mutex_unlock(&lock);
+        return SUCCESS;
+    }
+
+    Batch **prev = &open_batches;
+    while (*prev != NULL && strcmp((*prev)->URL, URL) != 0) {
+        prev = &(*prev)->next;
+    }
+    Batch *batch = *prev;
+    if (batch == NULL) {
+        batch = calloc(1, sizeof(Batch));
+        strcpy(batch->URL, URL);
+        batch->size = ((len + 2 > batch_bytes) ? len : batch_bytes) + 2;
+        batch->json = malloc(batch->size);
+        batch->json[batch->len++] = '[';
+        batch->opened = now_ns();
+        *prev = batch;
+        queued += batch->size;
+    } else if (batch->len + len + 2 > batch->size) {
+        size_t size = batch->size;
+        while (batch->len + len + 2 > size) {
+            size *= 2;
+        }
+        batch->json = realloc(batch->json, size);
+        queued += size - batch->size;
+        batch->size = size;
+    }
+    if (batch->len > 1) {
+        batch->json[batch->len++] = ',';
+    }
+    memcpy(batch->json + batch->len, json, len);
+    batch->len += len;
+    batch->bulks++;
+    if (batch->len >= batch_bytes) {
+        /* the next bulk starts a new batch, while this one is sent */
+        queue_batch(prev);
+        pthread_cond_signal(&ready);
+    }
+    pthread_mutex_unlock(&lock);
+    return SUCCESS;
+}
+
+/* Queue the batches which are full or older than the flush interval, or all of them; under the lock */
+static void close_batches(int all)
+{
+    Batch **prev = &open_batches;
+    long long due = now_ns() - flush_interval * 1000000LL;
+
+    while (*prev != NULL) {
+        Batch *batch = *prev;
+        if (!all && batch->len < batch_bytes && batch->opened > due) {
+            prev = &batch->next;
+            continue;
+        }
+        queue_batch(prev);
+    }
+}
+
+/* Close the open batch at *prev, and queue it to be sent; under the lock */
+static void queue_batch(Batch **prev)
+{
+    Batch *batch = *prev;
+
+    *prev = batch->next;
+    batch->json[batch->len++] = ']';
+    batch->next = NULL;
+    *queue_tail = batch;
+    queue_tail = &batch->next;
+}
+
+/* Read the next frame; the data is allocated and has to be freed by the caller
+   return 1 on success; 0 if the connection is closed or the frame is malformed */
+static int read_frame(Client *c, char *URL, char **data, size_t *len, int *format)
+{
+    char line[FORWARD_HEADER_MAX];
+    size_t URL_len, i = 0;
+
+    /* the header line */
+    for (;;) {
+        if (c->pos == c->len && !fill(c)) {
+            return FAILED;
+        }
+        char ch = c->buffer[c->pos++];
+        if (ch == '\n') {
+            break;
+        }
+        if (i == sizeof(line) - 1) {
+            return FAILED;
+        }
+        line[i++] = ch;
+    }
+    line[i] = '\0';
+    if (!forward_parse_header(line, format, &URL_len, len)) {
+        fprintf(stderr, "Error: Malformed frame header %s\n", line);
+        return FAILED;
+    }
+    if (!read_exact(c, URL, URL_len)) {
+        return FAILED;
+    }
+    URL[URL_len] = '\0';
+    *data = malloc(*len);
+    if (*data == NULL || !read_exact(c, *data, *len)) {
+        free(*data);
+        return FAILED;
+    }
+    return SUCCESS;
+}
+
+/* Read more bytes of the connection into the empty buffer
+   return 1 on success; 0 if the connection is closed */
+static int fill(Client *c)
+{
+    ssize_t n;
+
+    do {
+        n = read(c->fd, c->buffer, sizeof(c->buffer));
+    } while (n < 0 && errno == EINTR);
+    if (n <= 0) {
+        return FAILED;
+    }
+    c->pos = 0;
+    c->len = n;
+    return SUCCESS;
+}
+
+/* Read len bytes of the connection into dst
+   return 1 on success; 0 if the connection is closed */
+static int read_exact(Client *c, char *dst, size_t len)
+{
+    while (len > 0) {
+        if (c->pos == c->len && !fill(c)) {
+            return FAILED;
+        }
+        size_t n = c->len - c->pos;
+        if (n > len) {
+            n = len;
+        }
+        memcpy(dst, c->buffer + c->pos, n);
+        c->pos += n;
+        dst += n;
+        len -= n;
+    }
+    return SUCCESS;
+}
+
+static long long now_ns(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * NSEC_PER_SEC + now.tv_nsec;
+}
+
+static void usage(const char *name)
+{
+    fprintf(stderr, "Usage: %s [-s socket] [-b batch bytes] [-i flush interval ms] [-q queue MB] "
+        "[-o name=value ...]\n", name);
+}
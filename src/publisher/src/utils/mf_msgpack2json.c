@@ -0,0 +1,125 @@
+/*
+ * Copyright (C) 2014-2015 University of Stuttgart
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Reference decoder of the MessagePack, columnar and gorilla bulks of the agent.
+ *
+ * mf_msgpack2json [bulk.msgpack [bulk.json]]
+ *
+ * Prints the bulk read from the file (or stdin) as json, in the same format as
+ * the json bulks of the agent; a columnar batch (wire_format = columns), and
+ * one encoded by column_codec = gorilla, is recognized by its header. Given a json file as well, it compares both
+ * instead, so that a server stand-in can check that the two encodings of a
+ * bulk match; the exit status is 0 if they do.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "msgpack.h"
+#include "columns.h"
+#include "gorilla.h"
+
+/*******************************************************************************
+ * Forward Declarations
+ ******************************************************************************/
+static char *read_file(const char *filename, size_t *len);
+
+/* mf_msgpack2json main function */
+int main(int argc, char** argv)
+{
+    size_t len, json_len, expected_len;
+    char *json;
+
+    char *data = read_file((argc > 1) ? argv[1] : NULL, &len);
+    if (data == NULL) {
+        fprintf(stderr, "Error: Cannot read %s\n", (argc > 1) ? argv[1] : "stdin");
+        return 2;
+    }
+    if (gorilla_is_encoded(data, len)) {
+        char *batch;
+        size_t batch_len;
+        if (!gorilla_decode(data, len, &batch, &batch_len)) {
+            fprintf(stderr, "Error: Malformed gorilla data\n");
+            free(data);
+            return 2;
+        }
+        free(data);
+        data = batch;
+        len = batch_len;
+    }
+    int columns = columns_is_batch(data, len);
+    if (columns ? !columns_to_json(data, len, &json, &json_len) : !msgpack_to_json(data, len, &json, &json_len)) {
+        fprintf(stderr, "Error: Malformed %s data\n", columns ? "columnar" : "MessagePack");
+        free(data);
+        return 2;
+    }
+    free(data);
+
+    if (argc <= 2) {
+        printf("%s\n", json);
+        free(json);
+        return 0;
+    }
+
+    char *expected = read_file(argv[2], &expected_len);
+    if (expected == NULL) {
+        fprintf(stderr, "Error: Cannot read %s\n", argv[2]);
+        free(json);
+        return 2;
+    }
+    /* ignore a trailing newline of the json file */
+    while (expected_len > 0 && (expected[expected_len - 1] == '\n' || expected[expected_len - 1] == '\r')) {
+        expected_len--;
+    }
+    size_t i;
+    for (i = 0; i < json_len && i < expected_len && json[i] == expected[i]; i++) {
+        ;
+    }
+    int ret = (i == json_len && i == expected_len) ? 0 : 1;
+    if (ret != 0) {
+        size_t from = (i > 40) ? i - 40 : 0;
+        printf("Encodings differ at byte %zu:\n  %-8s %.80s\n  json:    %.*s\n",
+            i, columns ? "columns:" : "msgpack:", json + from, (int) ((expected_len - from < 80) ? expected_len - from : 80), expected + from);
+    }
+    free(expected);
+    free(json);
+    return ret;
+}
+
+/* read the whole file, or stdin if filename is NULL */
+static char *read_file(const char *filename, size_t *len)
+{
+    FILE *fp = (filename != NULL) ? fopen(filename, "rb") : stdin;
+    if (fp == NULL) {
+        return NULL;
+    }
+    size_t size = 65536, n;
+    char *data = malloc(size);
+    *len = 0;
+    while ((n = fread(data + *len, 1, size - *len, fp)) > 0) {
+        *len += n;
+        if (*len == size) {
+            size *= 2;
+            data = realloc(data, size);
+        }
+    }
+    if (filename != NULL) {
+        fclose(fp);
+    }
+    return data;
+}